@@ -173,11 +173,20 @@ struct toysurface {
 	 * Post the surface to the server, returning the server allocation
 	 * rectangle. The Cairo surface from prepare() must be destroyed
 	 * after calling this.
+	 * damage is in buffer coordinates, NULL for the whole surface.
 	 */
 	void (*swap)(struct toysurface *base,
 		     enum wl_output_transform buffer_transform, int32_t buffer_scale,
+		     cairo_region_t *damage,
 		     struct rectangle *server_allocation);
 
+	/*
+	 * Return the number of frames since the contents of the surface
+	 * from prepare() were drawn, 1 when it holds the last posted frame,
+	 * 0 when the contents are undefined and must be redrawn in full.
+	 */
+	int (*buffer_age)(struct toysurface *base);
+
 	/*
 	 * Make the toysurface current with the given EGL context.
 	 * Returns 0 on success, and negative on failure.
@@ -216,6 +225,10 @@ struct surface {
 	struct wl_region *input_region;
 	struct wl_region *opaque_region;
 
+	/* damage in buffer coordinates, NULL when not reported */
+	cairo_region_t *damage;
+	int damage_all;
+
 	enum window_buffer_type buffer_type;
 	enum wl_output_transform buffer_transform;
 	int32_t buffer_scale;
@@ -577,6 +590,7 @@ egl_window_surface_prepare(struct toysurface *base, int dx, int dy,
 static void
 egl_window_surface_swap(struct toysurface *base,
 			enum wl_output_transform buffer_transform, int32_t buffer_scale,
+			cairo_region_t *damage,
 			struct rectangle *server_allocation)
 {
 	struct egl_window_surface *surface = to_egl_window_surface(base);
@@ -591,6 +605,12 @@ egl_window_surface_swap(struct toysurface *base,
 				&server_allocation->height);
 }
 
+static int
+egl_window_surface_buffer_age(struct toysurface *base)
+{
+	return 0;
+}
+
 static int
 egl_window_surface_acquire(struct toysurface *base, EGLContext ctx)
 {
@@ -665,6 +685,7 @@ egl_window_surface_create(struct display *display,
 
 	surface->base.prepare = egl_window_surface_prepare;
 	surface->base.swap = egl_window_surface_swap;
+	surface->base.buffer_age = egl_window_surface_buffer_age;
 	surface->base.acquire = egl_window_surface_acquire;
 	surface->base.release = egl_window_surface_release;
 	surface->base.destroy = egl_window_surface_destroy;
@@ -946,8 +967,19 @@ struct shm_surface_leaf {
 
 	struct shm_pool *resize_pool;
 	int busy;
+
+	/* changed since the contents of leaf were drawn, NULL for all */
+	cairo_region_t *stale;
 };
 
+static void
+shm_surface_leaf_invalidate(struct shm_surface_leaf *leaf)
+{
+	if (leaf->stale)
+		cairo_region_destroy(leaf->stale);
+	leaf->stale = NULL;
+}
+
 static void
 shm_surface_leaf_release(struct shm_surface_leaf *leaf)
 {
@@ -958,6 +990,8 @@ shm_surface_leaf_release(struct shm_surface_leaf *leaf)
 	if (leaf->resize_pool)
 		shm_pool_destroy(leaf->resize_pool);
 
+	shm_surface_leaf_invalidate(leaf);
+
 	memset(leaf, 0, sizeof *leaf);
 }
 
@@ -972,6 +1006,9 @@ struct shm_surface {
 
 	struct shm_surface_leaf leaf[MAX_LEAVES];
 	struct shm_surface_leaf *current;
+	/* posted last, holds the latest contents */
+	struct shm_surface_leaf *last;
+	int age;
 };
 
 static struct shm_surface *
@@ -1023,12 +1060,14 @@ shm_surface_buffer_release(void *data, struct wl_buffer *buffer)
 	}
 	assert(i < MAX_LEAVES && "unknown buffer released");
 
-	/* Leave one free leaf with storage, release others */
-	free_found = 0;
+	/* Leave one free leaf with storage, preferably the latest
+	 * contents to draw the next frame on, release others */
+	free_found = surface->last && !surface->last->busy;
 	for (i = 0; i < MAX_LEAVES; i++) {
 		leaf = &surface->leaf[i];
 
-		if (!leaf->cairo_surface || leaf->busy)
+		if (!leaf->cairo_surface || leaf->busy ||
+		    leaf == surface->last)
 			continue;
 
 		if (!free_found)
@@ -1044,6 +1083,53 @@ static const struct wl_buffer_listener shm_surface_buffer_listener = {
 	shm_surface_buffer_release
 };
 
+/*
+ * Copy the areas changed since the contents of leaf were drawn from
+ * the last posted leaf, so the client only redraws what it damages.
+ * Returns the buffer age of leaf.
+ */
+static int
+shm_surface_copy_forward(struct shm_surface *surface,
+			 struct shm_surface_leaf *leaf)
+{
+	struct shm_surface_leaf *last = surface->last;
+	cairo_rectangle_int_t rect;
+	cairo_t *cr;
+	int i, n;
+
+	if (leaf == last)
+		return 1;
+
+	/* without a tracked stale region, let the client redraw it all
+	 * rather than copying the whole last leaf */
+	if (!last || !leaf->stale ||
+	    cairo_image_surface_get_width(last->cairo_surface) !=
+	    cairo_image_surface_get_width(leaf->cairo_surface) ||
+	    cairo_image_surface_get_height(last->cairo_surface) !=
+	    cairo_image_surface_get_height(leaf->cairo_surface))
+		return 0;
+
+	if (cairo_region_is_empty(leaf->stale))
+		return 1;
+
+	cr = cairo_create(leaf->cairo_surface);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cr, last->cairo_surface, 0, 0);
+	n = cairo_region_num_rectangles(leaf->stale);
+	for (i = 0; i < n; i++) {
+		cairo_region_get_rectangle(leaf->stale, i, &rect);
+		cairo_rectangle(cr, rect.x, rect.y, rect.width, rect.height);
+	}
+	cairo_fill(cr);
+	cairo_destroy(cr);
+
+	DBG_OBJ(surface->surface, "copy forward leaf %d to %d\n",
+		(int)(last - &surface->leaf[0]),
+		(int)(leaf - &surface->leaf[0]));
+
+	return 1;
+}
+
 static cairo_surface_t *
 shm_surface_prepare(struct toysurface *base, int dx, int dy,
 		    int32_t width, int32_t height, uint32_t flags,
@@ -1081,6 +1167,9 @@ shm_surface_prepare(struct toysurface *base, int dx, int dy,
 		leaf->cairo_surface = NULL;
 		shm_pool_destroy(leaf->resize_pool);
 		leaf->resize_pool = NULL;
+		shm_surface_leaf_invalidate(leaf);
+		if (leaf == surface->last)
+			surface->last = NULL;
 	}
 
 	surface_to_buffer_size (buffer_transform, buffer_scale, &width, &height);
@@ -1092,6 +1181,9 @@ shm_surface_prepare(struct toysurface *base, int dx, int dy,
 
 	if (leaf->cairo_surface)
 		cairo_surface_destroy(leaf->cairo_surface);
+	shm_surface_leaf_invalidate(leaf);
+	if (leaf == surface->last)
+		surface->last = NULL;
 
 #ifdef USE_RESIZE_POOL
 	if (resize_hint && !leaf->resize_pool) {
@@ -1122,6 +1214,7 @@ shm_surface_prepare(struct toysurface *base, int dx, int dy,
 
 out:
 	surface->current = leaf;
+	surface->age = shm_surface_copy_forward(surface, leaf);
 
 	return cairo_surface_reference(leaf->cairo_surface);
 }
@@ -1129,10 +1222,20 @@ out:
 static void
 shm_surface_swap(struct toysurface *base,
 		 enum wl_output_transform buffer_transform, int32_t buffer_scale,
+		 cairo_region_t *damage,
 		 struct rectangle *server_allocation)
 {
 	struct shm_surface *surface = to_shm_surface(base);
 	struct shm_surface_leaf *leaf = surface->current;
+	struct shm_surface_leaf *other;
+	cairo_rectangle_int_t rect;
+	int i, n;
+
+	/* the whole buffer was redrawn */
+	if (surface->age == 0 ||
+	    wl_surface_get_version(surface->surface) <
+	    WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION)
+		damage = NULL;
 
 	server_allocation->width =
 		cairo_image_surface_get_width(leaf->cairo_surface);
@@ -1145,15 +1248,50 @@ shm_surface_swap(struct toysurface *base,
 
 	wl_surface_attach(surface->surface, leaf->data->buffer,
 			  surface->dx, surface->dy);
-	wl_surface_damage(surface->surface, 0, 0,
-			  server_allocation->width, server_allocation->height);
+	if (damage) {
+		n = cairo_region_num_rectangles(damage);
+		for (i = 0; i < n; i++) {
+			cairo_region_get_rectangle(damage, i, &rect);
+			wl_surface_damage_buffer(surface->surface,
+						 rect.x, rect.y,
+						 rect.width, rect.height);
+		}
+	} else {
+		wl_surface_damage(surface->surface, 0, 0,
+				  server_allocation->width,
+				  server_allocation->height);
+	}
 	wl_surface_commit(surface->surface);
 
 	DBG_OBJ(surface->surface, "leaf %d busy\n",
 		(int)(leaf - &surface->leaf[0]));
 
+	/* the other leaves miss the damage of this frame */
+	for (i = 0; i < MAX_LEAVES; i++) {
+		other = &surface->leaf[i];
+		if (other == leaf || !other->stale)
+			continue;
+
+		if (damage)
+			cairo_region_union(other->stale, damage);
+		else
+			shm_surface_leaf_invalidate(other);
+	}
+	if (leaf->stale)
+		cairo_region_destroy(leaf->stale);
+	leaf->stale = cairo_region_create();
+
 	leaf->busy = 1;
 	surface->current = NULL;
+	surface->last = leaf;
+}
+
+static int
+shm_surface_buffer_age(struct toysurface *base)
+{
+	struct shm_surface *surface = to_shm_surface(base);
+
+	return surface->current ? surface->age : 0;
 }
 
 static int
@@ -1189,6 +1327,7 @@ shm_surface_create(struct display *display, struct wl_surface *wl_surface,
 	surface = xzalloc(sizeof *surface);
 	surface->base.prepare = shm_surface_prepare;
 	surface->base.swap = shm_surface_swap;
+	surface->base.buffer_age = shm_surface_buffer_age;
 	surface->base.acquire = shm_surface_acquire;
 	surface->base.release = shm_surface_release;
 	surface->base.destroy = shm_surface_destroy;
@@ -1417,10 +1556,16 @@ surface_flush(struct surface *surface)
 
 	surface->toysurface->swap(surface->toysurface,
 				  surface->buffer_transform, surface->buffer_scale,
+				  surface->damage_all ? NULL : surface->damage,
 				  &surface->server_allocation);
 
 	cairo_surface_destroy(surface->cairo_surface);
 	surface->cairo_surface = NULL;
+
+	if (surface->damage)
+		cairo_region_destroy(surface->damage);
+	surface->damage = NULL;
+	surface->damage_all = 0;
 }
 
 int
@@ -1542,6 +1687,9 @@ surface_destroy(struct surface *surface)
 	if (surface->opaque_region)
 		wl_region_destroy(surface->opaque_region);
 
+	if (surface->damage)
+		cairo_region_destroy(surface->damage);
+
 	if (surface->subsurface)
 		wl_subsurface_destroy(surface->subsurface);
 
@@ -2033,6 +2181,44 @@ widget_schedule_redraw(struct widget *widget)
 	window_schedule_redraw_task(widget->window);
 }
 
+void
+widget_damage(struct widget *widget,
+	      int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	struct surface *surface = widget->surface;
+	int32_t scale = surface->buffer_scale;
+	cairo_rectangle_int_t rect;
+
+	if (surface->damage_all)
+		return;
+
+	/* damage of rotated buffers is not tracked */
+	if (surface->buffer_transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+		surface->damage_all = 1;
+		return;
+	}
+
+	if (!surface->damage)
+		surface->damage = cairo_region_create();
+
+	rect.x = (x - surface->allocation.x) * scale;
+	rect.y = (y - surface->allocation.y) * scale;
+	rect.width = width * scale;
+	rect.height = height * scale;
+	cairo_region_union_rectangle(surface->damage, &rect);
+}
+
+int
+widget_get_buffer_age(struct widget *widget)
+{
+	struct toysurface *toysurface = widget->surface->toysurface;
+
+	if (!toysurface)
+		return 0;
+
+	return toysurface->buffer_age(toysurface);
+}
+
 void
 widget_set_use_cairo(struct widget *widget,
 		     int use_cairo)
@@ -2319,6 +2505,9 @@ frame_redraw_handler(struct widget *widget, void *data)
 	frame_repaint(frame->frame, cr);
 
 	cairo_destroy(cr);
+
+	widget_damage(widget, widget->allocation.x, widget->allocation.y,
+		      widget->allocation.width, widget->allocation.height);
 }
 
 static int
@@ -4835,6 +5024,13 @@ window_get_title(struct window *window)
 	return window->title;
 }
 
+void
+window_set_appid(struct window *window, const char *appid)
+{
+	if (window->xdg_toplevel)
+		xdg_toplevel_set_app_id(window->xdg_toplevel, appid);
+}
+
 void
 window_set_text_cursor_position(struct window *window, int32_t x, int32_t y)
 {
@@ -6029,7 +6225,8 @@ registry_handle_global(void *data, struct wl_registry *registry, uint32_t id,
 
 	if (strcmp(interface, "wl_compositor") == 0) {
 		d->compositor = wl_registry_bind(registry, id,
-						 &wl_compositor_interface, 3);
+						 &wl_compositor_interface,
+						 MIN(version, 4));
 	} else if (strcmp(interface, "wl_output") == 0) {
 		display_add_output(d, id);
 	} else if (strcmp(interface, "wl_seat") == 0) {
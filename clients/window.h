@@ -503,6 +503,9 @@ window_set_title(struct window *window, const char *title);
 const char *
 window_get_title(struct window *window);
 
+void
+window_set_appid(struct window *window, const char *appid);
+
 void
 window_set_text_cursor_position(struct window *window, int32_t x, int32_t y);
 
@@ -599,6 +602,20 @@ void
 window_uninhibit_redraw(struct window *window);
 void
 widget_schedule_redraw(struct widget *widget);
+/*
+ * Report the area the redraw handler changed, in the coordinates of
+ * widget allocation. Without any report the whole surface is damaged.
+ */
+void
+widget_damage(struct widget *widget,
+	      int32_t x, int32_t y, int32_t width, int32_t height);
+/*
+ * Frames since the buffer drawn by redraw handler was last drawn,
+ * 1 when it holds the last frame and only the changes need redraw,
+ * 0 when it must be redrawn in full.
+ */
+int
+widget_get_buffer_age(struct widget *widget);
 void
 widget_set_use_cairo(struct widget *widget, int use_cairo);
 
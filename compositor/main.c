@@ -665,6 +665,8 @@ usage(int error_code)
 		"  --shell=MODULE\tShell module, defaults to desktop-shell.so\n"
 		"  -S, --socket=NAME\tName of socket to listen on\n"
 		"  -i, --idle-time=SECS\tIdle time in seconds\n"
+		"  --render-threads=N\tRender outputs in parallel on N threads\n"
+		"\t\t\twith the pixman renderer, 0 to disable\n"
 #if defined(BUILD_XWAYLAND)
 		"  --xwayland\t\tLoad the xwayland module\n"
 #endif
@@ -3510,6 +3512,7 @@ wet_main(int argc, char *argv[], const struct weston_testsuite_data *test_data)
 	char *flight_rec_scopes = NULL;
 	char *server_socket = NULL;
 	int32_t idle_time = -1;
+	int32_t render_threads = -1;
 	int32_t help = 0;
 	char *socket_name = NULL;
 	int32_t version = 0;
@@ -3536,6 +3539,7 @@ wet_main(int argc, char *argv[], const struct weston_testsuite_data *test_data)
 		{ WESTON_OPTION_STRING, "shell", 0, &shell },
 		{ WESTON_OPTION_STRING, "socket", 'S', &socket_name },
 		{ WESTON_OPTION_INTEGER, "idle-time", 'i', &idle_time },
+		{ WESTON_OPTION_INTEGER, "render-threads", 0, &render_threads },
 #if defined(BUILD_XWAYLAND)
 		{ WESTON_OPTION_BOOLEAN, "xwayland", 0, &xwayland },
 #endif
@@ -3695,6 +3699,16 @@ wet_main(int argc, char *argv[], const struct weston_testsuite_data *test_data)
 		goto out;
 	}
 
+	if (render_threads < 0)
+		weston_config_section_get_int(section, "render-threads",
+					      &render_threads, 0);
+	if (weston_compositor_set_render_threads(wet.compositor,
+						 render_threads) < 0) {
+		weston_log("fatal: failed to create %d render threads\n",
+			   render_threads);
+		goto out;
+	}
+
 	if (test_data && !check_compositor_capabilities(wet.compositor,
 				test_data->test_quirks.required_capabilities)) {
 		ret = WET_MAIN_RET_MISSING_CAPS;
@@ -200,6 +200,8 @@ struct weston_testsuite_quirks {
 	bool gl_force_full_upload;
 	/** Ensure GL shadow fb is used, and always repaint it fully. */
 	bool gl_force_full_redraw_of_shadow_fb;
+	/** Run the renders of the render threads on the workers only. */
+	bool render_on_workers_only;
 	/** Required enum weston_capability bit mask, otherwise skip run. */
 	uint32_t required_capabilities;
 };
@@ -293,11 +295,19 @@ struct weston_output {
 	struct wl_list animation_list;
 	int32_t x, y, width, height;
 
+	/* Frame callbacks of the surfaces repainted, sent when the frame is
+	 * posted: after the repaint, or at the end of the repaint cycle when
+	 * outputs are rendered in parallel. */
+	struct wl_list frame_callback_list;
+	bool frame_post_pending;
+
 	/** List of paint nodes in z-order, from top to bottom, maybe pruned
 	 *
 	 *  struct weston_paint_node::z_order_link
 	 */
 	struct wl_list paint_node_z_order_list;
+	/** weston_compositor::view_list_generation the list was built at */
+	uint32_t paint_node_z_order_generation;
 
 	/** Output area in global coordinates, simple rect */
 	pixman_region32_t region;
@@ -309,6 +319,10 @@ struct weston_output {
 	/** Used only between repaint_begin and repaint_cancel. */
 	bool repainted;
 
+	/** Repaints are held while greater than zero, so that several
+	 *  changes are shown in one repaint, see weston_output_hold_repaint */
+	int repaint_hold;
+
 	/** State of the repaint loop */
 	enum {
 		REPAINT_NOT_SCHEDULED = 0, /**< idle; no repaint will occur */
@@ -933,6 +947,13 @@ struct weston_plane {
 	pixman_region32_t clip;
 	int32_t x, y;
 	struct wl_list link;
+
+	/* The paint nodes on the plane in z-order, linked by
+	 * weston_paint_node::plane_next, valid while damage_serial is the
+	 * one of the compositor. */
+	struct weston_paint_node *paint_node_first;
+	struct weston_paint_node *paint_node_last;
+	uint32_t damage_serial;
 };
 
 struct weston_drm_format_array;
@@ -1104,7 +1125,21 @@ struct weston_compositor {
 	struct wl_list seat_list;
 	struct wl_list layer_list;	/* struct weston_layer::link */
 	struct wl_list view_list;	/* struct weston_view::link */
+	/* Bumped by the changes of layers, views and sub-surfaces which
+	 * change view_list, it is rebuilt only when built is behind. */
+	uint32_t view_list_generation;
+	uint32_t view_list_built;
+	/* views to update at repaint, weston_view::transform.dirty_link */
+	struct wl_list transform_dirty_list;
+	/* spatial index of view_list for weston_compositor_pick_view() */
+	struct weston_pick_index *pick_index;
+	/* renders outputs in parallel, see
+	 * weston_compositor_set_render_threads() */
+	struct weston_render_pool *render_pool;
 	struct wl_list plane_list;
+	/* Bumped by each accumulation of output damage, marks the planes
+	 * and surfaces seen by it. */
+	uint32_t damage_serial;
 	struct wl_list key_binding_list;
 	struct wl_list modifier_binding_list;
 	struct wl_list button_binding_list;
@@ -1295,6 +1330,13 @@ struct weston_view {
 
 	struct wl_list link;             /* weston_compositor::view_list */
 	struct weston_layer_entry layer_link; /* part of geometry */
+
+	/* Position in weston_compositor::pick_index, private */
+	struct {
+		uint32_t serial;
+		uint32_t rank;
+		bool loose;
+	} pick;
 	struct weston_plane *plane;
 
 	/* For weston_layer inheritance from another view */
@@ -1331,6 +1373,8 @@ struct weston_view {
 	 */
 	struct {
 		int dirty;
+		/* in weston_compositor::transform_dirty_list while dirty */
+		struct wl_list dirty_link;
 
 		/* Approximations in global coordinates:
 		 * - boundingbox is guaranteed to include the whole view in
@@ -1464,9 +1508,10 @@ struct weston_surface {
 	int32_t ref_count;
 
 	/* Not for long-term storage.  This exists for book-keeping while
-	 * iterating over surfaces and views
+	 * iterating over surfaces and views, see
+	 * weston_compositor::damage_serial
 	 */
-	bool touched;
+	uint32_t touched_serial;
 
 	void *renderer_state;
 
@@ -1674,6 +1719,10 @@ weston_layer_mask_is_infinite(struct weston_layer *layer);
 void
 weston_output_schedule_repaint(struct weston_output *output);
 void
+weston_output_hold_repaint(struct weston_output *output);
+void
+weston_output_release_repaint(struct weston_output *output);
+void
 weston_compositor_schedule_repaint(struct weston_compositor *compositor);
 void
 weston_compositor_damage_all(struct weston_compositor *compositor);
@@ -1755,6 +1804,10 @@ void
 weston_compositor_set_default_pointer_grab(struct weston_compositor *compositor,
 			const struct weston_pointer_grab_interface *interface);
 
+int
+weston_compositor_set_render_threads(struct weston_compositor *compositor,
+				     int thread_count);
+
 struct weston_surface *
 weston_surface_create(struct weston_compositor *compositor);
 
@@ -94,6 +94,7 @@ struct rdp_output {
 	struct weston_output base;
 	struct wl_event_source *finish_frame_timer;
 	pixman_image_t *shadow_surface;
+	struct wl_listener frame_listener;
 
 	struct wl_list peers;
 };
@@ -325,27 +326,39 @@ rdp_output_start_repaint_loop(struct weston_output *output)
 	return 0;
 }
 
+/* The shadow surface is rendered when the frame signal is emitted, which
+ * is at the end of the repaint cycle when outputs are rendered in parallel
+ */
+static void
+rdp_output_handle_frame(struct wl_listener *listener, void *data)
+{
+	struct rdp_output *output =
+		container_of(listener, struct rdp_output, frame_listener);
+	pixman_region32_t *damage = data;
+	struct rdp_peers_item *outputPeer;
+
+	if (!pixman_region32_not_empty(damage))
+		return;
+
+	wl_list_for_each(outputPeer, &output->peers, link) {
+		if ((outputPeer->flags & RDP_PEER_ACTIVATED) &&
+				(outputPeer->flags & RDP_PEER_OUTPUT_ENABLED))
+		{
+			rdp_peer_refresh_region(damage, outputPeer->peer);
+		}
+	}
+}
+
 static int
 rdp_output_repaint(struct weston_output *output_base, pixman_region32_t *damage,
 		   void *repaint_data)
 {
 	struct rdp_output *output = container_of(output_base, struct rdp_output, base);
 	struct weston_compositor *ec = output->base.compositor;
-	struct rdp_peers_item *outputPeer;
 
 	pixman_renderer_output_set_buffer(output_base, output->shadow_surface);
 	ec->renderer->repaint_output(&output->base, damage);
 
-	if (pixman_region32_not_empty(damage)) {
-		wl_list_for_each(outputPeer, &output->peers, link) {
-			if ((outputPeer->flags & RDP_PEER_ACTIVATED) &&
-					(outputPeer->flags & RDP_PEER_OUTPUT_ENABLED))
-			{
-				rdp_peer_refresh_region(damage, outputPeer->peer);
-			}
-		}
-	}
-
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
 
@@ -512,6 +525,9 @@ rdp_output_enable(struct weston_output *base)
 		return -1;
 	}
 
+	output->frame_listener.notify = rdp_output_handle_frame;
+	wl_signal_add(&output->base.frame_signal, &output->frame_listener);
+
 	loop = wl_display_get_event_loop(b->compositor->wl_display);
 	output->finish_frame_timer = wl_event_loop_add_timer(loop, finish_frame_handler, output);
 
@@ -529,6 +545,7 @@ rdp_output_disable(struct weston_output *base)
 	if (!output->base.enabled)
 		return 0;
 
+	wl_list_remove(&output->frame_listener.link);
 	pixman_image_unref(output->shadow_surface);
 	pixman_renderer_output_destroy(&output->base);
 
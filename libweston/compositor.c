@@ -94,13 +94,12 @@ static void
 weston_output_transform_scale_init(struct weston_output *output,
 				   uint32_t transform, uint32_t scale);
 
-static void
-weston_compositor_build_view_list(struct weston_compositor *compositor,
-				  struct weston_output *output);
-
 static char *
 weston_output_create_heads_string(struct weston_output *output);
 
+static void
+weston_compositor_view_list_dirty(struct weston_compositor *compositor);
+
 static struct weston_paint_node *
 weston_paint_node_create(struct weston_surface *surface,
 			 struct weston_view *view,
@@ -140,6 +139,7 @@ weston_paint_node_create(struct weston_surface *surface,
 	wl_list_insert(&output->paint_node_list, &pnode->output_link);
 
 	wl_list_init(&pnode->z_order_link);
+	pixman_region32_init(&pnode->visible);
 
 	return pnode;
 }
@@ -154,6 +154,7 @@ weston_paint_node_destroy(struct weston_paint_node *pnode)
 	wl_list_remove(&pnode->z_order_link);
 	assert(pnode->surf_xform_valid || !pnode->surf_xform.transform);
 	weston_surface_color_transform_fini(&pnode->surf_xform);
+	pixman_region32_fini(&pnode->visible);
 	free(pnode);
 }
 
@@ -410,6 +411,8 @@ weston_view_create(struct weston_surface *surface)
 	pixman_region32_init(&view->geometry.scissor);
 	pixman_region32_init(&view->transform.boundingbox);
 	view->transform.dirty = 1;
+	wl_list_insert(&surface->compositor->transform_dirty_list,
+		       &view->transform.dirty_link);
 
 	return view;
 }
@@ -1609,6 +1612,8 @@ weston_view_update_transform(struct weston_view *view)
 		weston_view_update_transform(parent);
 
 	view->transform.dirty = 0;
+	wl_list_remove(&view->transform.dirty_link);
+	wl_list_init(&view->transform.dirty_link);
 
 	weston_view_damage_below(view);
 
@@ -1638,6 +1643,8 @@ weston_view_update_transform(struct weston_view *view)
 		pixman_region32_fini(&mask);
 	}
 
+	weston_pick_index_view_moved(view);
+
 	weston_view_damage_below(view);
 
 	weston_view_assign_output(view);
@@ -1662,6 +1669,8 @@ weston_view_geometry_dirty(struct weston_view *view)
 		return;
 
 	view->transform.dirty = 1;
+	wl_list_insert(view->surface->compositor->transform_dirty_list.prev,
+		       &view->transform.dirty_link);
 
 	wl_list_for_each(child, &view->geometry.child_list,
 			 geometry.parent_link)
@@ -2158,14 +2167,18 @@ weston_compositor_pick_view(struct weston_compositor *compositor,
 			    wl_fixed_t x, wl_fixed_t y,
 			    wl_fixed_t *vx, wl_fixed_t *vy)
 {
+	struct weston_pick_iter iter;
 	struct weston_view *view;
 	wl_fixed_t view_x, view_y;
 	int view_ix, view_iy;
 	int ix = wl_fixed_to_int(x);
 	int iy = wl_fixed_to_int(y);
 
-	/* Can't use paint node list: occlusion by input regions, not opaque. */
-	wl_list_for_each(view, &compositor->view_list, link) {
+	/* Can't use paint node list: occlusion by input regions, not opaque.
+	 * The index walks the views of view_list around the point in order.
+	 */
+	weston_pick_index_begin(compositor, &iter, ix, iy);
+	while ((view = weston_pick_index_next(&iter))) {
 		if (!pixman_region32_contains_point(
 				&view->transform.boundingbox, ix, iy, NULL))
 			continue;
@@ -2218,8 +2231,10 @@ weston_view_unmap(struct weston_view *view)
 	view->plane = NULL;
 	view->is_mapped = false;
 	weston_layer_entry_remove(&view->layer_link);
+	weston_pick_index_view_removed(view);
 	wl_list_remove(&view->link);
 	wl_list_init(&view->link);
+	weston_compositor_view_list_dirty(view->surface->compositor);
 	view->output_mask = 0;
 	weston_surface_assign_output(view->surface);
 
@@ -2280,8 +2295,11 @@ weston_view_destroy(struct weston_view *view)
 	wl_list_for_each_safe(pnode, pntmp, &view->paint_node_list, view_link)
 		weston_paint_node_destroy(pnode);
 
+	weston_pick_index_view_removed(view);
 	wl_list_remove(&view->link);
 	weston_layer_entry_remove(&view->layer_link);
+	wl_list_remove(&view->transform.dirty_link);
+	weston_compositor_view_list_dirty(view->surface->compositor);
 
 	pixman_region32_fini(&view->clip);
 	pixman_region32_fini(&view->geometry.scissor);
@@ -2591,12 +2609,81 @@ view_accumulate_damage(struct weston_view *view,
 }
 
 static void
-output_accumulate_damage(struct weston_output *output)
+paint_node_accumulate_damage(struct weston_paint_node *pnode,
+			     pixman_region32_t *opaque)
+{
+	struct weston_view *view = pnode->view;
+
+	pixman_region32_intersect(&pnode->visible,
+				  &view->transform.boundingbox,
+				  &pnode->output->region);
+	pixman_region32_subtract(&pnode->visible, &pnode->visible, opaque);
+	pixman_region32_subtract(&pnode->visible, &pnode->visible,
+				 &view->plane->clip);
+
+	if (pixman_region32_not_empty(&pnode->visible)) {
+		view_accumulate_damage(view, opaque);
+		return;
+	}
+
+	/* Fully occluded on this output: no damage from it here. Its
+	 * surface is still flushed and its buffer released below, only
+	 * the damage and the draw are culled. */
+	pixman_region32_copy(&view->clip, opaque);
+	pixman_region32_union(opaque, opaque, &view->transform.opaque);
+}
+
+/* Sort the paint nodes of output into the buckets of their planes, keeping
+ * z-order. Nodes on a plane not stacked in plane_list are left out.
+ */
+static void
+output_bucket_paint_nodes(struct weston_output *output, uint32_t serial)
+{
+	struct weston_compositor *ec = output->compositor;
+	struct weston_plane *plane;
+	struct weston_paint_node *pnode;
+
+	wl_list_for_each(plane, &ec->plane_list, link) {
+		plane->paint_node_first = NULL;
+		plane->paint_node_last = NULL;
+		plane->damage_serial = serial;
+	}
+
+	wl_list_for_each(pnode, &output->paint_node_z_order_list,
+			 z_order_link) {
+		plane = pnode->view->plane;
+		if (!plane || plane->damage_serial != serial) {
+			/* not culled, as it adds no damage */
+			pixman_region32_intersect(&pnode->visible,
+						  &pnode->view->transform.boundingbox,
+						  &output->region);
+			continue;
+		}
+
+		pnode->plane_next = NULL;
+		if (plane->paint_node_last)
+			plane->paint_node_last->plane_next = pnode;
+		else
+			plane->paint_node_first = pnode;
+		plane->paint_node_last = pnode;
+	}
+}
+
+WL_EXPORT void
+weston_output_accumulate_damage(struct weston_output *output)
 {
 	struct weston_compositor *ec = output->compositor;
 	struct weston_plane *plane;
 	struct weston_paint_node *pnode;
 	pixman_region32_t opaque, clip;
+	uint32_t serial;
+
+	/* 0 is the serial of planes and surfaces never seen */
+	serial = ++ec->damage_serial;
+	if (serial == 0)
+		serial = ++ec->damage_serial;
+
+	output_bucket_paint_nodes(output, serial);
 
 	pixman_region32_init(&clip);
 
@@ -2605,13 +2692,9 @@ output_accumulate_damage(struct weston_output *output)
 
 		pixman_region32_init(&opaque);
 
-		wl_list_for_each(pnode, &output->paint_node_z_order_list,
-				 z_order_link) {
-			if (pnode->view->plane != plane)
-				continue;
-
-			view_accumulate_damage(pnode->view, &opaque);
-		}
+		for (pnode = plane->paint_node_first; pnode;
+		     pnode = pnode->plane_next)
+			paint_node_accumulate_damage(pnode, &opaque);
 
 		pixman_region32_union(&clip, &clip, &opaque);
 		pixman_region32_fini(&opaque);
@@ -2619,20 +2702,15 @@ output_accumulate_damage(struct weston_output *output)
 
 	pixman_region32_fini(&clip);
 
-	wl_list_for_each(pnode, &output->paint_node_z_order_list,
-			 z_order_link) {
-		pnode->surface->touched = false;
-	}
-
 	wl_list_for_each(pnode, &output->paint_node_z_order_list,
 			 z_order_link) {
 		/* Ignore views not visible on the current output */
 		/* TODO: turn this into assert once z_order_list is pruned. */
 		if (!(pnode->view->output_mask & (1u << output->id)))
 			continue;
-		if (pnode->surface->touched)
+		if (pnode->surface->touched_serial == serial)
 			continue;
-		pnode->surface->touched = true;
+		pnode->surface->touched_serial = serial;
 
 		surface_flush_damage(pnode->surface);
 
@@ -2723,12 +2801,10 @@ add_to_z_order_list(struct weston_output *output,
 static void
 view_list_add_subsurface_view(struct weston_compositor *compositor,
 			      struct weston_subsurface *sub,
-			      struct weston_view *parent,
-			      struct weston_output *output)
+			      struct weston_view *parent)
 {
 	struct weston_subsurface *child;
 	struct weston_view *view = NULL, *iv;
-	struct weston_paint_node *pnode;
 
 	if (!weston_surface_is_mapped(sub->surface))
 		return;
@@ -2755,21 +2831,17 @@ view_list_add_subsurface_view(struct weston_compositor *compositor,
 	view->parent_view = parent;
 	weston_view_update_transform(view);
 	view->is_mapped = true;
-	pnode = view_ensure_paint_node(view, output);
 
 	if (wl_list_empty(&sub->surface->subsurface_list)) {
 		wl_list_insert(compositor->view_list.prev, &view->link);
-		add_to_z_order_list(output, pnode);
 		return;
 	}
 
 	wl_list_for_each(child, &sub->surface->subsurface_list, parent_link) {
-		if (child->surface == sub->surface) {
+		if (child->surface == sub->surface)
 			wl_list_insert(compositor->view_list.prev, &view->link);
-			add_to_z_order_list(output, pnode);
-		} else {
-			view_list_add_subsurface_view(compositor, child, view, output);
-		}
+		else
+			view_list_add_subsurface_view(compositor, child, view);
 	}
 }
 
@@ -2781,43 +2853,77 @@ view_list_add_subsurface_view(struct weston_compositor *compositor,
  */
 static void
 view_list_add(struct weston_compositor *compositor,
-	      struct weston_view *view,
-	      struct weston_output *output)
+	      struct weston_view *view)
 {
-	struct weston_paint_node *pnode;
 	struct weston_subsurface *sub;
 
 	weston_view_update_transform(view);
-	pnode = view_ensure_paint_node(view, output);
 
 	if (wl_list_empty(&view->surface->subsurface_list)) {
 		wl_list_insert(compositor->view_list.prev, &view->link);
-		add_to_z_order_list(output, pnode);
 		return;
 	}
 
 	wl_list_for_each(sub, &view->surface->subsurface_list, parent_link) {
-		if (sub->surface == view->surface) {
+		if (sub->surface == view->surface)
 			wl_list_insert(compositor->view_list.prev, &view->link);
-			add_to_z_order_list(output, pnode);
-		} else {
-			view_list_add_subsurface_view(compositor, sub, view, output);
+		else
+			view_list_add_subsurface_view(compositor, sub, view);
+	}
+}
+
+/* Mark view_list to be rebuilt at next repaint */
+static void
+weston_compositor_view_list_dirty(struct weston_compositor *compositor)
+{
+	compositor->view_list_generation++;
+}
+
+/* Update the transforms of views in view_list without rebuilding it, the
+ * views out of it are updated when the list is rebuilt with them.
+ */
+static void
+weston_compositor_update_dirty_transforms(struct weston_compositor *compositor)
+{
+	struct weston_view *view;
+
+	while (!wl_list_empty(&compositor->transform_dirty_list)) {
+		view = container_of(compositor->transform_dirty_list.next,
+				    struct weston_view, transform.dirty_link);
+
+		if (wl_list_empty(&view->link)) {
+			wl_list_remove(&view->transform.dirty_link);
+			wl_list_init(&view->transform.dirty_link);
+			continue;
 		}
+
+		/* takes the view, and its dirty parents, off the list */
+		weston_view_update_transform(view);
 	}
 }
 
 static void
-weston_compositor_build_view_list(struct weston_compositor *compositor,
-				  struct weston_output *output)
+weston_output_build_z_order_list(struct weston_output *output)
+{
+	struct weston_compositor *compositor = output->compositor;
+	struct weston_view *view;
+
+	wl_list_remove(&output->paint_node_z_order_list);
+	wl_list_init(&output->paint_node_z_order_list);
+
+	wl_list_for_each(view, &compositor->view_list, link)
+		add_to_z_order_list(output,
+				    view_ensure_paint_node(view, output));
+
+	output->paint_node_z_order_generation = compositor->view_list_built;
+}
+
+static void
+weston_compositor_rebuild_view_list(struct weston_compositor *compositor)
 {
 	struct weston_view *view, *tmp;
 	struct weston_layer *layer;
 
-	if (output) {
-		wl_list_remove(&output->paint_node_z_order_list);
-		wl_list_init(&output->paint_node_z_order_list);
-	}
-
 	wl_list_for_each(layer, &compositor->layer_list, link)
 		wl_list_for_each(view, &layer->view_list.link, layer_link.link)
 			surface_stash_subsurface_views(view->surface);
@@ -2828,13 +2934,40 @@ weston_compositor_build_view_list(struct weston_compositor *compositor,
 
 	wl_list_for_each(layer, &compositor->layer_list, link) {
 		wl_list_for_each(view, &layer->view_list.link, layer_link.link) {
-			view_list_add(compositor, view, output);
+			view_list_add(compositor, view);
 		}
 	}
 
 	wl_list_for_each(layer, &compositor->layer_list, link)
 		wl_list_for_each(view, &layer->view_list.link, layer_link.link)
 			surface_free_unused_subsurface_views(view->surface);
+
+	/* the unused views just unmapped are gone from view_list */
+	compositor->view_list_built = compositor->view_list_generation;
+
+	weston_pick_index_view_list_rebuilt(compositor);
+}
+
+/** Bring view_list and the paint node z-order list of output up to date
+ *
+ * view_list is rebuilt from the layers only after a change of layers,
+ * layer entries, sub-surfaces or mapping, see
+ * weston_compositor_view_list_dirty(); otherwise only the dirty
+ * transforms are updated. The z-order list of output is rebuilt when it
+ * is behind view_list.
+ */
+WL_EXPORT void
+weston_compositor_build_view_list(struct weston_compositor *compositor,
+				  struct weston_output *output)
+{
+	if (compositor->view_list_built != compositor->view_list_generation)
+		weston_compositor_rebuild_view_list(compositor);
+
+	weston_compositor_update_dirty_transforms(compositor);
+
+	if (output &&
+	    output->paint_node_z_order_generation != compositor->view_list_built)
+		weston_output_build_z_order_list(output);
 }
 
 static void
@@ -2862,17 +2995,40 @@ weston_output_take_feedback_list(struct weston_output *output,
 	wl_list_init(&surface->feedback_list);
 }
 
+static void
+weston_output_post_frame(struct weston_output *output)
+{
+	struct weston_compositor *ec = output->compositor;
+	struct weston_animation *animation, *next;
+	struct wl_resource *cb, *cnext;
+	uint32_t frame_time_msec;
+
+	output->frame_post_pending = false;
+
+	weston_compositor_repick(ec);
+
+	frame_time_msec = timespec_to_msec(&output->frame_time);
+
+	wl_resource_for_each_safe(cb, cnext, &output->frame_callback_list) {
+		wl_callback_send_done(cb, frame_time_msec);
+		wl_resource_destroy(cb);
+	}
+
+	wl_list_for_each_safe(animation, next, &output->animation_list, link) {
+		animation->frame_counter++;
+		animation->frame(animation, output, &output->frame_time);
+	}
+
+	TL_POINT(ec, "core_repaint_posted", TLP_OUTPUT(output), TLP_END);
+}
+
 static int
 weston_output_repaint(struct weston_output *output, void *repaint_data)
 {
 	struct weston_compositor *ec = output->compositor;
 	struct weston_paint_node *pnode;
-	struct weston_animation *animation, *next;
-	struct wl_resource *cb, *cnext;
-	struct wl_list frame_callback_list;
 	pixman_region32_t output_damage;
 	int r;
-	uint32_t frame_time_msec;
 	enum weston_hdcp_protection highest_requested = WESTON_HDCP_DISABLE;
 
 	if (output->destroying)
@@ -2912,14 +3068,13 @@ weston_output_repaint(struct weston_output *output, void *repaint_data)
 		}
 	}
 
-	wl_list_init(&frame_callback_list);
 	wl_list_for_each(pnode, &output->paint_node_z_order_list,
 			 z_order_link) {
 		/* Note: This operation is safe to do multiple times on the
 		 * same surface.
 		 */
 		if (pnode->surface->output == output) {
-			wl_list_insert_list(&frame_callback_list,
+			wl_list_insert_list(&output->frame_callback_list,
 					    &pnode->surface->frame_callback_list);
 			wl_list_init(&pnode->surface->frame_callback_list);
 
@@ -2927,7 +3082,7 @@ weston_output_repaint(struct weston_output *output, void *repaint_data)
 		}
 	}
 
-	output_accumulate_damage(output);
+	weston_output_accumulate_damage(output);
 
 	pixman_region32_init(&output_damage);
 	pixman_region32_intersect(&output_damage,
@@ -2946,21 +3101,12 @@ weston_output_repaint(struct weston_output *output, void *repaint_data)
 	if (r == 0)
 		output->repaint_status = REPAINT_AWAITING_COMPLETION;
 
-	weston_compositor_repick(ec);
-
-	frame_time_msec = timespec_to_msec(&output->frame_time);
-
-	wl_resource_for_each_safe(cb, cnext, &frame_callback_list) {
-		wl_callback_send_done(cb, frame_time_msec);
-		wl_resource_destroy(cb);
-	}
-
-	wl_list_for_each_safe(animation, next, &output->animation_list, link) {
-		animation->frame_counter++;
-		animation->frame(animation, output, &output->frame_time);
-	}
-
-	TL_POINT(ec, "core_repaint_posted", TLP_OUTPUT(output), TLP_END);
+	/* The render may still be queued, the compositor state must not
+	 * change until the end of the repaint cycle then. */
+	if (ec->render_pool)
+		output->frame_post_pending = true;
+	else
+		weston_output_post_frame(output);
 
 	return r;
 }
@@ -2995,6 +3141,11 @@ weston_output_maybe_repaint(struct weston_output *output, struct timespec *now,
 	    compositor->state == WESTON_COMPOSITOR_OFFSCREEN)
 		goto err;
 
+	/* The repaint is held; drop it from repaint, the damage is kept
+	 * in repaint_needed and repainted when the hold is released. */
+	if (output->repaint_hold > 0)
+		goto err;
+
 	/* We don't actually need to repaint this output; drop it from
 	 * repaint until something causes damage. */
 	if (!output->repaint_needed)
@@ -3072,12 +3223,25 @@ output_repaint_timer_handler(void *data)
 	if (compositor->backend->repaint_begin)
 		repaint_data = compositor->backend->repaint_begin(compositor);
 
+	if (compositor->render_pool)
+		weston_render_pool_begin(compositor->render_pool);
+
 	wl_list_for_each(output, &compositor->output_list, link) {
 		ret = weston_output_maybe_repaint(output, &now, repaint_data);
 		if (ret)
 			break;
 	}
 
+	/* Join the renders before the frames are flushed or finished */
+	if (compositor->render_pool) {
+		weston_render_pool_finish(compositor->render_pool);
+
+		wl_list_for_each(output, &compositor->output_list, link) {
+			if (output->frame_post_pending)
+				weston_output_post_frame(output);
+		}
+	}
+
 	if (ret == 0) {
 		if (compositor->backend->repaint_flush)
 			ret = compositor->backend->repaint_flush(compositor,
@@ -3248,11 +3412,15 @@ weston_layer_entry_insert(struct weston_layer_entry *list,
 {
 	wl_list_insert(&list->link, &entry->link);
 	entry->layer = list->layer;
+	weston_compositor_view_list_dirty(entry->layer->compositor);
 }
 
 WL_EXPORT void
 weston_layer_entry_remove(struct weston_layer_entry *entry)
 {
+	if (entry->layer)
+		weston_compositor_view_list_dirty(entry->layer->compositor);
+
 	wl_list_remove(&entry->link);
 	wl_list_init(&entry->link);
 	entry->layer = NULL;
@@ -3283,6 +3451,7 @@ WL_EXPORT void
 weston_layer_fini(struct weston_layer *layer)
 {
 	wl_list_remove(&layer->link);
+	weston_compositor_view_list_dirty(layer->compositor);
 
 	if (!wl_list_empty(&layer->view_list.link))
 		weston_log("BUG: finalizing a layer with views still on it.\n");
@@ -3305,6 +3474,7 @@ weston_layer_set_position(struct weston_layer *layer,
 	struct weston_layer *below;
 
 	wl_list_remove(&layer->link);
+	weston_compositor_view_list_dirty(layer->compositor);
 
 	/* layer_list is ordered from top to bottom, the last layer being the
 	 * background with the smallest position value */
@@ -3329,6 +3499,7 @@ weston_layer_unset_position(struct weston_layer *layer)
 {
 	wl_list_remove(&layer->link);
 	wl_list_init(&layer->link);
+	weston_compositor_view_list_dirty(layer->compositor);
 }
 
 WL_EXPORT void
@@ -3404,6 +3575,39 @@ weston_output_schedule_repaint(struct weston_output *output)
 	TL_POINT(compositor, "core_repaint_enter_loop", TLP_OUTPUT(output), TLP_END);
 }
 
+/** Hold repaints of the output
+ *
+ * \param output The output to hold.
+ *
+ * Damage and frame callbacks are kept until the last hold is released
+ * by weston_output_release_repaint(), so that changes made while the
+ * output is held are shown together in one repaint. Holds nest.
+ *
+ * \ingroup output
+ */
+WL_EXPORT void
+weston_output_hold_repaint(struct weston_output *output)
+{
+	output->repaint_hold++;
+}
+
+/** Release a hold of weston_output_hold_repaint()
+ *
+ * \param output The output to release.
+ *
+ * A repaint is scheduled when the last hold is released.
+ *
+ * \ingroup output
+ */
+WL_EXPORT void
+weston_output_release_repaint(struct weston_output *output)
+{
+	assert(output->repaint_hold > 0);
+
+	if (--output->repaint_hold == 0)
+		weston_output_schedule_repaint(output);
+}
+
 /** weston_compositor_schedule_repaint
  *  \ingroup compositor
  */
@@ -3560,6 +3764,17 @@ static void
 weston_surface_commit_subsurface_order(struct weston_surface *surface)
 {
 	struct weston_subsurface *sub;
+	struct wl_list *link = &surface->subsurface_list;
+
+	/* Both lists hold the same sub-surfaces, restacked if they differ */
+	wl_list_for_each(sub, &surface->subsurface_list_pending,
+			 parent_link_pending) {
+		link = link->next;
+		if (link != &sub->parent_link) {
+			weston_compositor_view_list_dirty(surface->compositor);
+			break;
+		}
+	}
 
 	wl_list_for_each_reverse(sub, &surface->subsurface_list_pending,
 				 parent_link_pending) {
@@ -4360,6 +4575,7 @@ subsurface_committed(struct weston_surface *surface, int32_t dx, int32_t dy)
 
 	if (!weston_surface_is_mapped(surface)) {
 		surface->is_mapped = true;
+		weston_compositor_view_list_dirty(surface->compositor);
 
 		/* Cannot call weston_view_update_transform(),
 		 * because that would call it also for the parent surface,
@@ -4698,6 +4914,7 @@ subsurface_set_desync(struct wl_client *client, struct wl_resource *resource)
 static void
 weston_subsurface_unlink_parent(struct weston_subsurface *sub)
 {
+	weston_compositor_view_list_dirty(sub->surface->compositor);
 	wl_list_remove(&sub->parent_link);
 	wl_list_remove(&sub->parent_link_pending);
 	wl_list_remove(&sub->parent_destroy_listener.link);
@@ -4764,6 +4981,7 @@ weston_subsurface_link_parent(struct weston_subsurface *sub,
 	wl_list_insert(&parent->subsurface_list, &sub->parent_link);
 	wl_list_insert(&parent->subsurface_list_pending,
 		       &sub->parent_link_pending);
+	weston_compositor_view_list_dirty(parent->compositor);
 }
 
 static void
@@ -4806,6 +5024,7 @@ weston_subsurface_destroy(struct weston_subsurface *sub)
 	} else {
 		/* the dummy weston_subsurface for the parent itself */
 		assert(sub->parent_destroy_listener.notify == NULL);
+		weston_compositor_view_list_dirty(sub->surface->compositor);
 		wl_list_remove(&sub->parent_link);
 		wl_list_remove(&sub->parent_link_pending);
 	}
@@ -4872,6 +5091,7 @@ weston_subsurface_create_for_parent(struct weston_surface *parent)
 	wl_list_insert(&parent->subsurface_list, &sub->parent_link);
 	wl_list_insert(&parent->subsurface_list_pending,
 		       &sub->parent_link_pending);
+	weston_compositor_view_list_dirty(parent->compositor);
 
 	return sub;
 }
@@ -5099,6 +5319,9 @@ weston_plane_init(struct weston_plane *plane,
 	plane->x = x;
 	plane->y = y;
 	plane->compositor = ec;
+	plane->paint_node_first = NULL;
+	plane->paint_node_last = NULL;
+	plane->damage_serial = 0;
 
 	/* Init the link so that the call to wl_list_remove() when releasing
 	 * the plane without ever stacking doesn't lead to a crash */
@@ -6565,11 +6788,13 @@ weston_output_set_color_profile(struct weston_output *output,
 			return false;
 		}
 
-		/* Remove outdated cached color transformations */
+		/* Remove outdated cached color transformations, the z-order
+		 * list is rebuilt to install new ones */
 		wl_list_for_each(pnode, &output->paint_node_list, output_link) {
 			weston_surface_color_transform_fini(&pnode->surf_xform);
 			pnode->surf_xform_valid = false;
 		}
+		output->paint_node_z_order_generation = 0;
 	}
 
 	weston_color_profile_unref(old);
@@ -6766,6 +6991,9 @@ weston_output_enable(struct weston_output *output)
 	wl_list_init(&output->feedback_list);
 	wl_list_init(&output->paint_node_list);
 	wl_list_init(&output->paint_node_z_order_list);
+	output->paint_node_z_order_generation = 0;
+	wl_list_init(&output->frame_callback_list);
+	output->frame_post_pending = false;
 
 	if (!weston_output_set_color_transforms(output))
 		return -1;
@@ -7801,6 +8029,12 @@ weston_compositor_create(struct wl_display *display,
 		goto fail;
 
 	wl_list_init(&ec->view_list);
+	/* view_list_built is behind, build at first repaint */
+	ec->view_list_generation = 1;
+	wl_list_init(&ec->transform_dirty_list);
+	ec->pick_index = weston_pick_index_create();
+	if (!ec->pick_index)
+		goto fail;
 	wl_list_init(&ec->plane_list);
 	wl_list_init(&ec->layer_list);
 	wl_list_init(&ec->seat_list);
@@ -7930,6 +8164,44 @@ weston_compositor_set_default_pointer_grab(struct weston_compositor *ec,
 	}
 }
 
+/** Render the outputs in parallel
+ *
+ * \param compositor The compositor instance.
+ * \param thread_count The count of worker threads, 0 to render the outputs
+ * one after another on the compositor thread.
+ * \return 0 on success, -1 on failure.
+ *
+ * The outputs due in a repaint cycle are prepared one after another, then
+ * their renders run on the workers and the compositor thread, and the
+ * frames are posted once all are rendered. Only the pixman renderer
+ * queues its renders, see weston_output_queue_render(); this is meant for
+ * the pixman-backed backends like headless, fbdev and RDP.
+ *
+ * \ingroup compositor
+ */
+WL_EXPORT int
+weston_compositor_set_render_threads(struct weston_compositor *compositor,
+				     int thread_count)
+{
+	struct weston_render_pool *pool = NULL;
+
+	if (thread_count < 0)
+		return -1;
+
+	if (thread_count > 0) {
+		pool = weston_render_pool_create(thread_count,
+			compositor->test_data.test_quirks.render_on_workers_only);
+		if (!pool)
+			return -1;
+	}
+
+	if (compositor->render_pool)
+		weston_render_pool_destroy(compositor->render_pool);
+	compositor->render_pool = pool;
+
+	return 0;
+}
+
 /** weston_compositor_set_presentation_clock
  * \ingroup compositor
  */
@@ -8212,6 +8484,10 @@ weston_compositor_destroy(struct weston_compositor *compositor)
 
 	weston_compositor_xkb_destroy(compositor);
 
+	if (compositor->render_pool)
+		weston_render_pool_destroy(compositor->render_pool);
+	compositor->render_pool = NULL;
+
 	if (compositor->backend)
 		compositor->backend->destroy(compositor);
 
@@ -8234,6 +8510,8 @@ weston_compositor_destroy(struct weston_compositor *compositor)
 		weston_dmabuf_feedback_format_table_destroy(compositor->dmabuf_feedback_format_table);
 	}
 
+	weston_pick_index_destroy(compositor->pick_index);
+
 	free(compositor);
 }
 
@@ -153,6 +153,80 @@ weston_compositor_xkb_destroy(struct weston_compositor *ec);
 int
 weston_input_init(struct weston_compositor *compositor);
 
+void
+weston_compositor_build_view_list(struct weston_compositor *compositor,
+				  struct weston_output *output);
+
+void
+weston_output_accumulate_damage(struct weston_output *output);
+
+/* weston_pick_index */
+
+struct weston_pick_iter {
+	struct weston_compositor *compositor;
+	struct weston_pick_index *index;
+	uint32_t cell;
+	uint32_t cell_end;
+	uint32_t loose;
+	struct wl_list *link;
+};
+
+struct weston_pick_index *
+weston_pick_index_create(void);
+
+void
+weston_pick_index_destroy(struct weston_pick_index *index);
+
+void
+weston_pick_index_view_removed(struct weston_view *view);
+
+void
+weston_pick_index_view_list_rebuilt(struct weston_compositor *compositor);
+
+void
+weston_pick_index_view_moved(struct weston_view *view);
+
+void
+weston_pick_index_begin(struct weston_compositor *compositor,
+			struct weston_pick_iter *iter, int32_t x, int32_t y);
+
+struct weston_view *
+weston_pick_index_next(struct weston_pick_iter *iter);
+
+/* weston_render_pool */
+
+typedef void (*weston_render_func_t)(struct weston_output *output,
+				     void *data);
+
+struct weston_render_pool *
+weston_render_pool_create(int thread_count, bool workers_only);
+
+void
+weston_render_pool_destroy(struct weston_render_pool *pool);
+
+void
+weston_render_pool_begin(struct weston_render_pool *pool);
+
+bool
+weston_render_pool_queue(struct weston_render_pool *pool,
+			 struct weston_output *output,
+			 weston_render_func_t render,
+			 weston_render_func_t done,
+			 void *data);
+
+void
+weston_render_pool_finish(struct weston_render_pool *pool);
+
+bool
+weston_output_queue_render(struct weston_output *output,
+			   weston_render_func_t render,
+			   weston_render_func_t done,
+			   void *data);
+
+void
+weston_compositor_repaint_outputs(struct weston_compositor *compositor,
+				  weston_render_func_t repaint, void *data);
+
 /* weston_output */
 
 void
@@ -414,6 +488,15 @@ struct weston_paint_node {
 	/* struct weston_output::paint_node_z_order_list */
 	struct wl_list z_order_link;
 
+	/* struct weston_plane::paint_node_first, see
+	 * weston_output_accumulate_damage() */
+	struct weston_paint_node *plane_next;
+
+	/* The part on the output not covered by the opaque views above, in
+	 * global coordinates, empty when fully occluded. Updated by
+	 * weston_output_accumulate_damage() for the nodes on a plane. */
+	pixman_region32_t visible;
+
 	struct weston_surface_color_transform surf_xform;
 	bool surf_xform_valid;
 
@@ -0,0 +1,409 @@
+/*
+ * Copyright © 2021 The qimm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libweston/libweston.h>
+#include <libweston/zalloc.h>
+#include "libweston-internal.h"
+#include "shared/helpers.h"
+
+/*
+ * Spatial index for weston_compositor_pick_view().
+ *
+ * The views of weston_compositor::view_list are numbered by their rank in
+ * the list, and the ranks are put in the cells of a uniform grid over the
+ * bounding boxes. A pick walks the cell under the point in rank order, so
+ * the first hit is the topmost view like a walk of view_list.
+ *
+ * The index is rebuilt lazily at the next pick after view_list changes.
+ * A view whose bounding box changes, like the cursor sprite, goes to the
+ * loose list instead, which is walked by every pick; views covering too
+ * many cells are kept there too. Too many loose views rebuild the index.
+ */
+
+/* cells in each direction at most */
+#define PICK_INDEX_GRID_MAX 64
+/* views moved since the index was built, before it is rebuilt */
+#define PICK_INDEX_MOVED_MAX 32
+
+struct weston_pick_index {
+	bool dirty;
+	uint32_t serial;
+
+	/* weston_compositor::view_list when built, indexed by rank */
+	struct weston_view **views;
+	uint32_t count;
+	uint32_t views_alloc;
+
+	/* the grid, ranks of cell i are ranks[cells[i]] to ranks[cells[i + 1]] */
+	int32_t x, y;
+	int32_t cell_width, cell_height;
+	int32_t columns, rows;
+	uint32_t *cells;
+	uint32_t cells_alloc;
+	uint32_t *ranks;
+	uint32_t ranks_alloc;
+
+	/* sorted ranks walked by every pick */
+	uint32_t *loose;
+	uint32_t loose_count;
+	uint32_t loose_alloc;
+	uint32_t moved_count;
+};
+
+struct weston_pick_index *
+weston_pick_index_create(void)
+{
+	struct weston_pick_index *index;
+
+	index = zalloc(sizeof *index);
+	if (!index)
+		return NULL;
+
+	index->dirty = true;
+
+	return index;
+}
+
+void
+weston_pick_index_destroy(struct weston_pick_index *index)
+{
+	free(index->views);
+	free(index->cells);
+	free(index->ranks);
+	free(index->loose);
+	free(index);
+}
+
+static bool
+pick_index_reserve(void **array, uint32_t *alloc, uint32_t count, size_t size)
+{
+	void *data;
+
+	if (count <= *alloc)
+		return true;
+
+	data = realloc(*array, count * size);
+	if (!data)
+		return false;
+
+	*array = data;
+	*alloc = count;
+
+	return true;
+}
+
+static bool
+pick_index_has(struct weston_pick_index *index, struct weston_view *view)
+{
+	return !index->dirty && view->pick.serial == index->serial;
+}
+
+/* the cells covered by a box, false when it is empty */
+static bool
+pick_index_box_cells(struct weston_pick_index *index, pixman_box32_t *box,
+		     int32_t *c1, int32_t *r1, int32_t *c2, int32_t *r2)
+{
+	if (box->x1 >= box->x2 || box->y1 >= box->y2)
+		return false;
+
+	*c1 = (box->x1 - index->x) / index->cell_width;
+	*r1 = (box->y1 - index->y) / index->cell_height;
+	*c2 = (box->x2 - 1 - index->x) / index->cell_width;
+	*r2 = (box->y2 - 1 - index->y) / index->cell_height;
+
+	return true;
+}
+
+static void
+pick_index_layout(struct weston_pick_index *index, pixman_box32_t *extents)
+{
+	int32_t width = extents->x2 - extents->x1;
+	int32_t height = extents->y2 - extents->y1;
+	double cells;
+
+	/* about one view for each cell */
+	cells = MIN(index->count, PICK_INDEX_GRID_MAX * PICK_INDEX_GRID_MAX);
+	index->columns = ceil(sqrt(cells * width / height));
+	index->columns = MAX(1, MIN(index->columns, PICK_INDEX_GRID_MAX));
+	index->rows = ceil(cells / index->columns);
+	index->rows = MAX(1, MIN(index->rows, PICK_INDEX_GRID_MAX));
+
+	index->x = extents->x1;
+	index->y = extents->y1;
+	index->cell_width = (width + index->columns - 1) / index->columns;
+	index->cell_height = (height + index->rows - 1) / index->rows;
+}
+
+static bool
+pick_index_build(struct weston_pick_index *index,
+		 struct weston_compositor *compositor)
+{
+	struct weston_view *view;
+	pixman_box32_t extents = { INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN };
+	pixman_box32_t *box;
+	uint32_t count, rank, total, i, wide;
+	int32_t c1, r1, c2, r2, c, r;
+
+	index->dirty = true;
+	/* 0 is never indexed, views are created with it */
+	if (++index->serial == 0)
+		index->serial = 1;
+
+	count = wl_list_length(&compositor->view_list);
+	if (!pick_index_reserve((void **)&index->views, &index->views_alloc,
+				count, sizeof *index->views))
+		return false;
+
+	rank = 0;
+	wl_list_for_each(view, &compositor->view_list, link) {
+		box = pixman_region32_extents(&view->transform.boundingbox);
+		if (box->x1 < box->x2 && box->y1 < box->y2) {
+			extents.x1 = MIN(extents.x1, box->x1);
+			extents.y1 = MIN(extents.y1, box->y1);
+			extents.x2 = MAX(extents.x2, box->x2);
+			extents.y2 = MAX(extents.y2, box->y2);
+		}
+
+		view->pick.serial = index->serial;
+		view->pick.rank = rank;
+		view->pick.loose = false;
+		index->views[rank++] = view;
+	}
+	index->count = count;
+	index->loose_count = 0;
+	index->moved_count = 0;
+
+	if (extents.x1 >= extents.x2) {
+		index->columns = index->rows = 0;
+		index->dirty = false;
+		return true;
+	}
+	pick_index_layout(index, &extents);
+
+	/* count the ranks of each cell, wide views go to the loose list */
+	if (!pick_index_reserve((void **)&index->cells, &index->cells_alloc,
+				index->columns * index->rows + 1,
+				sizeof *index->cells))
+		return false;
+	memset(index->cells, 0,
+	       (index->columns * index->rows + 1) * sizeof *index->cells);
+
+	wide = 0;
+	for (rank = 0; rank < count; rank++) {
+		view = index->views[rank];
+		box = pixman_region32_extents(&view->transform.boundingbox);
+		if (!pick_index_box_cells(index, box, &c1, &r1, &c2, &r2))
+			continue;
+
+		if (index->columns * index->rows >= 16 &&
+		    (c2 - c1 + 1) * (r2 - r1 + 1) * 4 >
+		    index->columns * index->rows) {
+			view->pick.loose = true;
+			wide++;
+			continue;
+		}
+
+		for (r = r1; r <= r2; r++)
+			for (c = c1; c <= c2; c++)
+				index->cells[r * index->columns + c + 1]++;
+	}
+
+	total = 0;
+	for (i = 1; i <= (uint32_t)(index->columns * index->rows); i++) {
+		total += index->cells[i];
+		index->cells[i] = total;
+	}
+
+	if (!pick_index_reserve((void **)&index->ranks, &index->ranks_alloc,
+				total, sizeof *index->ranks) ||
+	    !pick_index_reserve((void **)&index->loose, &index->loose_alloc,
+				wide + PICK_INDEX_MOVED_MAX,
+				sizeof *index->loose))
+		return false;
+
+	/* fill in rank order, cells[i] moves to the end of cell i */
+	for (rank = 0; rank < count; rank++) {
+		view = index->views[rank];
+		if (view->pick.loose) {
+			index->loose[index->loose_count++] = rank;
+			continue;
+		}
+
+		box = pixman_region32_extents(&view->transform.boundingbox);
+		if (!pick_index_box_cells(index, box, &c1, &r1, &c2, &r2))
+			continue;
+
+		for (r = r1; r <= r2; r++)
+			for (c = c1; c <= c2; c++)
+				index->ranks[index->cells[r * index->columns + c]++] = rank;
+	}
+	memmove(index->cells + 1, index->cells,
+		index->columns * index->rows * sizeof *index->cells);
+	index->cells[0] = 0;
+
+	index->dirty = false;
+
+	return true;
+}
+
+/** Mark the index out of date
+ *
+ * Called when weston_compositor::view_list is changed out of
+ * weston_compositor_build_view_list(), when a view leaves it.
+ */
+void
+weston_pick_index_view_removed(struct weston_view *view)
+{
+	struct weston_pick_index *index = view->surface->compositor->pick_index;
+
+	if (pick_index_has(index, view))
+		index->dirty = true;
+}
+
+/** Check weston_compositor::view_list after it is rebuilt
+ *
+ * The list is rebuilt at each repaint, mostly in the same order.
+ */
+void
+weston_pick_index_view_list_rebuilt(struct weston_compositor *compositor)
+{
+	struct weston_pick_index *index = compositor->pick_index;
+	struct weston_view *view;
+	uint32_t rank = 0;
+
+	if (index->dirty)
+		return;
+
+	wl_list_for_each(view, &compositor->view_list, link) {
+		if (rank == index->count || index->views[rank] != view) {
+			index->dirty = true;
+			return;
+		}
+		rank++;
+	}
+
+	if (rank != index->count)
+		index->dirty = true;
+}
+
+/** Move a view to the loose list after its bounding box changed */
+void
+weston_pick_index_view_moved(struct weston_view *view)
+{
+	struct weston_pick_index *index = view->surface->compositor->pick_index;
+	uint32_t i;
+
+	if (!pick_index_has(index, view) || view->pick.loose)
+		return;
+
+	if (index->moved_count == PICK_INDEX_MOVED_MAX) {
+		index->dirty = true;
+		return;
+	}
+
+	for (i = index->loose_count; i > 0; i--) {
+		if (index->loose[i - 1] < view->pick.rank)
+			break;
+		index->loose[i] = index->loose[i - 1];
+	}
+	index->loose[i] = view->pick.rank;
+	index->loose_count++;
+	index->moved_count++;
+	view->pick.loose = true;
+}
+
+/** Start a walk of the views which may contain a point, top to bottom
+ *
+ * The views are walked by weston_pick_index_next(). If the index can not
+ * be built, all of weston_compositor::view_list is walked.
+ */
+void
+weston_pick_index_begin(struct weston_compositor *compositor,
+			struct weston_pick_iter *iter, int32_t x, int32_t y)
+{
+	struct weston_pick_index *index = compositor->pick_index;
+	int32_t c, r;
+
+	memset(iter, 0, sizeof *iter);
+	iter->compositor = compositor;
+
+	if (index->dirty && !pick_index_build(index, compositor)) {
+		iter->link = compositor->view_list.next;
+		return;
+	}
+
+	iter->index = index;
+	if (x < index->x || y < index->y || index->columns == 0)
+		return;
+
+	c = (x - index->x) / index->cell_width;
+	r = (y - index->y) / index->cell_height;
+	if (c >= index->columns || r >= index->rows)
+		return;
+
+	iter->cell = index->cells[r * index->columns + c];
+	iter->cell_end = index->cells[r * index->columns + c + 1];
+}
+
+struct weston_view *
+weston_pick_index_next(struct weston_pick_iter *iter)
+{
+	struct weston_pick_index *index = iter->index;
+	struct weston_view *view;
+	uint32_t rank;
+
+	if (!index) {
+		if (iter->link == &iter->compositor->view_list)
+			return NULL;
+
+		view = container_of(iter->link, struct weston_view, link);
+		iter->link = iter->link->next;
+		return view;
+	}
+
+	/* the cell has stale boxes of the loose views */
+	while (iter->cell < iter->cell_end &&
+	       index->views[index->ranks[iter->cell]]->pick.loose)
+		iter->cell++;
+
+	if (iter->cell < iter->cell_end &&
+	    (iter->loose == index->loose_count ||
+	     index->ranks[iter->cell] < index->loose[iter->loose]))
+		rank = index->ranks[iter->cell++];
+	else if (iter->loose < index->loose_count)
+		rank = index->loose[iter->loose++];
+	else
+		return NULL;
+
+	return index->views[rank];
+}
@@ -44,12 +44,14 @@ struct pixman_output_state {
 	pixman_image_t *shadow_image;
 	pixman_image_t *hw_buffer;
 	pixman_region32_t *hw_extra_damage;
+	bool render_queued; /* rendered in parallel with other outputs */
 };
 
 struct pixman_surface_state {
 	struct weston_surface *surface;
 
 	pixman_image_t *image;
+	pixman_color_t color; /* of the solid fill image */
 	struct weston_buffer_reference buffer_ref;
 	struct weston_buffer_release_reference buffer_release_ref;
 
@@ -309,6 +311,30 @@ composite_clipped(pixman_image_t *src,
 	}
 }
 
+/* A render queued with weston_output_queue_render() may run in parallel
+ * with other outputs, so its draws set their transform and filter on their
+ * own image of the surface pixels rather than on the image shared by the
+ * outputs.
+ */
+static pixman_image_t *
+surface_source_image(struct pixman_surface_state *ps, bool render_queued)
+{
+	pixman_image_t *image = ps->image;
+	uint32_t *data = pixman_image_get_data(image);
+
+	if (!render_queued)
+		return pixman_image_ref(image);
+
+	if (!data)
+		return pixman_image_create_solid_fill(&ps->color);
+
+	return pixman_image_create_bits_no_clear(pixman_image_get_format(image),
+						 pixman_image_get_width(image),
+						 pixman_image_get_height(image),
+						 data,
+						 pixman_image_get_stride(image));
+}
+
 /** Paint an intersected region
  *
  * \param ev The view to be painted.
@@ -330,6 +356,7 @@ repaint_region(struct weston_view *ev, struct weston_output *output,
 	struct pixman_output_state *po = get_output_state(output);
 	struct weston_buffer_viewport *vp = &ev->surface->buffer_viewport;
 	pixman_image_t *target_image;
+	pixman_image_t *source_image;
 	pixman_transform_t transform;
 	pixman_filter_t filter;
 	pixman_image_t *mask_image;
@@ -360,12 +387,14 @@ repaint_region(struct weston_view *ev, struct weston_output *output,
 		mask_image = NULL;
 	}
 
+	source_image = surface_source_image(ps, po->render_queued);
 	if (source_clip)
-		composite_clipped(ps->image, mask_image, target_image,
+		composite_clipped(source_image, mask_image, target_image,
 				  &transform, filter, source_clip);
 	else
-		composite_whole(pixman_op, ps->image, mask_image,
+		composite_whole(pixman_op, source_image, mask_image,
 				target_image, &transform, filter);
+	pixman_image_unref(source_image);
 
 	if (mask_image)
 		pixman_image_unref(mask_image);
@@ -489,10 +518,10 @@ draw_paint_node(struct weston_paint_node *pnode,
 	if (!ps->image)
 		return;
 
+	/* The visible region is per output, unlike weston_view::clip which
+	 * the next output repainted overwrites before a queued render. */
 	pixman_region32_init(&repaint);
-	pixman_region32_intersect(&repaint,
-				  &pnode->view->transform.boundingbox, damage);
-	pixman_region32_subtract(&repaint, &repaint, &pnode->view->clip);
+	pixman_region32_intersect(&repaint, &pnode->visible, damage);
 
 	if (!pixman_region32_not_empty(&repaint))
 		goto out;
@@ -528,7 +557,8 @@ repaint_surfaces(struct weston_output *output, pixman_region32_t *damage)
 
 	wl_list_for_each_reverse(pnode, &output->paint_node_z_order_list,
 				 z_order_link) {
-		if (pnode->view->plane == &compositor->primary_plane)
+		if (pnode->view->plane == &compositor->primary_plane &&
+		    pixman_region32_not_empty(&pnode->visible))
 			draw_paint_node(pnode, damage);
 	}
 }
@@ -560,6 +590,80 @@ copy_to_hw_buffer(struct weston_output *output, pixman_region32_t *region)
 	pixman_image_set_clip_region32 (po->hw_buffer, NULL);
 }
 
+static void
+render_output(struct weston_output *output,
+	      pixman_region32_t *output_damage,
+	      pixman_region32_t *hw_damage)
+{
+	struct pixman_output_state *po = get_output_state(output);
+
+	if (po->shadow_image) {
+		repaint_surfaces(output, output_damage);
+		copy_to_hw_buffer(output, hw_damage);
+	} else {
+		repaint_surfaces(output, hw_damage);
+	}
+}
+
+/* A render queued with weston_output_queue_render() */
+struct pixman_render_job {
+	pixman_region32_t output_damage;
+	pixman_region32_t hw_damage;
+};
+
+static void
+pixman_render_job_render(struct weston_output *output, void *data)
+{
+	struct pixman_render_job *job = data;
+
+	render_output(output, &job->output_damage, &job->hw_damage);
+}
+
+static void
+pixman_render_job_done(struct weston_output *output, void *data)
+{
+	struct pixman_render_job *job = data;
+
+	wl_signal_emit(&output->frame_signal, &job->output_damage);
+
+	pixman_region32_fini(&job->output_damage);
+	pixman_region32_fini(&job->hw_damage);
+	free(job);
+}
+
+static bool
+queue_render_output(struct weston_output *output,
+		    pixman_region32_t *output_damage,
+		    pixman_region32_t *hw_damage)
+{
+	struct pixman_output_state *po = get_output_state(output);
+	struct pixman_render_job *job;
+
+	po->render_queued = false;
+	if (!output->compositor->render_pool)
+		return false;
+
+	job = zalloc(sizeof *job);
+	if (!job)
+		return false;
+
+	pixman_region32_init(&job->output_damage);
+	pixman_region32_copy(&job->output_damage, output_damage);
+	pixman_region32_init(&job->hw_damage);
+	pixman_region32_copy(&job->hw_damage, hw_damage);
+
+	if (!weston_output_queue_render(output, pixman_render_job_render,
+					pixman_render_job_done, job)) {
+		pixman_region32_fini(&job->output_damage);
+		pixman_region32_fini(&job->hw_damage);
+		free(job);
+		return false;
+	}
+
+	po->render_queued = true;
+	return true;
+}
+
 static void
 pixman_renderer_repaint_output(struct weston_output *output,
 			       pixman_region32_t *output_damage)
@@ -584,12 +688,13 @@ pixman_renderer_repaint_output(struct weston_output *output,
 		pixman_region32_copy(&hw_damage, output_damage);
 	}
 
-	if (po->shadow_image) {
-		repaint_surfaces(output, output_damage);
-		copy_to_hw_buffer(output, &hw_damage);
-	} else {
-		repaint_surfaces(output, &hw_damage);
+	/* Rendered at the end of the repaint cycle, with the other outputs */
+	if (queue_render_output(output, output_damage, &hw_damage)) {
+		pixman_region32_fini(&hw_damage);
+		return;
 	}
+
+	render_output(output, output_damage, &hw_damage);
 	pixman_region32_fini(&hw_damage);
 
 	wl_signal_emit(&output->frame_signal, output_damage);
@@ -767,6 +872,7 @@ pixman_renderer_surface_set_color(struct weston_surface *es,
 		ps->image = NULL;
 	}
 
+	ps->color = color;
 	ps->image = pixman_image_create_solid_fill(&color);
 }
 
@@ -0,0 +1,315 @@
+/*
+ * Copyright © 2021 The qimm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <libweston/libweston.h>
+#include <libweston/zalloc.h>
+#include "libweston-internal.h"
+#include "shared/helpers.h"
+
+/*
+ * Worker pool to render outputs in parallel.
+ *
+ * A repaint cycle queues the render of each output while it repaints the
+ * outputs one after another, nothing is run yet. At the end of the cycle,
+ * the workers and the compositor thread run the renders, which only read
+ * the compositor state; the done callbacks are then called in the order
+ * of queueing on the compositor thread, before any frame is finished.
+ */
+
+struct weston_render_job {
+	struct wl_list link; /* weston_render_pool::jobs */
+	struct weston_output *output;
+	weston_render_func_t render;
+	weston_render_func_t done;
+	void *data;
+};
+
+struct weston_render_pool {
+	pthread_t *threads;
+	int thread_count;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t run_cond; /* jobs to run or quit */
+	pthread_cond_t done_cond; /* all jobs run */
+	bool quit;
+	bool workers_only; /* the compositor thread does not render */
+
+	bool collecting; /* between begin and finish */
+	struct wl_list jobs;
+	struct wl_list *next; /* next job to run, NULL when none */
+	int running;
+};
+
+/* take the next job, with the mutex held */
+static struct weston_render_job *
+render_pool_take(struct weston_render_pool *pool)
+{
+	struct weston_render_job *job;
+
+	if (!pool->next)
+		return NULL;
+
+	job = container_of(pool->next, struct weston_render_job, link);
+	pool->next = job->link.next == &pool->jobs ? NULL : job->link.next;
+	pool->running++;
+
+	return job;
+}
+
+/* run the job taken, with the mutex held */
+static void
+render_pool_run(struct weston_render_pool *pool, struct weston_render_job *job)
+{
+	pthread_mutex_unlock(&pool->mutex);
+	job->render(job->output, job->data);
+	pthread_mutex_lock(&pool->mutex);
+
+	pool->running--;
+	if (!pool->next && pool->running == 0)
+		pthread_cond_signal(&pool->done_cond);
+}
+
+static void *
+render_pool_worker(void *data)
+{
+	struct weston_render_pool *pool = data;
+	struct weston_render_job *job;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (!pool->quit) {
+		job = render_pool_take(pool);
+		if (job)
+			render_pool_run(pool, job);
+		else
+			pthread_cond_wait(&pool->run_cond, &pool->mutex);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+static void
+render_pool_stop(struct weston_render_pool *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->run_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->thread_count; i++)
+		pthread_join(pool->threads[i], NULL);
+	pool->thread_count = 0;
+}
+
+/** Create a pool of thread_count workers
+ *
+ * The compositor thread runs renders too, so thread_count workers render
+ * thread_count + 1 outputs at once, unless workers_only is set.
+ */
+struct weston_render_pool *
+weston_render_pool_create(int thread_count, bool workers_only)
+{
+	struct weston_render_pool *pool;
+	sigset_t mask, old_mask;
+
+	pool = zalloc(sizeof *pool);
+	if (!pool)
+		return NULL;
+
+	pool->threads = calloc(thread_count, sizeof *pool->threads);
+	if (!pool->threads) {
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->run_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+	wl_list_init(&pool->jobs);
+	pool->workers_only = workers_only;
+
+	/* Signals are handled by the compositor thread, except the faults
+	 * raised by the worker itself: a SIGBUS from a truncated wl_shm
+	 * pool must reach the libwayland handler on the faulting thread. */
+	sigfillset(&mask);
+	sigdelset(&mask, SIGBUS);
+	sigdelset(&mask, SIGSEGV);
+	sigdelset(&mask, SIGFPE);
+	sigdelset(&mask, SIGILL);
+	pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+	for (; pool->thread_count < thread_count; pool->thread_count++) {
+		if (pthread_create(&pool->threads[pool->thread_count], NULL,
+				   render_pool_worker, pool) != 0)
+			break;
+	}
+	pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+	if (pool->thread_count < thread_count) {
+		weston_log("Error: failed to create render threads.\n");
+		weston_render_pool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+void
+weston_render_pool_destroy(struct weston_render_pool *pool)
+{
+	assert(!pool->collecting);
+
+	render_pool_stop(pool);
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->run_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->threads);
+	free(pool);
+}
+
+/** Start a repaint cycle, the renders are queued until it is finished */
+void
+weston_render_pool_begin(struct weston_render_pool *pool)
+{
+	assert(wl_list_empty(&pool->jobs));
+	pool->collecting = true;
+}
+
+bool
+weston_render_pool_queue(struct weston_render_pool *pool,
+			 struct weston_output *output,
+			 weston_render_func_t render,
+			 weston_render_func_t done,
+			 void *data)
+{
+	struct weston_render_job *job;
+
+	if (!pool->collecting)
+		return false;
+
+	job = zalloc(sizeof *job);
+	if (!job)
+		return false;
+
+	job->output = output;
+	job->render = render;
+	job->done = done;
+	job->data = data;
+	wl_list_insert(pool->jobs.prev, &job->link);
+
+	return true;
+}
+
+/** Run the queued renders and wait for them, then call their done
+ *
+ * Called on the compositor thread at the end of the repaint cycle.
+ */
+void
+weston_render_pool_finish(struct weston_render_pool *pool)
+{
+	struct weston_render_job *job, *tmp;
+
+	pool->collecting = false;
+	if (wl_list_empty(&pool->jobs))
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->next = pool->jobs.next;
+	pthread_cond_broadcast(&pool->run_cond);
+
+	while (!pool->workers_only && (job = render_pool_take(pool)))
+		render_pool_run(pool, job);
+	while (pool->next || pool->running > 0)
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	pthread_mutex_unlock(&pool->mutex);
+
+	wl_list_for_each_safe(job, tmp, &pool->jobs, link) {
+		wl_list_remove(&job->link);
+		job->done(job->output, job->data);
+		free(job);
+	}
+}
+
+/** Queue the render of output in the repaint cycle
+ *
+ * \param output The output being repainted.
+ * \param render Renders output, on any thread. It must not change the
+ * compositor state.
+ * \param done Called on the compositor thread once rendered, to post the
+ * frame and free data.
+ * \param data Passed to render and done.
+ * \return false when renders are not run in parallel, the caller renders
+ * by itself then.
+ *
+ * \sa weston_compositor_set_render_threads
+ */
+bool
+weston_output_queue_render(struct weston_output *output,
+			   weston_render_func_t render,
+			   weston_render_func_t done,
+			   void *data)
+{
+	struct weston_render_pool *pool = output->compositor->render_pool;
+
+	if (!pool)
+		return false;
+
+	return weston_render_pool_queue(pool, output, render, done, data);
+}
+
+/** Repaint each output in one repaint cycle, without the backend
+ *
+ * \param compositor The compositor instance.
+ * \param repaint Repaints output with the renderer, its render is queued
+ * to the render threads if any.
+ * \param data Passed to repaint.
+ *
+ * Returns once all the renders are done. This is meant for the benchmarks
+ * of the renderers.
+ */
+WL_EXPORT void
+weston_compositor_repaint_outputs(struct weston_compositor *compositor,
+				  weston_render_func_t repaint, void *data)
+{
+	struct weston_output *output;
+
+	if (compositor->render_pool)
+		weston_render_pool_begin(compositor->render_pool);
+
+	wl_list_for_each(output, &compositor->output_list, link)
+		repaint(output, data);
+
+	if (compositor->render_pool)
+		weston_render_pool_finish(compositor->render_pool);
+}
@@ -1141,7 +1141,8 @@ repaint_views(struct weston_output *output, pixman_region32_t *damage)
 
 	wl_list_for_each_reverse(pnode, &output->paint_node_z_order_list,
 				 z_order_link) {
-		if (pnode->view->plane == &compositor->primary_plane)
+		if (pnode->view->plane == &compositor->primary_plane &&
+		    pixman_region32_not_empty(&pnode->visible))
 			draw_paint_node(pnode, damage);
 	}
 }
@@ -0,0 +1,143 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+#include <ftw.h>
+
+static int
+qimm_bench_log_quiet(const char *fmt, va_list ap) {
+    return 0;
+}
+
+static int
+qimm_bench_log(const char *fmt, va_list ap) {
+    return vfprintf(stderr, fmt, ap);
+}
+
+void
+qimm_bench_init(void) {
+    if (getenv("QIMM_BENCH_VERBOSE"))
+        weston_log_set_handler(qimm_bench_log, qimm_bench_log);
+    else
+        weston_log_set_handler(qimm_bench_log_quiet, qimm_bench_log_quiet);
+}
+
+uint64_t
+qimm_bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return timespec_to_nsec(&ts);
+}
+
+void
+qimm_bench_stat_add(struct qimm_bench_stat *stat, uint64_t nsec) {
+    if (stat->count == stat->alloc) {
+        size_t alloc = stat->alloc ? stat->alloc * 2 : 64;
+        uint64_t *samples = realloc(stat->samples, alloc * sizeof *samples);
+        if (!samples)
+            return;
+        stat->samples = samples;
+        stat->alloc = alloc;
+    }
+    stat->samples[stat->count++] = nsec;
+}
+
+static int
+qimm_bench_compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+uint64_t
+qimm_bench_stat_percentile(struct qimm_bench_stat *stat, int percentile) {
+    if (stat->count == 0)
+        return 0;
+
+    qsort(stat->samples, stat->count, sizeof *stat->samples,
+          qimm_bench_compare);
+    size_t i = (stat->count - 1) * percentile / 100;
+    return stat->samples[i];
+}
+
+uint64_t
+qimm_bench_stat_mean(struct qimm_bench_stat *stat) {
+    if (stat->count == 0)
+        return 0;
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < stat->count; i++)
+        sum += stat->samples[i];
+    return sum / stat->count;
+}
+
+void
+qimm_bench_stat_print(const char *name, struct qimm_bench_stat *stat) {
+    printf("%-24s n=%-6zu mean %10.3f us  p50 %10.3f us  "
+           "p90 %10.3f us  p99 %10.3f us\n",
+           name, stat->count,
+           qimm_bench_stat_mean(stat) / 1000.0,
+           qimm_bench_stat_percentile(stat, 50) / 1000.0,
+           qimm_bench_stat_percentile(stat, 90) / 1000.0,
+           qimm_bench_stat_percentile(stat, 99) / 1000.0);
+}
+
+void
+qimm_bench_stat_json(FILE *fp, const char *name, struct qimm_bench_stat *stat) {
+    fprintf(fp, "\"%s\": {\"count\": %zu, \"mean_us\": %.3f, "
+                "\"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f}",
+            name, stat->count,
+            qimm_bench_stat_mean(stat) / 1000.0,
+            qimm_bench_stat_percentile(stat, 50) / 1000.0,
+            qimm_bench_stat_percentile(stat, 90) / 1000.0,
+            qimm_bench_stat_percentile(stat, 99) / 1000.0);
+}
+
+void
+qimm_bench_stat_release(struct qimm_bench_stat *stat) {
+    free(stat->samples);
+    stat->samples = NULL;
+    stat->count = stat->alloc = 0;
+}
+
+char *
+qimm_bench_make_dir(void) {
+    const char *tmp = getenv("TMPDIR");
+    char *dir;
+
+    if (asprintf(&dir, "%s/qimm-bench-XXXXXX", tmp ?: "/tmp") < 0)
+        return NULL;
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "failed to make directory %s: %s\n",
+                dir, strerror(errno));
+        free(dir);
+        return NULL;
+    }
+    return dir;
+}
+
+static int
+qimm_bench_remove_file(const char *path, const struct stat *st,
+                       int flag, struct FTW *ftw) {
+    return remove(path);
+}
+
+void
+qimm_bench_remove_dir(const char *dir) {
+    nftw(dir, qimm_bench_remove_file, 16, FTW_DEPTH | FTW_PHYS);
+}
@@ -0,0 +1,70 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef QIMM_BENCH_H
+#define QIMM_BENCH_H
+
+#include "qimm.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Helpers for qimm benchmarks.
+ * Each benchmark is a standalone executable run by meson benchmark.
+ */
+struct qimm_bench_stat {
+    uint64_t *samples; /* nsec */
+    size_t count;
+    size_t alloc;
+};
+
+/* quiet the weston log unless QIMM_BENCH_VERBOSE is set */
+void
+qimm_bench_init(void);
+
+/* monotonic time in nsec */
+uint64_t
+qimm_bench_now(void);
+
+void
+qimm_bench_stat_add(struct qimm_bench_stat *stat, uint64_t nsec);
+/* percentile in 0..100, in nsec */
+uint64_t
+qimm_bench_stat_percentile(struct qimm_bench_stat *stat, int percentile);
+uint64_t
+qimm_bench_stat_mean(struct qimm_bench_stat *stat);
+void
+qimm_bench_stat_print(const char *name, struct qimm_bench_stat *stat);
+/* print as a json member: "name": {"count": .., "mean_us": .., ...} */
+void
+qimm_bench_stat_json(FILE *fp, const char *name, struct qimm_bench_stat *stat);
+void
+qimm_bench_stat_release(struct qimm_bench_stat *stat);
+
+/* make a temporary directory for benchmark data */
+char *
+qimm_bench_make_dir(void);
+void
+qimm_bench_remove_dir(const char *dir);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif // QIMM_BENCH_H
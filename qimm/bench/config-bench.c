@@ -0,0 +1,128 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+/*
+ * Compare loading project config from yaml and from compiled cache.
+ */
+#define BENCH_CONFIG_NAME "qimm-bench"
+
+static int
+bench_config_write_yaml(const char *path, int count) {
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+
+    fprintf(fp, "name: %s\n"
+                "themes:\n"
+                "  - name: default\n"
+                "    foreground: '#334455'\n"
+                "    background: '#aacc99'\n"
+                "types:\n", BENCH_CONFIG_NAME);
+    for (int i = 0; i < count; i++)
+        fprintf(fp, "  - name: type%d\n"
+                    "    summary: the summary for benchmark type %d\n", i, i);
+    fprintf(fp, "layouts:\n");
+    for (int i = 0; i < count; i++)
+        fprintf(fp, "  - { name: type%d , x: -1 , y: -1 , w: %d , h: %d }\n",
+                i, 100 + i % 200, 100 + i % 100);
+
+    return fclose(fp);
+}
+
+static int
+bench_config_count(struct qimm_project_config *config) {
+    return wl_list_length(&config->themes) +
+           wl_list_length(&config->types) +
+           wl_list_length(&config->layouts);
+}
+
+/*
+ * load config for times, return nodes of last loaded config
+ */
+static int
+bench_config_load(const char *cache_path, int times,
+                  struct qimm_bench_stat *stat) {
+    int nodes = -1;
+    for (int i = 0; i < times; i++) {
+        uint64_t start = qimm_bench_now();
+        struct qimm_project_config *config =
+                qimm_config_project_load(BENCH_CONFIG_NAME, BENCH_CONFIG_NAME,
+                                         cache_path);
+        qimm_bench_stat_add(stat, qimm_bench_now() - start);
+        if (!config)
+            return -1;
+
+        nodes = bench_config_count(config);
+        qimm_config_project_free(config);
+    }
+    return nodes;
+}
+
+int
+main(int argc, char *argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 5000;
+    int times = argc > 2 ? atoi(argv[2]) : 20;
+    int ret = EXIT_FAILURE;
+
+    qimm_bench_init();
+
+    char *dir = qimm_bench_make_dir();
+    if (!dir)
+        return EXIT_FAILURE;
+
+    char *yaml = NULL, *map = NULL;
+    if (asprintf(&yaml, "%s/%s.yaml", dir, BENCH_CONFIG_NAME) < 0 ||
+        asprintf(&map, "%s.yaml=%s", BENCH_CONFIG_NAME, yaml) < 0)
+        goto out;
+    /* qimm_get_project_path finds the config by module map */
+    setenv("WESTON_MODULE_MAP", map, 1);
+
+    if (bench_config_write_yaml(yaml, count) < 0) {
+        fprintf(stderr, "failed to write %s\n", yaml);
+        goto out;
+    }
+
+    struct qimm_bench_stat stat_yaml = {0}, stat_cache = {0};
+    int nodes_yaml = bench_config_load(NULL, times, &stat_yaml);
+
+    /* the first load writes the cache */
+    struct qimm_bench_stat stat_build = {0};
+    bench_config_load(dir, 1, &stat_build);
+    int nodes_cache = bench_config_load(dir, times, &stat_cache);
+
+    if (nodes_yaml < 0 || nodes_yaml != nodes_cache) {
+        fprintf(stderr, "config mismatch: yaml %d nodes, cache %d nodes\n",
+                nodes_yaml, nodes_cache);
+        goto out;
+    }
+
+    printf("config with %d types and %d layouts, %d loads\n",
+           count, count, times);
+    qimm_bench_stat_print("yaml", &stat_yaml);
+    qimm_bench_stat_print("cache write", &stat_build);
+    qimm_bench_stat_print("cache", &stat_cache);
+    ret = EXIT_SUCCESS;
+
+out:
+    qimm_bench_remove_dir(dir);
+    free(map);
+    free(yaml);
+    free(dir);
+    return ret;
+}
@@ -0,0 +1,221 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+/*
+ * Compare project datas in yaml files and in the log store:
+ * load all projects at startup, and save one project.
+ */
+static int
+bench_data_write_file(const char *dir, const char *name, const char *file,
+                      const char *content) {
+    char *path;
+    if (asprintf(&path, "%s/%s", dir, name) < 0)
+        return -1;
+    mkdir(path, QIMM_DATA_DIR_MODE);
+    free(path);
+
+    if (asprintf(&path, "%s/%s/%s", dir, name, file) < 0)
+        return -1;
+    FILE *fp = fopen(path, "w");
+    free(path);
+    if (!fp)
+        return -1;
+    fputs(content, fp);
+    return fclose(fp);
+}
+
+/*
+ * the yaml tree of projects, every other project has a background
+ */
+static int
+bench_data_write_tree(const char *dir, int count) {
+    for (int i = 0; i < count; i++) {
+        char name[32];
+        snprintf(name, sizeof name, "project%d", i);
+        if (bench_data_write_file(dir, name, "config.yaml",
+                                  "config_name: dashboard\n"
+                                  "output_name: HDMI-A-1\n") < 0)
+            return -1;
+        if (i % 2 == 0 &&
+            bench_data_write_file(dir, name, "background.yaml",
+                                  "color: 3355443\n"
+                                  "image: wallpaper.png\n"
+                                  "type: crop\n") < 0)
+            return -1;
+    }
+    return 0;
+}
+
+struct bench_data_load {
+    struct qimm_shell *shell;
+    int projects;
+    int backgrounds;
+};
+
+static int
+bench_data_load_project(const char *name, void *data) {
+    struct bench_data_load *load = data;
+
+    struct qimm_project *project = qimm_data_read_project(load->shell, name);
+    if (!project)
+        return -1;
+    load->projects++;
+    free(project->config_name);
+    free(project->output_name);
+    free(project);
+
+    struct qimm_data_background *background =
+            qimm_data_read_background(load->shell, name);
+    if (background) {
+        load->backgrounds++;
+        qimm_data_background_free(background);
+    }
+    return 0;
+}
+
+/*
+ * load all projects like the project loader, return projects loaded
+ */
+static int
+bench_data_load(struct qimm_shell *shell, bool log, int times,
+                struct qimm_bench_stat *stat) {
+    int projects = -1;
+    for (int i = 0; i < times; i++) {
+        uint64_t start = qimm_bench_now();
+        if (log && !(shell->data_store = qimm_data_store_open(shell->data_path)))
+            return -1;
+
+        struct bench_data_load load = {shell};
+        int ret = qimm_data_for_each_project(shell, bench_data_load_project,
+                                             &load);
+
+        if (log) {
+            qimm_data_store_close(shell->data_store);
+            shell->data_store = NULL;
+        }
+        qimm_bench_stat_add(stat, qimm_bench_now() - start);
+        if (ret < 0)
+            return -1;
+        projects = load.projects + load.backgrounds;
+    }
+    return projects;
+}
+
+/*
+ * save projects one by one, each save is durable when it returns
+ */
+static int
+bench_data_save(struct qimm_shell *shell, int count, int times,
+                struct qimm_bench_stat *stat) {
+    for (int i = 0; i < times; i++) {
+        char name[32], output[32];
+        snprintf(name, sizeof name, "project%d", i * 7919 % count);
+        snprintf(output, sizeof output, "HDMI-A-%d", i);
+        struct qimm_project project = {
+                .shell = shell,
+                .name = name,
+                .config_name = "dashboard",
+                .output_name = output,
+        };
+
+        uint64_t start = qimm_bench_now();
+        int ret = qimm_data_save_project(&project);
+        qimm_bench_stat_add(stat, qimm_bench_now() - start);
+        if (ret < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int
+main(int argc, char *argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 2000;
+    int times = argc > 2 ? atoi(argv[2]) : 10;
+    int saves = argc > 3 ? atoi(argv[3]) : 200;
+    int ret = EXIT_FAILURE;
+
+    qimm_bench_init();
+
+    char *dir = qimm_bench_make_dir();
+    if (!dir)
+        return EXIT_FAILURE;
+
+    struct qimm_shell shell = {0};
+    if (asprintf(&shell.data_path, "%s/data", dir) < 0) {
+        shell.data_path = NULL;
+        goto out;
+    }
+    mkdir(shell.data_path, QIMM_DATA_DIR_MODE);
+    if (bench_data_write_tree(shell.data_path, count) < 0) {
+        fprintf(stderr, "failed to write projects in %s\n", shell.data_path);
+        goto out;
+    }
+
+    struct qimm_bench_stat stat_yaml = {0}, stat_import = {0},
+            stat_log = {0}, stat_save_yaml = {0}, stat_save_log = {0};
+    int nodes_yaml = bench_data_load(&shell, false, times, &stat_yaml);
+
+    /* the first open imports the yaml tree */
+    uint64_t start = qimm_bench_now();
+    struct qimm_data_store *store = qimm_data_store_open(shell.data_path);
+    qimm_bench_stat_add(&stat_import, qimm_bench_now() - start);
+    if (!store)
+        goto out;
+    qimm_data_store_close(store);
+
+    int nodes_log = bench_data_load(&shell, true, times, &stat_log);
+    if (nodes_yaml < 0 || nodes_yaml != nodes_log) {
+        fprintf(stderr, "data mismatch: yaml %d files, log %d files\n",
+                nodes_yaml, nodes_log);
+        goto out;
+    }
+
+    if (bench_data_save(&shell, count, saves, &stat_save_yaml) < 0)
+        goto out;
+    shell.data_store = qimm_data_store_open(shell.data_path);
+    if (!shell.data_store ||
+        bench_data_save(&shell, count, saves, &stat_save_log) < 0)
+        goto out;
+
+    /* overwritten records are compacted, the log loads the same */
+    qimm_data_store_close(shell.data_store);
+    shell.data_store = NULL;
+    struct qimm_bench_stat stat_reload = {0};
+    if (bench_data_load(&shell, true, 1, &stat_reload) != nodes_yaml) {
+        fprintf(stderr, "data mismatch after saves\n");
+        goto out;
+    }
+
+    printf("%d projects with %d files, %d loads, %d saves\n",
+           count, nodes_yaml, times, saves);
+    qimm_bench_stat_print("load yaml", &stat_yaml);
+    qimm_bench_stat_print("load log", &stat_log);
+    qimm_bench_stat_print("log import", &stat_import);
+    qimm_bench_stat_print("save yaml", &stat_save_yaml);
+    qimm_bench_stat_print("save log", &stat_save_log);
+    ret = EXIT_SUCCESS;
+
+out:
+    if (shell.data_store)
+        qimm_data_store_close(shell.data_store);
+    qimm_bench_remove_dir(dir);
+    free(shell.data_path);
+    free(dir);
+    return ret;
+}
@@ -0,0 +1,216 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+/*
+ * Run the layout flow over a project with thousands of layouts:
+ * the full flow when output is resized, and the incremental flow when
+ * one layout is resized or the output is moved.
+ * The incremental result is checked against the full flow.
+ */
+#define BENCH_CONFIG_NAME "qimm-bench"
+#define BENCH_TYPES 16
+
+struct bench_geometry {
+    int32_t x, y, w, h;
+};
+
+static int
+bench_config_write_yaml(const char *path, int count) {
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+
+    fprintf(fp, "name: %s\ntypes:\n", BENCH_CONFIG_NAME);
+    for (int i = 0; i < BENCH_TYPES; i++)
+        fprintf(fp, "  - name: type%d\n", i);
+    fprintf(fp, "layouts:\n");
+    for (int i = 0; i < count; i++) {
+        int type = i % BENCH_TYPES;
+        if (i % 13 == 0) /* share free width of row */
+            fprintf(fp, "  - { name: type%d , x: -1 , y: -1 , w: 160 , "
+                        "h: %d , weight: %d , max_w: 480 }\n",
+                    type, 80 + i % 5 * 30, 1 + i % 3);
+        else if (i % 7 == 0) /* part of output */
+            fprintf(fp, "  - { name: type%d , x: -1 , y: -1 , w: -%d , "
+                        "h: -12 , min_w: 200 }\n",
+                    type, 6 + i % 4);
+        else
+            fprintf(fp, "  - { name: type%d , x: -1 , y: -1 , w: %d , "
+                        "h: %d }\n",
+                    type, 100 + i % 7 * 40, 80 + i % 5 * 30);
+    }
+
+    return fclose(fp);
+}
+
+static struct bench_geometry *
+bench_geometry_save(struct qimm_project *project, int count) {
+    struct bench_geometry *geometry = calloc(count, sizeof *geometry);
+    if (!geometry)
+        return NULL;
+
+    int i = 0;
+    struct qimm_layout *layout;
+    wl_list_for_each(layout, &project->layouts, link) {
+        geometry[i++] = (struct bench_geometry) {
+                layout->x, layout->y, layout->w, layout->h
+        };
+    }
+    return geometry;
+}
+
+/*
+ * the incremental flow must be the same as the full flow
+ */
+static int
+bench_layout_check(struct qimm_project *project, int count) {
+    struct bench_geometry *incremental = bench_geometry_save(project, count);
+    if (!incremental)
+        return -1;
+
+    qimm_layout_project_invalidate(project);
+    qimm_layout_project_update(project);
+    struct bench_geometry *full = bench_geometry_save(project, count);
+
+    int ret = full && !memcmp(incremental, full, count * sizeof *full) ? 0 : -1;
+    free(incremental);
+    free(full);
+    return ret;
+}
+
+static struct qimm_layout *
+bench_layout_at(struct qimm_layout **layouts, int count) {
+    return layouts[rand() % count];
+}
+
+int
+main(int argc, char *argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 10000;
+    int times = argc > 2 ? atoi(argv[2]) : 200;
+    int ret = EXIT_FAILURE;
+
+    qimm_bench_init();
+    srand(1);
+
+    char *dir = qimm_bench_make_dir();
+    if (!dir)
+        return EXIT_FAILURE;
+
+    struct qimm_project *project = NULL;
+    struct qimm_layout **layouts = NULL;
+    char *yaml = NULL, *map = NULL;
+    if (asprintf(&yaml, "%s/%s.yaml", dir, BENCH_CONFIG_NAME) < 0 ||
+        asprintf(&map, "%s.yaml=%s", BENCH_CONFIG_NAME, yaml) < 0)
+        goto out;
+    /* qimm_get_project_path finds the config by module map */
+    setenv("WESTON_MODULE_MAP", map, 1);
+
+    if (bench_config_write_yaml(yaml, count) < 0) {
+        fprintf(stderr, "failed to write %s\n", yaml);
+        goto out;
+    }
+
+    struct qimm_shell shell = {0};
+    struct weston_output output = {0};
+    struct qimm_output qimm_output = {0};
+    wl_list_init(&shell.outputs);
+    qimm_index_init(&shell);
+    output.name = "bench";
+    output.width = 3840;
+    output.height = 2160;
+    qimm_output.shell = &shell;
+    qimm_output.output = &output;
+    wl_list_init(&qimm_output.projects);
+    wl_list_insert(&shell.outputs, &qimm_output.link);
+
+    project = qimm_project_create(&shell, "project", BENCH_CONFIG_NAME);
+    if (!project) {
+        fprintf(stderr, "failed to create project\n");
+        goto out_shell;
+    }
+    project->output = &qimm_output;
+    wl_list_insert(&qimm_output.projects, &project->link);
+
+    layouts = calloc(count, sizeof *layouts);
+    if (!layouts || wl_list_length(&project->layouts) != count)
+        goto out_shell;
+    int i = 0;
+    struct qimm_layout *layout;
+    wl_list_for_each(layout, &project->layouts, link)
+        layouts[i++] = layout;
+
+    struct qimm_bench_stat stat_full = {0}, stat_one = {0},
+            stat_last = {0}, stat_move = {0};
+    for (i = 0; i < times; i++) {
+        /* resized output places all layouts again */
+        output.width = i % 2 ? 3840 : 2560;
+        uint64_t start = qimm_bench_now();
+        qimm_layout_project_update(project);
+        qimm_bench_stat_add(&stat_full, qimm_bench_now() - start);
+
+        /* one layout resized */
+        layout = bench_layout_at(layouts, count);
+        int32_t w = i % 3 ? layout->w + 40 : 0;
+        start = qimm_bench_now();
+        qimm_layout_resize(layout, w, 0);
+        qimm_bench_stat_add(&stat_one, qimm_bench_now() - start);
+
+        /* the last layout resized */
+        start = qimm_bench_now();
+        qimm_layout_resize(layouts[count - 1], i % 2 ? 320 : 0, 0);
+        qimm_bench_stat_add(&stat_last, qimm_bench_now() - start);
+
+        /* output moved */
+        output.x = i % 2 ? 0 : output.width;
+        start = qimm_bench_now();
+        qimm_layout_project_update(project);
+        qimm_bench_stat_add(&stat_move, qimm_bench_now() - start);
+
+        if (i % 16 == 0 && bench_layout_check(project, count) < 0) {
+            fprintf(stderr, "incremental flow differs from full flow\n");
+            goto out_shell;
+        }
+    }
+
+    printf("project with %d layouts, %d updates\n", count, times);
+    qimm_bench_stat_print("output resized", &stat_full);
+    qimm_bench_stat_print("one layout resized", &stat_one);
+    qimm_bench_stat_print("last layout resized", &stat_last);
+    qimm_bench_stat_print("output moved", &stat_move);
+    ret = EXIT_SUCCESS;
+
+    qimm_bench_stat_release(&stat_full);
+    qimm_bench_stat_release(&stat_one);
+    qimm_bench_stat_release(&stat_last);
+    qimm_bench_stat_release(&stat_move);
+
+out_shell:
+    if (project) {
+        qimm_output_project_remove(project);
+        qimm_project_destroy(project);
+    }
+    qimm_index_release(&shell);
+out:
+    qimm_bench_remove_dir(dir);
+    free(layouts);
+    free(map);
+    free(yaml);
+    free(dir);
+    return ret;
+}
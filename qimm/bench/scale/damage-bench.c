@@ -0,0 +1,326 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+#include "libweston-internal.h"
+#include "tests/test-config.h"
+#include "tests/weston-test-runner.h"
+#include "tests/weston-test-fixture-compositor.h"
+
+/*
+ * Measure weston_output_accumulate_damage, run at each output repaint,
+ * against the count of views and of planes, like many overlay candidates
+ * spread by assign_planes of the drm backend over its planes.
+ *
+ * The result is checked against a walk of the whole z-order list for each
+ * plane, as libweston did before the paint nodes were bucketed per plane,
+ * which is also measured.
+ */
+#define BENCH_DAMAGE_ROUNDS 200
+#define BENCH_DAMAGE_WIDTH 1920
+#define BENCH_DAMAGE_HEIGHT 1080
+
+struct bench_damage {
+    struct fixture_metadata meta;
+    int views;
+    int planes; /* besides the primary plane */
+};
+
+static const struct bench_damage bench_damages[] = {
+        {.meta.name = "100 views 4 planes", .views = 100, .planes = 4},
+        {.meta.name = "1000 views 8 planes", .views = 1000, .planes = 8},
+        {.meta.name = "1000 views 32 planes", .views = 1000, .planes = 32},
+        {.meta.name = "5000 views 32 planes", .views = 5000, .planes = 32},
+};
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness,
+              const struct bench_damage *arg) {
+    struct compositor_setup setup;
+    compositor_setup_defaults(&setup);
+    setup.width = BENCH_DAMAGE_WIDTH;
+    setup.height = BENCH_DAMAGE_HEIGHT;
+
+    return weston_test_harness_execute_as_plugin(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP_WITH_ARG(fixture_setup, bench_damages, meta);
+
+struct bench_damage_state {
+    struct weston_compositor *compositor;
+    struct weston_output *output;
+    const struct bench_damage *arg;
+
+    struct weston_layer layer;
+    struct weston_surface **surfaces;
+    struct weston_plane *planes;
+    uint32_t seed;
+
+    struct qimm_bench_stat accumulate;
+    struct qimm_bench_stat accumulate_linear;
+};
+
+static int
+bench_damage_random(struct bench_damage_state *state, int max) {
+    state->seed = state->seed * 1103515245 + 12345;
+    return (int) ((state->seed >> 8) % max);
+}
+
+static struct weston_view *
+bench_damage_view(struct bench_damage_state *state, int i) {
+    return container_of(state->surfaces[i]->views.next,
+                        struct weston_view, surface_link);
+}
+
+/*
+ * windows of 40 to 400 pixels, half of them opaque, on the primary plane
+ * or one of the overlay planes
+ */
+static void
+bench_damage_add_views(struct bench_damage_state *state) {
+    struct weston_compositor *compositor = state->compositor;
+    int count = state->arg->views;
+    state->surfaces = calloc(count, sizeof *state->surfaces);
+    state->planes = calloc(state->arg->planes, sizeof *state->planes);
+    assert(state->surfaces && state->planes);
+
+    for (int i = 0; i < state->arg->planes; i++) {
+        weston_plane_init(&state->planes[i], compositor, 0, 0);
+        weston_compositor_stack_plane(compositor, &state->planes[i], NULL);
+    }
+
+    weston_layer_init(&state->layer, compositor);
+    weston_layer_set_position(&state->layer, WESTON_LAYER_POSITION_NORMAL);
+
+    for (int i = 0; i < count; i++) {
+        struct weston_surface *surface = weston_surface_create(compositor);
+        assert(surface);
+        surface->width = 40 + bench_damage_random(state, 360);
+        surface->height = 40 + bench_damage_random(state, 360);
+        if (i % 2 == 0) {
+            pixman_region32_fini(&surface->opaque);
+            pixman_region32_init_rect(&surface->opaque, 0, 0,
+                                      surface->width, surface->height);
+        }
+
+        struct weston_view *view = weston_view_create(surface);
+        assert(view);
+        weston_view_set_position(view,
+                                 bench_damage_random(state, BENCH_DAMAGE_WIDTH),
+                                 bench_damage_random(state, BENCH_DAMAGE_HEIGHT));
+        weston_layer_entry_insert(&state->layer.view_list,
+                                  &view->layer_link);
+        state->surfaces[i] = surface;
+    }
+
+    weston_compositor_build_view_list(compositor, state->output);
+
+    for (int i = 0; i < count; i++) {
+        int plane = bench_damage_random(state, state->arg->planes + 1);
+        weston_view_move_to_plane(bench_damage_view(state, i),
+                                  plane ? &state->planes[plane - 1] :
+                                  &compositor->primary_plane);
+    }
+}
+
+/*
+ * clients commit damage on some of the surfaces
+ */
+static void
+bench_damage_commit(struct bench_damage_state *state) {
+    struct weston_plane *plane;
+    wl_list_for_each(plane, &state->compositor->plane_list, link) {
+        pixman_region32_clear(&plane->damage);
+        pixman_region32_clear(&plane->clip);
+    }
+
+    for (int i = 0; i < state->arg->views; i++) {
+        struct weston_surface *surface = state->surfaces[i];
+        pixman_region32_clear(&surface->damage);
+        if (i % 3)
+            continue;
+        pixman_region32_union_rect(&surface->damage, &surface->damage,
+                                   0, 0, surface->width / 2,
+                                   surface->height / 2);
+    }
+}
+
+/*
+ * weston_output_accumulate_damage before the buckets, for views without
+ * transform, with the same culling of occluded views
+ */
+static void
+bench_damage_linear(struct bench_damage_state *state) {
+    struct weston_output *output = state->output;
+    struct weston_plane *plane;
+    struct weston_paint_node *pnode;
+    pixman_region32_t opaque, clip, damage, visible;
+
+    pixman_region32_init(&clip);
+    wl_list_for_each(plane, &state->compositor->plane_list, link) {
+        pixman_region32_copy(&plane->clip, &clip);
+        pixman_region32_init(&opaque);
+
+        wl_list_for_each(pnode, &output->paint_node_z_order_list,
+                         z_order_link) {
+            struct weston_view *view = pnode->view;
+            if (view->plane != plane)
+                continue;
+
+            assert(!view->transform.enabled);
+            pixman_region32_init(&visible);
+            pixman_region32_intersect(&visible, &view->transform.boundingbox,
+                                      &output->region);
+            pixman_region32_subtract(&visible, &visible, &opaque);
+            pixman_region32_subtract(&visible, &visible, &plane->clip);
+            bool occluded = !pixman_region32_not_empty(&visible);
+            pixman_region32_fini(&visible);
+
+            pixman_region32_init(&damage);
+            if (!occluded)
+                pixman_region32_copy(&damage, &view->surface->damage);
+            pixman_region32_translate(&damage, view->geometry.x,
+                                      view->geometry.y);
+            pixman_region32_intersect(&damage, &damage,
+                                      &view->transform.boundingbox);
+            pixman_region32_subtract(&damage, &damage, &opaque);
+            pixman_region32_union(&plane->damage, &plane->damage, &damage);
+            pixman_region32_fini(&damage);
+            pixman_region32_copy(&view->clip, &opaque);
+            pixman_region32_union(&opaque, &opaque, &view->transform.opaque);
+        }
+
+        pixman_region32_union(&clip, &clip, &opaque);
+        pixman_region32_fini(&opaque);
+    }
+    pixman_region32_fini(&clip);
+
+    for (int i = 0; i < state->arg->views; i++)
+        pixman_region32_clear(&state->surfaces[i]->damage);
+}
+
+/*
+ * the planes and the views are left with the same damage and clips
+ */
+static void
+bench_damage_check(struct bench_damage_state *state) {
+    struct weston_compositor *compositor = state->compositor;
+    int count = state->arg->views;
+    int planes = state->arg->planes + 1;
+    pixman_region32_t *clips = calloc(count + planes * 2, sizeof *clips);
+    assert(clips);
+
+    bench_damage_commit(state);
+    bench_damage_linear(state);
+
+    struct weston_plane *plane;
+    int i = count;
+    for (int j = 0; j < count; j++) {
+        pixman_region32_init(&clips[j]);
+        pixman_region32_copy(&clips[j], &bench_damage_view(state, j)->clip);
+    }
+    wl_list_for_each(plane, &compositor->plane_list, link) {
+        assert(i < count + planes * 2);
+        pixman_region32_init(&clips[i]);
+        pixman_region32_copy(&clips[i++], &plane->damage);
+        pixman_region32_init(&clips[i]);
+        pixman_region32_copy(&clips[i++], &plane->clip);
+    }
+
+    bench_damage_commit(state);
+    weston_output_accumulate_damage(state->output);
+
+    i = count;
+    for (int j = 0; j < count; j++)
+        assert(pixman_region32_equal(&clips[j],
+                                     &bench_damage_view(state, j)->clip));
+    wl_list_for_each(plane, &compositor->plane_list, link) {
+        assert(pixman_region32_equal(&clips[i++], &plane->damage));
+        assert(pixman_region32_equal(&clips[i++], &plane->clip));
+    }
+
+    for (int j = 0; j < i; j++)
+        pixman_region32_fini(&clips[j]);
+    free(clips);
+}
+
+static void
+bench_damage_run(struct bench_damage_state *state, bool linear,
+                 struct qimm_bench_stat *stat) {
+    for (int i = 0; i < BENCH_DAMAGE_ROUNDS; i++) {
+        bench_damage_commit(state);
+
+        uint64_t start = qimm_bench_now();
+        if (linear)
+            bench_damage_linear(state);
+        else
+            weston_output_accumulate_damage(state->output);
+        qimm_bench_stat_add(stat, qimm_bench_now() - start);
+    }
+}
+
+static void
+bench_damage_print(FILE *fp, struct bench_damage_state *state) {
+    fprintf(fp, "{\"bench\": \"qimm-damage\", \"views\": %d, "
+                "\"planes\": %d, ", state->arg->views, state->arg->planes);
+    qimm_bench_stat_json(fp, "accumulate", &state->accumulate);
+    fprintf(fp, ", ");
+    qimm_bench_stat_json(fp, "accumulate_linear", &state->accumulate_linear);
+    fprintf(fp, "}\n");
+}
+
+static void
+bench_damage_release(struct bench_damage_state *state) {
+    /* the views are destroyed with surfaces */
+    for (int i = 0; i < state->arg->views; i++)
+        weston_surface_destroy(state->surfaces[i]);
+    weston_layer_fini(&state->layer);
+    weston_compositor_build_view_list(state->compositor, NULL);
+    for (int i = 0; i < state->arg->planes; i++)
+        weston_plane_release(&state->planes[i]);
+
+    qimm_bench_stat_release(&state->accumulate);
+    qimm_bench_stat_release(&state->accumulate_linear);
+    free(state->surfaces);
+    free(state->planes);
+}
+
+PLUGIN_TEST(qimm_damage) {
+    struct bench_damage_state state = {
+            .compositor = compositor,
+            .arg = &bench_damages[get_test_fixture_index()],
+            .seed = 1,
+    };
+    assert(!wl_list_empty(&compositor->output_list));
+    state.output = container_of(compositor->output_list.next,
+                                struct weston_output, link);
+
+    bench_damage_add_views(&state);
+    bench_damage_check(&state);
+    bench_damage_run(&state, false, &state.accumulate);
+    bench_damage_run(&state, true, &state.accumulate_linear);
+
+    bench_damage_print(stdout, &state);
+    const char *path = getenv("QIMM_BENCH_JSON");
+    FILE *fp = path ? fopen(path, "a") : NULL;
+    if (fp) {
+        bench_damage_print(fp, &state);
+        fclose(fp);
+    }
+
+    bench_damage_release(&state);
+}
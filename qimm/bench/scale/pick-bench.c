@@ -0,0 +1,289 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+#include "libweston-internal.h"
+#include "tests/test-config.h"
+#include "tests/weston-test-runner.h"
+#include "tests/weston-test-fixture-compositor.h"
+
+/*
+ * Measure weston_compositor_pick_view against the count of views, like
+ * the widgets of many layouts on a large desktop, and check each pick
+ * against a walk of the whole view_list as libweston did before the
+ * spatial index.
+ *
+ * The views are put in a layer of the running compositor and view_list is
+ * rebuilt as a repaint would do, so picks measure only the lookup.
+ */
+#define BENCH_PICK_POINTS 20000
+#define BENCH_PICK_BATCH 16
+#define BENCH_PICK_WIDTH 1920
+#define BENCH_PICK_HEIGHT 1080
+
+struct bench_pick {
+    struct fixture_metadata meta;
+    int views;
+};
+
+static const struct bench_pick bench_picks[] = {
+        {.meta.name = "10 views", .views = 10},
+        {.meta.name = "100 views", .views = 100},
+        {.meta.name = "500 views", .views = 500},
+        {.meta.name = "1000 views", .views = 1000},
+        {.meta.name = "5000 views", .views = 5000},
+};
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness,
+              const struct bench_pick *arg) {
+    struct compositor_setup setup;
+    compositor_setup_defaults(&setup);
+    setup.width = BENCH_PICK_WIDTH;
+    setup.height = BENCH_PICK_HEIGHT;
+
+    return weston_test_harness_execute_as_plugin(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP_WITH_ARG(fixture_setup, bench_picks, meta);
+
+struct bench_pick_state {
+    struct weston_compositor *compositor;
+    const struct bench_pick *arg;
+
+    struct weston_layer layer;
+    struct weston_surface **surfaces;
+    wl_fixed_t *points; /* x, y */
+    uint32_t seed;
+
+    struct qimm_bench_stat build;
+    struct qimm_bench_stat pick;
+    struct qimm_bench_stat pick_linear;
+    struct qimm_bench_stat pick_moved;
+};
+
+static int
+bench_pick_random(struct bench_pick_state *state, int max) {
+    state->seed = state->seed * 1103515245 + 12345;
+    return (int) ((state->seed >> 8) % max);
+}
+
+/*
+ * the walk of weston_compositor_pick_view before the index
+ */
+static struct weston_view *
+bench_pick_linear(struct weston_compositor *compositor,
+                  wl_fixed_t x, wl_fixed_t y,
+                  wl_fixed_t *vx, wl_fixed_t *vy) {
+    int ix = wl_fixed_to_int(x);
+    int iy = wl_fixed_to_int(y);
+
+    struct weston_view *view;
+    wl_list_for_each(view, &compositor->view_list, link) {
+        if (!pixman_region32_contains_point(&view->transform.boundingbox,
+                                            ix, iy, NULL))
+            continue;
+
+        weston_view_from_global_fixed(view, x, y, vx, vy);
+        int view_ix = wl_fixed_to_int(*vx);
+        int view_iy = wl_fixed_to_int(*vy);
+        if (!pixman_region32_contains_point(&view->surface->input,
+                                            view_ix, view_iy, NULL))
+            continue;
+        if (view->geometry.scissor_enabled &&
+            !pixman_region32_contains_point(&view->geometry.scissor,
+                                            view_ix, view_iy, NULL))
+            continue;
+        return view;
+    }
+    return NULL;
+}
+
+/*
+ * widgets of 40 to 400 pixels spread over the desktop, some overlapped,
+ * some with an input region smaller than the surface
+ */
+static void
+bench_pick_add_views(struct bench_pick_state *state) {
+    int count = state->arg->views;
+    state->surfaces = calloc(count, sizeof *state->surfaces);
+    assert(state->surfaces);
+
+    weston_layer_init(&state->layer, state->compositor);
+    weston_layer_set_position(&state->layer, WESTON_LAYER_POSITION_NORMAL);
+
+    for (int i = 0; i < count; i++) {
+        struct weston_surface *surface =
+                weston_surface_create(state->compositor);
+        assert(surface);
+        surface->width = 40 + bench_pick_random(state, 360);
+        surface->height = 40 + bench_pick_random(state, 360);
+        if (i % 4 == 0) {
+            pixman_region32_fini(&surface->input);
+            pixman_region32_init_rect(&surface->input, 4, 4,
+                                      surface->width - 8,
+                                      surface->height - 8);
+        }
+
+        struct weston_view *view = weston_view_create(surface);
+        assert(view);
+        weston_view_set_position(view,
+                                 bench_pick_random(state, BENCH_PICK_WIDTH),
+                                 bench_pick_random(state, BENCH_PICK_HEIGHT));
+        weston_layer_entry_insert(&state->layer.view_list,
+                                  &view->layer_link);
+        state->surfaces[i] = surface;
+    }
+
+    uint64_t start = qimm_bench_now();
+    weston_compositor_build_view_list(state->compositor, NULL);
+    wl_fixed_t vx, vy;
+    weston_compositor_pick_view(state->compositor, 0, 0, &vx, &vy);
+    qimm_bench_stat_add(&state->build, qimm_bench_now() - start);
+}
+
+static void
+bench_pick_points(struct bench_pick_state *state) {
+    state->points = calloc(BENCH_PICK_POINTS * 2, sizeof *state->points);
+    assert(state->points);
+    for (int i = 0; i < BENCH_PICK_POINTS * 2; i += 2) {
+        state->points[i] = wl_fixed_from_double(
+                bench_pick_random(state, BENCH_PICK_WIDTH * 16) / 16.0);
+        state->points[i + 1] = wl_fixed_from_double(
+                bench_pick_random(state, BENCH_PICK_HEIGHT * 16) / 16.0);
+    }
+}
+
+/*
+ * the picks must be the same as the walk of whole view_list
+ */
+static void
+bench_pick_check(struct bench_pick_state *state) {
+    for (int i = 0; i < BENCH_PICK_POINTS * 2; i += 2) {
+        wl_fixed_t x = state->points[i], y = state->points[i + 1];
+        wl_fixed_t vx, vy, lvx = 0, lvy = 0;
+
+        struct weston_view *view =
+                weston_compositor_pick_view(state->compositor, x, y, &vx, &vy);
+        struct weston_view *expect =
+                bench_pick_linear(state->compositor, x, y, &lvx, &lvy);
+        assert(view == expect);
+        assert(!view || (vx == lvx && vy == lvy));
+    }
+}
+
+static void
+bench_pick_run(struct bench_pick_state *state, bool linear,
+               struct qimm_bench_stat *stat) {
+    wl_fixed_t vx, vy;
+    for (int i = 0; i < BENCH_PICK_POINTS * 2; i += BENCH_PICK_BATCH * 2) {
+        uint64_t start = qimm_bench_now();
+        for (int j = i; j < i + BENCH_PICK_BATCH * 2; j += 2) {
+            if (linear)
+                bench_pick_linear(state->compositor, state->points[j],
+                                  state->points[j + 1], &vx, &vy);
+            else
+                weston_compositor_pick_view(state->compositor,
+                                            state->points[j],
+                                            state->points[j + 1], &vx, &vy);
+        }
+        qimm_bench_stat_add(stat, (qimm_bench_now() - start) /
+                                  BENCH_PICK_BATCH);
+    }
+}
+
+/*
+ * a view moves between picks, like the cursor sprite on pointer motion
+ */
+static void
+bench_pick_moved(struct bench_pick_state *state) {
+    struct weston_view *view = container_of(
+            state->surfaces[state->arg->views / 2]->views.next,
+            struct weston_view, surface_link);
+
+    for (int i = 0; i < BENCH_PICK_POINTS * 2; i += 2) {
+        wl_fixed_t x = state->points[i], y = state->points[i + 1];
+        wl_fixed_t vx, vy, lvx = 0, lvy = 0;
+
+        weston_view_set_position(view, wl_fixed_to_double(x) - 10,
+                                 wl_fixed_to_double(y) - 10);
+        weston_view_update_transform(view);
+
+        uint64_t start = qimm_bench_now();
+        struct weston_view *pick =
+                weston_compositor_pick_view(state->compositor, x, y, &vx, &vy);
+        qimm_bench_stat_add(&state->pick_moved, qimm_bench_now() - start);
+
+        assert(pick == bench_pick_linear(state->compositor, x, y,
+                                         &lvx, &lvy));
+    }
+}
+
+static void
+bench_pick_print(FILE *fp, struct bench_pick_state *state) {
+    fprintf(fp, "{\"bench\": \"qimm-pick\", \"views\": %d, ",
+            state->arg->views);
+    qimm_bench_stat_json(fp, "build", &state->build);
+    fprintf(fp, ", ");
+    qimm_bench_stat_json(fp, "pick", &state->pick);
+    fprintf(fp, ", ");
+    qimm_bench_stat_json(fp, "pick_linear", &state->pick_linear);
+    fprintf(fp, ", ");
+    qimm_bench_stat_json(fp, "pick_moved", &state->pick_moved);
+    fprintf(fp, "}\n");
+}
+
+static void
+bench_pick_release(struct bench_pick_state *state) {
+    /* the views are destroyed with surfaces */
+    for (int i = 0; i < state->arg->views; i++)
+        weston_surface_destroy(state->surfaces[i]);
+    weston_layer_fini(&state->layer);
+    weston_compositor_build_view_list(state->compositor, NULL);
+
+    qimm_bench_stat_release(&state->build);
+    qimm_bench_stat_release(&state->pick);
+    qimm_bench_stat_release(&state->pick_linear);
+    qimm_bench_stat_release(&state->pick_moved);
+    free(state->surfaces);
+    free(state->points);
+}
+
+PLUGIN_TEST(qimm_pick) {
+    struct bench_pick_state state = {
+            .compositor = compositor,
+            .arg = &bench_picks[get_test_fixture_index()],
+            .seed = 1,
+    };
+
+    bench_pick_add_views(&state);
+    bench_pick_points(&state);
+    bench_pick_check(&state);
+    bench_pick_run(&state, false, &state.pick);
+    bench_pick_run(&state, true, &state.pick_linear);
+    bench_pick_moved(&state);
+
+    bench_pick_print(stdout, &state);
+    const char *path = getenv("QIMM_BENCH_JSON");
+    FILE *fp = path ? fopen(path, "a") : NULL;
+    if (fp) {
+        bench_pick_print(fp, &state);
+        fclose(fp);
+    }
+
+    bench_pick_release(&state);
+}
@@ -0,0 +1,232 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+#include <libweston/windowed-output-api.h>
+
+#include "libweston-internal.h"
+#include "tests/test-config.h"
+#include "tests/weston-test-runner.h"
+#include "tests/weston-test-fixture-compositor.h"
+
+/*
+ * Measure the frames per second of the pixman renderer against the count
+ * of headless outputs, rendered one after another or on render threads,
+ * see weston_compositor_set_render_threads.
+ *
+ * Each frame repaints every output whole like a repaint cycle would: the
+ * outputs are prepared one after another and their renders queued, then
+ * joined. Each output shows an opaque background under translucent
+ * windows, so every pixel is blended.
+ */
+#define BENCH_RENDER_FRAMES 100
+#define BENCH_RENDER_WINDOWS 8 /* each output */
+#define BENCH_RENDER_WIDTH 1920
+#define BENCH_RENDER_HEIGHT 1080
+
+struct bench_render {
+    struct fixture_metadata meta;
+    int outputs;
+    int threads;
+};
+
+static const struct bench_render bench_renders[] = {
+        {.meta.name = "1 output", .outputs = 1, .threads = 0},
+        {.meta.name = "2 outputs", .outputs = 2, .threads = 0},
+        {.meta.name = "2 outputs, 1 thread", .outputs = 2, .threads = 1},
+        {.meta.name = "3 outputs", .outputs = 3, .threads = 0},
+        {.meta.name = "3 outputs, 2 threads", .outputs = 3, .threads = 2},
+        {.meta.name = "4 outputs", .outputs = 4, .threads = 0},
+        {.meta.name = "4 outputs, 3 threads", .outputs = 4, .threads = 3},
+};
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness,
+              const struct bench_render *arg) {
+    struct compositor_setup setup;
+    compositor_setup_defaults(&setup);
+    setup.renderer = RENDERER_PIXMAN;
+    setup.width = BENCH_RENDER_WIDTH;
+    setup.height = BENCH_RENDER_HEIGHT;
+
+    return weston_test_harness_execute_as_plugin(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP_WITH_ARG(fixture_setup, bench_renders, meta);
+
+struct bench_render_state {
+    struct weston_compositor *compositor;
+    const struct bench_render *arg;
+
+    struct weston_layer layer;
+    struct weston_surface **surfaces;
+    int surface_count;
+
+    struct qimm_bench_stat frame;
+};
+
+static void
+bench_render_add_outputs(struct bench_render_state *state) {
+    struct weston_compositor *compositor = state->compositor;
+    const struct weston_windowed_output_api *api =
+            weston_windowed_output_get_api(compositor);
+    assert(api);
+
+    for (int i = wl_list_length(&compositor->output_list);
+         i < state->arg->outputs; i++) {
+        char name[32];
+        snprintf(name, sizeof name, "bench-%d", i);
+        assert(api->create_head(compositor, name) == 0);
+        weston_compositor_flush_heads_changed(compositor);
+    }
+    assert(wl_list_length(&compositor->output_list) == state->arg->outputs);
+}
+
+static struct weston_surface *
+bench_render_add_surface(struct bench_render_state *state,
+                         int x, int y, int width, int height,
+                         float alpha) {
+    struct weston_surface *surface = weston_surface_create(state->compositor);
+    assert(surface);
+    int i = state->surface_count;
+    weston_surface_set_color(surface, (i % 3) / 2.0f, (i % 5) / 4.0f,
+                             (i % 7) / 6.0f, 1.0f);
+    weston_surface_set_size(surface, width, height);
+    if (alpha == 1.0f) {
+        pixman_region32_fini(&surface->opaque);
+        pixman_region32_init_rect(&surface->opaque, 0, 0, width, height);
+    }
+
+    struct weston_view *view = weston_view_create(surface);
+    assert(view);
+    view->alpha = alpha;
+    weston_view_set_position(view, x, y);
+    weston_layer_entry_insert(&state->layer.view_list, &view->layer_link);
+    state->surfaces[state->surface_count++] = surface;
+    return surface;
+}
+
+static void
+bench_render_add_views(struct bench_render_state *state) {
+    struct weston_compositor *compositor = state->compositor;
+    state->surfaces = calloc(state->arg->outputs * (BENCH_RENDER_WINDOWS + 1),
+                             sizeof *state->surfaces);
+    assert(state->surfaces);
+
+    weston_layer_init(&state->layer, compositor);
+    weston_layer_set_position(&state->layer, WESTON_LAYER_POSITION_NORMAL);
+
+    struct weston_output *output;
+    wl_list_for_each(output, &compositor->output_list, link) {
+        /* inserted on top, windows first */
+        for (int i = 0; i < BENCH_RENDER_WINDOWS; i++)
+            bench_render_add_surface(
+                    state,
+                    output->x + i * output->width / (BENCH_RENDER_WINDOWS * 2),
+                    output->y + i * output->height / (BENCH_RENDER_WINDOWS * 2),
+                    output->width / 2, output->height / 2, 0.7f);
+        bench_render_add_surface(state, output->x, output->y,
+                                 output->width, output->height, 1.0f);
+    }
+}
+
+/*
+ * the repaint of an output in the cycle of libweston, without the backends
+ */
+static void
+bench_render_output(struct weston_output *output, void *data) {
+    struct weston_compositor *compositor = output->compositor;
+    pixman_region32_t damage;
+
+    weston_compositor_build_view_list(compositor, output);
+    weston_output_accumulate_damage(output);
+
+    pixman_region32_init(&damage);
+    pixman_region32_intersect(&damage, &compositor->primary_plane.damage,
+                              &output->region);
+    compositor->renderer->repaint_output(output, &damage);
+    pixman_region32_subtract(&compositor->primary_plane.damage,
+                             &compositor->primary_plane.damage, &damage);
+    pixman_region32_fini(&damage);
+}
+
+static void
+bench_render_frame(struct bench_render_state *state) {
+    struct weston_compositor *compositor = state->compositor;
+    struct weston_output *output;
+
+    wl_list_for_each(output, &compositor->output_list, link)
+        pixman_region32_union(&compositor->primary_plane.damage,
+                              &compositor->primary_plane.damage,
+                              &output->region);
+
+    uint64_t start = qimm_bench_now();
+    weston_compositor_repaint_outputs(compositor, bench_render_output, NULL);
+    qimm_bench_stat_add(&state->frame, qimm_bench_now() - start);
+}
+
+static void
+bench_render_print(FILE *fp, struct bench_render_state *state) {
+    uint64_t mean = qimm_bench_stat_mean(&state->frame);
+    fprintf(fp, "{\"bench\": \"qimm-render\", \"outputs\": %d, "
+                "\"threads\": %d, \"fps\": %.1f, ",
+            state->arg->outputs, state->arg->threads,
+            mean ? 1e9 / mean : 0.0);
+    qimm_bench_stat_json(fp, "frame", &state->frame);
+    fprintf(fp, "}\n");
+}
+
+static void
+bench_render_release(struct bench_render_state *state) {
+    /* the views are destroyed with surfaces */
+    for (int i = 0; i < state->surface_count; i++)
+        weston_surface_destroy(state->surfaces[i]);
+    weston_layer_fini(&state->layer);
+    weston_compositor_build_view_list(state->compositor, NULL);
+    assert(weston_compositor_set_render_threads(state->compositor, 0) == 0);
+
+    qimm_bench_stat_release(&state->frame);
+    free(state->surfaces);
+}
+
+PLUGIN_TEST(qimm_render) {
+    struct bench_render_state state = {
+            .compositor = compositor,
+            .arg = &bench_renders[get_test_fixture_index()],
+    };
+
+    bench_render_add_outputs(&state);
+    assert(weston_compositor_set_render_threads(compositor,
+                                                state.arg->threads) == 0);
+    bench_render_add_views(&state);
+
+    /* the first frame creates the paint nodes */
+    bench_render_frame(&state);
+    qimm_bench_stat_release(&state.frame);
+    for (int i = 0; i < BENCH_RENDER_FRAMES; i++)
+        bench_render_frame(&state);
+
+    bench_render_print(stdout, &state);
+    const char *path = getenv("QIMM_BENCH_JSON");
+    FILE *fp = path ? fopen(path, "a") : NULL;
+    if (fp) {
+        bench_render_print(fp, &state);
+        fclose(fp);
+    }
+
+    bench_render_release(&state);
+}
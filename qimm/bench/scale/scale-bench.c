@@ -0,0 +1,383 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+#include <malloc.h>
+#include <libweston/windowed-output-api.h>
+
+#include "tests/test-config.h"
+#include "tests/weston-test-runner.h"
+#include "tests/weston-test-fixture-compositor.h"
+
+/*
+ * Measure qimm-shell.so at scale in the headless compositor of weston test
+ * harness: the projects are created in the running shell, spread to
+ * virtual outputs, with a fake client for each layout like surface bench.
+ *
+ * The plugin test runs in an idle handler of compositor, so only the work
+ * done in the calls is measured, the repaints after them are not.
+ *
+ * Each fixture prints one line of json to stdout, and appends it to the
+ * file in QIMM_BENCH_JSON if set, to compare releases.
+ */
+#define BENCH_SCALE_CONFIG "qimm-bench-scale"
+#define BENCH_SCALE_SWITCHES 200
+#define BENCH_SCALE_HOTPLUGS 50
+
+struct bench_scale {
+    struct fixture_metadata meta;
+    int projects;
+    int layouts; /* each project */
+    int outputs;
+};
+
+static const struct bench_scale bench_scales[] = {
+        {
+                .meta.name = "1 project",
+                .projects = 1,
+                .layouts = 1,
+                .outputs = 1,
+        },
+        {
+                .meta.name = "10 projects",
+                .projects = 10,
+                .layouts = 8,
+                .outputs = 2,
+        },
+        {
+                .meta.name = "100 projects",
+                .projects = 100,
+                .layouts = 16,
+                .outputs = 4,
+        },
+        {
+                .meta.name = "1000 projects",
+                .projects = 1000,
+                .layouts = 1,
+                .outputs = 4,
+        },
+        {
+                .meta.name = "1000 projects, 64 layouts",
+                .projects = 1000,
+                .layouts = 64,
+                .outputs = 4,
+        },
+};
+
+static int
+bench_scale_write_config(const char *path, int count) {
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+
+    fprintf(fp, "name: %s\ntypes:\n", BENCH_SCALE_CONFIG);
+    for (int i = 0; i < count; i++)
+        fprintf(fp, "  - name: type%d\n"
+                    "    summary: the summary for scale type %d\n", i, i);
+    fprintf(fp, "layouts:\n");
+    for (int i = 0; i < count; i++)
+        fprintf(fp, "  - { name: type%d , x: -1 , y: -1 , w: 200 , h: 150 }\n",
+                i);
+
+    return fclose(fp);
+}
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness,
+              const struct bench_scale *arg) {
+    enum test_result_code ret = RESULT_HARD_ERROR;
+    char *yaml = NULL, *map = NULL;
+
+    /* the shell saves datas in the home */
+    char *dir = qimm_bench_make_dir();
+    if (!dir)
+        return RESULT_HARD_ERROR;
+    if (asprintf(&yaml, "%s/%s.yaml", dir, BENCH_SCALE_CONFIG) < 0 ||
+        asprintf(&map, "%s%s.yaml=%s", WESTON_MODULE_MAP,
+                 BENCH_SCALE_CONFIG, yaml) < 0 ||
+        bench_scale_write_config(yaml, arg->layouts) < 0)
+        goto out;
+    setenv("HOME", dir, 1);
+    /* qimm_get_project_path finds the config by module map */
+    setenv("WESTON_MODULE_MAP", map, 1);
+
+    struct compositor_setup setup;
+    compositor_setup_defaults(&setup);
+    setup.shell = SHELL_QIMM;
+    setup.width = 1920;
+    setup.height = 1080;
+    /* keep the log of thousands of projects out of the timings */
+    setup.logging_scopes = QIMM_STARTUP_SCOPE;
+
+    ret = weston_test_harness_execute_as_plugin(harness, &setup);
+
+out:
+    qimm_bench_remove_dir(dir);
+    free(map);
+    free(yaml);
+    free(dir);
+    return ret;
+}
+DECLARE_FIXTURE_SETUP_WITH_ARG(fixture_setup, bench_scales, meta);
+
+struct bench_scale_state {
+    const struct qimm_shell_api *api;
+    struct qimm_shell *shell;
+    const struct bench_scale *arg;
+
+    struct qimm_project **projects;
+    int layout_count;
+    struct qimm_layout **layouts;
+    struct qimm_client *clients;
+    char *client_keys; /* fake wl_client pointers */
+
+    struct qimm_bench_stat output_add;
+    struct qimm_bench_stat project_create;
+    struct qimm_bench_stat surface_add;
+    struct qimm_bench_stat project_switch;
+    struct qimm_bench_stat hotplug_remove;
+    struct qimm_bench_stat hotplug_add;
+    size_t memory_per_project;
+};
+
+/*
+ * plug virtual outputs until the count, each one is created by the shell
+ */
+static void
+bench_scale_add_outputs(struct bench_scale_state *state) {
+    struct weston_compositor *compositor = state->shell->compositor;
+    const struct weston_windowed_output_api *api =
+            weston_windowed_output_get_api(compositor);
+    assert(api);
+
+    for (int i = wl_list_length(&state->shell->outputs);
+         i < state->arg->outputs; i++) {
+        char name[32];
+        snprintf(name, sizeof name, "bench-%d", i);
+
+        uint64_t start = qimm_bench_now();
+        assert(api->create_head(compositor, name) == 0);
+        weston_compositor_flush_heads_changed(compositor);
+        qimm_bench_stat_add(&state->output_add, qimm_bench_now() - start);
+    }
+    assert(wl_list_length(&state->shell->outputs) == state->arg->outputs);
+}
+
+static void
+bench_scale_add_projects(struct bench_scale_state *state) {
+    struct qimm_shell *shell = state->shell;
+    int count = state->arg->projects;
+
+    state->projects = calloc(count, sizeof *state->projects);
+    assert(state->projects);
+
+    struct mallinfo2 before = mallinfo2();
+    struct wl_list *link = &shell->outputs;
+    for (int i = 0; i < count; i++) {
+        char name[32];
+        snprintf(name, sizeof name, "bench%d", i);
+
+        uint64_t start = qimm_bench_now();
+        struct qimm_project *project =
+                state->api->project_create(shell, name, BENCH_SCALE_CONFIG);
+        qimm_bench_stat_add(&state->project_create, qimm_bench_now() - start);
+        assert(project);
+
+        /* spread to outputs like restored, without saving datas */
+        link = link->next == &shell->outputs ? shell->outputs.next : link->next;
+        struct qimm_output *output =
+                container_of(link, struct qimm_output, link);
+        project->output = output;
+        project->output_name = strdup(output->output->name);
+        wl_list_insert(output->projects.prev, &project->link);
+
+        state->projects[i] = project;
+        state->layout_count += wl_list_length(&project->layouts);
+    }
+    struct mallinfo2 after = mallinfo2();
+    state->memory_per_project = (after.uordblks - before.uordblks) / count;
+}
+
+/*
+ * one fake client for each layout, its surfaces are never created
+ */
+static void
+bench_scale_add_clients(struct bench_scale_state *state) {
+    int count = state->layout_count;
+    state->layouts = calloc(count, sizeof *state->layouts);
+    state->clients = calloc(count, sizeof *state->clients);
+    state->client_keys = calloc(count, 16);
+    assert(state->layouts && state->clients && state->client_keys);
+
+    int i = 0;
+    for (int p = 0; p < state->arg->projects; p++) {
+        struct qimm_layout *layout;
+        wl_list_for_each(layout, &state->projects[p]->layouts, link) {
+            struct qimm_client *client = &state->clients[i];
+            client->shell = state->shell;
+            client->client = (void *) &state->client_keys[i * 16];
+            wl_list_init(&client->layouts);
+            layout->client = client;
+            wl_list_insert(&client->layouts, &layout->client_link);
+            assert(state->api->index_client_add(client) == 0);
+            state->layouts[i++] = layout;
+        }
+    }
+}
+
+/*
+ * find layout of each new surface, in random order as the clients start
+ */
+static void
+bench_scale_surface_add(struct bench_scale_state *state) {
+    for (int i = 0; i < state->layout_count; i++) {
+        struct qimm_layout *expect =
+                state->layouts[(int) (((int64_t) i * 7919) %
+                                      state->layout_count)];
+
+        uint64_t start = qimm_bench_now();
+        struct qimm_layout *layout =
+                state->api->layout_find_by_client(
+                        state->shell, expect->client->client,
+                        expect->config_layout->name);
+        qimm_bench_stat_add(&state->surface_add, qimm_bench_now() - start);
+        assert(layout == expect);
+    }
+}
+
+static void
+bench_scale_switch(struct bench_scale_state *state) {
+    for (int i = 0; i < BENCH_SCALE_SWITCHES; i++) {
+        struct qimm_project *project =
+                state->projects[i * 31 % state->arg->projects];
+
+        uint64_t start = qimm_bench_now();
+        state->api->project_show(project);
+        qimm_bench_stat_add(&state->project_switch, qimm_bench_now() - start);
+        assert(project->output->project_cur == project);
+    }
+}
+
+/*
+ * the projects leave an unplugged output and come back when it is plugged,
+ * as the output destroy and create handlers of shell
+ */
+static void
+bench_scale_hotplug(struct bench_scale_state *state) {
+    struct qimm_shell *shell = state->shell;
+    if (state->arg->outputs < 2)
+        return;
+
+    for (int i = 0; i < BENCH_SCALE_HOTPLUGS; i++) {
+        struct wl_list *link = shell->outputs.next;
+        for (int j = 0; j < 1 + i % (state->arg->outputs - 1); j++)
+            link = link->next;
+        struct qimm_output *output =
+                container_of(link, struct qimm_output, link);
+
+        uint64_t start = qimm_bench_now();
+        assert(state->api->output_project_move(output) == 0);
+        qimm_bench_stat_add(&state->hotplug_remove, qimm_bench_now() - start);
+
+        start = qimm_bench_now();
+        state->api->transaction_begin(shell);
+        state->api->output_project_restore(output);
+        if (!wl_list_empty(&output->projects))
+            state->api->project_show(container_of(output->projects.next,
+                                                  struct qimm_project, link));
+        state->api->transaction_commit(shell);
+        qimm_bench_stat_add(&state->hotplug_add, qimm_bench_now() - start);
+    }
+}
+
+static void
+bench_scale_print(FILE *fp, struct bench_scale_state *state) {
+    fprintf(fp, "{\"bench\": \"qimm-scale\", \"projects\": %d, "
+                "\"layouts\": %d, \"outputs\": %d, "
+                "\"memory_per_project\": %zu, ",
+            state->arg->projects, state->arg->layouts, state->arg->outputs,
+            state->memory_per_project);
+    qimm_bench_stat_json(fp, "output_add", &state->output_add);
+    fprintf(fp, ", ");
+    qimm_bench_stat_json(fp, "project_create", &state->project_create);
+    fprintf(fp, ", ");
+    qimm_bench_stat_json(fp, "surface_add", &state->surface_add);
+    fprintf(fp, ", ");
+    qimm_bench_stat_json(fp, "project_switch", &state->project_switch);
+    fprintf(fp, ", ");
+    qimm_bench_stat_json(fp, "hotplug_remove", &state->hotplug_remove);
+    fprintf(fp, ", ");
+    qimm_bench_stat_json(fp, "hotplug_add", &state->hotplug_add);
+    fprintf(fp, "}\n");
+}
+
+/*
+ * the fake clients must not be destroyed by the shell
+ */
+static void
+bench_scale_release(struct bench_scale_state *state) {
+    for (int i = 0; i < state->layout_count; i++) {
+        struct qimm_layout *layout = state->layouts[i];
+        state->api->index_client_remove(layout->client);
+        wl_list_remove(&layout->client_link);
+        wl_list_init(&layout->client_link);
+        layout->client = NULL;
+    }
+    for (int i = 0; i < state->arg->projects; i++) {
+        state->api->output_project_remove(state->projects[i]);
+        state->api->project_destroy(state->projects[i]);
+    }
+
+    qimm_bench_stat_release(&state->output_add);
+    qimm_bench_stat_release(&state->project_create);
+    qimm_bench_stat_release(&state->surface_add);
+    qimm_bench_stat_release(&state->project_switch);
+    qimm_bench_stat_release(&state->hotplug_remove);
+    qimm_bench_stat_release(&state->hotplug_add);
+    free(state->projects);
+    free(state->layouts);
+    free(state->clients);
+    free(state->client_keys);
+}
+
+PLUGIN_TEST(qimm_scale) {
+    struct bench_scale_state state = {
+            .api = qimm_shell_get_api(compositor),
+            .arg = &bench_scales[get_test_fixture_index()],
+    };
+    assert(state.api);
+    state.shell = state.api->get(compositor);
+    assert(state.shell);
+
+    bench_scale_add_outputs(&state);
+    bench_scale_add_projects(&state);
+    bench_scale_add_clients(&state);
+    bench_scale_surface_add(&state);
+    bench_scale_switch(&state);
+    bench_scale_hotplug(&state);
+
+    bench_scale_print(stdout, &state);
+    const char *path = getenv("QIMM_BENCH_JSON");
+    FILE *fp = path ? fopen(path, "a") : NULL;
+    if (fp) {
+        bench_scale_print(fp, &state);
+        fclose(fp);
+    }
+
+    bench_scale_release(&state);
+}
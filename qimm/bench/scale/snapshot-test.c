@@ -0,0 +1,262 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+#include <libweston/backend-headless.h>
+#include <libweston/windowed-output-api.h>
+
+#include "tests/test-config.h"
+#include "tests/weston-test-runner.h"
+
+/*
+ * Check snapshot placeholders on the headless backend. The compositor is
+ * made by the test instead of the harness, so the test runs its event
+ * loop while the internal buffer client talks to it.
+ *
+ * A snapshot is captured from a surface of known pixels, then the project
+ * is switched to: its placeholder shows the same pixels in the layout, and
+ * the switch latency is measured until the placeholder is painted.
+ */
+#define SNAPSHOT_TEST_WIDTH 64
+#define SNAPSHOT_TEST_HEIGHT 48
+#define SNAPSHOT_TEST_DISPATCHES 500
+
+struct snapshot_test {
+    struct wl_display *display;
+    struct weston_log_context *log_ctx;
+    struct weston_compositor *compositor;
+
+    struct qimm_shell shell;
+    struct qimm_output output;
+    struct qimm_project project;
+    struct qimm_project_config_layout config_layout;
+    struct qimm_layout layout;
+};
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness) {
+    return weston_test_harness_execute_standalone(harness);
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+static uint32_t
+snapshot_test_pixel(int32_t x, int32_t y) {
+    return 0xff000080 | (uint32_t) (x * 4) << 16 | (uint32_t) (y * 4) << 8;
+}
+
+static void
+snapshot_test_dispatch(struct snapshot_test *t) {
+    struct wl_event_loop *loop = wl_display_get_event_loop(t->display);
+    wl_display_flush_clients(t->display);
+    wl_event_loop_dispatch(loop, 10);
+}
+
+static struct weston_output *
+snapshot_test_create_output(struct weston_compositor *compositor) {
+    const struct weston_windowed_output_api *api =
+            weston_windowed_output_get_api(compositor);
+    if (!api || api->create_head(compositor, "headless") < 0)
+        return NULL;
+
+    struct weston_head *head = weston_compositor_iterate_heads(compositor,
+                                                               NULL);
+    struct weston_output *output =
+            weston_compositor_create_output_with_head(compositor, head);
+    if (!output)
+        return NULL;
+    weston_output_set_scale(output, 1);
+    weston_output_set_transform(output, WL_OUTPUT_TRANSFORM_NORMAL);
+    if (api->output_set_size(output, 320, 240) < 0 ||
+        weston_output_enable(output) < 0) {
+        weston_output_destroy(output);
+        return NULL;
+    }
+    return output;
+}
+
+static void
+snapshot_test_init(struct snapshot_test *t) {
+    /* the headless backend is found in the module map of tests */
+    setenv("WESTON_MODULE_MAP", WESTON_MODULE_MAP, 0);
+
+    t->display = wl_display_create();
+    assert(t->display);
+    t->log_ctx = weston_log_ctx_create();
+    assert(t->log_ctx);
+    t->compositor = weston_compositor_create(t->display, t->log_ctx,
+                                             NULL, NULL);
+    assert(t->compositor);
+
+    /* copy_content of surfaces is done by pixman renderer */
+    struct weston_headless_backend_config config = {
+            .base.struct_version = WESTON_HEADLESS_BACKEND_CONFIG_VERSION,
+            .base.struct_size = sizeof config,
+            .use_pixman = true,
+    };
+    int ret = weston_compositor_load_backend(t->compositor,
+                                             WESTON_BACKEND_HEADLESS,
+                                             &config.base);
+    assert(ret == 0);
+    struct weston_output *output = snapshot_test_create_output(t->compositor);
+    assert(output);
+    weston_compositor_wake(t->compositor);
+
+    /* only the parts of shell used by snapshots */
+    struct qimm_shell *shell = &t->shell;
+    shell->compositor = t->compositor;
+    wl_list_init(&shell->outputs);
+    weston_layer_init(&shell->background_layer, t->compositor);
+    weston_layer_set_position(&shell->background_layer,
+                              WESTON_LAYER_POSITION_BACKGROUND);
+    ret = qimm_buffer_init(shell);
+    assert(ret == 0);
+    ret = qimm_snapshot_init(shell);
+    assert(ret == 0);
+
+    t->output.shell = shell;
+    t->output.output = output;
+    wl_list_init(&t->output.projects);
+    wl_list_insert(&shell->outputs, &t->output.link);
+
+    /* the first layout is in background layer */
+    t->project.shell = shell;
+    t->project.name = "snapshot-test";
+    t->project.output = &t->output;
+    weston_layer_init(&t->project.layer, t->compositor);
+    wl_list_init(&t->project.layouts);
+    t->layout.project = &t->project;
+    t->layout.config_layout = &t->config_layout;
+    t->layout.x = 16;
+    t->layout.y = 8;
+    wl_list_insert(&t->project.layouts, &t->layout.link);
+}
+
+static void
+snapshot_test_release(struct snapshot_test *t) {
+    qimm_snapshot_layout_release(&t->layout);
+    if (t->output.switching)
+        wl_list_remove(&t->output.frame_listener.link);
+
+    qimm_snapshot_release(&t->shell);
+    qimm_buffer_release(&t->shell);
+    weston_layer_fini(&t->project.layer);
+    weston_layer_fini(&t->shell.background_layer);
+
+    weston_compositor_destroy(t->compositor);
+    weston_log_ctx_destroy(t->log_ctx);
+    wl_display_destroy(t->display);
+}
+
+static void
+handle_committed(struct weston_surface *surface, void *data) {
+    struct weston_surface **committed = data;
+    *committed = surface;
+}
+
+/*
+ * capture the snapshot of layout from a surface of the buffer client
+ */
+static void
+snapshot_test_capture(struct snapshot_test *t) {
+    struct qimm_buffer *buffer = qimm_buffer_create(&t->shell,
+                                                    SNAPSHOT_TEST_WIDTH,
+                                                    SNAPSHOT_TEST_HEIGHT);
+    assert(buffer);
+    uint32_t *pixels = qimm_buffer_get_data(buffer);
+    for (int32_t y = 0; y < SNAPSHOT_TEST_HEIGHT; y++)
+        for (int32_t x = 0; x < SNAPSHOT_TEST_WIDTH; x++)
+            pixels[y * SNAPSHOT_TEST_WIDTH + x] = snapshot_test_pixel(x, y);
+
+    struct weston_surface *committed = NULL;
+    struct qimm_buffer_surface *surface =
+            qimm_buffer_surface_create(&t->shell, handle_committed,
+                                       &committed);
+    assert(surface);
+    qimm_buffer_surface_attach(surface, buffer);
+    for (int i = 0; i < SNAPSHOT_TEST_DISPATCHES && !committed; i++)
+        snapshot_test_dispatch(t);
+    assert(committed);
+
+    qimm_snapshot_layout_capture(&t->layout, committed);
+
+    qimm_buffer_surface_destroy(surface);
+    qimm_buffer_destroy(buffer);
+}
+
+static struct weston_view *
+snapshot_test_placeholder_view(struct snapshot_test *t) {
+    struct weston_layer *layer = &t->shell.background_layer;
+    if (wl_list_empty(&layer->view_list.link))
+        return NULL;
+    return container_of(layer->view_list.link.next, struct weston_view,
+                        layer_link.link);
+}
+
+TEST(placeholder_shows_snapshot) {
+    struct snapshot_test *t = zalloc(sizeof *t);
+    assert(t);
+    snapshot_test_init(t);
+    snapshot_test_capture(t);
+
+    /* switched to: the placeholder is made by the buffer client */
+    qimm_output_switch_start(&t->output);
+    t->output.project_cur = &t->project;
+    qimm_snapshot_project_show(&t->project);
+    assert(t->layout.placeholder);
+    assert(!qimm_snapshot_layout_shown(&t->layout));
+
+    for (int i = 0; i < SNAPSHOT_TEST_DISPATCHES &&
+                    !qimm_snapshot_layout_shown(&t->layout); i++)
+        snapshot_test_dispatch(t);
+    assert(qimm_snapshot_layout_shown(&t->layout));
+
+    struct weston_view *view = snapshot_test_placeholder_view(t);
+    assert(view);
+    assert(view->geometry.x == t->layout.x);
+    assert(view->geometry.y == t->layout.y);
+
+    int32_t width, height;
+    weston_surface_get_content_size(view->surface, &width, &height);
+    assert(width == SNAPSHOT_TEST_WIDTH);
+    assert(height == SNAPSHOT_TEST_HEIGHT);
+
+    /* PIXMAN_a8b8g8r8 from renderer */
+    size_t size = (size_t) width * height * 4;
+    uint32_t *pixels = malloc(size);
+    assert(pixels);
+    int ret = weston_surface_copy_content(view->surface, pixels, size,
+                                          0, 0, width, height);
+    assert(ret == 0);
+    for (int32_t y = 0; y < height; y++) {
+        for (int32_t x = 0; x < width; x++) {
+            uint32_t p = pixels[y * width + x];
+            p = (p & 0xff00ff00) | (p & 0xff) << 16 | (p >> 16 & 0xff);
+            assert(p == snapshot_test_pixel(x, y));
+        }
+    }
+    free(pixels);
+
+    /* the switch is measured until the placeholder is painted */
+    for (int i = 0; i < SNAPSHOT_TEST_DISPATCHES && t->output.switching; i++)
+        snapshot_test_dispatch(t);
+    assert(!t->output.switching);
+    assert(t->project.painted);
+
+    snapshot_test_release(t);
+    free(t);
+}
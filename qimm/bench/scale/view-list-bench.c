@@ -0,0 +1,233 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+#include "libweston-internal.h"
+#include "tests/test-config.h"
+#include "tests/weston-test-runner.h"
+#include "tests/weston-test-fixture-compositor.h"
+
+/*
+ * Measure weston_compositor_build_view_list, run at the start of each
+ * output repaint, against the count of views:
+ *   idle     nothing changed since the last repaint
+ *   moved    one view moved, like a dragged window
+ *   raised   one view raised in its layer, view_list and the paint node
+ *            z-order are rebuilt as libweston did on every repaint
+ *
+ * Each build is checked: view_list and the z-order list of the output
+ * follow the layer, and no view is left with a dirty transform.
+ */
+#define BENCH_VIEW_LIST_ROUNDS 2000
+#define BENCH_VIEW_LIST_WIDTH 1920
+#define BENCH_VIEW_LIST_HEIGHT 1080
+
+struct bench_view_list {
+    struct fixture_metadata meta;
+    int views;
+};
+
+static const struct bench_view_list bench_view_lists[] = {
+        {.meta.name = "10 views", .views = 10},
+        {.meta.name = "100 views", .views = 100},
+        {.meta.name = "1000 views", .views = 1000},
+        {.meta.name = "5000 views", .views = 5000},
+};
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness,
+              const struct bench_view_list *arg) {
+    struct compositor_setup setup;
+    compositor_setup_defaults(&setup);
+    setup.width = BENCH_VIEW_LIST_WIDTH;
+    setup.height = BENCH_VIEW_LIST_HEIGHT;
+
+    return weston_test_harness_execute_as_plugin(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP_WITH_ARG(fixture_setup, bench_view_lists, meta);
+
+struct bench_view_list_state {
+    struct weston_compositor *compositor;
+    struct weston_output *output;
+    const struct bench_view_list *arg;
+
+    struct weston_layer layer;
+    struct weston_surface **surfaces;
+    uint32_t seed;
+
+    struct qimm_bench_stat idle;
+    struct qimm_bench_stat moved;
+    struct qimm_bench_stat raised;
+};
+
+static int
+bench_view_list_random(struct bench_view_list_state *state, int max) {
+    state->seed = state->seed * 1103515245 + 12345;
+    return (int) ((state->seed >> 8) % max);
+}
+
+static struct weston_view *
+bench_view_list_view(struct bench_view_list_state *state, int i) {
+    return container_of(state->surfaces[i]->views.next,
+                        struct weston_view, surface_link);
+}
+
+static void
+bench_view_list_add_views(struct bench_view_list_state *state) {
+    int count = state->arg->views;
+    state->surfaces = calloc(count, sizeof *state->surfaces);
+    assert(state->surfaces);
+
+    weston_layer_init(&state->layer, state->compositor);
+    weston_layer_set_position(&state->layer, WESTON_LAYER_POSITION_NORMAL);
+
+    for (int i = 0; i < count; i++) {
+        struct weston_surface *surface =
+                weston_surface_create(state->compositor);
+        assert(surface);
+        surface->width = 40 + bench_view_list_random(state, 360);
+        surface->height = 40 + bench_view_list_random(state, 360);
+
+        struct weston_view *view = weston_view_create(surface);
+        assert(view);
+        weston_view_set_position(
+                view,
+                bench_view_list_random(state, BENCH_VIEW_LIST_WIDTH),
+                bench_view_list_random(state, BENCH_VIEW_LIST_HEIGHT));
+        weston_layer_entry_insert(&state->layer.view_list,
+                                  &view->layer_link);
+        state->surfaces[i] = surface;
+    }
+
+    weston_compositor_build_view_list(state->compositor, state->output);
+}
+
+/*
+ * view_list and the z-order of output are the views of the layers in order
+ */
+static void
+bench_view_list_check(struct bench_view_list_state *state) {
+    struct weston_compositor *compositor = state->compositor;
+    struct wl_list *link = &compositor->view_list;
+    struct wl_list *pnode_link = &state->output->paint_node_z_order_list;
+    struct weston_layer *layer;
+    struct weston_view *view;
+
+    wl_list_for_each(layer, &compositor->layer_list, link) {
+        wl_list_for_each(view, &layer->view_list.link, layer_link.link) {
+            link = link->next;
+            assert(link == &view->link);
+            assert(!view->transform.dirty);
+
+            pnode_link = pnode_link->next;
+            struct weston_paint_node *pnode =
+                    container_of(pnode_link, struct weston_paint_node,
+                                 z_order_link);
+            assert(pnode->view == view);
+        }
+    }
+    assert(link->next == &compositor->view_list);
+    assert(pnode_link->next == &state->output->paint_node_z_order_list);
+    assert(wl_list_empty(&compositor->transform_dirty_list));
+}
+
+static void
+bench_view_list_build(struct bench_view_list_state *state,
+                      struct qimm_bench_stat *stat) {
+    uint64_t start = qimm_bench_now();
+    weston_compositor_build_view_list(state->compositor, state->output);
+    qimm_bench_stat_add(stat, qimm_bench_now() - start);
+}
+
+static void
+bench_view_list_run(struct bench_view_list_state *state) {
+    for (int i = 0; i < BENCH_VIEW_LIST_ROUNDS; i++) {
+        bench_view_list_build(state, &state->idle);
+
+        struct weston_view *view = bench_view_list_view(
+                state, bench_view_list_random(state, state->arg->views));
+        weston_view_set_position(
+                view,
+                bench_view_list_random(state, BENCH_VIEW_LIST_WIDTH),
+                bench_view_list_random(state, BENCH_VIEW_LIST_HEIGHT));
+        bench_view_list_build(state, &state->moved);
+        assert(!view->transform.dirty);
+
+        view = bench_view_list_view(
+                state, bench_view_list_random(state, state->arg->views));
+        weston_layer_entry_remove(&view->layer_link);
+        weston_layer_entry_insert(&state->layer.view_list,
+                                  &view->layer_link);
+        bench_view_list_build(state, &state->raised);
+
+        if (i % 100 == 0)
+            bench_view_list_check(state);
+    }
+    bench_view_list_check(state);
+}
+
+static void
+bench_view_list_print(FILE *fp, struct bench_view_list_state *state) {
+    fprintf(fp, "{\"bench\": \"qimm-view-list\", \"views\": %d, ",
+            state->arg->views);
+    qimm_bench_stat_json(fp, "idle", &state->idle);
+    fprintf(fp, ", ");
+    qimm_bench_stat_json(fp, "moved", &state->moved);
+    fprintf(fp, ", ");
+    qimm_bench_stat_json(fp, "raised", &state->raised);
+    fprintf(fp, "}\n");
+}
+
+static void
+bench_view_list_release(struct bench_view_list_state *state) {
+    /* the views are destroyed with surfaces */
+    for (int i = 0; i < state->arg->views; i++)
+        weston_surface_destroy(state->surfaces[i]);
+    weston_layer_fini(&state->layer);
+    weston_compositor_build_view_list(state->compositor, NULL);
+
+    qimm_bench_stat_release(&state->idle);
+    qimm_bench_stat_release(&state->moved);
+    qimm_bench_stat_release(&state->raised);
+    free(state->surfaces);
+}
+
+PLUGIN_TEST(qimm_view_list) {
+    struct bench_view_list_state state = {
+            .compositor = compositor,
+            .arg = &bench_view_lists[get_test_fixture_index()],
+            .seed = 1,
+    };
+    assert(!wl_list_empty(&compositor->output_list));
+    state.output = container_of(compositor->output_list.next,
+                                struct weston_output, link);
+
+    bench_view_list_add_views(&state);
+    bench_view_list_check(&state);
+    bench_view_list_run(&state);
+
+    bench_view_list_print(stdout, &state);
+    const char *path = getenv("QIMM_BENCH_JSON");
+    FILE *fp = path ? fopen(path, "a") : NULL;
+    if (fp) {
+        bench_view_list_print(fp, &state);
+        fclose(fp);
+    }
+
+    bench_view_list_release(&state);
+}
@@ -0,0 +1,183 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+/*
+ * Find projects by words with the search index, and by reading the yaml
+ * of every project like before the index.
+ */
+static const char *bench_search_configs[] = {
+        "dashboard", "assistant", "notes", "browser", "terminal", "gallery",
+};
+static const char *bench_search_types[] = {
+        "text Plain text notes",
+        "image Photos and pictures",
+        "web Web pages and bookmarks",
+        "shell Commands run in terminal",
+        "chart Charts of system metrics",
+};
+static const char *bench_search_queries[] = {
+        "project4217", "notes", "gal", "hdmi 3", "photos web", "missing",
+};
+
+static void
+bench_search_fields(int i, char *name, char *types, char *data,
+                    const char *fields[QIMM_SEARCH_FIELD_COUNT]) {
+    int configs = ARRAY_LENGTH(bench_search_configs);
+    int type_count = ARRAY_LENGTH(bench_search_types);
+    sprintf(name, "project%d", i);
+    sprintf(types, "%s\n%s", bench_search_types[i % type_count],
+            bench_search_types[(i / type_count) % type_count]);
+    sprintf(data, "HDMI-A-%d wallpaper%d.png crop", i % 4, i % 100);
+    fields[QIMM_SEARCH_FIELD_NAME] = name;
+    fields[QIMM_SEARCH_FIELD_CONFIG] = bench_search_configs[i % configs];
+    fields[QIMM_SEARCH_FIELD_TYPE] = types;
+    fields[QIMM_SEARCH_FIELD_DATA] = data;
+}
+
+static int
+bench_search_update(struct qimm_search *search, int i) {
+    char name[32], types[256], data[128];
+    const char *fields[QIMM_SEARCH_FIELD_COUNT];
+    bench_search_fields(i, name, types, data, fields);
+    return qimm_search_update(search, name, fields);
+}
+
+static int
+bench_search_write_tree(const char *dir, int count) {
+    for (int i = 0; i < count; i++) {
+        char *path;
+        if (asprintf(&path, "%s/project%d", dir, i) < 0)
+            return -1;
+        mkdir(path, QIMM_DATA_DIR_MODE);
+        free(path);
+        if (asprintf(&path, "%s/project%d/config.yaml", dir, i) < 0)
+            return -1;
+        FILE *fp = fopen(path, "w");
+        free(path);
+        if (!fp)
+            return -1;
+        fprintf(fp, "config_name: %s\noutput_name: HDMI-A-%d\n",
+                bench_search_configs[i % ARRAY_LENGTH(bench_search_configs)],
+                i % 4);
+        if (fclose(fp) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+struct bench_search_scan {
+    struct qimm_shell *shell;
+    const char *word;
+    int found;
+};
+
+static int
+bench_search_scan_project(const char *name, void *data) {
+    struct bench_search_scan *scan = data;
+    struct qimm_project *project = qimm_data_read_project(scan->shell, name);
+    if (!project)
+        return -1;
+    if ((project->config_name && strstr(project->config_name, scan->word)) ||
+        strstr(name, scan->word))
+        scan->found++;
+    free(project->config_name);
+    free(project->output_name);
+    free(project);
+    return 0;
+}
+
+int
+main(int argc, char *argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 10000;
+    int times = argc > 2 ? atoi(argv[2]) : 1000;
+    int ret = EXIT_FAILURE;
+
+    qimm_bench_init();
+    if (count <= 0 || times <= 0)
+        return EXIT_FAILURE;
+
+    struct qimm_search *search = qimm_search_create();
+    if (!search)
+        return EXIT_FAILURE;
+
+    struct qimm_bench_stat stat_build = {0}, stat_update = {0},
+            stat_query = {0}, stat_scan = {0};
+    uint64_t start = qimm_bench_now();
+    for (int i = 0; i < count; i++) {
+        if (bench_search_update(search, i) < 0)
+            goto out;
+    }
+    qimm_bench_stat_add(&stat_build, qimm_bench_now() - start);
+
+    /* a saved project is indexed again alone */
+    for (int i = 0; i < times; i++) {
+        start = qimm_bench_now();
+        int ret_update = bench_search_update(search, i * 7919 % count);
+        qimm_bench_stat_add(&stat_update, qimm_bench_now() - start);
+        if (ret_update < 0)
+            goto out;
+    }
+
+    struct qimm_search_result results[16];
+    for (int i = 0; i < times; i++) {
+        const char *query =
+                bench_search_queries[i % ARRAY_LENGTH(bench_search_queries)];
+        start = qimm_bench_now();
+        int n = qimm_search_query(search, query, results,
+                                  ARRAY_LENGTH(results));
+        qimm_bench_stat_add(&stat_query, qimm_bench_now() - start);
+        if (n < 0)
+            goto out;
+        if (i < (int) ARRAY_LENGTH(bench_search_queries))
+            printf("%-12s %d results, first %s\n", query, n,
+                   n ? results[0].name : "-");
+    }
+
+    /* the same lookup by reading all yaml files */
+    char *dir = qimm_bench_make_dir();
+    if (!dir)
+        goto out;
+    struct qimm_shell shell = {.data_path = dir};
+    if (bench_search_write_tree(dir, count) == 0) {
+        for (int i = 0; i < 3; i++) {
+            struct bench_search_scan scan = {&shell, "notes"};
+            start = qimm_bench_now();
+            qimm_data_for_each_project(&shell, bench_search_scan_project,
+                                       &scan);
+            qimm_bench_stat_add(&stat_scan, qimm_bench_now() - start);
+        }
+    }
+    qimm_bench_remove_dir(dir);
+    free(dir);
+
+    printf("%d projects, %d updates and queries\n", count, times);
+    qimm_bench_stat_print("index build", &stat_build);
+    qimm_bench_stat_print("index update", &stat_update);
+    qimm_bench_stat_print("index query", &stat_query);
+    qimm_bench_stat_print("yaml scan", &stat_scan);
+    ret = EXIT_SUCCESS;
+
+out:
+    qimm_bench_stat_release(&stat_build);
+    qimm_bench_stat_release(&stat_update);
+    qimm_bench_stat_release(&stat_query);
+    qimm_bench_stat_release(&stat_scan);
+    qimm_search_destroy(search);
+    return ret;
+}
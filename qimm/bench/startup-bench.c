@@ -0,0 +1,218 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+#include <poll.h>
+
+/*
+ * Start qimm on the headless backend with synthetic projects and trace
+ * its startup in the qimm-startup log scope, until the first project is
+ * painted. The phases of all rounds are reported as time since exec.
+ */
+#define BENCH_STARTUP_TIMEOUT 20000 /* ms */
+#define BENCH_STARTUP_POLL 10 /* ms */
+
+static const char *const bench_startup_phases[] = {
+        "shell_init",
+        "layer_output_init",
+        "modules_init",
+        "data_path",
+        "common_config",
+        "disk_load",
+        "prepare_output",
+        "shell_ready",
+        "client_launch",
+        "client_commit",
+        "project_paint",
+        "disk_load_done",
+};
+#define BENCH_STARTUP_PHASES ARRAY_LENGTH(bench_startup_phases)
+
+static int
+bench_startup_write_projects(const char *dir, int count) {
+    for (int i = 0; i < count; i++) {
+        char *path;
+        if (asprintf(&path, "%s/project%d", dir, i) < 0)
+            return -1;
+        mkdir(path, QIMM_DATA_DIR_MODE);
+        free(path);
+
+        if (asprintf(&path, "%s/project%d/config.yaml", dir, i) < 0)
+            return -1;
+        FILE *fp = fopen(path, "w");
+        free(path);
+        if (!fp)
+            return -1;
+        fputs("config_name: dashboard\n"
+              "output_name: headless\n", fp);
+        if (fclose(fp) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static pid_t
+bench_startup_spawn(const char *qimm, const char *home, const char *log) {
+    char *log_arg;
+    if (asprintf(&log_arg, "--log=%s", log) < 0)
+        return -1;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        setenv("HOME", home, 1);
+        setenv("XDG_RUNTIME_DIR", home, 1);
+        unsetenv("WAYLAND_DISPLAY");
+        unsetenv("WAYLAND_SOCKET");
+        execl(qimm, qimm, "--backend=headless-backend.so", "--use-pixman",
+              "--logger-scopes=" QIMM_STARTUP_SCOPE, log_arg, (char *) NULL);
+        _exit(127);
+    }
+    free(log_arg);
+    return pid;
+}
+
+/*
+ * add phases in log to stats, return true when the project is painted
+ */
+static bool
+bench_startup_parse(const char *log, uint64_t exec_time,
+                    struct qimm_bench_stat *stats, bool add) {
+    FILE *fp = fopen(log, "r");
+    if (!fp)
+        return false;
+
+    bool painted = false;
+    char line[512];
+    while (fgets(line, sizeof line, fp)) {
+        char *p = strstr(line, QIMM_STARTUP_SCOPE " ");
+        char phase[64];
+        int64_t time;
+        if (!p || sscanf(p + strlen(QIMM_STARTUP_SCOPE " "),
+                         "%63s %" SCNd64, phase, &time) != 2)
+            continue;
+
+        for (size_t i = 0; i < BENCH_STARTUP_PHASES; i++) {
+            if (strcmp(phase, bench_startup_phases[i]))
+                continue;
+            if (add && time >= (int64_t) exec_time)
+                qimm_bench_stat_add(&stats[i], time - exec_time);
+            painted = painted || !strcmp(phase, "project_paint");
+        }
+    }
+    fclose(fp);
+    return painted;
+}
+
+static int
+bench_startup_round(const char *qimm, const char *home,
+                    struct qimm_bench_stat *stats) {
+    char *log;
+    if (asprintf(&log, "%s/qimm.log", home) < 0)
+        return -1;
+    unlink(log);
+
+    uint64_t exec_time = qimm_bench_now();
+    pid_t pid = bench_startup_spawn(qimm, home, log);
+    if (pid < 0) {
+        free(log);
+        return -1;
+    }
+
+    bool painted = false, exited = false;
+    int status = 0;
+    for (int waited = 0; waited < BENCH_STARTUP_TIMEOUT && !painted;
+         waited += BENCH_STARTUP_POLL) {
+        poll(NULL, 0, BENCH_STARTUP_POLL);
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            exited = true;
+            break;
+        }
+        painted = bench_startup_parse(log, exec_time, NULL, false);
+    }
+
+    if (!exited) {
+        kill(pid, SIGTERM);
+        waitpid(pid, &status, 0);
+    }
+    if (!painted) {
+        fprintf(stderr, "qimm %s before the first project painted, see %s\n",
+                exited ? "exited" : "timed out", log);
+        free(log);
+        return -1;
+    }
+
+    bench_startup_parse(log, exec_time, stats, true);
+    free(log);
+    return 0;
+}
+
+int
+main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s QIMM [PROJECTS] [ROUNDS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *qimm = argv[1];
+    int count = argc > 2 ? atoi(argv[2]) : 100;
+    int rounds = argc > 3 ? atoi(argv[3]) : 10;
+    int ret = EXIT_FAILURE;
+
+    qimm_bench_init();
+
+    char *dir = qimm_bench_make_dir();
+    if (!dir)
+        return EXIT_FAILURE;
+
+    /* the data directory of qimm in the home */
+    char *data;
+    if (asprintf(&data, "%s/.config", dir) < 0)
+        goto out;
+    mkdir(data, QIMM_DATA_DIR_MODE);
+    free(data);
+    if (asprintf(&data, "%s/.config/qimm", dir) < 0)
+        goto out;
+    mkdir(data, QIMM_DATA_DIR_MODE);
+    if (bench_startup_write_projects(data, count) < 0) {
+        fprintf(stderr, "failed to write projects in %s\n", data);
+        free(data);
+        goto out;
+    }
+    free(data);
+
+    struct qimm_bench_stat stats[BENCH_STARTUP_PHASES] = {0};
+    for (int i = 0; i < rounds; i++) {
+        if (bench_startup_round(qimm, dir, stats) < 0)
+            goto out_stats;
+    }
+
+    printf("startup of %d projects in %d rounds, since exec:\n",
+           count, rounds);
+    for (size_t i = 0; i < BENCH_STARTUP_PHASES; i++) {
+        if (stats[i].count)
+            qimm_bench_stat_print(bench_startup_phases[i], &stats[i]);
+    }
+    ret = EXIT_SUCCESS;
+
+out_stats:
+    for (size_t i = 0; i < BENCH_STARTUP_PHASES; i++)
+        qimm_bench_stat_release(&stats[i]);
+out:
+    qimm_bench_remove_dir(dir);
+    free(dir);
+    return ret;
+}
@@ -0,0 +1,305 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+/*
+ * Stress the lookups of desktop_surface_added with thousands of projects
+ * and layouts: each new surface finds its layout by wl_client and app id.
+ * The projects are created by the shell with types found by index,
+ * the clients are fake, only their wl_client pointers are used as keys.
+ */
+#define BENCH_CONFIG_NAME "qimm-bench"
+#define BENCH_OUTPUTS 4
+
+struct bench_shell {
+    struct qimm_shell shell;
+    struct weston_output outputs[BENCH_OUTPUTS];
+    char output_names[BENCH_OUTPUTS][16];
+
+    int surfaces;
+    struct qimm_layout **layouts; /* layout of each surface */
+    struct qimm_client *clients;
+    char *client_keys; /* fake wl_client pointers */
+};
+
+static int
+bench_config_write_yaml(const char *path, int count) {
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+
+    fprintf(fp, "name: %s\ntypes:\n", BENCH_CONFIG_NAME);
+    for (int i = 0; i < count; i++)
+        fprintf(fp, "  - name: type%d\n"
+                    "    summary: the summary for benchmark type %d\n", i, i);
+    fprintf(fp, "layouts:\n");
+    for (int i = count - 1; i >= 0; i--)
+        fprintf(fp, "  - { name: type%d , x: -1 , y: -1 , w: 100 , h: 100 }\n",
+                i);
+
+    return fclose(fp);
+}
+
+/*
+ * the layout lookup before client index, for comparison
+ */
+static struct qimm_layout *
+bench_find_by_client_linear(struct qimm_shell *shell,
+                            struct wl_client *client,
+                            const char *app_id) {
+    struct qimm_output *output;
+    wl_list_for_each(output, &shell->outputs, link) {
+        struct qimm_project *project;
+        wl_list_for_each(project, &output->projects, link) {
+            struct qimm_layout *layout;
+            wl_list_for_each(layout, &project->layouts, link) {
+                if (layout->client && layout->client->client == client)
+                    return qimm_client_find_layout(layout->client, app_id);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void
+bench_shell_init(struct bench_shell *bench, const char *dir) {
+    struct qimm_shell *shell = &bench->shell;
+
+    shell->cache_path = strdup(dir);
+    wl_list_init(&shell->outputs);
+    qimm_index_init(shell);
+
+    for (int i = 0; i < BENCH_OUTPUTS; i++) {
+        struct qimm_output *output = zalloc(sizeof *output);
+        snprintf(bench->output_names[i], sizeof bench->output_names[i],
+                 "bench-%d", i);
+        bench->outputs[i].name = bench->output_names[i];
+        output->shell = shell;
+        output->output = &bench->outputs[i];
+        wl_list_init(&output->projects);
+        wl_list_insert(shell->outputs.prev, &output->link);
+        qimm_index_output_add(output);
+    }
+}
+
+static int
+bench_shell_add_projects(struct bench_shell *bench, int projects,
+                         struct qimm_bench_stat *stat) {
+    struct qimm_shell *shell = &bench->shell;
+
+    struct qimm_output *output = qimm_output_get_default(shell);
+    for (int i = 0; i < projects; i++) {
+        char name[32];
+        snprintf(name, sizeof name, "project%d", i);
+
+        uint64_t start = qimm_bench_now();
+        struct qimm_project *project =
+                qimm_project_create(shell, name, BENCH_CONFIG_NAME);
+        qimm_bench_stat_add(stat, qimm_bench_now() - start);
+        if (!project)
+            return -1;
+
+        /* spread projects to outputs by name, like restored from data */
+        snprintf(name, sizeof name, "bench-%d", i % BENCH_OUTPUTS);
+        output = qimm_output_find_by_name(shell, name) ?: output;
+        project->output = output;
+        wl_list_insert(output->projects.prev, &project->link);
+
+        bench->surfaces += wl_list_length(&project->layouts);
+    }
+    return 0;
+}
+
+/*
+ * one client for each layout, like launched by qimm_client_start_layout
+ */
+static int
+bench_shell_add_clients(struct bench_shell *bench) {
+    struct qimm_shell *shell = &bench->shell;
+
+    bench->layouts = calloc(bench->surfaces, sizeof *bench->layouts);
+    bench->clients = calloc(bench->surfaces, sizeof *bench->clients);
+    bench->client_keys = calloc(bench->surfaces, 16);
+    if (!bench->layouts || !bench->clients || !bench->client_keys)
+        return -1;
+
+    int i = 0;
+    struct qimm_output *output;
+    wl_list_for_each(output, &shell->outputs, link) {
+        struct qimm_project *project;
+        wl_list_for_each(project, &output->projects, link) {
+            struct qimm_layout *layout;
+            wl_list_for_each(layout, &project->layouts, link) {
+                struct qimm_client *client = &bench->clients[i];
+                client->shell = shell;
+                client->client = (void *) &bench->client_keys[i * 16];
+                wl_list_init(&client->layouts);
+                layout->client = client;
+                wl_list_insert(&client->layouts, &layout->client_link);
+                if (qimm_index_client_add(client) < 0)
+                    return -1;
+                bench->layouts[i++] = layout;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * the surfaces are added in random order, as the clients start
+ */
+static void
+bench_shell_shuffle(struct bench_shell *bench, int *order) {
+    for (int i = 0; i < bench->surfaces; i++)
+        order[i] = i;
+    for (int i = bench->surfaces - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+}
+
+static int
+bench_surface_added(struct bench_shell *bench, int *order, bool linear,
+                    struct qimm_bench_stat *stat) {
+    struct qimm_shell *shell = &bench->shell;
+
+    for (int i = 0; i < bench->surfaces; i++) {
+        struct qimm_layout *expect = bench->layouts[order[i]];
+        struct wl_client *client = expect->client->client;
+        const char *app_id = expect->config_layout->name;
+
+        uint64_t start = qimm_bench_now();
+        struct qimm_layout *layout = linear ?
+                bench_find_by_client_linear(shell, client, app_id) :
+                qimm_layout_find_by_client(shell, client, app_id);
+        qimm_bench_stat_add(stat, qimm_bench_now() - start);
+
+        if (layout != expect)
+            return -1;
+    }
+    return 0;
+}
+
+static void
+bench_shell_release(struct bench_shell *bench) {
+    struct qimm_shell *shell = &bench->shell;
+
+    /* the fake clients must not be destroyed by layout clear */
+    for (int i = 0; bench->layouts && i < bench->surfaces; i++) {
+        struct qimm_layout *layout = bench->layouts[i];
+        if (!layout)
+            break;
+        qimm_index_client_remove(layout->client);
+        wl_list_remove(&layout->client_link);
+        wl_list_init(&layout->client_link);
+        layout->client = NULL;
+    }
+
+    struct qimm_output *output, *tmp_output;
+    wl_list_for_each_safe(output, tmp_output, &shell->outputs, link) {
+        struct qimm_project *project, *tmp;
+        wl_list_for_each_safe(project, tmp, &output->projects, link) {
+            qimm_output_project_remove(project);
+            qimm_project_destroy(project);
+        }
+        qimm_index_output_remove(output);
+        wl_list_remove(&output->link);
+        free(output);
+    }
+
+    qimm_index_release(shell);
+    free(shell->cache_path);
+    free(bench->layouts);
+    free(bench->clients);
+    free(bench->client_keys);
+}
+
+int
+main(int argc, char *argv[]) {
+    int projects = argc > 1 ? atoi(argv[1]) : 2000;
+    int types = argc > 2 ? atoi(argv[2]) : 16;
+    int rounds = argc > 3 ? atoi(argv[3]) : 5;
+    int ret = EXIT_FAILURE;
+
+    qimm_bench_init();
+    srand(1);
+
+    char *dir = qimm_bench_make_dir();
+    if (!dir)
+        return EXIT_FAILURE;
+
+    struct bench_shell bench = {0};
+    int *order = NULL;
+    char *yaml = NULL, *map = NULL;
+    if (asprintf(&yaml, "%s/%s.yaml", dir, BENCH_CONFIG_NAME) < 0 ||
+        asprintf(&map, "%s.yaml=%s", BENCH_CONFIG_NAME, yaml) < 0)
+        goto out;
+    /* qimm_get_project_path finds the config by module map */
+    setenv("WESTON_MODULE_MAP", map, 1);
+
+    if (bench_config_write_yaml(yaml, types) < 0) {
+        fprintf(stderr, "failed to write %s\n", yaml);
+        goto out;
+    }
+
+    bench_shell_init(&bench, dir);
+
+    struct qimm_bench_stat stat_project = {0};
+    if (bench_shell_add_projects(&bench, projects, &stat_project) < 0 ||
+        bench_shell_add_clients(&bench) < 0) {
+        fprintf(stderr, "failed to create projects\n");
+        goto out_shell;
+    }
+
+    order = calloc(bench.surfaces, sizeof *order);
+    if (!order)
+        goto out_shell;
+
+    struct qimm_bench_stat stat_index = {0}, stat_linear = {0};
+    for (int i = 0; i < rounds; i++) {
+        bench_shell_shuffle(&bench, order);
+        if (bench_surface_added(&bench, order, false, &stat_index) < 0 ||
+            bench_surface_added(&bench, order, true, &stat_linear) < 0) {
+            fprintf(stderr, "surface added to wrong layout\n");
+            goto out_shell;
+        }
+    }
+
+    printf("%d projects with %d layouts in %d outputs, %d surfaces x %d\n",
+           projects, types, BENCH_OUTPUTS, bench.surfaces, rounds);
+    qimm_bench_stat_print("project create", &stat_project);
+    qimm_bench_stat_print("surface added (index)", &stat_index);
+    qimm_bench_stat_print("surface added (linear)", &stat_linear);
+    ret = EXIT_SUCCESS;
+
+    qimm_bench_stat_release(&stat_project);
+    qimm_bench_stat_release(&stat_index);
+    qimm_bench_stat_release(&stat_linear);
+
+out_shell:
+    bench_shell_release(&bench);
+out:
+    qimm_bench_remove_dir(dir);
+    free(order);
+    free(map);
+    free(yaml);
+    free(dir);
+    return ret;
+}
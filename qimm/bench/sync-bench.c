@@ -0,0 +1,291 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "bench.h"
+
+#include <sys/un.h>
+
+/*
+ * Sync a large project to a directory peer and to a socket peer:
+ * the first export, exports after one small item or one byte of a big
+ * image changed, and imports into another data directory.
+ */
+struct bench_sync_result {
+    struct qimm_bench_stat time;
+    uint64_t bytes;
+    uint64_t bytes_sent;
+};
+
+static int
+bench_sync_write_file(const char *dir, const char *file,
+                      const void *content, size_t size) {
+    char *path;
+    if (asprintf(&path, "%s/%s", dir, file) < 0)
+        return -1;
+    FILE *fp = fopen(path, "w");
+    free(path);
+    if (!fp)
+        return -1;
+    fwrite(content, 1, size, fp);
+    return fclose(fp);
+}
+
+static int
+bench_sync_write_item(const char *dir, int i, int version) {
+    char file[32], content[256];
+    snprintf(file, sizeof file, "item%d.yaml", i);
+    int len = snprintf(content, sizeof content,
+                       "name: item%d\n"
+                       "version: %d\n"
+                       "text: the note number %d of the large project\n"
+                       "x: %d\n"
+                       "y: %d\n",
+                       i, version, i, i * 37 % 1920, i * 53 % 1080);
+    return bench_sync_write_file(dir, file, content, len);
+}
+
+/*
+ * the project with items and one big image
+ */
+static int
+bench_sync_write_project(const char *dir, int items, char *image,
+                         size_t image_size) {
+    mkdir(dir, QIMM_DATA_DIR_MODE);
+    if (bench_sync_write_file(dir, "config.yaml",
+                              "config_name: dashboard\n", 23) < 0)
+        return -1;
+    for (int i = 0; i < items; i++) {
+        if (bench_sync_write_item(dir, i, 0) < 0)
+            return -1;
+    }
+    return bench_sync_write_file(dir, "image.png", image, image_size);
+}
+
+static void
+bench_sync_add(struct bench_sync_result *result, struct qimm_sync_stat *stat) {
+    qimm_bench_stat_add(&result->time, stat->nsec);
+    result->bytes += stat->bytes;
+    result->bytes_sent += stat->bytes_sent;
+}
+
+static void
+bench_sync_print(const char *name, struct bench_sync_result *result) {
+    qimm_bench_stat_print(name, &result->time);
+    uint64_t n = result->time.count ?: 1;
+    uint64_t mean = qimm_bench_stat_mean(&result->time) ?: 1;
+    printf("%-24s %10.1f MB/s of project  %12" PRIu64 " bytes sent\n", "",
+           result->bytes / n * 1000.0 / mean, result->bytes_sent / n);
+    qimm_bench_stat_release(&result->time);
+}
+
+struct bench_sync_server {
+    struct qimm_sync_peer *peer;
+    int fd;
+};
+
+static void *
+bench_sync_serve(void *data) {
+    struct bench_sync_server *server = data;
+    int client = accept(server->fd, NULL, NULL);
+    if (client >= 0) {
+        qimm_sync_peer_serve(server->peer, client);
+        close(client);
+    }
+    return NULL;
+}
+
+/*
+ * serve the directory peer like qimm-syncd, for one client
+ */
+static int
+bench_sync_server_start(struct bench_sync_server *server, pthread_t *thread,
+                        const char *dir, const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof addr.sun_path)
+        return -1;
+    strcpy(addr.sun_path, path);
+
+    server->peer = qimm_sync_peer_open(dir);
+    if (!server->peer)
+        return -1;
+    server->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server->fd < 0 ||
+        bind(server->fd, (struct sockaddr *) &addr, sizeof addr) < 0 ||
+        listen(server->fd, 1) < 0 ||
+        create_worker_thread(thread, bench_sync_serve, server) < 0) {
+        if (server->fd >= 0)
+            close(server->fd);
+        qimm_sync_peer_close(server->peer);
+        return -1;
+    }
+    return 0;
+}
+
+static void
+bench_sync_server_stop(struct bench_sync_server *server, pthread_t thread) {
+    pthread_join(thread, NULL);
+    close(server->fd);
+    qimm_sync_peer_close(server->peer);
+}
+
+static int
+bench_sync_run(const char *dir, const char *spec, const char *label,
+               int items, int times) {
+    struct qimm_shell src = {0}, dst = {0};
+    struct qimm_sync_peer *peer = NULL;
+    struct qimm_sync_stat stat;
+    int ret = -1;
+
+    char *image = NULL, *project = NULL;
+    size_t image_size = 0;
+    if (asprintf(&src.data_path, "%s/%s-src", dir, label) < 0 ||
+        asprintf(&dst.data_path, "%s/%s-dst", dir, label) < 0 ||
+        asprintf(&project, "%s/large", src.data_path) < 0)
+        goto out;
+    mkdir(src.data_path, QIMM_DATA_DIR_MODE);
+    mkdir(dst.data_path, QIMM_DATA_DIR_MODE);
+
+    /* random content does not compress or dedupe */
+    const char *env = getenv("QIMM_BENCH_IMAGE_MIB");
+    image_size = (size_t) (env ? atoi(env) : 64) << 20;
+    image = malloc(image_size);
+    if (!image)
+        goto out;
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i + 8 <= image_size; i += 8) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        memcpy(image + i, &x, 8);
+    }
+    if (bench_sync_write_project(project, items, image, image_size) < 0) {
+        fprintf(stderr, "failed to write project in %s\n", project);
+        goto out;
+    }
+
+    peer = qimm_sync_peer_open(spec);
+    if (!peer)
+        goto out;
+
+    struct bench_sync_result full = {0}, item = {0}, byte = {0},
+            import_full = {0}, import_item = {0};
+    if (qimm_sync_project_export(&src, "large", peer, &stat) < 0)
+        goto out;
+    bench_sync_add(&full, &stat);
+
+    for (int i = 0; i < times; i++) {
+        if (bench_sync_write_item(project, i * 7919 % items, i + 1) < 0 ||
+            qimm_sync_project_export(&src, "large", peer, &stat) < 0)
+            goto out;
+        bench_sync_add(&item, &stat);
+    }
+
+    for (int i = 0; i < times; i++) {
+        image[image_size / 2 + i * 4099] ^= 0xff;
+        if (bench_sync_write_file(project, "image.png", image,
+                                  image_size) < 0 ||
+            qimm_sync_project_export(&src, "large", peer, &stat) < 0)
+            goto out;
+        bench_sync_add(&byte, &stat);
+    }
+
+    if (qimm_sync_project_import(&dst, "large", peer, &stat) < 0)
+        goto out;
+    bench_sync_add(&import_full, &stat);
+
+    for (int i = 0; i < times; i++) {
+        if (bench_sync_write_item(project, i * 104729 % items, times + i) < 0 ||
+            qimm_sync_project_export(&src, "large", peer, &stat) < 0 ||
+            qimm_sync_project_import(&dst, "large", peer, &stat) < 0)
+            goto out;
+        bench_sync_add(&import_item, &stat);
+    }
+
+    char name[64];
+    printf("%s peer: %d items, %zu MiB image\n", label, items,
+           image_size >> 20);
+    snprintf(name, sizeof name, "%s export full", label);
+    bench_sync_print(name, &full);
+    snprintf(name, sizeof name, "%s export item", label);
+    bench_sync_print(name, &item);
+    snprintf(name, sizeof name, "%s export image byte", label);
+    bench_sync_print(name, &byte);
+    snprintf(name, sizeof name, "%s import full", label);
+    bench_sync_print(name, &import_full);
+    snprintf(name, sizeof name, "%s import item", label);
+    bench_sync_print(name, &import_item);
+    ret = 0;
+
+out:
+    if (peer)
+        qimm_sync_peer_close(peer);
+    free(image);
+    free(project);
+    free(src.data_path);
+    free(dst.data_path);
+    return ret;
+}
+
+int
+main(int argc, char *argv[]) {
+    int items = argc > 1 ? atoi(argv[1]) : 5000;
+    int times = argc > 2 ? atoi(argv[2]) : 10;
+    int ret = EXIT_FAILURE;
+
+    qimm_bench_init();
+    if (items <= 0 || times <= 0)
+        return EXIT_FAILURE;
+
+    char *dir = qimm_bench_make_dir();
+    if (!dir)
+        return EXIT_FAILURE;
+
+    char *peer_dir = NULL, *socket_dir = NULL, *socket_path = NULL,
+            *socket_spec = NULL;
+    if (asprintf(&peer_dir, "%s/peer", dir) < 0 ||
+        asprintf(&socket_dir, "%s/syncd", dir) < 0 ||
+        asprintf(&socket_path, "%s/syncd.sock", dir) < 0 ||
+        asprintf(&socket_spec, "unix:%s", socket_path) < 0)
+        goto out;
+
+    if (bench_sync_run(dir, peer_dir, "dir", items, times) < 0) {
+        fprintf(stderr, "sync with directory failed\n");
+        goto out;
+    }
+
+    struct bench_sync_server server;
+    pthread_t thread;
+    if (bench_sync_server_start(&server, &thread, socket_dir,
+                                socket_path) < 0)
+        goto out;
+    int run = bench_sync_run(dir, socket_spec, "socket", items, times);
+    bench_sync_server_stop(&server, thread);
+    if (run < 0) {
+        fprintf(stderr, "sync with socket failed\n");
+        goto out;
+    }
+    ret = EXIT_SUCCESS;
+
+out:
+    qimm_bench_remove_dir(dir);
+    free(peer_dir);
+    free(socket_dir);
+    free(socket_path);
+    free(socket_spec);
+    free(dir);
+    return ret;
+}
@@ -15,67 +15,452 @@
  * You should have received a copy of the GNU Affero General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <math.h>
+
 #include "share.h"
 #include "clients/window.h"
+#include "qimm-desktop-shell-client-protocol.h"
+
+/*
+ * the system metrics shown by application, see metrics feed of shell
+ */
+enum app_metric {
+    APP_METRIC_NONE = 0,
+    APP_METRIC_CPU,
+    APP_METRIC_MEMORY,
+    APP_METRIC_NETWORK,
+    APP_METRIC_DISK,
+    APP_METRIC_DATE,
+};
+
+/*
+ * what application has drawn in the buffer, to redraw only the changes
+ */
+struct app_render {
+    bool full; /* redraw all at next frame */
+    struct rectangle allocation;
+
+    /* laid out at full redraw */
+    double name_x, name_y; /* baseline of name */
+    double line; /* height of name */
+
+    char metric[64];
+    struct rectangle metric_box; /* ink of metric, empty when no metric */
+};
+
+/*
+ * the client runs one or more applications,
+ * each application renders a layout in its own window.
+ */
+struct app {
+    struct wl_list link; /* client::apps */
+    struct client *client;
 
-struct client {
-    struct display *display;
     struct window *window;
     struct widget *widget;
 
+    char *name;
+    float rgb[3];
+    enum app_metric metric;
+
+    struct app_render render;
+};
+
+struct client {
+    struct display *display;
+    struct wl_list apps; /* app::link */
+
     char *project;
-    char *app;
+
+    struct qimm_desktop_shell *shell;
+    /* ack layout transaction after configured windows are redrawn */
+    struct task transaction_task;
+    uint32_t transaction_serial;
+
+    /* the metrics feed shared by all applications */
+    struct qimm_desktop_metrics *metrics;
+    const struct qimm_metrics_ring *ring;
+    size_t ring_size;
+    struct qimm_metrics_sample sample, sample_prev;
 };
 
+/* --------- metrics --------- */
+static enum app_metric
+app_metric_from_name(const char *name) {
+    static const char *names[] = {
+            [APP_METRIC_CPU] = "cpu",
+            [APP_METRIC_MEMORY] = "memory",
+            [APP_METRIC_NETWORK] = "network",
+            [APP_METRIC_DISK] = "disk",
+            [APP_METRIC_DATE] = "date",
+    };
+    for (size_t i = 1; i < ARRAY_LENGTH(names); i++) {
+        if (!strcmp(name, names[i]))
+            return i;
+    }
+    return APP_METRIC_NONE;
+}
+
 static void
-redraw_handler(struct widget *widget, void *data) {
-    struct rectangle allocation;
-    widget_get_allocation(widget, &allocation);
-    if (allocation.width == 0)
+format_bytes(char *buf, size_t len, double bytes) {
+    const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    size_t i = 0;
+    while (bytes >= 1024 && i < ARRAY_LENGTH(units) - 1) {
+        bytes /= 1024;
+        i++;
+    }
+    snprintf(buf, len, "%.1f %s", bytes, units[i]);
+}
+
+/*
+ * rate per second of counter between the last two samples
+ */
+static double
+metric_rate(struct client *client, uint64_t cur, uint64_t prev) {
+    uint64_t ms = client->sample.time - client->sample_prev.time;
+    if (!client->sample_prev.number || ms == 0 || cur < prev)
+        return 0;
+    return (cur - prev) * 1000.0 / ms;
+}
+
+/*
+ * text of metric, false when there is no sample
+ */
+static bool
+app_metric_text(struct app *app, char *buf, size_t len) {
+    struct client *client = app->client;
+    struct qimm_metrics_sample *s = &client->sample, *p = &client->sample_prev;
+    char a[32], b[32];
+
+    if (app->metric == APP_METRIC_NONE || !s->number)
+        return false;
+
+    switch (app->metric) {
+        case APP_METRIC_CPU: {
+            uint64_t total = s->cpu_total - p->cpu_total;
+            uint64_t idle = s->cpu_idle - p->cpu_idle;
+            if (!p->number || total == 0 || idle > total)
+                return false;
+            snprintf(buf, len, "%.1f%%", 100.0 * (total - idle) / total);
+            break;
+        }
+        case APP_METRIC_MEMORY:
+            format_bytes(a, sizeof a, s->mem_total - s->mem_available);
+            format_bytes(b, sizeof b, s->mem_total);
+            snprintf(buf, len, "%s / %s", a, b);
+            break;
+        case APP_METRIC_NETWORK:
+            format_bytes(a, sizeof a, metric_rate(client, s->net_rx, p->net_rx));
+            format_bytes(b, sizeof b, metric_rate(client, s->net_tx, p->net_tx));
+            snprintf(buf, len, "rx %s/s  tx %s/s", a, b);
+            break;
+        case APP_METRIC_DISK:
+            format_bytes(a, sizeof a,
+                         metric_rate(client, s->disk_read, p->disk_read));
+            format_bytes(b, sizeof b,
+                         metric_rate(client, s->disk_write, p->disk_write));
+            snprintf(buf, len, "read %s/s  write %s/s", a, b);
+            break;
+        case APP_METRIC_DATE: {
+            time_t t = s->time / 1000;
+            struct tm tm;
+            if (!localtime_r(&t, &tm) ||
+                !strftime(buf, len, "%Y-%m-%d %H:%M:%S", &tm))
+                return false;
+            break;
+        }
+        default:
+            return false;
+    }
+    return true;
+}
+
+static void
+metrics_handle_ring(void *data, struct qimm_desktop_metrics *metrics,
+                    int32_t fd, uint32_t size) {
+    struct client *client = data;
+
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "failed to map metrics: %s\n", strerror(errno));
         return;
+    }
 
+    client->ring = qimm_metrics_ring_check(map, size);
+    if (!client->ring) {
+        fprintf(stderr, "metrics ring is not compatible\n");
+        munmap(map, size);
+        return;
+    }
+    client->ring_size = size;
+}
+
+/*
+ * one wakeup for all applications of client at each tick
+ */
+static void
+metrics_handle_update(void *data, struct qimm_desktop_metrics *metrics,
+                      uint32_t number) {
     struct client *client = data;
-    cairo_t *cr = widget_cairo_create(client->widget);
+    struct qimm_metrics_sample sample;
+
+    if (!client->ring || qimm_metrics_ring_read(client->ring, &sample) < 0)
+        return;
+    if (sample.number == client->sample.number)
+        return;
+
+    client->sample_prev = client->sample;
+    client->sample = sample;
+
+    struct app *app;
+    wl_list_for_each(app, &client->apps, link) {
+        if (app->metric != APP_METRIC_NONE && app->widget)
+            widget_schedule_redraw(app->widget);
+    }
+}
+
+static const struct qimm_desktop_metrics_listener metrics_listener = {
+        metrics_handle_ring,
+        metrics_handle_update,
+};
+
+/* --------- layout transaction --------- */
+static void
+transaction_ack(struct task *task, uint32_t events) {
+    struct client *client =
+            container_of(task, struct client, transaction_task);
+
+    /* removed from deferred list without init */
+    wl_list_init(&task->link);
+    qimm_desktop_shell_ack_layout_transaction(client->shell,
+                                              client->transaction_serial);
+}
+
+/*
+ * the redraws of configured windows are deferred before the event,
+ * ack after them.
+ */
+static void
+shell_handle_layout_transaction(void *data, struct qimm_desktop_shell *shell,
+                                uint32_t serial) {
+    struct client *client = data;
+
+    client->transaction_serial = serial;
+    if (wl_list_empty(&client->transaction_task.link))
+        display_defer(client->display, &client->transaction_task);
+}
+
+/* themes of project reloaded */
+static void
+shell_handle_redraw(void *data, struct qimm_desktop_shell *shell) {
+    struct client *client = data;
+
+    struct app *app;
+    wl_list_for_each(app, &client->apps, link) {
+        app->render.full = true;
+        if (app->widget)
+            widget_schedule_redraw(app->widget);
+    }
+}
+
+/* the shell sends no other events to layout clients */
+static const struct qimm_desktop_shell_listener shell_listener = {
+        .layout_transaction = shell_handle_layout_transaction,
+        .redraw = shell_handle_redraw,
+};
+
+static void
+global_handler(struct display *display, uint32_t name,
+               const char *interface, uint32_t version, void *data) {
+    struct client *client = data;
+
+    if (strcmp(interface, qimm_desktop_shell_interface.name) ||
+        version < 2 || client->shell)
+        return;
+
+    /* no application shows metrics, save the wakeups */
+    struct app *app;
+    bool metric = false;
+    wl_list_for_each(app, &client->apps, link)
+        metric = metric || app->metric != APP_METRIC_NONE;
+    if (!metric && version < 3)
+        return;
+
+    client->shell = display_bind(display, name, &qimm_desktop_shell_interface,
+                                 MIN(version, 5));
+    qimm_desktop_shell_add_listener(client->shell, &shell_listener, client);
+
+    if (metric) {
+        client->metrics = qimm_desktop_shell_get_metrics(client->shell);
+        qimm_desktop_metrics_add_listener(client->metrics,
+                                          &metrics_listener, client);
+    }
+}
+
+/* --------- render --------- */
+/*
+ * draw all contents, the clip of cr limits what is touched
+ */
+static void
+app_render_draw(struct app *app, cairo_t *cr) {
+    struct app_render *render = &app->render;
 
-    float rgb[3];
-    random_rgb(rgb);
     cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-    cairo_set_source_rgba(cr, rgb[0], rgb[1], rgb[2], 1.0);
+    cairo_set_source_rgba(cr, app->rgb[0], app->rgb[1], app->rgb[2], 1.0);
     cairo_paint(cr);
 
-    cairo_text_extents_t extents;
     cairo_set_font_size(cr, 14);
-    cairo_text_extents(cr, client->app, &extents);
-    if (allocation.x > 0)
-        allocation.x += allocation.width - extents.width;
-    else
-        allocation.x += allocation.width / 2 - extents.width / 2;
-    allocation.y += allocation.height / 2 - 1 + extents.height / 2;
-    cairo_move_to(cr, allocation.x + 1, allocation.y + 1);
+    cairo_move_to(cr, render->name_x + 1, render->name_y + 1);
     cairo_set_source_rgba(cr, 0, 0, 0, 0.85);
-    cairo_show_text(cr, client->app);
-    cairo_move_to(cr, allocation.x, allocation.y);
+    cairo_show_text(cr, app->name);
+    cairo_move_to(cr, render->name_x, render->name_y);
     cairo_set_source_rgba(cr, 1, 1, 1, 0.85);
-    cairo_show_text(cr, client->app);
+    cairo_show_text(cr, app->name);
+
+    /* the metric in next line */
+    if (render->metric[0]) {
+        cairo_move_to(cr, render->name_x, render->name_y + render->line * 2);
+        cairo_show_text(cr, render->metric);
+    }
+}
+
+static void
+app_render_layout(struct app *app, cairo_t *cr, struct rectangle *allocation) {
+    struct app_render *render = &app->render;
+    cairo_text_extents_t extents;
+
+    cairo_set_font_size(cr, 14);
+    cairo_text_extents(cr, app->name, &extents);
+    if (allocation->x > 0)
+        render->name_x = allocation->x + allocation->width - extents.width;
+    else
+        render->name_x = allocation->x + allocation->width / 2 -
+                         extents.width / 2;
+    render->name_y = allocation->y + allocation->height / 2 - 1 +
+                     extents.height / 2;
+    render->line = extents.height;
+}
+
+/*
+ * ink box of metric text, with a pixel of margin for antialiasing
+ */
+static void
+app_render_metric_box(struct app *app, cairo_t *cr, struct rectangle *box) {
+    struct app_render *render = &app->render;
+    cairo_text_extents_t extents;
+
+    if (!render->metric[0]) {
+        *box = (struct rectangle) {0};
+        return;
+    }
+    cairo_set_font_size(cr, 14);
+    cairo_text_extents(cr, render->metric, &extents);
+    double x = render->name_x + extents.x_bearing;
+    double y = render->name_y + render->line * 2 + extents.y_bearing;
+    box->x = (int32_t) floor(x) - 1;
+    box->y = (int32_t) floor(y) - 1;
+    box->width = (int32_t) ceil(x + extents.width) + 1 - box->x;
+    box->height = (int32_t) ceil(y + extents.height) + 1 - box->y;
+}
+
+static void
+redraw_handler(struct widget *widget, void *data) {
+    struct rectangle allocation;
+    widget_get_allocation(widget, &allocation);
+    if (allocation.width == 0)
+        return;
+
+    struct app *app = data;
+    struct app_render *render = &app->render;
+    char text[64];
+    if (!app_metric_text(app, text, sizeof text))
+        text[0] = '\0';
+
+    /* the buffer holds the last frame unless it is new or resized */
+    bool full = render->full || widget_get_buffer_age(widget) != 1 ||
+                memcmp(&render->allocation, &allocation, sizeof allocation);
+    if (!full && !strcmp(text, render->metric)) {
+        widget_damage(widget, allocation.x, allocation.y, 0, 0);
+        return;
+    }
+
+    cairo_t *cr = widget_cairo_create(widget);
+    if (full) {
+        render->full = false;
+        render->allocation = allocation;
+        app_render_layout(app, cr, &allocation);
+        snprintf(render->metric, sizeof render->metric, "%s", text);
+        app_render_metric_box(app, cr, &render->metric_box);
+
+        app_render_draw(app, cr);
+        widget_damage(widget, allocation.x, allocation.y,
+                      allocation.width, allocation.height);
+    } else {
+        /* only the metric changed at tick, redraw under old and new text */
+        struct rectangle old = render->metric_box;
+        snprintf(render->metric, sizeof render->metric, "%s", text);
+        app_render_metric_box(app, cr, &render->metric_box);
+
+        struct rectangle *boxes[] = {&old, &render->metric_box};
+        for (size_t i = 0; i < ARRAY_LENGTH(boxes); i++) {
+            if (boxes[i]->width <= 0 || boxes[i]->height <= 0)
+                continue;
+            cairo_rectangle(cr, boxes[i]->x, boxes[i]->y,
+                            boxes[i]->width, boxes[i]->height);
+            widget_damage(widget, boxes[i]->x, boxes[i]->y,
+                          boxes[i]->width, boxes[i]->height);
+        }
+        cairo_clip(cr);
+        app_render_draw(app, cr);
+    }
 
     cairo_destroy(cr);
 }
 
 static int
 run(struct client *client) {
-    client->window = window_create(client->display);
-    client->widget = window_add_widget(client->window, client);
-    window_set_title(client->window, "qimm-client");
+    /*
+     * all windows share the display connection,
+     * so the fonts, caches and shm pools are shared too
+     */
+    struct app *app, *tmp;
+    wl_list_for_each(app, &client->apps, link) {
+        random_rgb(app->rgb);
+        app->metric = app_metric_from_name(app->name);
+        app->render.full = true;
+        app->window = window_create(client->display);
+        app->widget = window_add_widget(app->window, app);
+        window_set_title(app->window, "qimm-client");
+        /* the shell finds layout for window by app id */
+        window_set_appid(app->window, app->name);
+
+        widget_set_redraw_handler(app->widget, redraw_handler);
+        // widget_set_button_handler(app->widget, button_handler);
+        widget_set_default_cursor(app->widget, CURSOR_LEFT_PTR);
+        // widget_set_touch_down_handler(app->widget, touch_down_handler);
+    }
 
-    widget_set_redraw_handler(client->widget, redraw_handler);
-    // widget_set_button_handler(client.widget, button_handler);
-    widget_set_default_cursor(client->widget, CURSOR_LEFT_PTR);
-    // widget_set_touch_down_handler(client.widget, touch_down_handler);
+    client->transaction_task.run = transaction_ack;
+    wl_list_init(&client->transaction_task.link);
+    display_set_user_data(client->display, client);
+    display_set_global_handler(client->display, global_handler);
 
     display_run(client->display);
 
-    widget_destroy(client->widget);
-    window_destroy(client->window);
+    if (client->metrics)
+        qimm_desktop_metrics_destroy(client->metrics);
+    if (client->shell)
+        qimm_desktop_shell_destroy(client->shell);
+    if (client->ring)
+        munmap((void *) client->ring, client->ring_size);
+
+    wl_list_for_each_safe(app, tmp, &client->apps, link) {
+        widget_destroy(app->widget);
+        window_destroy(app->window);
+        wl_list_remove(&app->link);
+        free(app);
+    }
     display_destroy(client->display);
     return 0;
 }
@@ -91,32 +476,32 @@ usage(int error_code) {
                  "Core options:\n"
                  "\n"
                  "  -p, --project\t\tWhich project this client belongs to\n"
-                 "  -a, --app\t\tWhich application this client run as\n"
+                 "  -a, --app\t\tWhich application this client run as,\n"
+                 "\t\t\tcan be repeated to run many applications\n"
+                 "  -z, --zygote\t\tRun as zygote to fork clients for shell\n"
                  "  -h, --help\t\tThis help message\n\n");
 
     exit(error_code);
 }
 
-int
-main(int argc, char **argv) {
-// #ifdef DEBUG
-#ifndef DEBUG
-    printf("Qimm PID is %ld - "
-               "waiting for debugger, send SIGCONT to continue...\n",
-            (long)getpid());
-    raise(SIGSTOP);
-#endif
-
-    struct client client = {0};
+/*
+ * parse options to client
+ * return 1 when run as zygote
+ */
+static int
+client_parse_options(struct client *client, int argc, char **argv) {
+    int zygote = 0;
     const struct option long_options[] = {
             {"help",    no_argument,       NULL, 'h'},
             {"project", required_argument, NULL, 'p'},
             {"app",     required_argument, NULL, 'a'},
+            {"zygote",  no_argument,       NULL, 'z'},
             {0, 0, 0,                            0}
     };
+    optind = 1; /* parse again in forked child */
     while (1) {
         int i = 0;
-        int c = getopt_long(argc, argv, "hp:a:", long_options, &i);
+        int c = getopt_long(argc, argv, "hp:a:z", long_options, &i);
         if (c == -1) {
             break;
         }
@@ -125,26 +510,131 @@ main(int argc, char **argv) {
                 usage(EXIT_SUCCESS);
                 break;
             case 'p': // project
-                client.project = optarg;
+                client->project = optarg;
+                break;
+            case 'a': { // app
+                struct app *app = zalloc(sizeof *app);
+                if (!app) {
+                    fprintf(stderr, "no memory for app %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                app->client = client;
+                app->name = optarg;
+                wl_list_insert(client->apps.prev, &app->link);
                 break;
-            case 'a': // app
-                client.app = optarg;
+            }
+            case 'z': // zygote
+                zygote = 1;
                 break;
             default:
                 usage(EXIT_FAILURE);
         }
     }
-    if (!client.project || !client.app) {
+    if (zygote)
+        return 1;
+
+    if (!client->project || wl_list_empty(&client->apps)) {
         fprintf(stderr, "The qimm-client must belongs to a project "
                         "and run as a application.\n\n");
         usage(EXIT_FAILURE);
     }
+    return 0;
+}
 
-    client.display = display_create(&argc, argv);
-    if (client.display == NULL) {
+static int
+client_main(struct client *client, int argc, char **argv) {
+// #ifdef DEBUG
+#ifndef DEBUG
+    printf("Qimm PID is %ld - "
+               "waiting for debugger, send SIGCONT to continue...\n",
+            (long)getpid());
+    raise(SIGSTOP);
+#endif
+
+    client->display = display_create(&argc, argv);
+    if (client->display == NULL) {
         fprintf(stderr, "failed to create display: %s\n",
                 strerror(errno));
         return -1;
     }
-    return run(&client);
+    return run(client);
+}
+
+/*
+ * pay the cost of fontconfig and cairo font initialization once in zygote,
+ * the forked clients share the result.
+ */
+static void
+zygote_prepare(void) {
+    cairo_surface_t *surface =
+            cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+    cairo_t *cr = cairo_create(surface);
+    cairo_text_extents_t extents;
+    cairo_set_font_size(cr, 14);
+    cairo_text_extents(cr, QIMM_NAME, &extents);
+    cairo_destroy(cr);
+    cairo_surface_destroy(surface);
+}
+
+static int
+zygote_main(void) {
+    const char *env = getenv(QIMM_ZYGOTE_SOCKET);
+    if (!env) {
+        fprintf(stderr, "The zygote must be started by qimm shell.\n\n");
+        return -1;
+    }
+    int sock = strtol(env, NULL, 10);
+    unsetenv(QIMM_ZYGOTE_SOCKET);
+    os_fd_set_cloexec(sock);
+
+    zygote_prepare();
+
+    /* clients are reaped by kernel, shell only talks to them by wayland */
+    signal(SIGCHLD, SIG_IGN);
+
+    int fd;
+    char **argv;
+    while ((argv = qimm_zygote_recv_request(sock, &fd))) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(sock);
+            signal(SIGCHLD, SIG_DFL);
+
+            char s[32];
+            snprintf(s, sizeof s, "%d", fd);
+            setenv("WAYLAND_SOCKET", s, 1);
+
+            int argc = 0;
+            while (argv[argc])
+                argc++;
+
+            struct client client = {0};
+            wl_list_init(&client.apps);
+            client_parse_options(&client, argc, argv);
+            _exit(client_main(&client, argc, argv) < 0 ?
+                  EXIT_FAILURE : EXIT_SUCCESS);
+        }
+
+        if (pid < 0)
+            fprintf(stderr, "zygote fork failed: %s\n", strerror(errno));
+        close(fd);
+        free_command_line(argv);
+
+        if (qimm_zygote_send_reply(sock, pid) < 0)
+            break;
+    }
+
+    /* the shell has gone */
+    close(sock);
+    return 0;
+}
+
+int
+main(int argc, char **argv) {
+    struct client client = {0};
+    wl_list_init(&client.apps);
+    if (client_parse_options(&client, argc, argv))
+        return zygote_main();
+
+    return client_main(&client, argc, argv);
 }
@@ -28,6 +28,25 @@ usage(int error_code) {
             "\n"
             "Core options:\n"
             "\n"
+            "  -b, --backend=BACKEND\tWeston backend module, e.g. headless-backend.so\n"
+            "  --use-pixman\t\tUse the pixman (CPU) renderer\n"
+            "  -l, --logger-scopes=SCOPE\tWeston log scopes to print, e.g.\n"
+            "\t\t\tqimm-startup for the phases of startup\n"
+            "  --log=FILE\t\tWrite the weston log to FILE\n"
+            "  --render-threads=N\tRender outputs in parallel on N threads\n"
+            "\t\t\twith --use-pixman\n"
+            "  -m, --client-mode=MODE\tHow to start clients: zygote (default) or exec\n"
+            "  -s, --share-client\tRun all layouts of a project in one client\n"
+            "  --data-store=STORE\tSave project datas in yaml files (default)\n"
+            "\t\t\tor in one log\n"
+            "  --sync-peer=PEER\tSync projects with a directory or\n"
+            "\t\t\tunix:SOCKET of qimm-syncd\n"
+            "  --freeze-delay=SEC\tFreeze hidden projects after SEC seconds,\n"
+            "\t\t\t-1 to never freeze (default 10)\n"
+            "  --hidden-memory=MIB\tEvict hidden projects above MIB of memory,\n"
+            "\t\t\t0 for no limit (default 512)\n"
+            "  --hidden-cpu=PERCENT\tFreeze hidden projects above PERCENT of cpu,\n"
+            "\t\t\t0 for no limit (default 5)\n"
             "  -v, --version\t\tPrint qimm version\n"
             "  -h, --help\t\tThis help message\n\n");
 
@@ -51,22 +70,66 @@ version(void) {
     exit(EXIT_SUCCESS);
 }
 
+enum {
+    OPTION_FREEZE_DELAY = 256,
+    OPTION_HIDDEN_MEMORY,
+    OPTION_HIDDEN_CPU,
+    OPTION_USE_PIXMAN,
+    OPTION_DATA_STORE,
+    OPTION_SYNC_PEER,
+    OPTION_LOG,
+    OPTION_RENDER_THREADS,
+};
+
+static void
+set_number_env(const char *name, const char *value) {
+    char *end;
+    long l = strtol(value, &end, 10);
+    if (*value == '\0' || *end || l < -1 || l > INT_MAX)
+        usage(EXIT_FAILURE);
+    setenv(name, value, 1);
+}
+
 int
 main(int argc, char **argv) {
     char *args[] = {argv[0],
                     // "--config=/home/wayland/.config/weston-test.ini",
                     "--no-config",
                     // "--wait-for-debugger",
-                    "--shell=qimm-shell.so"};
+                    "--shell=qimm-shell.so",
+                    NULL, /* backend and log options */
+                    NULL,
+                    NULL,
+                    NULL,
+                    NULL,
+                    NULL};
+    int args_count = 3;
+    char *backend = NULL;
+    bool use_pixman = false;
+    char *log_scopes = NULL;
+    char *log = NULL;
+    char *render_threads = NULL;
 
     const struct option long_options[] = {
             {"help",    no_argument, NULL, 'h'},
             {"version", no_argument, NULL, 'v'},
+            {"backend", required_argument, NULL, 'b'},
+            {"use-pixman", no_argument, NULL, OPTION_USE_PIXMAN},
+            {"logger-scopes", required_argument, NULL, 'l'},
+            {"log", required_argument, NULL, OPTION_LOG},
+            {"render-threads", required_argument, NULL, OPTION_RENDER_THREADS},
+            {"client-mode", required_argument, NULL, 'm'},
+            {"share-client", no_argument, NULL, 's'},
+            {"data-store", required_argument, NULL, OPTION_DATA_STORE},
+            {"sync-peer", required_argument, NULL, OPTION_SYNC_PEER},
+            {"freeze-delay", required_argument, NULL, OPTION_FREEZE_DELAY},
+            {"hidden-memory", required_argument, NULL, OPTION_HIDDEN_MEMORY},
+            {"hidden-cpu", required_argument, NULL, OPTION_HIDDEN_CPU},
             {0, 0, 0,                      0}
     };
     while (1) {
         int i = 0;
-        int c = getopt_long(argc, argv, "hv", long_options, &i);
+        int c = getopt_long(argc, argv, "hvb:l:m:s", long_options, &i);
         if (c == -1) {
             break;
         }
@@ -77,6 +140,55 @@ main(int argc, char **argv) {
             case 'v': // version
                 version();
                 break;
+            case 'b': // backend
+                free(backend);
+                if (asprintf(&backend, "--backend=%s", optarg) < 0)
+                    return EXIT_FAILURE;
+                break;
+            case OPTION_USE_PIXMAN:
+                use_pixman = true;
+                break;
+            case 'l': // logger scopes
+                free(log_scopes);
+                if (asprintf(&log_scopes, "--logger-scopes=%s", optarg) < 0)
+                    return EXIT_FAILURE;
+                break;
+            case OPTION_LOG:
+                free(log);
+                if (asprintf(&log, "--log=%s", optarg) < 0)
+                    return EXIT_FAILURE;
+                break;
+            case OPTION_RENDER_THREADS:
+                free(render_threads);
+                if (asprintf(&render_threads, "--render-threads=%s",
+                             optarg) < 0)
+                    return EXIT_FAILURE;
+                break;
+            case 'm': // client mode
+                if (strcmp(optarg, "zygote") && strcmp(optarg, "exec"))
+                    usage(EXIT_FAILURE);
+                setenv(QIMM_CLIENT_MODE, optarg, 1);
+                break;
+            case 's': // share client
+                setenv(QIMM_CLIENT_SHARE, "1", 1);
+                break;
+            case OPTION_DATA_STORE:
+                if (strcmp(optarg, "yaml") && strcmp(optarg, "log"))
+                    usage(EXIT_FAILURE);
+                setenv(QIMM_DATA_STORE, optarg, 1);
+                break;
+            case OPTION_SYNC_PEER:
+                setenv(QIMM_SYNC_PEER, optarg, 1);
+                break;
+            case OPTION_FREEZE_DELAY:
+                set_number_env(QIMM_FREEZE_DELAY, optarg);
+                break;
+            case OPTION_HIDDEN_MEMORY:
+                set_number_env(QIMM_HIDDEN_MEMORY, optarg);
+                break;
+            case OPTION_HIDDEN_CPU:
+                set_number_env(QIMM_HIDDEN_CPU, optarg);
+                break;
             default:
                 usage(EXIT_FAILURE);
         }
@@ -89,5 +201,23 @@ main(int argc, char **argv) {
     }
 #endif
 
-    return wet_main(ARRAY_LENGTH(args), args, NULL);
+    /* pass backend options to weston */
+    if (backend)
+        args[args_count++] = backend;
+    if (use_pixman)
+        args[args_count++] = "--use-pixman";
+    /* pass log options to weston */
+    if (log_scopes)
+        args[args_count++] = log_scopes;
+    if (log)
+        args[args_count++] = log;
+    if (render_threads)
+        args[args_count++] = render_threads;
+
+    int ret = wet_main(args_count, args, NULL);
+    free(backend);
+    free(log_scopes);
+    free(log);
+    free(render_threads);
+    return ret;
 }
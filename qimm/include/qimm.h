@@ -19,11 +19,22 @@
 #define QIMM_H
 
 #include "share.h"
+#include "libweston/plugin-registry.h"
 
 #ifdef  __cplusplus
 extern "C" {
 #endif
 
+/*
+ * The index for lookups in hot paths of shell, e.g. desktop surface added.
+ * Each table is updated by create and destroy of the indexed objects.
+ */
+struct qimm_index {
+    struct qimm_hash clients; /* qimm_client::index_node, by wl_client */
+    struct qimm_hash outputs; /* qimm_output::index_node, by name */
+    struct qimm_hash configs; /* types by name of each config, by config */
+};
+
 /*
  * Qimm shell use multiple projects to composite a desktop.
  */
@@ -35,14 +46,21 @@ struct qimm_shell {
 
     struct wl_listener output_create_listener;
     struct wl_listener output_move_listener;
+    struct wl_listener output_resize_listener;
     struct wl_list outputs; /* qimm_output::link */
     struct qimm_output *output_focus;
 
+    struct qimm_index index;
+
     /* the layer for background in all outputs */
     struct weston_layer background_layer;
 
     /* the path of qimm client */
     char *client_path;
+    /* the pre-initialised client to fork, NULL in exec mode */
+    struct qimm_zygote *zygote;
+    /* one client hosts all layouts of a project */
+    bool client_share;
     /* the interface of global desktop shell */
     struct wl_global *global_shell_iface;
 
@@ -51,10 +69,39 @@ struct qimm_shell {
 
     /* path for data directory */
     char *data_path;
+    /* path for compiled config cache, next to data directory */
+    char *cache_path;
+    /* loading projects in background, NULL when finished */
+    struct qimm_project_loader *loader;
+    /* saving project datas in background */
+    struct qimm_data_writer *data_writer;
+    /* the log of project datas, NULL when saved as yaml files */
+    struct qimm_data_store *data_store;
+    /* sync projects with peer, NULL when no peer */
+    struct qimm_sync *sync;
+    /* find projects by words in their datas */
+    struct qimm_search *search;
+    /* reload configs and datas changed on disk */
+    struct qimm_reload *reload;
+
+    /* hibernate hidden projects */
+    struct qimm_lifecycle *lifecycle;
+    /* last frames of layouts for project switching */
+    struct qimm_snapshot_cache *snapshot;
+    /* the internal client owning buffers of surfaces without client */
+    struct qimm_buffer_client *buffers;
+    /* decoded and scaled background images of projects */
+    struct qimm_background_cache *background;
+    /* system metrics shared with clients */
+    struct qimm_metrics *metrics;
+    /* show layouts resized together in one repaint */
+    struct qimm_transaction *transaction;
 
     bool locked;
 
+    /* the time of shell init, phases are traced in the startup scope */
     struct timespec startup_time;
+    struct weston_log_scope *startup_scope;
 };
 
 /*
@@ -66,6 +113,7 @@ struct qimm_output {
     struct qimm_shell *shell;
     struct weston_output *output;
     struct wl_listener destroy_listener;
+    struct qimm_hash_node index_node; /* qimm_index::outputs */
 
     /*
      * many projects will attach to one output, each output can
@@ -73,6 +121,18 @@ struct qimm_output {
      */
     struct wl_list projects; /* qimm_project::link */
     struct qimm_project *project_cur; /* the current project on show */
+    struct qimm_project *project_next; /* the prefetched project to show */
+
+    /* measure project switch until all layouts are painted */
+    struct wl_listener frame_listener;
+    struct timespec switch_time;
+    bool switching;
+
+    /* repaint is held by the layout transaction */
+    bool transaction_held;
+
+    /* the background of current project, NULL for none */
+    struct qimm_background_view *background;
 };
 
 /*
@@ -92,6 +152,13 @@ struct qimm_output {
  * When previous project is finished, user can create next project, this
  * reflects the actual work of the user.
  */
+enum qimm_project_state {
+    QIMM_PROJECT_STOPPED = 0, /* no clients, not started or evicted */
+    QIMM_PROJECT_ACTIVE, /* shown in output */
+    QIMM_PROJECT_IDLE, /* hidden, clients are running */
+    QIMM_PROJECT_FROZEN, /* hidden, clients are stopped by SIGSTOP */
+};
+
 struct qimm_project {
     struct wl_list link; /* qimm_output::projects */
     struct qimm_output *output;
@@ -105,12 +172,27 @@ struct qimm_project {
     char *config_name;
     struct qimm_project_config *config;
 
+    /* the image shown under layouts, NULL for none */
+    struct qimm_data_background *background;
+
     /*
      * the current client layout in project
      * need to be updated when output, client and layout config changed.
      */
     struct wl_list layouts; /* qimm_layout::link */
     struct qimm_output *output_layouted; /* last layout output */
+    struct weston_geometry area_layouted; /* output area of last layout */
+    struct qimm_layout *dirty_first; /* the first dirty layout */
+    int dirty_count;
+
+    /* painted fully once, see qimm_startup_mark */
+    bool painted;
+
+    /* managed by lifecycle when project is hidden */
+    enum qimm_project_state state;
+    struct wl_list lru_link; /* qimm_lifecycle::lru */
+    struct timespec hide_time;
+    uint64_t cpu_time; /* cpu ticks of clients at last sample */
 };
 
 /*
@@ -124,6 +206,10 @@ struct qimm_project_config {
     struct wl_list themes; /* qimm_project_config_theme::link */
     struct wl_list types; /* qimm_project_config_type::link */
     struct wl_list layouts; /* qimm_project_config_layout::link */
+
+    /* the mapped cache image when loaded from cache, see config cache */
+    void *image;
+    size_t image_size;
 };
 struct qimm_project_config_theme {
     struct wl_list link; /* qimm_project_config::themes */
@@ -146,6 +232,22 @@ struct qimm_project_config_layout {
     /* location in config */
     int32_t x, y;
     int32_t w, h;
+
+    /* limits of size, 0 for no limit */
+    int32_t min_w, min_h;
+    int32_t max_w, max_h;
+    /* share of free width in its row, 0 to keep its width */
+    int32_t weight;
+    /* max frames per second of surface, 0 for no limit */
+    int32_t fps;
+};
+
+/*
+ * The state of row flow before a layout, see qimm_layout_project_update
+ */
+struct qimm_layout_flow {
+    int32_t dx; /* right of the row */
+    int32_t dy, dy2; /* top and bottom of the row */
 };
 
 /*
@@ -157,10 +259,23 @@ struct qimm_layout {
 
     struct qimm_project *project;
     struct qimm_project_config_layout *config_layout;
+    int index; /* position in project layouts */
 
     /* location in runtime, update if necessray */
     int32_t x, y;
     int32_t w, h;
+    /* size requested at runtime, 0 to follow config */
+    int32_t request_w, request_h;
+    /* size sent to surface, to skip configure of the same size */
+    int32_t sent_w, sent_h;
+
+    /* recomputed with its row in next update */
+    bool dirty;
+    /* the first layout in a row keeps the flow to recompute the row */
+    bool row_start;
+    struct qimm_layout_flow flow;
+    /* kept by config reload, see qimm_layout_project_reload */
+    bool reload_matched;
 
     /*
      * filled when client process started
@@ -168,24 +283,138 @@ struct qimm_layout {
      * used to find layout for client surface
      */
     struct qimm_client *client;
+    struct wl_list client_link; /* qimm_client::layouts */
+    /* the client to launch for layout, NULL when launched */
+    struct qimm_client_startup *startup;
+
+    /* the surface rendering this layout, NULL until client creates it */
+    struct qimm_surface *surface;
+    /* the last frame shown until surface is mapped, see snapshot */
+    struct qimm_placeholder *placeholder;
+
+    /* waiting for surface commit in layout transaction */
+    struct wl_list transaction_link; /* qimm_transaction::layouts */
+
+    /* frame callbacks held to cap fps, NULL until throttled */
+    struct qimm_throttle *throttle;
+    uint64_t frames; /* committed by surface */
+    uint64_t frames_throttled; /* with frame callbacks held */
 };
 
 /*
  * The client to render layout for project
  */
 struct qimm_client {
+    struct qimm_shell *shell; /* NULL after shell destroyed */
     struct wl_client *client;
-    struct wl_resource *resource;
+    struct wl_resource *resource; /* qimm_desktop_shell, version >= 3 */
+    struct wl_listener resource_destroy_listener;
     struct wl_listener destroy_listener;
+    struct qimm_hash_node index_node; /* qimm_index::clients */
 
     struct weston_surface *surface;
 
+    /* the client process, used to freeze and measure it */
+    pid_t pid;
+
+    /* used to measure client startup */
+    struct timespec launch_time;
+
+    /* the last layout transaction sent to resource */
+    uint32_t transaction_serial;
+
     /*
      * filled when client process started
      * used to clear client field in layout when client destroyed
+     *
+     * one layout for each client by default,
+     * all layouts of a project when client_share is set in shell
      */
+    struct wl_list layouts; /* qimm_layout::client_link */
+};
+/*
+ * The zygote is a pre-initialised qimm-client process.
+ * It forks a ready child for each layout client, so the client need not
+ * to pay for exec, dynamic linking and font initialization again.
+ */
+struct qimm_zygote {
+    pid_t pid;
+    int sock; /* control socket, see qimm_zygote_send_request */
+    struct wl_event_source *source;
+};
+
+/*
+ * The lifecycle manager hibernates hidden projects:
+ *     idle -> frozen (SIGSTOP) -> stopped (clients destroyed)
+ * Hidden projects are frozen after freeze_delay, or earlier when they
+ * use more cpu than cpu_budget. The least recently shown projects are
+ * evicted when hidden projects use more memory than memory_budget.
+ */
+struct qimm_lifecycle {
+    struct qimm_shell *shell;
+    struct wl_event_source *timer;
+
+    int freeze_delay; /* ms, -1 to never freeze */
+    uint64_t memory_budget; /* bytes, 0 for no limit */
+    int cpu_budget; /* percent of one cpu, 0 for no limit */
+
+    struct wl_list lru; /* qimm_project::lru_link, most recent first */
+};
+
+/*
+ * The metrics sampler reads procfs once per tick for all clients,
+ * and writes samples to the ring shared with them, see share.h.
+ * It only ticks when there are clients reading metrics.
+ */
+struct qimm_metrics {
+    struct qimm_shell *shell;
+    struct wl_event_source *timer;
+    struct wl_list resources; /* qimm_desktop_metrics resources */
+
+    struct qimm_metrics_ring *ring;
+    size_t size;
+    int fd; /* writable memfd of ring */
+    int reader_fd; /* read-only fd for clients */
+
+    /* procfs files read from start at each tick */
+    int stat_fd;
+    int meminfo_fd;
+    int netdev_fd;
+    int diskstats_fd;
+    char **disks; /* names of disks in diskstats, NULL terminated */
+    char *buf;
+};
+
+/*
+ * The layout transaction shows layouts resized together in one repaint,
+ * e.g. when an output is plugged or a project is shown.
+ *
+ * Layouts resized between begin and commit join the transaction, the
+ * repaint of their outputs is held until all surfaces committed the new
+ * sizes, or their clients acked the transaction, or the deadline passed.
+ */
+struct qimm_transaction {
+    struct qimm_shell *shell;
+    struct wl_event_source *timer; /* deadline */
+
+    uint32_t serial;
+    int depth; /* nested begin */
+    int pending; /* count of layouts */
+    struct wl_list layouts; /* qimm_layout::transaction_link */
+};
+
+/*
+ * The throttle caps fps of layout surface by holding its frame callbacks,
+ * the done events are sent once per interval at most.
+ */
+struct qimm_throttle {
     struct qimm_layout *layout;
+    struct wl_event_source *timer;
+    struct wl_list callbacks; /* wl_callback resources */
+    struct timespec last_done;
+    bool armed;
 };
+
 /*
  * client start helper
  * client == NULL when error
@@ -258,6 +487,37 @@ void
 qimm_layer_for_each(struct qimm_shell *shell,
                     qimm_layer_for_each_func_t func, void *data);
 
+/* --------- index --------- */
+void
+qimm_index_init(struct qimm_shell *shell);
+void
+qimm_index_release(struct qimm_shell *shell);
+int
+qimm_index_client_add(struct qimm_client *client);
+void
+qimm_index_client_remove(struct qimm_client *client);
+struct qimm_client *
+qimm_index_find_client(struct qimm_shell *shell, struct wl_client *client);
+int
+qimm_index_output_add(struct qimm_output *output);
+void
+qimm_index_output_remove(struct qimm_output *output);
+struct qimm_output *
+qimm_index_find_output(struct qimm_shell *shell, const char *name);
+/*
+ * index types of config, remove them before config freed
+ */
+int
+qimm_index_config_add(struct qimm_shell *shell,
+                      struct qimm_project_config *config);
+void
+qimm_index_config_remove(struct qimm_shell *shell,
+                         struct qimm_project_config *config);
+struct qimm_project_config_type *
+qimm_index_find_type(struct qimm_shell *shell,
+                     struct qimm_project_config *config,
+                     const char *name);
+
 /* --------- output --------- */
 void
 qimm_output_init(struct qimm_shell *shell);
@@ -283,10 +543,192 @@ qimm_output_project_move(struct qimm_output *from);
  */
 void
 qimm_output_project_restore(struct qimm_output *to);
+/*
+ * start to measure switch latency of project in output
+ */
+void
+qimm_output_switch_start(struct qimm_output *output);
 
 /* --------- process --------- */
 struct wl_client *
-qimm_process_launch(struct weston_compositor *compositor, char *const argv[]);
+qimm_process_launch(struct weston_compositor *compositor, char *const argv[],
+                    pid_t *pid);
+
+pid_t
+qimm_process_spawn(char *const argv[], const char *env, int sockfd);
+
+/*
+ * user and system time of process in clock ticks, 0 when it is gone
+ */
+uint64_t
+qimm_process_cpu_time(pid_t pid);
+
+/* --------- zygote --------- */
+int
+qimm_zygote_init(struct qimm_shell *shell);
+void
+qimm_zygote_release(struct qimm_shell *shell);
+struct wl_client *
+qimm_zygote_launch(struct qimm_shell *shell, char *const argv[], pid_t *pid);
+
+/* --------- lifecycle --------- */
+int
+qimm_lifecycle_init(struct qimm_shell *shell);
+void
+qimm_lifecycle_release(struct qimm_shell *shell);
+/*
+ * hide current project in its output and resume project to show
+ */
+void
+qimm_lifecycle_project_show(struct qimm_project *project);
+/*
+ * resume and forget project when it is removed from output
+ */
+void
+qimm_lifecycle_project_remove(struct qimm_project *project);
+/*
+ * start the project which is most likely shown next in output
+ */
+void
+qimm_lifecycle_output_prefetch(struct qimm_output *output);
+
+/* --------- snapshot --------- */
+int
+qimm_snapshot_init(struct qimm_shell *shell);
+void
+qimm_snapshot_release(struct qimm_shell *shell);
+/*
+ * keep the last frame of each mapped layout in project
+ */
+void
+qimm_snapshot_project_capture(struct qimm_project *project);
+/*
+ * keep the content of surface as the last frame of layout
+ */
+void
+qimm_snapshot_layout_capture(struct qimm_layout *layout,
+                             struct weston_surface *surface);
+/*
+ * show placeholders for layouts without mapped surface
+ */
+void
+qimm_snapshot_project_show(struct qimm_project *project);
+void
+qimm_snapshot_project_hide(struct qimm_project *project);
+/*
+ * the placeholder of layout is committed and in its layer
+ */
+bool
+qimm_snapshot_layout_shown(struct qimm_layout *layout);
+/*
+ * drop placeholder of layout when its surface mapped or layout cleared
+ */
+void
+qimm_snapshot_layout_release(struct qimm_layout *layout);
+/*
+ * drop all snapshots of project when it is destroyed
+ */
+void
+qimm_snapshot_project_forget(struct qimm_project *project);
+
+/* --------- buffer --------- */
+int
+qimm_buffer_init(struct qimm_shell *shell);
+void
+qimm_buffer_release(struct qimm_shell *shell);
+/*
+ * an ARGB8888 shm buffer of the internal client, its pixels are written
+ * by shell before it is attached
+ */
+struct qimm_buffer *
+qimm_buffer_create(struct qimm_shell *shell, int32_t width, int32_t height);
+void *
+qimm_buffer_get_data(struct qimm_buffer *buffer);
+void
+qimm_buffer_destroy(struct qimm_buffer *buffer);
+/*
+ * a surface of the internal client, `committed` is called with its weston
+ * surface when compositor handled a commit of attached buffer
+ */
+typedef void (*qimm_buffer_committed_func_t)(struct weston_surface *surface,
+                                             void *data);
+struct qimm_buffer_surface *
+qimm_buffer_surface_create(struct qimm_shell *shell,
+                           qimm_buffer_committed_func_t committed,
+                           void *data);
+void
+qimm_buffer_surface_attach(struct qimm_buffer_surface *surface,
+                           struct qimm_buffer *buffer);
+void
+qimm_buffer_surface_destroy(struct qimm_buffer_surface *surface);
+
+/* --------- background --------- */
+int
+qimm_background_init(struct qimm_shell *shell);
+void
+qimm_background_release(struct qimm_shell *shell);
+/*
+ * show background of current project in output, scaled for output size
+ */
+void
+qimm_background_output_update(struct qimm_output *output);
+void
+qimm_background_output_remove(struct qimm_output *output);
+
+/* --------- metrics --------- */
+int
+qimm_metrics_init(struct qimm_shell *shell);
+void
+qimm_metrics_release(struct qimm_shell *shell);
+/*
+ * create metrics resource for client, see get_metrics request
+ */
+void
+qimm_metrics_add_client(struct qimm_shell *shell,
+                        struct wl_client *client,
+                        uint32_t version, uint32_t id);
+
+/* --------- transaction --------- */
+int
+qimm_transaction_init(struct qimm_shell *shell);
+void
+qimm_transaction_release(struct qimm_shell *shell);
+void
+qimm_transaction_begin(struct qimm_shell *shell);
+void
+qimm_transaction_commit(struct qimm_shell *shell);
+/*
+ * called when configure of layout is sent
+ */
+void
+qimm_transaction_layout_add(struct qimm_layout *layout);
+void
+qimm_transaction_layout_committed(struct qimm_layout *layout);
+void
+qimm_transaction_layout_remove(struct qimm_layout *layout);
+/*
+ * see ack_layout_transaction request
+ */
+void
+qimm_transaction_ack(struct qimm_shell *shell, struct qimm_client *client,
+                     uint32_t serial);
+void
+qimm_transaction_output_remove(struct qimm_output *output);
+
+/* --------- throttle --------- */
+/*
+ * called before the frame callbacks of commit are applied to surface
+ */
+void
+qimm_throttle_layout_committed(struct qimm_layout *layout,
+                               struct weston_surface *surface);
+void
+qimm_throttle_layout_release(struct qimm_layout *layout);
+/*
+ * log frame counters and cpu time of layouts in shown projects
+ */
+void
+qimm_throttle_log(struct qimm_shell *shell);
 
 /* --------- client --------- */
 int
@@ -297,6 +739,12 @@ void
 qimm_client_start(struct qimm_client_startup *startup);
 void
 qimm_client_project_start(struct qimm_project *project);
+/*
+ * find layout in client by app id of surface,
+ * or the first layout without surface when app id is unknown
+ */
+struct qimm_layout *
+qimm_client_find_layout(struct qimm_client *client, const char *app_id);
 
 /* --------- project --------- */
 struct qimm_project *
@@ -309,6 +757,13 @@ struct qimm_project *
 qimm_project_create_assistant(struct qimm_shell *shell);
 void
 qimm_project_destroy(struct qimm_project *project);
+/*
+ * setup project read from data directory and add it to its output
+ */
+struct qimm_project *
+qimm_project_merge(struct qimm_shell *shell,
+                   const char *name,
+                   struct qimm_project *project);
 
 int
 qimm_project_load(struct qimm_shell *shell);
@@ -318,39 +773,388 @@ qimm_project_unload(struct qimm_shell *shell);
 void
 qimm_project_show(struct qimm_project *project);
 
+/* --------- project loader --------- */
+/*
+ * load projects in data directory on worker threads,
+ * return when each output has a project to show.
+ */
+int
+qimm_project_loader_start(struct qimm_shell *shell);
+/*
+ * load a project saved in data directory after startup, in this thread
+ */
+struct qimm_project *
+qimm_project_loader_load(struct qimm_shell *shell, const char *name);
+void
+qimm_project_loader_stop(struct qimm_shell *shell);
+
 /* --------- config --------- */
+/*
+ * load config from compiled cache in cache_path if it is valid,
+ * otherwise parse yaml and update the cache.
+ * cache_path can be NULL to disable cache.
+ */
 void *
-qimm_config_project_load(const char *name, const char *config_name);
+qimm_config_project_load(const char *name, const char *config_name,
+                         const char *cache_path);
 void
 qimm_config_project_free(void *project_config);
 
+/* --------- config cache --------- */
+uint64_t
+qimm_config_cache_hash(const void *data, size_t size);
+/*
+ * source is stat of the yaml file and source_hash is hash of the bytes
+ * parsed into config, both taken when it is read
+ */
+int
+qimm_config_cache_write(const char *path, const struct stat *source,
+                        uint64_t source_hash,
+                        struct qimm_project_config *config);
+/*
+ * return NULL when cache is missing, stale or broken
+ */
+struct qimm_project_config *
+qimm_config_cache_load(const char *path, const char *source);
+void
+qimm_config_cache_free(struct qimm_project_config *config);
+
 /* --------- layout --------- */
 int
 qimm_layout_project_init(struct qimm_project *project);
 void
 qimm_layout_project_clear(struct qimm_project *project);
 /*
- * find layout for wayland client sureface
+ * find layout for wayland client sureface by client and app id
  * NOTE: find in all output and all project in shell
- *       for project preload reseaon
+ *       for project preload reseaon, by client index
  */
 struct qimm_layout *
-qimm_layout_find_by_client(struct qimm_shell *shell, struct wl_client *client);
+qimm_layout_find_by_client(struct qimm_shell *shell,
+                           struct wl_client *client,
+                           const char *app_id);
+/*
+ * place layouts of project in its output by row flow,
+ * only the rows with dirty layouts are recomputed if output is not resized,
+ * and only surfaces with changed geometry are configured.
+ */
 int
 qimm_layout_project_update(struct qimm_project *project);
+/*
+ * recompute all layouts in next update, e.g. layouts config changed
+ */
+void
+qimm_layout_project_invalidate(struct qimm_project *project);
+/*
+ * resize layout at runtime, w or h <= 0 to follow config
+ */
+void
+qimm_layout_resize(struct qimm_layout *layout, int32_t w, int32_t h);
+/*
+ * match layouts with configs again after common or project config is
+ * replaced, the old configs are still valid, NULL when not replaced.
+ * The layouts of the same name keep their clients, the removed ones stop
+ * their clients, the new ones start clients when project is shown.
+ * return true when layouts need an update.
+ */
+bool
+qimm_layout_project_reload(struct qimm_project *project,
+                           struct qimm_project_config *common,
+                           struct qimm_project_config *config);
 
 /* --------- data --------- */
+#define QIMM_DATA_DIR_MODE (S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH)
+#define QIMM_DATA_FILE_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
+
 char *
 qimm_data_path(void);
+char *
+qimm_data_cache_path(const char *data_path);
 int
 qimm_data_save_project(struct qimm_project *project);
 void *
 qimm_data_read_project(struct qimm_shell *shell, const char *name);
+bool
+qimm_data_project_exists(struct qimm_shell *shell, const char *name);
 int
 qimm_data_save_background(struct qimm_project *project,
                           struct qimm_data_background *background);
+/*
+ * return NULL when project has no background
+ */
+struct qimm_data_background *
+qimm_data_read_background(struct qimm_shell *shell, const char *name);
+void
+qimm_data_background_free(struct qimm_data_background *background);
+/*
+ * call func with name of each saved project, stop when func returns -1
+ */
+int
+qimm_data_for_each_project(struct qimm_shell *shell,
+                           int (*func)(const char *name, void *data),
+                           void *data);
+/*
+ * call func with content of each file of project, stop when it returns -1,
+ * the content is valid in func only.
+ */
+typedef int (*qimm_data_file_func_t)(const char *file, const char *value,
+                                     size_t size, void *data);
+int
+qimm_data_for_each_file(struct qimm_shell *shell, const char *name,
+                        qimm_data_file_func_t func, void *data);
+int
+qimm_data_put_file(struct qimm_shell *shell, const char *name,
+                   const char *file, const void *value, size_t size);
+
+/* --------- data store --------- */
+int
+qimm_data_store_init(struct qimm_shell *shell);
+/*
+ * commit and close the log, after data writer is released
+ */
+void
+qimm_data_store_release(struct qimm_shell *shell);
+struct qimm_data_store *
+qimm_data_store_open(const char *data_path);
+void
+qimm_data_store_close(struct qimm_data_store *store);
+/*
+ * return the key of file path in data directory, NULL when not in it
+ */
+const char *
+qimm_data_store_key(struct qimm_data_store *store, const char *path);
+/*
+ * append value of key to log, it is durable after commit
+ */
+int
+qimm_data_store_write(struct qimm_data_store *store, const char *key,
+                      const void *value, size_t size);
+int
+qimm_data_store_commit(struct qimm_data_store *store);
+/*
+ * call func with the mapped value of key and return its result,
+ * return NULL when key is not found. The value is valid in func only.
+ */
+typedef void *(*qimm_data_store_read_func_t)(const char *value, size_t size,
+                                              void *data);
+void *
+qimm_data_store_read(struct qimm_data_store *store, const char *key,
+                     qimm_data_store_read_func_t func, void *data);
+bool
+qimm_data_store_contains(struct qimm_data_store *store, const char *key);
+int
+qimm_data_store_for_each(struct qimm_data_store *store,
+                         int (*func)(const char *key, void *data),
+                         void *data);
+int
+qimm_data_store_export(struct qimm_data_store *store);
+
+/* --------- data writer --------- */
+int
+qimm_data_writer_init(struct qimm_shell *shell);
+/*
+ * write all dirty datas and stop the writer thread
+ */
+void
+qimm_data_writer_release(struct qimm_shell *shell);
+/*
+ * save data to path later, path and data are owned by writer,
+ * data is a snapshot freed by free_data after written.
+ */
+int
+qimm_data_writer_save(struct qimm_shell *shell, char *path,
+                      qimm_yaml_write_data_func_t func,
+                      void *data, void (*free_data)(void *data));
+
+/* --------- search --------- */
+enum qimm_search_field {
+    QIMM_SEARCH_FIELD_NAME, /* name of project */
+    QIMM_SEARCH_FIELD_CONFIG, /* name of config */
+    QIMM_SEARCH_FIELD_TYPE, /* names and summaries of types */
+    QIMM_SEARCH_FIELD_DATA, /* saved fields */
+    QIMM_SEARCH_FIELD_COUNT,
+};
+
+struct qimm_search_result {
+    const char *name; /* valid until the index is updated */
+    uint32_t score;
+};
+
+struct qimm_search *
+qimm_search_create(void);
+void
+qimm_search_destroy(struct qimm_search *search);
+/*
+ * replace words of project with words in texts of fields,
+ * NULL for field without text
+ */
+int
+qimm_search_update(struct qimm_search *search, const char *name,
+                   const char *const fields[QIMM_SEARCH_FIELD_COUNT]);
+void
+qimm_search_remove(struct qimm_search *search, const char *name);
+/*
+ * find projects having all words of query, as prefix of their words,
+ * ranked by score. return count of results, at most max.
+ */
+int
+qimm_search_query(struct qimm_search *search, const char *query,
+                  struct qimm_search_result *results, int max);
+
+int
+qimm_search_init(struct qimm_shell *shell);
+void
+qimm_search_release(struct qimm_shell *shell);
+/*
+ * index project with its background, called when its datas are saved
+ */
+void
+qimm_search_project_update(struct qimm_project *project,
+                           struct qimm_data_background *background);
+
+/* --------- startup --------- */
+#define QIMM_STARTUP_SCOPE "qimm-startup"
+
+void
+qimm_startup_init(struct qimm_shell *shell);
+void
+qimm_startup_release(struct qimm_shell *shell);
+/*
+ * trace a startup phase with optional detail, e.g. name of project
+ */
+void
+qimm_startup_mark(struct qimm_shell *shell, const char *phase,
+                  const char *detail);
+
+/* --------- reload --------- */
+/*
+ * watch configs and project datas, apply the changes to live projects
+ */
+int
+qimm_reload_init(struct qimm_shell *shell);
+void
+qimm_reload_release(struct qimm_shell *shell);
+void
+qimm_reload_project_add(struct qimm_project *project);
+void
+qimm_reload_project_remove(struct qimm_project *project);
+
+/* --------- sync --------- */
+struct qimm_sync_peer;
+
+struct qimm_sync_stat {
+    uint64_t bytes; /* of all files */
+    uint64_t chunks; /* of all files */
+    uint64_t bytes_sent; /* of chunks transferred */
+    uint64_t chunks_sent;
+    uint64_t nsec;
+};
+
+/*
+ * open peer by "unix:<socket path>" of qimm-syncd, or directory path
+ */
+struct qimm_sync_peer *
+qimm_sync_peer_open(const char *spec);
+void
+qimm_sync_peer_close(struct qimm_sync_peer *peer);
+/*
+ * names of projects in peer, free with free_command_line
+ */
+char **
+qimm_sync_peer_list(struct qimm_sync_peer *peer);
+/*
+ * serve requests from socket with peer until the socket is closed
+ */
+int
+qimm_sync_peer_serve(struct qimm_sync_peer *peer, int fd);
+/*
+ * send files of project changed since last export to peer,
+ * safe to call from any thread
+ */
+int
+qimm_sync_project_export(struct qimm_shell *shell, const char *name,
+                         struct qimm_sync_peer *peer,
+                         struct qimm_sync_stat *stat);
+/*
+ * fetch files of project changed in peer, files not in peer are kept
+ */
+int
+qimm_sync_project_import(struct qimm_shell *shell, const char *name,
+                         struct qimm_sync_peer *peer,
+                         struct qimm_sync_stat *stat);
+/*
+ * import projects of peer not saved locally in background,
+ * and load them when imported
+ */
+int
+qimm_sync_init(struct qimm_shell *shell);
+/*
+ * wait for the import or export in progress
+ */
+void
+qimm_sync_release(struct qimm_shell *shell);
+/*
+ * export project to peer in background, one at a time
+ */
+int
+qimm_sync_project_push(struct qimm_project *project);
+
+/* --------- desktop --------- */
+/*
+ * move views of project to its layers, the background of project
+ * is shown in background layer only when project is current one
+ */
+void
+qimm_surface_project_update_layer(struct qimm_project *project);
+/*
+ * configure surface of layout when its size or position changed
+ */
+void
+qimm_surface_layout_update(struct qimm_layout *layout);
+/*
+ * hide surface of the removed layout, its client keeps running
+ */
+void
+qimm_surface_layout_remove(struct qimm_layout *layout);
 
 /* --------- shell --------- */
+/*
+ * the functions of shell for the modules in the same compositor, e.g. the
+ * benchmarks on weston test harness, registered as a plugin api.
+ * the calls go to the loaded shell, not to a copy linked in the module.
+ */
+#define QIMM_SHELL_API_NAME "qimm_shell_v1"
+
+struct qimm_shell_api {
+    /* the shell running in compositor */
+    struct qimm_shell *(*get)(struct weston_compositor *compositor);
+
+    struct qimm_project *(*project_create)(struct qimm_shell *shell,
+                                           const char *name,
+                                           const char *config_name);
+    void (*project_destroy)(struct qimm_project *project);
+    void (*project_show)(struct qimm_project *project);
+
+    void (*output_project_remove)(struct qimm_project *project);
+    int (*output_project_move)(struct qimm_output *from);
+    void (*output_project_restore)(struct qimm_output *to);
+
+    int (*index_client_add)(struct qimm_client *client);
+    void (*index_client_remove)(struct qimm_client *client);
+    struct qimm_layout *(*layout_find_by_client)(struct qimm_shell *shell,
+                                                 struct wl_client *client,
+                                                 const char *app_id);
+
+    void (*transaction_begin)(struct qimm_shell *shell);
+    void (*transaction_commit)(struct qimm_shell *shell);
+};
+
+static inline const struct qimm_shell_api *
+qimm_shell_get_api(struct weston_compositor *compositor) {
+    return weston_plugin_api_get(compositor, QIMM_SHELL_API_NAME,
+                                 sizeof(struct qimm_shell_api));
+}
+
 struct qimm_output *
 qimm_shell_get_focus_output(struct qimm_shell *shell);
 struct qimm_project *
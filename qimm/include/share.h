@@ -26,14 +26,19 @@
 
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <sys/param.h>
 #include <linux/limits.h>
 #include <linux/input.h>
 #include <stdio.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <inttypes.h>
 #include <string.h>
 #include <getopt.h>
 #include <assert.h>
@@ -41,6 +46,7 @@
 #include <signal.h>
 #include <stdarg.h>
 #include <dirent.h>
+#include <pthread.h>
 #include <wayland-version.h>
 #include <wayland-util.h>
 #include <yaml.h>
@@ -49,6 +55,7 @@
 #include "shared/helpers.h"
 #include "shared/file-util.h"
 #include "shared/os-compatibility.h"
+#include "shared/timespec-util.h"
 #include "libweston/version.h"
 #include "libweston/libweston.h"
 #include "libweston-desktop/libweston-desktop.h"
@@ -68,19 +75,41 @@ extern "C" {
 
 /* literal only */
 #define qimm_log(fmt, ...) \
-    weston_log("[qimm] [%s:%d] " fmt "\n", _QIMM_FILE, __LINE__, ##__VA_ARGS__)
+    qimm_log_print("[qimm] [%s:%d] " fmt "\n", _QIMM_FILE, __LINE__, \
+                   ##__VA_ARGS__)
 
 /* literal & char * */
 #define qimm_plog(m, f, ...) ({          \
     char *j;                             \
     int l = asprintf(&j, "[qimm] [%s:%d] %s %s\n", _QIMM_FILE, __LINE__, m, f); \
     if (l == -1) {                       \
-        weston_log(f, ##__VA_ARGS__);    \
+        qimm_log_print(f, ##__VA_ARGS__); \
     } else {                             \
-        weston_log(j, ##__VA_ARGS__);    \
+        qimm_log_print(j, ##__VA_ARGS__); \
         free(j);                         \
     } })
 
+/*
+ * weston_log is not thread-safe. A worker thread keeps its log in a
+ * qimm_log_defer between begin and end, and the main thread writes it
+ * out with flush, e.g. when the result of the job is merged.
+ */
+struct qimm_log_defer {
+    char *buf;
+    size_t size;
+    FILE *fp; /* the log of this thread goes here, NULL when ended */
+};
+
+void
+qimm_log_print(const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+void
+qimm_log_defer_begin(struct qimm_log_defer *defer);
+void
+qimm_log_defer_end(struct qimm_log_defer *defer);
+/* main thread only, the defer is empty after */
+void
+qimm_log_defer_flush(struct qimm_log_defer *defer);
+
 /* --------- file --------- */
 char *
 qimm_get_module_path(const char *name);
@@ -133,11 +162,173 @@ qimm_yaml_read_sequence(yaml_parser_t *parser, yaml_event_t *event,
 
 typedef int (*qimm_yaml_write_data_func_t)(yaml_emitter_t *emitter,
                                            void *data);
+/*
+ * write document to an opened file, the file is not closed
+ */
+int
+qimm_yaml_write_file(FILE *file,
+                     qimm_yaml_write_data_func_t func,
+                     void *data);
 int
 qimm_yaml_write_document(const char *path,
                          qimm_yaml_write_data_func_t func,
                          void *data);
 
+/* --------- lifecycle --------- */
+/* seconds to freeze hidden project, -1 to never freeze */
+#define QIMM_FREEZE_DELAY "QIMM_FREEZE_DELAY"
+/* MiB of memory for hidden projects, 0 for no limit */
+#define QIMM_HIDDEN_MEMORY "QIMM_HIDDEN_MEMORY"
+/* percent of one cpu for hidden projects, 0 for no limit */
+#define QIMM_HIDDEN_CPU "QIMM_HIDDEN_CPU"
+
+/* --------- data --------- */
+/* the environment variable to select data store: yaml (default) or log */
+#define QIMM_DATA_STORE "QIMM_DATA_STORE"
+/* the environment variable of peer to sync projects, see qimm_sync_peer_open */
+#define QIMM_SYNC_PEER "QIMM_SYNC_PEER"
+
+/* --------- zygote --------- */
+/* the environment variable to select client mode: zygote (default) or exec */
+#define QIMM_CLIENT_MODE "QIMM_CLIENT_MODE"
+/* the environment variable to start one client for all layouts in project */
+#define QIMM_CLIENT_SHARE "QIMM_CLIENT_SHARE"
+/*
+ * the environment variable to pass control socket to zygote,
+ * like WAYLAND_SOCKET to pass wayland socket to client
+ */
+#define QIMM_ZYGOTE_SOCKET "QIMM_ZYGOTE_SOCKET"
+#define QIMM_ZYGOTE_MSG_MAX 8192
+
+/*
+ * request zygote to fork a client with command line args,
+ * fd is the wayland socket for the new client
+ */
+int
+qimm_zygote_send_request(int sock, int fd, char *const argv[]);
+/*
+ * return args of the request, free with free_command_line
+ * return NULL when error or the shell has gone
+ */
+char **
+qimm_zygote_recv_request(int sock, int *fd);
+int
+qimm_zygote_send_reply(int sock, pid_t pid);
+pid_t
+qimm_zygote_recv_reply(int sock);
+
+/* --------- metrics --------- */
+/*
+ * The system metrics sampled by shell, shared with clients by a ring
+ * in sealed memfd, see qimm_desktop_metrics in qimm-desktop-shell.xml.
+ *
+ * Each slot is guarded by a sequence lock: the seq is odd while the shell
+ * is writing the slot, readers copy the sample and retry when the seq
+ * changed, so readers never block the shell.
+ */
+#define QIMM_METRICS_MAGIC 0x4d4d4951 /* "QIMM" */
+#define QIMM_METRICS_VERSION 1
+#define QIMM_METRICS_SLOTS 64
+#define QIMM_METRICS_INTERVAL 1000 /* ms */
+
+struct qimm_metrics_sample {
+    uint64_t number; /* the head of ring when written */
+    uint64_t time; /* realtime in ms */
+
+    /* cpu time of all cpus in clock ticks since boot */
+    uint64_t cpu_total;
+    uint64_t cpu_idle;
+    /* bytes */
+    uint64_t mem_total;
+    uint64_t mem_available;
+    /* bytes since boot, of all network interfaces except loopback */
+    uint64_t net_rx;
+    uint64_t net_tx;
+    /* bytes since boot, of all disks */
+    uint64_t disk_read;
+    uint64_t disk_write;
+};
+struct qimm_metrics_slot {
+    uint32_t seq;
+    uint32_t padding;
+    struct qimm_metrics_sample sample;
+};
+struct qimm_metrics_ring {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size; /* sizeof(struct qimm_metrics_slot) */
+    uint32_t interval; /* ms */
+    uint32_t padding;
+    uint64_t head; /* number of the latest sample, 0 before the first */
+    struct qimm_metrics_slot slots[];
+};
+
+/*
+ * create the ring in a sealed memfd, the fd is writable for the shell,
+ * use qimm_metrics_ring_reader_fd to share it with clients.
+ */
+struct qimm_metrics_ring *
+qimm_metrics_ring_create(int *fd, size_t *size);
+int
+qimm_metrics_ring_reader_fd(int fd);
+/*
+ * return NULL when the mapped ring is not compatible
+ */
+const struct qimm_metrics_ring *
+qimm_metrics_ring_check(const void *map, size_t size);
+void
+qimm_metrics_ring_write(struct qimm_metrics_ring *ring,
+                        struct qimm_metrics_sample *sample);
+/*
+ * read the latest sample, never block.
+ * return -1 when no sample or the slot is being written too often
+ */
+int
+qimm_metrics_ring_read(const struct qimm_metrics_ring *ring,
+                       struct qimm_metrics_sample *sample);
+
+/* --------- hash --------- */
+/*
+ * Intrusive hash table, embed qimm_hash_node in the object to index.
+ * The key is a pointer or a string owned by the object,
+ * nodes with the same key are allowed and the first inserted is found.
+ */
+struct qimm_hash_node {
+    struct qimm_hash_node *next;
+    uint32_t hash;
+    const void *key;
+};
+struct qimm_hash {
+    struct qimm_hash_node **buckets;
+    uint32_t size; /* power of 2 */
+    uint32_t count;
+    bool string_key;
+};
+
+void
+qimm_hash_init(struct qimm_hash *hash, bool string_key);
+void
+qimm_hash_release(struct qimm_hash *hash);
+int
+qimm_hash_insert(struct qimm_hash *hash, struct qimm_hash_node *node,
+                 const void *key);
+void
+qimm_hash_remove(struct qimm_hash *hash, struct qimm_hash_node *node);
+struct qimm_hash_node *
+qimm_hash_find(struct qimm_hash *hash, const void *key);
+/*
+ * remove and return any node, NULL when empty
+ */
+struct qimm_hash_node *
+qimm_hash_pop(struct qimm_hash *hash);
+
+/* --------- sha256 --------- */
+#define QIMM_SHA256_SIZE 32
+
+void
+qimm_sha256(const void *data, size_t size, uint8_t digest[QIMM_SHA256_SIZE]);
+
 /* --------- shares --------- */
 char *
 get_command_line(char *const argv[]);
@@ -150,6 +341,13 @@ empty_region(pixman_region32_t *region);
 void
 random_rgb(float rgb[3]);
 
+/*
+ * create a thread with all signals blocked,
+ * signals are handled by the compositor thread
+ */
+int
+create_worker_thread(pthread_t *thread, void *(*func)(void *), void *data);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -0,0 +1,461 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+
+/*
+ * The compiled config cache is a flat image of qimm_project_config:
+ *
+ *     header | qimm_project_config | themes | types | layouts | strings
+ *
+ * All pointers (strings and wl_list links) in the image are saved as
+ * offsets from the start of image, 0 for NULL. The image is loaded by
+ * one private mmap, and the pointers are relocated in place, so there is
+ * no allocation for each node.
+ */
+#define QIMM_CONFIG_CACHE_MAGIC 0x434d4951 /* "QIMC" */
+#define QIMM_CONFIG_CACHE_VERSION 3
+
+struct qimm_config_cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pointer_size; /* the image is only for the same ABI */
+    uint32_t config_offset;
+    uint64_t size; /* size of whole image */
+
+    /* the source yaml file to validate */
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t source_size;
+    uint64_t source_hash;
+};
+
+/* FNV-1a */
+uint64_t
+qimm_config_cache_hash(const void *data, size_t size) {
+    const unsigned char *p = data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/*
+ * fill source info of header from source yaml file, to validate
+ */
+static int
+qimm_config_cache_source(const char *source,
+                         struct qimm_config_cache_header *header) {
+    int fd = open(source, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return -1;
+
+    header->source_mtime_sec = st.st_mtim.tv_sec;
+    header->source_mtime_nsec = st.st_mtim.tv_nsec;
+    header->source_size = st.st_size;
+    header->source_hash = qimm_config_cache_hash(data, st.st_size);
+
+    munmap(data, st.st_size);
+    return 0;
+}
+
+/* --------- cache: write --------- */
+struct qimm_config_cache_writer {
+    char *buf;
+    size_t size;
+    size_t alloc;
+};
+
+#define CACHE_AT(w, off, type) ((type *) ((w)->buf + (off)))
+#define CACHE_PTR(off) ((void *) (uintptr_t) (off))
+
+/*
+ * alloc zeroed space in image
+ * return offset of the space, 0 when error
+ */
+static size_t
+qimm_config_cache_alloc(struct qimm_config_cache_writer *w, size_t len) {
+    size_t off = (w->size + 7) & ~(size_t) 7;
+    if (off + len > w->alloc) {
+        size_t alloc = w->alloc ? w->alloc : 4096;
+        while (off + len > alloc)
+            alloc *= 2;
+        char *buf = realloc(w->buf, alloc);
+        if (!buf)
+            return 0;
+        memset(buf + w->alloc, 0, alloc - w->alloc);
+        w->buf = buf;
+        w->alloc = alloc;
+    }
+    w->size = off + len;
+    return off;
+}
+
+static size_t
+qimm_config_cache_string(struct qimm_config_cache_writer *w, const char *str) {
+    if (!str)
+        return 0;
+
+    size_t len = strlen(str) + 1;
+    size_t off = qimm_config_cache_alloc(w, len);
+    if (off)
+        memcpy(w->buf + off, str, len);
+    return off;
+}
+
+/*
+ * link nodes in offset space, as wl_list_insert(head->prev, link)
+ */
+static void
+qimm_config_cache_link(struct qimm_config_cache_writer *w,
+                       size_t head, size_t link) {
+    struct wl_list *h = CACHE_AT(w, head, struct wl_list);
+    size_t last = (uintptr_t) h->prev;
+
+    CACHE_AT(w, link, struct wl_list)->prev = CACHE_PTR(last);
+    CACHE_AT(w, link, struct wl_list)->next = CACHE_PTR(head);
+    CACHE_AT(w, last, struct wl_list)->next = CACHE_PTR(link);
+    CACHE_AT(w, head, struct wl_list)->prev = CACHE_PTR(link);
+}
+
+static void
+qimm_config_cache_link_init(struct qimm_config_cache_writer *w, size_t head) {
+    CACHE_AT(w, head, struct wl_list)->prev = CACHE_PTR(head);
+    CACHE_AT(w, head, struct wl_list)->next = CACHE_PTR(head);
+}
+
+/*
+ * NOTE: every alloc may move the buffer,
+ *       so only offsets are kept between allocs
+ */
+static int
+qimm_config_cache_build(struct qimm_config_cache_writer *w,
+                        struct qimm_project_config *config) {
+    size_t off_header = qimm_config_cache_alloc(w, sizeof(struct qimm_config_cache_header));
+    size_t off_config = qimm_config_cache_alloc(w, sizeof *config);
+    if (!w->buf || off_header != 0 || !off_config)
+        return -1;
+
+    size_t off, str;
+#define CONFIG_FIELD(f) (off_config + offsetof(struct qimm_project_config, f))
+    qimm_config_cache_link_init(w, CONFIG_FIELD(themes));
+    qimm_config_cache_link_init(w, CONFIG_FIELD(types));
+    qimm_config_cache_link_init(w, CONFIG_FIELD(layouts));
+
+    if (!(str = qimm_config_cache_string(w, config->name)) && config->name)
+        return -1;
+    CACHE_AT(w, off_config, struct qimm_project_config)->name = CACHE_PTR(str);
+
+    struct qimm_project_config_theme *theme;
+    wl_list_for_each(theme, &config->themes, link) {
+        if (!(off = qimm_config_cache_alloc(w, sizeof *theme)))
+            return -1;
+        struct qimm_project_config_theme t = {0};
+        if (!(str = qimm_config_cache_string(w, theme->name)) && theme->name)
+            return -1;
+        t.name = CACHE_PTR(str);
+        if (!(str = qimm_config_cache_string(w, theme->foreground)) &&
+            theme->foreground)
+            return -1;
+        t.foreground = CACHE_PTR(str);
+        if (!(str = qimm_config_cache_string(w, theme->background)) &&
+            theme->background)
+            return -1;
+        t.background = CACHE_PTR(str);
+        *CACHE_AT(w, off, struct qimm_project_config_theme) = t;
+        qimm_config_cache_link(w, CONFIG_FIELD(themes),
+                off + offsetof(struct qimm_project_config_theme, link));
+    }
+
+    struct qimm_project_config_type *type;
+    wl_list_for_each(type, &config->types, link) {
+        if (!(off = qimm_config_cache_alloc(w, sizeof *type)))
+            return -1;
+        struct qimm_project_config_type t = {0};
+        if (!(str = qimm_config_cache_string(w, type->name)) && type->name)
+            return -1;
+        t.name = CACHE_PTR(str);
+        if (!(str = qimm_config_cache_string(w, type->summary)) &&
+            type->summary)
+            return -1;
+        t.summary = CACHE_PTR(str);
+        *CACHE_AT(w, off, struct qimm_project_config_type) = t;
+        qimm_config_cache_link(w, CONFIG_FIELD(types),
+                off + offsetof(struct qimm_project_config_type, link));
+    }
+
+    struct qimm_project_config_layout *layout;
+    wl_list_for_each(layout, &config->layouts, link) {
+        if (!(off = qimm_config_cache_alloc(w, sizeof *layout)))
+            return -1;
+        struct qimm_project_config_layout l = *layout;
+        if (!(str = qimm_config_cache_string(w, layout->name)) &&
+            layout->name)
+            return -1;
+        l.name = CACHE_PTR(str);
+        *CACHE_AT(w, off, struct qimm_project_config_layout) = l;
+        qimm_config_cache_link(w, CONFIG_FIELD(layouts),
+                off + offsetof(struct qimm_project_config_layout, link));
+    }
+#undef CONFIG_FIELD
+
+    struct qimm_config_cache_header *header =
+            CACHE_AT(w, off_header, struct qimm_config_cache_header);
+    header->magic = QIMM_CONFIG_CACHE_MAGIC;
+    header->version = QIMM_CONFIG_CACHE_VERSION;
+    header->pointer_size = sizeof(void *);
+    header->config_offset = off_config;
+    header->size = w->size;
+    return 0;
+}
+
+int
+qimm_config_cache_write(const char *path, const struct stat *source,
+                        uint64_t source_hash,
+                        struct qimm_project_config *config) {
+    struct qimm_config_cache_writer w = {0};
+    char *tmp = NULL;
+    int ret = -1;
+
+    if (qimm_config_cache_build(&w, config) < 0)
+        goto final;
+
+    /* the source as parsed, the file may be changed since */
+    struct qimm_config_cache_header *header = (void *) w.buf;
+    header->source_mtime_sec = source->st_mtim.tv_sec;
+    header->source_mtime_nsec = source->st_mtim.tv_nsec;
+    header->source_size = source->st_size;
+    header->source_hash = source_hash;
+
+    /* write to temp file and rename, never leave a partial image */
+    if (asprintf(&tmp, "%s.XXXXXX", path) < 0) {
+        tmp = NULL;
+        goto final;
+    }
+    int fd = mkostemp(tmp, O_CLOEXEC);
+    if (fd < 0)
+        goto final;
+
+    size_t done = 0;
+    while (done < w.size) {
+        ssize_t n = write(fd, w.buf + done, w.size - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    close(fd);
+
+    if (done == w.size && rename(tmp, path) == 0)
+        ret = 0;
+    else
+        unlink(tmp);
+
+final:
+    if (ret < 0)
+        qimm_log("config cache write failed: %s", path);
+    free(tmp);
+    free(w.buf);
+    return ret;
+}
+
+/* --------- cache: load --------- */
+struct qimm_config_cache_image {
+    char *base;
+    size_t size;
+};
+
+/*
+ * relocate offset in image to pointer
+ * return -1 when offset is out of image
+ */
+static int
+qimm_config_cache_reloc(struct qimm_config_cache_image *image,
+                        void *ptr, size_t min) {
+    void **p = ptr;
+    uintptr_t off = (uintptr_t) *p;
+    if (off == 0)
+        return 0;
+    if (off > image->size || image->size - off < min)
+        return -1;
+    *p = image->base + off;
+    return 0;
+}
+
+static int
+qimm_config_cache_reloc_string(struct qimm_config_cache_image *image,
+                               char **str) {
+    if (qimm_config_cache_reloc(image, str, 1) < 0)
+        return -1;
+    /* must be terminated in image */
+    if (*str && !memchr(*str, '\0', image->base + image->size - *str))
+        return -1;
+    return 0;
+}
+
+/*
+ * relocate list and call func to relocate each node
+ */
+static int
+qimm_config_cache_reloc_list(struct qimm_config_cache_image *image,
+                             struct wl_list *head,
+                             int (*func)(struct qimm_config_cache_image *,
+                                         struct wl_list *)) {
+    if (qimm_config_cache_reloc(image, &head->prev, sizeof *head) < 0 ||
+        qimm_config_cache_reloc(image, &head->next, sizeof *head) < 0)
+        return -1;
+
+    size_t count = 0;
+    struct wl_list *link;
+    for (link = head->next; link != head; link = link->next) {
+        /* a corrupt image may link nodes in a loop */
+        if (++count > image->size / sizeof *link)
+            return -1;
+        if (qimm_config_cache_reloc(image, &link->next, sizeof *link) < 0 ||
+            qimm_config_cache_reloc(image, &link->prev, sizeof *link) < 0 ||
+            !link->next)
+            return -1;
+        if (func(image, link) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int
+qimm_config_cache_reloc_theme(struct qimm_config_cache_image *image,
+                              struct wl_list *link) {
+    struct qimm_project_config_theme *theme =
+            container_of(link, struct qimm_project_config_theme, link);
+    if ((char *) theme < image->base ||
+        (char *) (theme + 1) > image->base + image->size)
+        return -1;
+    if (qimm_config_cache_reloc_string(image, &theme->name) < 0 ||
+        qimm_config_cache_reloc_string(image, &theme->foreground) < 0 ||
+        qimm_config_cache_reloc_string(image, &theme->background) < 0)
+        return -1;
+    return 0;
+}
+
+static int
+qimm_config_cache_reloc_type(struct qimm_config_cache_image *image,
+                             struct wl_list *link) {
+    struct qimm_project_config_type *type =
+            container_of(link, struct qimm_project_config_type, link);
+    if ((char *) type < image->base ||
+        (char *) (type + 1) > image->base + image->size)
+        return -1;
+    if (qimm_config_cache_reloc_string(image, &type->name) < 0 ||
+        qimm_config_cache_reloc_string(image, &type->summary) < 0)
+        return -1;
+    return 0;
+}
+
+static int
+qimm_config_cache_reloc_layout(struct qimm_config_cache_image *image,
+                               struct wl_list *link) {
+    struct qimm_project_config_layout *layout =
+            container_of(link, struct qimm_project_config_layout, link);
+    if ((char *) layout < image->base ||
+        (char *) (layout + 1) > image->base + image->size)
+        return -1;
+    if (qimm_config_cache_reloc_string(image, &layout->name) < 0)
+        return -1;
+    return 0;
+}
+
+struct qimm_project_config *
+qimm_config_cache_load(const char *path, const char *source) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 ||
+        st.st_size < (off_t) sizeof(struct qimm_config_cache_header)) {
+        close(fd);
+        return NULL;
+    }
+
+    /* private and writable for relocation, pages are copied on write */
+    struct qimm_config_cache_image image;
+    image.size = st.st_size;
+    image.base = mmap(NULL, image.size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image.base == MAP_FAILED)
+        return NULL;
+
+    struct qimm_config_cache_header *header = (void *) image.base;
+    struct qimm_config_cache_header source_header;
+    if (header->magic != QIMM_CONFIG_CACHE_MAGIC ||
+        header->version != QIMM_CONFIG_CACHE_VERSION ||
+        header->pointer_size != sizeof(void *) ||
+        header->size != image.size ||
+        header->config_offset < sizeof *header ||
+        header->config_offset > image.size - sizeof(struct qimm_project_config))
+        goto err;
+
+    /* check mtime and size first, they are cheap */
+    struct stat source_st;
+    if (stat(source, &source_st) < 0 ||
+        source_st.st_mtim.tv_sec != header->source_mtime_sec ||
+        source_st.st_mtim.tv_nsec != header->source_mtime_nsec ||
+        (uint64_t) source_st.st_size != header->source_size)
+        goto err;
+    if (qimm_config_cache_source(source, &source_header) < 0 ||
+        source_header.source_hash != header->source_hash)
+        goto err;
+
+    struct qimm_project_config *config =
+            (void *) (image.base + header->config_offset);
+    if (qimm_config_cache_reloc_string(&image, &config->name) < 0 ||
+        qimm_config_cache_reloc_list(&image, &config->themes,
+                                     qimm_config_cache_reloc_theme) < 0 ||
+        qimm_config_cache_reloc_list(&image, &config->types,
+                                     qimm_config_cache_reloc_type) < 0 ||
+        qimm_config_cache_reloc_list(&image, &config->layouts,
+                                     qimm_config_cache_reloc_layout) < 0)
+        goto err;
+
+    config->image = image.base;
+    config->image_size = image.size;
+    return config;
+
+err:
+    munmap(image.base, image.size);
+    return NULL;
+}
+
+void
+qimm_config_cache_free(struct qimm_project_config *config) {
+    assert(config->image);
+    munmap(config->image, config->image_size);
+}
@@ -38,6 +38,18 @@ qimm_config_project_layout_data(yaml_parser_t *parser, yaml_event_t *event,
         layout->w = qimm_yaml_next_value_int(parser, event);
     else if (!strcmp(key, "h"))
         layout->h = qimm_yaml_next_value_int(parser, event);
+    else if (!strcmp(key, "min_w"))
+        layout->min_w = qimm_yaml_next_value_int(parser, event);
+    else if (!strcmp(key, "min_h"))
+        layout->min_h = qimm_yaml_next_value_int(parser, event);
+    else if (!strcmp(key, "max_w"))
+        layout->max_w = qimm_yaml_next_value_int(parser, event);
+    else if (!strcmp(key, "max_h"))
+        layout->max_h = qimm_yaml_next_value_int(parser, event);
+    else if (!strcmp(key, "weight"))
+        layout->weight = qimm_yaml_next_value_int(parser, event);
+    else if (!strcmp(key, "fps") || !strcmp(key, "max_rate"))
+        layout->fps = qimm_yaml_next_value_int(parser, event);
     else
         return -2;
     return 0;
@@ -55,8 +67,13 @@ qimm_config_project_layout_print(struct qimm_project_config_layout *layout) {
     fprintf(stderr, "\tqimm_project_config_layout:\n"
                     "\t\tname: %s\n"
                     "\t\tx: %5d,  y: %5d\n"
-                    "\t\tw: %5d,  h: %5d\n",
-            layout->name, layout->x, layout->y, layout->w, layout->h);
+                    "\t\tw: %5d,  h: %5d\n"
+                    "\t\tmin: %5d x %5d,  max: %5d x %5d\n"
+                    "\t\tweight: %d\n"
+                    "\t\tfps: %d\n",
+            layout->name, layout->x, layout->y, layout->w, layout->h,
+            layout->min_w, layout->min_h, layout->max_w, layout->max_h,
+            layout->weight, layout->fps);
 }
 
 static struct wl_list *
@@ -221,6 +238,12 @@ qimm_config_project_free(void *project_config) {
     struct qimm_project_config *config = project_config;
     assert(config);
 
+    /* all nodes are in the cache image */
+    if (config->image) {
+        qimm_config_cache_free(config);
+        return;
+    }
+
     struct qimm_project_config_theme *theme, *tmp;
     wl_list_for_each_safe(theme, tmp, &config->themes, link) {
         qimm_config_project_theme_free(theme);
@@ -276,15 +299,39 @@ qimm_config_project_get_path(const char *name) {
 }
 
 void *
-qimm_config_project_load(const char *name, const char *config_name) {
+qimm_config_project_load(const char *name, const char *config_name,
+                         const char *cache_path) {
     char *path = qimm_config_project_get_path(config_name);
     if (!path)
         return NULL;
     qimm_log("project (%s) config with %s", name, path);
 
-    FILE *fh = fopen(path, "r");
-    if (!fh) {
+    char *cache = NULL;
+    if (cache_path &&
+        asprintf(&cache, "%s/%s.bin", cache_path, config_name) < 0)
+        cache = NULL;
+    if (cache) {
+        struct qimm_project_config *config =
+                qimm_config_cache_load(cache, path);
+        if (config) {
+            qimm_log("project (%s) config from cache %s", name, cache);
+            free(cache);
+            free(path);
+            return config;
+        }
+    }
+
+    /* map the file to parse and hash the same bytes for cache */
+    struct stat st;
+    void *data = MAP_FAILED;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0)
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (fd >= 0)
+        close(fd);
+    if (data == MAP_FAILED) {
         qimm_log("project (%s) config failed: open file error", name);
+        free(cache);
         free(path);
         return NULL;
     }
@@ -296,7 +343,7 @@ qimm_config_project_load(const char *name, const char *config_name) {
                  name);
         goto err;
     }
-    yaml_parser_set_input_file(&parser, fh);
+    yaml_parser_set_input_string(&parser, data, st.st_size);
 
     yaml_event_t event;
     event.type = YAML_NO_EVENT; // mark is empty to auto delete in next event
@@ -325,7 +372,12 @@ err_parse:
     yaml_parser_delete(&parser);
 
 err:
-    fclose(fh);
+    if (ret && cache) {
+        uint64_t hash = qimm_config_cache_hash(data, st.st_size);
+        qimm_config_cache_write(cache, &st, hash, ret);
+    }
+    munmap(data, st.st_size);
+    free(cache);
     free(path);
     return ret;
 }
@@ -17,8 +17,6 @@
  */
 #include "qimm.h"
 
-#define DIR_MODE (S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH |S_IXOTH)
-
 char *
 qimm_data_path(void) {
     char *path_config, *path_qimm = NULL;
@@ -26,9 +24,9 @@ qimm_data_path(void) {
 
     if (home_dir)
         if (asprintf(&path_config, "%s/.config", home_dir) > 0) {
-            mkdir(path_config, DIR_MODE);
+            mkdir(path_config, QIMM_DATA_DIR_MODE);
             if (asprintf(&path_qimm, "%s/%s", path_config, QIMM_NAME) > 0)
-                mkdir(path_qimm, DIR_MODE);
+                mkdir(path_qimm, QIMM_DATA_DIR_MODE);
             free(path_config);
         }
 
@@ -43,6 +41,27 @@ qimm_data_path(void) {
     return NULL;
 }
 
+/*
+ * the compiled config cache is next to data directory,
+ * never in it, because each directory in it is a project.
+ */
+char *
+qimm_data_cache_path(const char *data_path) {
+    char *path;
+
+    if (asprintf(&path, "%s.cache", data_path) < 0)
+        return NULL;
+
+    mkdir(path, QIMM_DATA_DIR_MODE);
+    DIR *dir = opendir(path);
+    if (dir) {
+        closedir(dir);
+        return path;
+    }
+    free(path);
+    return NULL;
+}
+
 /* --------- project --------- */
 static char *
 qimm_data_project_path(struct qimm_project *project) {
@@ -113,34 +132,6 @@ err:
     return -1;
 }
 
-/*
- * make data directory for project
- * save project datas when it changed.
- */
-int
-qimm_data_save_project(struct qimm_project *project) {
-    int ret = -1;
-    char *path, *config = NULL;
-
-    path = qimm_data_project_path(project);
-    if (path) {
-        mkdir(path, DIR_MODE);
-        DIR *dir = opendir(path);
-        if (dir) {
-            closedir(dir);
-
-            if (asprintf(&config, "%s/config.yaml", path) > 0)
-                ret = qimm_yaml_write_document(config,
-                                               qimm_data_save_project_func,
-                                               project);
-        }
-    }
-
-    free(path);
-    free(config);
-    return ret;
-}
-
 static void *
 qimm_data_read_project_init() {
     struct qimm_project *project = zalloc(sizeof *project);
@@ -168,11 +159,109 @@ qimm_data_read_project_free(void *obj) {
     free(project);
 }
 
-void *
-qimm_data_read_project(struct qimm_shell *shell, const char *name) {
+/*
+ * save project datas when it changed.
+ * the datas are copied, and written to data directory of project later.
+ */
+int
+qimm_data_save_project(struct qimm_project *project) {
+    char *dir = qimm_data_project_path(project);
+    if (!dir)
+        return -1;
+
     char *path;
+    int len = asprintf(&path, "%s/config.yaml", dir);
+    free(dir);
+    if (len < 0)
+        return -1;
+
+    struct qimm_project *copy = qimm_data_read_project_init();
+    if (!copy) {
+        free(path);
+        return -1;
+    }
+    if (project->config_name)
+        copy->config_name = strdup(project->config_name);
+    if (project->output_name)
+        copy->output_name = strdup(project->output_name);
+
+    qimm_search_project_update(project, project->background);
+    return qimm_data_writer_save(project->shell, path,
+                                 qimm_data_save_project_func, copy,
+                                 qimm_data_read_project_free);
+}
 
-    if (asprintf(&path, "%s/%s/config.yaml", shell->data_path, name) < 0)
+/*
+ * read the mapping in the first document
+ */
+static void *
+qimm_data_read_parser(yaml_parser_t *parser,
+                      struct qimm_yaml_read_mapping_fun *fun) {
+    void *ret = NULL;
+    yaml_event_t event;
+    event.type = YAML_NO_EVENT; // mark is empty to auto delete in next event
+    do {
+        if (qimm_yaml_next_event(parser, &event) < 0)
+            return ret;
+
+        if (event.type == YAML_DOCUMENT_START_EVENT) {
+            ret = qimm_yaml_read_mapping(parser, &event, fun);
+            if (!ret)
+                break;
+        } else if (event.type == YAML_DOCUMENT_END_EVENT)
+            break;
+    } while (event.type != YAML_STREAM_END_EVENT);
+
+    yaml_event_delete(&event);
+    return ret;
+}
+
+struct qimm_data_read_args {
+    const char *name;
+    struct qimm_yaml_read_mapping_fun *fun;
+};
+
+/*
+ * called with the value mapped from data store
+ */
+static void *
+qimm_data_read_value(const char *value, size_t size, void *data) {
+    struct qimm_data_read_args *args = data;
+    yaml_parser_t parser;
+    if (!yaml_parser_initialize(&parser)) {
+        qimm_log("project (%s) read failed: initialize yaml parser error",
+                 args->name);
+        return NULL;
+    }
+    yaml_parser_set_input_string(&parser, (const unsigned char *) value, size);
+
+    void *ret = qimm_data_read_parser(&parser, args->fun);
+    yaml_parser_delete(&parser);
+    return ret;
+}
+
+/*
+ * read the mapping in file of project data directory
+ */
+static void *
+qimm_data_read_file(struct qimm_shell *shell, const char *name,
+                    const char *file, struct qimm_yaml_read_mapping_fun *fun) {
+    char *path;
+
+    if (shell->data_store) {
+        if (asprintf(&path, "%s/%s", name, file) < 0)
+            return NULL;
+        struct qimm_data_read_args args = {name, fun};
+        void *ret = qimm_data_store_read(shell->data_store, path,
+                                         qimm_data_read_value, &args);
+        if (!ret)
+            qimm_log("project (%s) read failed: %s not in data store",
+                     name, path);
+        free(path);
+        return ret;
+    }
+
+    if (asprintf(&path, "%s/%s/%s", shell->data_path, name, file) < 0)
         return NULL;
     qimm_log("project (%s) read from %s", name, path);
 
@@ -192,29 +281,7 @@ qimm_data_read_project(struct qimm_shell *shell, const char *name) {
     }
     yaml_parser_set_input_file(&parser, fh);
 
-    yaml_event_t event;
-    event.type = YAML_NO_EVENT; // mark is empty to auto delete in next event
-    do {
-        if (qimm_yaml_next_event(&parser, &event) < 0)
-            goto err_parse;
-
-        if (event.type == YAML_DOCUMENT_START_EVENT) {
-            struct qimm_yaml_read_mapping_fun fun = {
-                    qimm_data_read_project_init,
-                    qimm_data_read_project_data,
-                    qimm_data_read_project_free,
-            };
-            ret = qimm_yaml_read_mapping(&parser, &event, &fun);
-            if (!ret)
-                goto err_event;
-        } else if (event.type == YAML_DOCUMENT_END_EVENT)
-            break;
-    } while (event.type != YAML_STREAM_END_EVENT);
-
-err_event:
-    yaml_event_delete(&event);
-
-err_parse:
+    ret = qimm_data_read_parser(&parser, fun);
     yaml_parser_delete(&parser);
 
 err:
@@ -223,6 +290,90 @@ err:
     return ret;
 }
 
+static bool
+qimm_data_file_exists(struct qimm_shell *shell, const char *name,
+                      const char *file) {
+    char *path;
+    bool exist;
+
+    if (shell->data_store) {
+        if (asprintf(&path, "%s/%s", name, file) < 0)
+            return false;
+        exist = qimm_data_store_contains(shell->data_store, path);
+    } else {
+        if (asprintf(&path, "%s/%s/%s", shell->data_path, name, file) < 0)
+            return false;
+        exist = access(path, F_OK) == 0;
+    }
+    free(path);
+    return exist;
+}
+
+struct qimm_data_project_args {
+    int (*func)(const char *name, void *data);
+    void *data;
+};
+
+static int
+qimm_data_for_each_key(const char *key, void *data) {
+    struct qimm_data_project_args *args = data;
+
+    /* each project has its config.yaml */
+    const char *file = strchr(key, '/');
+    if (!file || strcmp(file, "/config.yaml"))
+        return 0;
+
+    char *name = strndup(key, file - key);
+    if (!name)
+        return -1;
+    int ret = args->func(name, args->data);
+    free(name);
+    return ret;
+}
+
+int
+qimm_data_for_each_project(struct qimm_shell *shell,
+                           int (*func)(const char *name, void *data),
+                           void *data) {
+    if (shell->data_store) {
+        struct qimm_data_project_args args = {func, data};
+        return qimm_data_store_for_each(shell->data_store,
+                                        qimm_data_for_each_key, &args);
+    }
+
+    DIR *dir = opendir(shell->data_path);
+    if (!dir)
+        return 0;
+
+    int ret = 0;
+    struct dirent *ent;
+    while (ent = readdir(dir)) {
+        if (ent->d_type != DT_DIR)
+            continue;
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+            continue;
+        if ((ret = func(ent->d_name, data)) < 0)
+            break;
+    }
+    closedir(dir);
+    return ret;
+}
+
+bool
+qimm_data_project_exists(struct qimm_shell *shell, const char *name) {
+    return qimm_data_file_exists(shell, name, "config.yaml");
+}
+
+void *
+qimm_data_read_project(struct qimm_shell *shell, const char *name) {
+    struct qimm_yaml_read_mapping_fun fun = {
+            qimm_data_read_project_init,
+            qimm_data_read_project_data,
+            qimm_data_read_project_free,
+    };
+    return qimm_data_read_file(shell, name, "config.yaml", &fun);
+}
+
 /* --------- background --------- */
 static int
 qimm_data_save_background_func(yaml_emitter_t *emitter, void *base) {
@@ -254,6 +405,7 @@ qimm_data_save_background_func(yaml_emitter_t *emitter, void *base) {
                                      (yaml_char_t *) buf, len,
                                      1, 0,
                                      YAML_PLAIN_SCALAR_STYLE);
+        free(buf);
         if (!yaml_emitter_emit(emitter, &event)) goto err;
     }
 
@@ -300,22 +452,333 @@ err:
     return -1;
 }
 
+static void
+qimm_data_background_free_func(void *data) {
+    struct qimm_data_background *d =
+            container_of(data, struct qimm_data_background, base);
+    free(d->base.name);
+    free(d->image);
+    free(d->type);
+    free(d);
+}
+
+void
+qimm_data_background_free(struct qimm_data_background *background) {
+    qimm_data_background_free_func(&background->base);
+}
+
+static void *
+qimm_data_read_background_init() {
+    struct qimm_data_background *d = zalloc(sizeof *d);
+    if (!d)
+        return NULL;
+    d->base.name = strdup("background");
+    d->base.func = qimm_data_save_background_func;
+    return &d->base;
+}
+
+static int
+qimm_data_read_background_data(yaml_parser_t *parser, yaml_event_t *event,
+                               void *obj, char *key) {
+    struct qimm_data_background *d =
+            container_of(obj, struct qimm_data_background, base);
+    if (!strcmp(key, "color"))
+        d->color = qimm_yaml_next_value_int(parser, event);
+    else if (!strcmp(key, "image"))
+        d->image = qimm_yaml_next_value(parser, event);
+    else if (!strcmp(key, "type"))
+        d->type = qimm_yaml_next_value(parser, event);
+    else
+        return -2;
+    return 0;
+}
+
+static int
+qimm_data_background_type(const char *type) {
+    static const char *types[] = {
+            [SCALE] = "scale",
+            [CROP] = "crop",
+            [TILE] = "tile",
+            [CENTERED] = "centered",
+    };
+    for (int i = 0; type && i < (int) ARRAY_LENGTH(types); i++) {
+        if (!strcmp(type, types[i]))
+            return i;
+    }
+    return SCALE;
+}
+
+/*
+ * read background.yaml of project, the relative image path is
+ * resolved in data directory of project.
+ */
+struct qimm_data_background *
+qimm_data_read_background(struct qimm_shell *shell, const char *name) {
+    if (!qimm_data_file_exists(shell, name, "background.yaml"))
+        return NULL;
+
+    struct qimm_yaml_read_mapping_fun fun = {
+            qimm_data_read_background_init,
+            qimm_data_read_background_data,
+            qimm_data_background_free_func,
+    };
+    void *base = qimm_data_read_file(shell, name, "background.yaml", &fun);
+    if (!base)
+        return NULL;
+
+    struct qimm_data_background *d =
+            container_of(base, struct qimm_data_background, base);
+    d->type_e = qimm_data_background_type(d->type);
+    if (d->image && d->image[0] != '/') {
+        char *image;
+        if (asprintf(&image, "%s/%s/%s", shell->data_path, name, d->image) < 0) {
+            qimm_data_background_free(d);
+            return NULL;
+        }
+        free(d->image);
+        d->image = image;
+    }
+    return d;
+}
+
 int
 qimm_data_save_background(struct qimm_project *project,
                           struct qimm_data_background *background) {
+    char *path = qimm_data_project_path(project);
+    if (!path)
+        return -1;
+
+    char *file;
+    int len = asprintf(&file, "%s/%s.yaml", path, background->base.name);
+    free(path);
+    if (len < 0)
+        return -1;
+
+    struct qimm_data_background *copy = zalloc(sizeof *copy);
+    if (!copy) {
+        free(file);
+        return -1;
+    }
+    copy->base.name = strdup(background->base.name);
+    copy->base.func = background->base.func;
+    copy->color = background->color;
+    if (background->image)
+        copy->image = strdup(background->image);
+    if (background->type)
+        copy->type = strdup(background->type);
+    copy->type_e = background->type_e;
+
+    qimm_search_project_update(project, background);
+    return qimm_data_writer_save(project->shell, file,
+                                 qimm_data_save_background_func, &copy->base,
+                                 qimm_data_background_free_func);
+}
+
+/* --------- files --------- */
+static bool
+qimm_data_is_yaml(const char *file) {
+    size_t len = strlen(file);
+    return len > 5 && !strcmp(file + len - 5, ".yaml");
+}
+
+struct qimm_data_keys {
+    const char *prefix;
+    size_t prefix_len;
+    char **keys;
+    int count, alloc;
+};
+
+static int
+qimm_data_collect_key(const char *key, void *data) {
+    struct qimm_data_keys *keys = data;
+    if (strncmp(key, keys->prefix, keys->prefix_len))
+        return 0;
+
+    if (keys->count == keys->alloc) {
+        int alloc = keys->alloc ? keys->alloc * 2 : 8;
+        char **k = realloc(keys->keys, alloc * sizeof *k);
+        if (!k)
+            return -1;
+        keys->keys = k;
+        keys->alloc = alloc;
+    }
+    if (!(keys->keys[keys->count] = strdup(key)))
+        return -1;
+    keys->count++;
+    return 0;
+}
+
+struct qimm_data_file_args {
+    const char *file;
+    qimm_data_file_func_t func;
+    void *data;
+    int ret;
+};
+
+static void *
+qimm_data_file_value(const char *value, size_t size, void *data) {
+    struct qimm_data_file_args *args = data;
+    args->ret = args->func(args->file, value, size, args->data);
+    return args;
+}
+
+static int
+qimm_data_for_each_store_file(struct qimm_shell *shell, const char *name,
+                              qimm_data_file_func_t func, void *data) {
+    char *prefix;
+    if (asprintf(&prefix, "%s/", name) < 0)
+        return -1;
+    struct qimm_data_keys keys = {prefix, strlen(prefix)};
+
+    /* read values after listing, not under the lock of listing */
+    int ret = qimm_data_store_for_each(shell->data_store,
+                                       qimm_data_collect_key, &keys);
+    for (int i = 0; i < keys.count; i++) {
+        struct qimm_data_file_args args = {
+                keys.keys[i] + keys.prefix_len, func, data, 0
+        };
+        if (ret == 0 &&
+            qimm_data_store_read(shell->data_store, keys.keys[i],
+                                 qimm_data_file_value, &args))
+            ret = args.ret;
+        free(keys.keys[i]);
+    }
+    free(keys.keys);
+    free(prefix);
+    return ret;
+}
+
+static int
+qimm_data_read_whole(const char *path, qimm_data_file_func_t func,
+                     const char *file, void *data) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    void *map = NULL;
     int ret = -1;
+    if (fstat(fd, &st) < 0)
+        goto out;
+    if (st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            map = NULL;
+            goto out;
+        }
+    }
+    ret = func(file, map ?: "", st.st_size, data);
 
-    char *path = qimm_data_project_path(project);
-    if (path) {
-        char *file;
-        if (asprintf(&file, "%s/%s.yaml", path, background->base.name) > 0) {
-            ret = 0;
+out:
+    if (map)
+        munmap(map, st.st_size);
+    close(fd);
+    return ret;
+}
+
+/*
+ * call func with content of each file of project, e.g. yaml datas
+ * and images in project directory, stop when func returns -1
+ */
+int
+qimm_data_for_each_file(struct qimm_shell *shell, const char *name,
+                        qimm_data_file_func_t func, void *data) {
+    int ret = 0;
+    /* yaml datas are in log, the yaml files left in directory are stale */
+    if (shell->data_store &&
+        qimm_data_for_each_store_file(shell, name, func, data) < 0)
+        return -1;
+
+    char *path;
+    if (asprintf(&path, "%s/%s", shell->data_path, name) < 0)
+        return -1;
+    DIR *dir = opendir(path);
+    if (!dir) {
+        free(path);
+        return 0;
+    }
 
-            free(file);
+    struct dirent *ent;
+    while (ret == 0 && (ent = readdir(dir))) {
+        if (ent->d_type != DT_REG)
+            continue;
+        /* temp files of writer, e.g. config.yaml.XXXXXX */
+        if (strstr(ent->d_name, ".yaml."))
+            continue;
+        if (shell->data_store && qimm_data_is_yaml(ent->d_name))
+            continue;
+
+        char *file;
+        if (asprintf(&file, "%s/%s", path, ent->d_name) < 0) {
+            ret = -1;
+            break;
         }
+        ret = qimm_data_read_whole(file, func, ent->d_name, data);
+        free(file);
+    }
+    closedir(dir);
+    free(path);
+    return ret;
+}
+
+/*
+ * replace a file of project, yaml datas go to log store if it is used.
+ * the log store is committed by caller.
+ */
+int
+qimm_data_put_file(struct qimm_shell *shell, const char *name,
+                   const char *file, const void *value, size_t size) {
+    char *path;
+    int ret = -1;
 
+    if (shell->data_store && qimm_data_is_yaml(file)) {
+        if (asprintf(&path, "%s/%s", name, file) < 0)
+            return -1;
+        ret = qimm_data_store_write(shell->data_store, path, value, size);
         free(path);
+        return ret;
     }
 
+    if (asprintf(&path, "%s/%s", shell->data_path, name) < 0)
+        return -1;
+    if (mkdir(path, QIMM_DATA_DIR_MODE) < 0 && errno != EEXIST)
+        goto out;
+
+    char *temp = NULL;
+    if (asprintf(&temp, "%s/%s.XXXXXX", path, file) < 0)
+        goto out;
+    int fd = mkostemp(temp, O_CLOEXEC);
+    if (fd < 0) {
+        free(temp);
+        goto out;
+    }
+    fchmod(fd, QIMM_DATA_FILE_MODE);
+
+    const char *p = value;
+    size_t left = size;
+    while (left > 0) {
+        ssize_t len = write(fd, p, left);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len < 0)
+            break;
+        p += len;
+        left -= len;
+    }
+
+    /* the name of temp is the name of file with suffix */
+    char *target = strndup(temp, strlen(temp) - 7);
+    if (left == 0 && fsync(fd) == 0 && target && rename(temp, target) == 0)
+        ret = 0;
+    else
+        unlink(temp);
+    close(fd);
+    free(target);
+    free(temp);
+
+out:
+    if (ret < 0)
+        qimm_log("project (%s) put %s failed: %s", name, file, strerror(errno));
+    free(path);
     return ret;
 }
@@ -0,0 +1,345 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+
+/*
+ * Load saved projects in data directory on a pool of worker threads.
+ *
+ * The workers only do the slow and independent part: read project data
+ * and load its config. The main thread merges results into shell in the
+ * order of saved projects, so the project order is stable.
+ *
+ * qimm_project_loader_start blocks only until each connected output has
+ * a project to show, the rest are merged later in event loop.
+ *
+ * weston_log is not thread-safe, so the log of a job is kept in the job
+ * and written when it is merged.
+ */
+#define QIMM_PROJECT_LOADER_THREADS_MAX 8
+
+struct qimm_project_load_job {
+    char *name;
+    struct qimm_project *project; /* NULL when failed */
+    struct qimm_log_defer log;
+    bool done;
+};
+
+struct qimm_project_loader {
+    struct qimm_shell *shell;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; /* broadcast when a job is done */
+    pthread_t threads[QIMM_PROJECT_LOADER_THREADS_MAX];
+    int thread_count;
+    bool stop;
+
+    struct qimm_project_load_job *jobs;
+    int job_count;
+    int job_alloc;
+    int job_next; /* next job to take by workers, under mutex */
+    int job_merged; /* jobs before it are merged, main thread only */
+
+    /* workers notify main thread about done jobs */
+    int event_fd;
+    struct wl_event_source *source;
+    int notify_error; /* errno of the last failed notify, under mutex */
+};
+
+static void
+qimm_project_loader_free_project(struct qimm_project *project) {
+    if (project->config)
+        qimm_config_project_free(project->config);
+    if (project->background)
+        qimm_data_background_free(project->background);
+    free(project->config_name);
+    free(project->output_name);
+    free(project);
+}
+
+/*
+ * called in worker threads, must not touch compositor,
+ * workers keep its log in the job by qimm_log_defer
+ */
+static struct qimm_project *
+qimm_project_loader_read(struct qimm_shell *shell, const char *name) {
+    struct qimm_project *project = qimm_data_read_project(shell, name);
+    if (!project)
+        return NULL;
+
+    if (project->config_name) {
+        project->config = qimm_config_project_load(name,
+                                                   project->config_name,
+                                                   shell->cache_path);
+        if (!project->config) {
+            qimm_log("project (%s) config failed", name);
+            qimm_project_loader_free_project(project);
+            return NULL;
+        }
+    }
+
+    project->background = qimm_data_read_background(shell, name);
+
+    return project;
+}
+
+static void *
+qimm_project_loader_worker(void *data) {
+    struct qimm_project_loader *loader = data;
+
+    pthread_mutex_lock(&loader->mutex);
+    while (!loader->stop && loader->job_next < loader->job_count) {
+        struct qimm_project_load_job *job = &loader->jobs[loader->job_next++];
+        pthread_mutex_unlock(&loader->mutex);
+
+        qimm_log_defer_begin(&job->log);
+        struct qimm_project *project =
+                qimm_project_loader_read(loader->shell, job->name);
+        qimm_log_defer_end(&job->log);
+
+        pthread_mutex_lock(&loader->mutex);
+        job->project = project;
+        job->done = true;
+        pthread_cond_broadcast(&loader->cond);
+
+        if (loader->event_fd >= 0) {
+            uint64_t one = 1;
+            if (write(loader->event_fd, &one, sizeof one) < 0)
+                loader->notify_error = errno;
+        }
+    }
+    pthread_mutex_unlock(&loader->mutex);
+
+    return NULL;
+}
+
+static int
+qimm_project_loader_add_job(const char *name, void *data) {
+    struct qimm_project_loader *loader = data;
+
+    if (loader->job_count == loader->job_alloc) {
+        int alloc = loader->job_alloc ? loader->job_alloc * 2 : 16;
+        void *jobs = realloc(loader->jobs, alloc * sizeof *loader->jobs);
+        if (!jobs)
+            return -1;
+        loader->jobs = jobs;
+        loader->job_alloc = alloc;
+    }
+
+    struct qimm_project_load_job *job = &loader->jobs[loader->job_count];
+    memset(job, 0, sizeof *job);
+    job->name = strdup(name);
+    if (!job->name)
+        return -1;
+    loader->job_count++;
+    return 0;
+}
+
+static int
+qimm_project_loader_scan(struct qimm_project_loader *loader) {
+    return qimm_data_for_each_project(loader->shell,
+                                      qimm_project_loader_add_job, loader);
+}
+
+static void
+qimm_project_loader_spawn(struct qimm_project_loader *loader) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int count = MIN(loader->job_count, QIMM_PROJECT_LOADER_THREADS_MAX);
+    if (cpus > 0)
+        count = MIN(count, cpus);
+
+    for (int i = 0; i < count; i++) {
+        if (create_worker_thread(&loader->threads[loader->thread_count],
+                                 qimm_project_loader_worker, loader) < 0) {
+            qimm_log("project loader thread error: %s", strerror(errno));
+            break;
+        }
+        loader->thread_count++;
+    }
+}
+
+/*
+ * an output without project would show nothing in first frame
+ */
+static bool
+qimm_project_loader_need_wait(struct qimm_shell *shell) {
+    struct qimm_output *output;
+    wl_list_for_each(output, &shell->outputs, link) {
+        if (wl_list_empty(&output->projects))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * merge done jobs in order.
+ * if wait is set, wait for undone jobs until each output has a project,
+ * or all jobs when no event source to merge the rest later.
+ * return -1 when a project failed.
+ */
+static int
+qimm_project_loader_merge(struct qimm_project_loader *loader, bool wait) {
+    int ret = 0;
+
+    while (loader->job_merged < loader->job_count) {
+        if (wait && loader->source &&
+            !qimm_project_loader_need_wait(loader->shell))
+            break;
+
+        struct qimm_project_load_job *job = &loader->jobs[loader->job_merged];
+
+        pthread_mutex_lock(&loader->mutex);
+        while (wait && !job->done)
+            pthread_cond_wait(&loader->cond, &loader->mutex);
+        bool done = job->done;
+        struct qimm_project *project = job->project;
+        job->project = NULL;
+        int notify_error = loader->notify_error;
+        loader->notify_error = 0;
+        pthread_mutex_unlock(&loader->mutex);
+
+        if (notify_error)
+            qimm_log("project loader notify error: %s",
+                     strerror(notify_error));
+        if (!done)
+            break;
+        loader->job_merged++;
+
+        /* the job is done, its log is not written by worker any more */
+        qimm_log_defer_flush(&job->log);
+
+        if (!project || !qimm_project_merge(loader->shell, job->name, project)) {
+            qimm_log("project (%s) load failed", job->name);
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+static void
+qimm_project_loader_destroy(struct qimm_project_loader *loader) {
+    pthread_mutex_lock(&loader->mutex);
+    loader->stop = true;
+    pthread_mutex_unlock(&loader->mutex);
+
+    for (int i = 0; i < loader->thread_count; i++)
+        pthread_join(loader->threads[i], NULL);
+
+    for (int i = 0; i < loader->job_count; i++) {
+        if (loader->jobs[i].project)
+            qimm_project_loader_free_project(loader->jobs[i].project);
+        qimm_log_defer_flush(&loader->jobs[i].log);
+        free(loader->jobs[i].name);
+    }
+    free(loader->jobs);
+
+    if (loader->source)
+        wl_event_source_remove(loader->source);
+    if (loader->event_fd >= 0)
+        close(loader->event_fd);
+
+    pthread_cond_destroy(&loader->cond);
+    pthread_mutex_destroy(&loader->mutex);
+
+    loader->shell->loader = NULL;
+    free(loader);
+}
+
+static int
+qimm_project_loader_handle_event(int fd, uint32_t mask, void *data) {
+    struct qimm_project_loader *loader = data;
+
+    uint64_t count;
+    if (read(fd, &count, sizeof count) < 0 && errno != EAGAIN)
+        qimm_log("project loader event error: %s", strerror(errno));
+
+    /* the projects failed after startup are skipped */
+    qimm_project_loader_merge(loader, false);
+
+    if (loader->job_merged == loader->job_count) {
+        qimm_log("project loader finished %d projects", loader->job_count);
+        qimm_startup_mark(loader->shell, "disk_load_done", NULL);
+        qimm_project_loader_destroy(loader);
+    }
+
+    return 0;
+}
+
+int
+qimm_project_loader_start(struct qimm_shell *shell) {
+    struct qimm_project_loader *loader = zalloc(sizeof *loader);
+    if (!loader)
+        return -1;
+
+    loader->shell = shell;
+    loader->event_fd = -1;
+    pthread_mutex_init(&loader->mutex, NULL);
+    pthread_cond_init(&loader->cond, NULL);
+    shell->loader = loader;
+
+    if (qimm_project_loader_scan(loader) < 0) {
+        qimm_log("project loader failed to read %s", shell->data_path);
+        goto err;
+    }
+    if (loader->job_count == 0) {
+        qimm_project_loader_destroy(loader);
+        return 0;
+    }
+
+    struct wl_event_loop *loop =
+            wl_display_get_event_loop(shell->compositor->wl_display);
+    loader->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (loader->event_fd >= 0)
+        loader->source = wl_event_loop_add_fd(loop, loader->event_fd,
+                                              WL_EVENT_READABLE,
+                                              qimm_project_loader_handle_event,
+                                              loader);
+
+    qimm_project_loader_spawn(loader);
+    /* no worker, load all in this thread */
+    if (loader->thread_count == 0)
+        qimm_project_loader_worker(loader);
+
+    if (qimm_project_loader_merge(loader, true) < 0)
+        goto err;
+
+    qimm_log("project loader merged %d of %d projects for startup",
+             loader->job_merged, loader->job_count);
+
+    if (loader->job_merged == loader->job_count)
+        qimm_project_loader_destroy(loader);
+    return 0;
+
+err:
+    qimm_project_loader_destroy(loader);
+    return -1;
+}
+
+struct qimm_project *
+qimm_project_loader_load(struct qimm_shell *shell, const char *name) {
+    struct qimm_project *project = qimm_project_loader_read(shell, name);
+    if (!project)
+        return NULL;
+    return qimm_project_merge(shell, name, project);
+}
+
+void
+qimm_project_loader_stop(struct qimm_shell *shell) {
+    if (shell->loader)
+        qimm_project_loader_destroy(shell->loader);
+}
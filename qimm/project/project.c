@@ -30,6 +30,7 @@ qimm_project_setup(struct qimm_shell *shell,
                    struct qimm_project *project) {
     wl_list_init(&project->link);
     wl_list_init(&project->layouts);
+    wl_list_init(&project->lru_link);
     weston_layer_init(&project->layer, shell->compositor);
 
     project->shell = shell;
@@ -37,19 +38,26 @@ qimm_project_setup(struct qimm_shell *shell,
 
     if (config_name)
         project->config_name = strdup(config_name);
-    if (project->config_name) {
+    /* config may be loaded by project loader already */
+    if (project->config_name && !project->config) {
         project->config = qimm_config_project_load(project->name,
-                                                   project->config_name);
+                                                   project->config_name,
+                                                   shell->cache_path);
         if (!project->config) {
             qimm_log("project (%s) config failed", project->name);
             goto err;
         }
     }
+    /* types are found by index in layout init */
+    if (project->config && qimm_index_config_add(shell, project->config) < 0)
+        qimm_log("project (%s) config index failed", project->name);
 
     if (qimm_layout_project_init(project) < 0) {
         qimm_log("project (%s) layout init failed", project->name);
         goto err;
     }
+    qimm_search_project_update(project, project->background);
+    qimm_reload_project_add(project);
 
     return 0;
 
@@ -97,10 +105,17 @@ qimm_project_create_assistant(struct qimm_shell *shell) {
 
 void
 qimm_project_destroy(struct qimm_project *project) {
+    qimm_reload_project_remove(project);
+    qimm_lifecycle_project_remove(project);
     qimm_layout_project_clear(project);
+    qimm_snapshot_project_forget(project);
 
-    if (project->config)
+    if (project->config) {
+        qimm_index_config_remove(project->shell, project->config);
         qimm_config_project_free(project->config);
+    }
+    if (project->background)
+        qimm_data_background_free(project->background);
 
     weston_layer_fini(&project->layer);
     free(project->name);
@@ -108,14 +123,12 @@ qimm_project_destroy(struct qimm_project *project) {
     free(project);
 }
 
-static struct qimm_project *
-qimm_project_read(struct qimm_shell *shell, const char *name) {
+struct qimm_project *
+qimm_project_merge(struct qimm_shell *shell,
+                   const char *name,
+                   struct qimm_project *project) {
     assert(name);
 
-    struct qimm_project *project = qimm_data_read_project(shell, name);
-    if (!project)
-        return NULL;
-
     if (qimm_project_setup(shell, name, NULL, project) < 0)
         return NULL;
 
@@ -123,35 +136,16 @@ qimm_project_read(struct qimm_shell *shell, const char *name) {
         project->output = qimm_output_find_by_name(shell, project->output_name);
     if (!project->output)
         project->output = qimm_output_get_default(shell);
+    if (!project->output) {
+        qimm_log("project (%s) has no output to merge", name);
+        qimm_project_destroy(project);
+        return NULL;
+    }
     wl_list_insert(project->output->projects.prev, &project->link);
 
     return project;
 }
 
-static int
-qimm_project_load_from_disk(struct qimm_shell *shell) {
-    int ret = 0;
-
-    struct dirent *ent;
-    DIR *dir = opendir(shell->data_path);
-    if (dir) {
-        while (ent = readdir(dir)) {
-            if (ent->d_type == DT_DIR) {
-                if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
-                    continue;
-
-                if (!qimm_project_read(shell, ent->d_name)) {
-                    ret = -1;
-                    break;
-                }
-            }
-        }
-        closedir(dir);
-    }
-
-    return ret;
-}
-
 static int
 qimm_project_prepare_for_output(struct qimm_shell *shell) {
     /*
@@ -190,26 +184,65 @@ qimm_project_load(struct qimm_shell *shell) {
         qimm_log("failed to get path for data directory");
         return -1;
     }
+    qimm_startup_mark(shell, "data_path", NULL);
+
+    /* projects are indexed when loaded, search finds nothing without it */
+    if (qimm_search_init(shell) < 0)
+        qimm_log("failed to init project search");
+
+    /* datas stay in yaml files if the log store failed */
+    if (qimm_data_store_init(shell) < 0)
+        qimm_log("failed to init data store");
+
+    /* datas are written synchronously without writer */
+    if (qimm_data_writer_init(shell) < 0)
+        qimm_log("failed to start data writer");
+
+    /* the cache is optional, load configs from yaml without it */
+    shell->cache_path = qimm_data_cache_path(shell->data_path);
+    if (!shell->cache_path)
+        qimm_log("failed to get path for config cache");
 
     /* load common config for all projects */
-    shell->config = qimm_config_project_load("shell->common", "common");
+    shell->config = qimm_config_project_load("shell->common", "common",
+                                             shell->cache_path);
     if (!shell->config) {
         qimm_log("project (%s) config failed", "common");
         return -1;
     }
+    if (qimm_index_config_add(shell, shell->config) < 0)
+        qimm_log("project (%s) config index failed", "common");
+    qimm_startup_mark(shell, "common_config", NULL);
+
+    /* configs are only loaded at startup without it */
+    if (qimm_reload_init(shell) < 0)
+        qimm_log("failed to watch configs for reload");
 
-    // load project from cache directory
-    if (qimm_project_load_from_disk(shell) < 0)
+    // load project from data directory
+    if (qimm_project_loader_start(shell) < 0)
         return -1;
+    qimm_startup_mark(shell, "disk_load", NULL);
+
+    /*
+     * the projects new in peer are imported after the loader scanned
+     * data directory, and loaded when imported
+     */
+    if (qimm_sync_init(shell) < 0)
+        qimm_log("failed to sync projects from peer");
 
     if (qimm_project_prepare_for_output(shell) < 0)
         return -1;
+    qimm_startup_mark(shell, "prepare_output", NULL);
 
     return 0;
 }
 
 void
 qimm_project_unload(struct qimm_shell *shell) {
+    /* drop the projects not merged yet */
+    qimm_project_loader_stop(shell);
+    qimm_reload_release(shell);
+
     struct qimm_output *output;
     wl_list_for_each(output, &shell->outputs, link) {
         struct qimm_project *project, *tmp;
@@ -219,11 +252,16 @@ qimm_project_unload(struct qimm_shell *shell) {
         }
     }
 
-    if (shell->config)
+    if (shell->config) {
+        qimm_index_config_remove(shell, shell->config);
         qimm_config_project_free(shell->config);
+    }
+
+    qimm_search_release(shell);
 
     if (shell->data_path)
         free(shell->data_path);
+    free(shell->cache_path);
 }
 
 void
@@ -234,17 +272,41 @@ qimm_project_show(struct qimm_project *project) {
         return;
     }
 
-    if (output->project_cur) {
-        if (output->project_cur == project)
-            return;
+    if (output->project_cur == project)
+        return;
+
+    /* the layer switch and resized layouts are shown in one repaint */
+    qimm_transaction_begin(project->shell);
 
+    if (output->project_cur)
         weston_layer_unset_position(&output->project_cur->layer);
-    }
 
+    qimm_output_switch_start(output);
+
+    /* resume clients or start them again */
+    qimm_lifecycle_project_show(project);
+
+    struct qimm_project *old = output->project_cur;
     output->project_cur = project;
     weston_layer_set_position(&project->layer, WESTON_LAYER_POSITION_NORMAL);
 
+    /* only the current project has its background shown */
+    if (old) {
+        qimm_snapshot_project_capture(old);
+        qimm_snapshot_project_hide(old);
+        qimm_surface_project_update_layer(old);
+    }
+    qimm_surface_project_update_layer(project);
+
     qimm_layout_project_update(project);
+    qimm_background_output_update(output);
+
+    /* show last frames until clients commit */
+    qimm_snapshot_project_show(project);
+
+    qimm_transaction_commit(project->shell);
 
     qimm_client_project_start(project);
+
+    qimm_lifecycle_output_prefetch(output);
 }
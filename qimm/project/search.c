@@ -0,0 +1,500 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+
+#include <ctype.h>
+
+/*
+ * Inverted index over the saved datas of projects, to find projects
+ * by content without reading their yaml files.
+ *
+ * Texts of each field are cut into lower case words, each word keeps
+ * the postings of projects having it. The words are also kept sorted,
+ * so a query word matches all words starting with it by binary search.
+ * A project is updated alone when its datas are saved.
+ */
+#define QIMM_SEARCH_TERMS_MAX 16
+#define QIMM_SEARCH_WORD_MAX 64
+
+/* weight of word in each field, doubled when the word is exact */
+static const uint32_t qimm_search_weights[QIMM_SEARCH_FIELD_COUNT] = {
+        [QIMM_SEARCH_FIELD_NAME] = 8,
+        [QIMM_SEARCH_FIELD_CONFIG] = 4,
+        [QIMM_SEARCH_FIELD_TYPE] = 2,
+        [QIMM_SEARCH_FIELD_DATA] = 1,
+};
+
+struct qimm_search_posting {
+    struct qimm_search_doc *doc;
+    uint32_t weight;
+};
+
+struct qimm_search_word {
+    struct qimm_hash_node node; /* qimm_search::words */
+    char *text;
+    struct qimm_search_posting *postings;
+    uint32_t count, alloc;
+};
+
+struct qimm_search_doc {
+    struct qimm_hash_node node; /* qimm_search::docs */
+    char *name;
+    struct qimm_search_word **words;
+    uint32_t count;
+
+    /* state of the query in progress */
+    uint32_t serial;
+    uint32_t terms; /* terms matched */
+    uint32_t term_score; /* of the current term */
+    uint32_t score;
+};
+
+struct qimm_search {
+    struct qimm_hash docs; /* qimm_search_doc::node, by name */
+    struct qimm_hash words; /* qimm_search_word::node, by text */
+    /* words sorted by text for prefix lookup */
+    struct qimm_search_word **sorted;
+    uint32_t sorted_count, sorted_alloc;
+
+    uint32_t serial;
+    struct qimm_search_doc **candidates;
+    uint32_t candidate_alloc;
+};
+
+struct qimm_search *
+qimm_search_create(void) {
+    struct qimm_search *search = zalloc(sizeof *search);
+    if (!search)
+        return NULL;
+    qimm_hash_init(&search->docs, true);
+    qimm_hash_init(&search->words, true);
+    return search;
+}
+
+static void
+qimm_search_doc_free(struct qimm_search_doc *doc) {
+    free(doc->name);
+    free(doc->words);
+    free(doc);
+}
+
+void
+qimm_search_destroy(struct qimm_search *search) {
+    struct qimm_hash_node *node;
+    while ((node = qimm_hash_pop(&search->docs)))
+        qimm_search_doc_free(container_of(node, struct qimm_search_doc, node));
+    for (uint32_t i = 0; i < search->sorted_count; i++) {
+        free(search->sorted[i]->text);
+        free(search->sorted[i]->postings);
+        free(search->sorted[i]);
+    }
+    qimm_hash_release(&search->docs);
+    qimm_hash_release(&search->words);
+    free(search->sorted);
+    free(search->candidates);
+    free(search);
+}
+
+/*
+ * the position of the first word not less than text
+ */
+static uint32_t
+qimm_search_lower_bound(struct qimm_search *search, const char *text) {
+    uint32_t lo = 0, hi = search->sorted_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (strcmp(search->sorted[mid]->text, text) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static struct qimm_search_word *
+qimm_search_word_get(struct qimm_search *search, const char *text) {
+    struct qimm_hash_node *node = qimm_hash_find(&search->words, text);
+    if (node)
+        return container_of(node, struct qimm_search_word, node);
+
+    if (search->sorted_count == search->sorted_alloc) {
+        uint32_t alloc = search->sorted_alloc ? search->sorted_alloc * 2 : 256;
+        void *sorted = realloc(search->sorted, alloc * sizeof *search->sorted);
+        if (!sorted)
+            return NULL;
+        search->sorted = sorted;
+        search->sorted_alloc = alloc;
+    }
+
+    struct qimm_search_word *word = zalloc(sizeof *word);
+    if (!word)
+        return NULL;
+    word->text = strdup(text);
+    if (!word->text ||
+        qimm_hash_insert(&search->words, &word->node, word->text) < 0) {
+        free(word->text);
+        free(word);
+        return NULL;
+    }
+
+    uint32_t pos = qimm_search_lower_bound(search, text);
+    memmove(&search->sorted[pos + 1], &search->sorted[pos],
+            (search->sorted_count - pos) * sizeof *search->sorted);
+    search->sorted[pos] = word;
+    search->sorted_count++;
+    return word;
+}
+
+static void
+qimm_search_word_remove(struct qimm_search *search,
+                        struct qimm_search_word *word) {
+    uint32_t pos = qimm_search_lower_bound(search, word->text);
+    memmove(&search->sorted[pos], &search->sorted[pos + 1],
+            (search->sorted_count - pos - 1) * sizeof *search->sorted);
+    search->sorted_count--;
+
+    qimm_hash_remove(&search->words, &word->node);
+    free(word->text);
+    free(word->postings);
+    free(word);
+}
+
+/*
+ * add weight of doc to word, the doc is the last posting if it has one
+ */
+static int
+qimm_search_word_post(struct qimm_search_word *word,
+                      struct qimm_search_doc *doc, uint32_t weight,
+                      bool *added) {
+    *added = false;
+    if (word->count && word->postings[word->count - 1].doc == doc) {
+        struct qimm_search_posting *posting = &word->postings[word->count - 1];
+        posting->weight = MAX(posting->weight, weight);
+        return 0;
+    }
+
+    if (word->count == word->alloc) {
+        uint32_t alloc = word->alloc ? word->alloc * 2 : 4;
+        void *postings = realloc(word->postings, alloc * sizeof *word->postings);
+        if (!postings)
+            return -1;
+        word->postings = postings;
+        word->alloc = alloc;
+    }
+    word->postings[word->count++] = (struct qimm_search_posting) {doc, weight};
+    *added = true;
+    return 0;
+}
+
+/*
+ * remove all postings of doc, keep the doc in docs
+ */
+static void
+qimm_search_doc_clear(struct qimm_search *search, struct qimm_search_doc *doc) {
+    for (uint32_t i = 0; i < doc->count; i++) {
+        struct qimm_search_word *word = doc->words[i];
+        for (uint32_t j = 0; j < word->count; j++) {
+            if (word->postings[j].doc == doc) {
+                /* keep order of postings, they are in order of update */
+                memmove(&word->postings[j], &word->postings[j + 1],
+                        (word->count - j - 1) * sizeof *word->postings);
+                word->count--;
+                break;
+            }
+        }
+        if (word->count == 0)
+            qimm_search_word_remove(search, word);
+    }
+    free(doc->words);
+    doc->words = NULL;
+    doc->count = 0;
+}
+
+/*
+ * cut text to lower case words, the ascii letters and digits and all
+ * bytes of utf-8 sequences are in words.
+ * return the length of next word and set start of it, 0 at the end.
+ */
+static size_t
+qimm_search_next_word(const char **text, char word[QIMM_SEARCH_WORD_MAX]) {
+    const unsigned char *p = (const unsigned char *) *text;
+    while (*p && *p < 0x80 && !isalnum(*p))
+        p++;
+
+    size_t len = 0;
+    while (*p && (*p >= 0x80 || isalnum(*p))) {
+        /* long words are cut, the prefix is still found */
+        if (len < QIMM_SEARCH_WORD_MAX - 1)
+            word[len++] = (char) tolower(*p);
+        p++;
+    }
+    word[len] = '\0';
+    *text = (const char *) p;
+    return len;
+}
+
+int
+qimm_search_update(struct qimm_search *search, const char *name,
+                   const char *const fields[QIMM_SEARCH_FIELD_COUNT]) {
+    struct qimm_search_doc *doc;
+    struct qimm_hash_node *node = qimm_hash_find(&search->docs, name);
+    if (node) {
+        doc = container_of(node, struct qimm_search_doc, node);
+        qimm_search_doc_clear(search, doc);
+    } else {
+        doc = zalloc(sizeof *doc);
+        if (!doc)
+            return -1;
+        doc->name = strdup(name);
+        if (!doc->name ||
+            qimm_hash_insert(&search->docs, &doc->node, doc->name) < 0) {
+            qimm_search_doc_free(doc);
+            return -1;
+        }
+    }
+
+    uint32_t alloc = 0;
+    char word[QIMM_SEARCH_WORD_MAX];
+    for (int f = 0; f < QIMM_SEARCH_FIELD_COUNT; f++) {
+        const char *text = fields[f];
+        if (!text)
+            continue;
+        while (qimm_search_next_word(&text, word)) {
+            struct qimm_search_word *w = qimm_search_word_get(search, word);
+            bool added;
+            if (!w || qimm_search_word_post(w, doc, qimm_search_weights[f],
+                                            &added) < 0)
+                goto err;
+            if (!added)
+                continue;
+
+            if (doc->count == alloc) {
+                alloc = alloc ? alloc * 2 : 16;
+                void *words = realloc(doc->words, alloc * sizeof *doc->words);
+                if (!words) {
+                    /* drop the posting not owned by doc */
+                    w->count--;
+                    if (w->count == 0)
+                        qimm_search_word_remove(search, w);
+                    goto err;
+                }
+                doc->words = words;
+            }
+            doc->words[doc->count++] = w;
+        }
+    }
+    return 0;
+
+err:
+    /* a doc is never half indexed */
+    qimm_search_doc_clear(search, doc);
+    return -1;
+}
+
+void
+qimm_search_remove(struct qimm_search *search, const char *name) {
+    struct qimm_hash_node *node = qimm_hash_find(&search->docs, name);
+    if (!node)
+        return;
+
+    struct qimm_search_doc *doc =
+            container_of(node, struct qimm_search_doc, node);
+    qimm_search_doc_clear(search, doc);
+    qimm_hash_remove(&search->docs, node);
+    qimm_search_doc_free(doc);
+}
+
+/*
+ * order of results, the better one is less
+ */
+static int
+qimm_search_result_compare(const void *a, const void *b) {
+    const struct qimm_search_doc *x = *(struct qimm_search_doc *const *) a;
+    const struct qimm_search_doc *y = *(struct qimm_search_doc *const *) b;
+    if (x->score != y->score)
+        return x->score > y->score ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+/*
+ * sift down in the heap with the worst result on top
+ */
+static void
+qimm_search_heap_down(struct qimm_search_doc **heap, uint32_t count,
+                      uint32_t i) {
+    for (;;) {
+        uint32_t worst = i, l = i * 2 + 1, r = l + 1;
+        if (l < count &&
+            qimm_search_result_compare(&heap[l], &heap[worst]) > 0)
+            worst = l;
+        if (r < count &&
+            qimm_search_result_compare(&heap[r], &heap[worst]) > 0)
+            worst = r;
+        if (worst == i)
+            return;
+        struct qimm_search_doc *doc = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = doc;
+        i = worst;
+    }
+}
+
+/*
+ * move the best k candidates to the front in order, without sorting all
+ */
+static void
+qimm_search_select(struct qimm_search_doc **candidates, uint32_t count,
+                   uint32_t k) {
+    for (uint32_t i = k / 2; i-- > 0;)
+        qimm_search_heap_down(candidates, k, i);
+    for (uint32_t i = k; i < count; i++) {
+        if (qimm_search_result_compare(&candidates[i], &candidates[0]) < 0) {
+            candidates[0] = candidates[i];
+            qimm_search_heap_down(candidates, k, 0);
+        }
+    }
+    qsort(candidates, k, sizeof *candidates, qimm_search_result_compare);
+}
+
+int
+qimm_search_query(struct qimm_search *search, const char *query,
+                  struct qimm_search_result *results, int max) {
+    char terms[QIMM_SEARCH_TERMS_MAX][QIMM_SEARCH_WORD_MAX];
+    int term_count = 0;
+    while (term_count < QIMM_SEARCH_TERMS_MAX &&
+           qimm_search_next_word(&query, terms[term_count]))
+        term_count++;
+    if (term_count == 0 || max <= 0)
+        return 0;
+
+    if (search->candidate_alloc < search->docs.count) {
+        void *candidates = realloc(search->candidates,
+                                   search->docs.count *
+                                   sizeof *search->candidates);
+        if (!candidates)
+            return -1;
+        search->candidates = candidates;
+        search->candidate_alloc = search->docs.count;
+    }
+    uint32_t candidate_count = 0;
+    uint32_t serial = ++search->serial;
+
+    /* every term matches the doc by its best word */
+    for (int t = 0; t < term_count; t++) {
+        const char *term = terms[t];
+        size_t len = strlen(term);
+        for (uint32_t i = qimm_search_lower_bound(search, term);
+             i < search->sorted_count &&
+             !strncmp(search->sorted[i]->text, term, len); i++) {
+            struct qimm_search_word *word = search->sorted[i];
+            uint32_t exact = word->text[len] == '\0' ? 2 : 1;
+            for (uint32_t j = 0; j < word->count; j++) {
+                struct qimm_search_doc *doc = word->postings[j].doc;
+                uint32_t score = word->postings[j].weight * exact;
+                if (t == 0 && doc->serial != serial) {
+                    doc->serial = serial;
+                    doc->terms = 0;
+                    doc->score = 0;
+                    search->candidates[candidate_count++] = doc;
+                }
+                if (doc->serial != serial || doc->terms < t)
+                    continue;
+                if (doc->terms == t) {
+                    doc->terms = t + 1;
+                    doc->term_score = score;
+                } else {
+                    doc->term_score = MAX(doc->term_score, score);
+                }
+            }
+        }
+
+        /* drop the candidates missed the term */
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < candidate_count; i++) {
+            struct qimm_search_doc *doc = search->candidates[i];
+            if (doc->terms == (uint32_t) t + 1) {
+                doc->score += doc->term_score;
+                search->candidates[n++] = doc;
+            }
+        }
+        candidate_count = n;
+    }
+
+    int count = MIN((uint32_t) max, candidate_count);
+    qimm_search_select(search->candidates, candidate_count, count);
+    for (int i = 0; i < count; i++) {
+        results[i].name = search->candidates[i]->name;
+        results[i].score = search->candidates[i]->score;
+    }
+    return count;
+}
+
+/* --------- shell --------- */
+int
+qimm_search_init(struct qimm_shell *shell) {
+    shell->search = qimm_search_create();
+    return shell->search ? 0 : -1;
+}
+
+void
+qimm_search_release(struct qimm_shell *shell) {
+    if (shell->search)
+        qimm_search_destroy(shell->search);
+    shell->search = NULL;
+}
+
+void
+qimm_search_project_update(struct qimm_project *project,
+                           struct qimm_data_background *background) {
+    struct qimm_search *search = project->shell->search;
+    if (!search)
+        return;
+
+    char *types = NULL, *data = NULL;
+    size_t size;
+    FILE *fp;
+
+    /* names and summaries of types in config */
+    if (project->config && (fp = open_memstream(&types, &size))) {
+        struct qimm_project_config_type *type;
+        wl_list_for_each(type, &project->config->types, link) {
+            fprintf(fp, "%s %s\n", type->name ?: "", type->summary ?: "");
+        }
+        fclose(fp);
+    }
+    /* the saved fields */
+    if ((fp = open_memstream(&data, &size))) {
+        if (project->output_name)
+            fprintf(fp, "%s\n", project->output_name);
+        if (background)
+            fprintf(fp, "%s %s\n", background->image ?: "",
+                    background->type ?: "");
+        fclose(fp);
+    }
+
+    const char *fields[QIMM_SEARCH_FIELD_COUNT] = {
+            [QIMM_SEARCH_FIELD_NAME] = project->name,
+            [QIMM_SEARCH_FIELD_CONFIG] = project->config_name,
+            [QIMM_SEARCH_FIELD_TYPE] = types,
+            [QIMM_SEARCH_FIELD_DATA] = data,
+    };
+    if (qimm_search_update(search, project->name, fields) < 0)
+        qimm_log("project (%s) search index failed", project->name);
+    free(types);
+    free(data);
+}
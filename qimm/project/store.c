@@ -0,0 +1,731 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+
+/*
+ * The log store keeps all project datas in one append-only file,
+ * instead of a directory with yaml files for each project.
+ *
+ * Each record is a yaml file of data directory, keyed by its path in
+ * data directory, e.g. "dashboard/config.yaml". A save appends the
+ * record, the last record of a key wins. Records are checked by crc,
+ * a torn tail after crash is dropped on open.
+ *
+ * The index of live records is built by one scan of the log on open,
+ * values are parsed in place from a shared read-only mapping of the log.
+ * The log is compacted on commit when the overwritten records are more
+ * than the live ones.
+ *
+ * The yaml tree is imported when the log is created, and exported back
+ * when the log store is turned off, see qimm_data_store_init.
+ */
+#define QIMM_DATA_STORE_FILE "store.log"
+#define QIMM_DATA_STORE_MAGIC 0x4c4d4951 /* "QIML" */
+#define QIMM_DATA_STORE_VERSION 1
+#define QIMM_DATA_STORE_RECORD_MAGIC 0x43455251 /* "QREC" */
+#define QIMM_DATA_STORE_MAP_MIN (1 << 20) /* bytes */
+#define QIMM_DATA_STORE_COMPACT_MIN (64 << 10) /* bytes of garbage */
+
+struct qimm_data_store_header {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct qimm_data_store_record {
+    uint32_t magic;
+    uint32_t crc; /* of the rest of record */
+    uint32_t key_size;
+    uint32_t value_size;
+    /* key and value follow, without '\0' */
+};
+
+struct qimm_data_store_entry {
+    struct qimm_hash_node node; /* qimm_data_store::index */
+    struct wl_list link; /* qimm_data_store::entries, first written first */
+    char *key;
+    uint64_t offset; /* of value in log */
+    uint32_t size; /* of value */
+    uint32_t record_size;
+};
+
+struct qimm_data_store {
+    char *data_path;
+    char *path; /* the log */
+    int fd;
+
+    /* index and mapping, written by the appender only */
+    pthread_rwlock_t lock;
+    struct qimm_hash index; /* qimm_data_store_entry::node */
+    struct wl_list entries; /* qimm_data_store_entry::link */
+    const char *map;
+    size_t map_size; /* may be larger than log, for appends */
+    uint64_t size; /* bytes of log */
+    uint64_t garbage; /* bytes of overwritten records */
+
+    /* one appender at a time, e.g. the data writer thread */
+    pthread_mutex_t append_mutex;
+    bool dirty; /* appended since last commit */
+};
+
+static uint32_t qimm_data_store_crc_table[256];
+static pthread_once_t qimm_data_store_crc_once = PTHREAD_ONCE_INIT;
+
+static void
+qimm_data_store_crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        qimm_data_store_crc_table[i] = c;
+    }
+}
+
+static uint32_t
+qimm_data_store_crc(const void *buf, size_t size) {
+    const uint8_t *p = buf;
+    uint32_t crc = 0xffffffff;
+    while (size--)
+        crc = qimm_data_store_crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static int
+qimm_data_store_write_all(int fd, const void *buf, size_t size) {
+    const char *p = buf;
+    while (size > 0) {
+        ssize_t len = write(fd, p, size);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += len;
+        size -= len;
+    }
+    return 0;
+}
+
+static void
+qimm_data_store_sync_dir(const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+/*
+ * map the log with room for appends, writes lock is held by caller
+ */
+static int
+qimm_data_store_map(struct qimm_data_store *store, size_t size) {
+    if (store->map && size <= store->map_size)
+        return 0;
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t map_size = MAX(size * 2, QIMM_DATA_STORE_MAP_MIN);
+    map_size = (map_size + page - 1) / page * page;
+
+    if (store->map)
+        munmap((void *) store->map, store->map_size);
+    store->map = NULL;
+    store->map_size = 0;
+
+    /* pages beyond the end of log are never read */
+    void *map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, store->fd, 0);
+    if (map == MAP_FAILED) {
+        qimm_log("data store map (%s) error: %s", store->path, strerror(errno));
+        return -1;
+    }
+    store->map = map;
+    store->map_size = map_size;
+    return 0;
+}
+
+static struct qimm_data_store_entry *
+qimm_data_store_find(struct qimm_data_store *store, const char *key) {
+    struct qimm_hash_node *node = qimm_hash_find(&store->index, key);
+    return node ? container_of(node, struct qimm_data_store_entry, node) : NULL;
+}
+
+/*
+ * point key to the record at offset, write lock is held by caller
+ */
+static int
+qimm_data_store_index(struct qimm_data_store *store, const char *key,
+                      uint64_t offset, const struct qimm_data_store_record *r) {
+    struct qimm_data_store_entry *entry = qimm_data_store_find(store, key);
+    if (entry) {
+        store->garbage += entry->record_size;
+    } else {
+        entry = zalloc(sizeof *entry);
+        if (!entry)
+            return -1;
+        entry->key = strdup(key);
+        if (!entry->key || qimm_hash_insert(&store->index, &entry->node,
+                                            entry->key) < 0) {
+            free(entry->key);
+            free(entry);
+            return -1;
+        }
+        wl_list_insert(store->entries.prev, &entry->link);
+    }
+
+    entry->offset = offset + sizeof *r + r->key_size;
+    entry->size = r->value_size;
+    entry->record_size = sizeof *r + r->key_size + r->value_size;
+    return 0;
+}
+
+/*
+ * build index from log, drop the broken tail
+ */
+static int
+qimm_data_store_replay(struct qimm_data_store *store) {
+    struct stat st;
+    if (fstat(store->fd, &st) < 0)
+        return -1;
+
+    uint64_t size = st.st_size;
+    if (size == 0) {
+        struct qimm_data_store_header header = {
+                QIMM_DATA_STORE_MAGIC, QIMM_DATA_STORE_VERSION
+        };
+        if (qimm_data_store_write_all(store->fd, &header, sizeof header) < 0)
+            return -1;
+        size = sizeof header;
+    }
+
+    if (qimm_data_store_map(store, size) < 0)
+        return -1;
+
+    struct qimm_data_store_header header;
+    if (size < sizeof header)
+        goto err_header;
+    memcpy(&header, store->map, sizeof header);
+    if (header.magic != QIMM_DATA_STORE_MAGIC ||
+        header.version != QIMM_DATA_STORE_VERSION)
+        goto err_header;
+
+    uint64_t offset = sizeof header;
+    while (offset < size) {
+        struct qimm_data_store_record r;
+        uint64_t left = size - offset;
+        if (left < sizeof r)
+            break;
+        memcpy(&r, store->map + offset, sizeof r);
+        if (r.magic != QIMM_DATA_STORE_RECORD_MAGIC || r.key_size == 0 ||
+            r.key_size > left - sizeof r ||
+            r.value_size > left - sizeof r - r.key_size)
+            break;
+
+        size_t skip = offsetof(struct qimm_data_store_record, key_size);
+        if (qimm_data_store_crc(store->map + offset + skip,
+                                sizeof r - skip + r.key_size +
+                                r.value_size) != r.crc)
+            break;
+
+        char *key = strndup(store->map + offset + sizeof r, r.key_size);
+        if (!key || qimm_data_store_index(store, key, offset, &r) < 0) {
+            free(key);
+            return -1;
+        }
+        free(key);
+        offset += sizeof r + r.key_size + r.value_size;
+    }
+
+    if (offset < size) {
+        qimm_log("data store (%s) drops %" PRIu64 " bytes of broken tail",
+                 store->path, size - offset);
+        if (ftruncate(store->fd, offset) < 0)
+            return -1;
+    }
+    store->size = offset;
+    return 0;
+
+err_header:
+    qimm_log("data store (%s) is not a qimm log", store->path);
+    return -1;
+}
+
+const char *
+qimm_data_store_key(struct qimm_data_store *store, const char *path) {
+    size_t len = strlen(store->data_path);
+    if (strncmp(path, store->data_path, len) || path[len] != '/')
+        return NULL;
+    return path + len + 1;
+}
+
+int
+qimm_data_store_write(struct qimm_data_store *store, const char *key,
+                      const void *value, size_t size) {
+    struct qimm_data_store_record r = {
+            .magic = QIMM_DATA_STORE_RECORD_MAGIC,
+            .key_size = strlen(key),
+            .value_size = size,
+    };
+    if (r.key_size == 0 || size > UINT32_MAX - sizeof r - r.key_size)
+        return -1;
+
+    size_t record_size = sizeof r + r.key_size + size;
+    char *buf = malloc(record_size);
+    if (!buf)
+        return -1;
+    memcpy(buf + sizeof r, key, r.key_size);
+    memcpy(buf + sizeof r + r.key_size, value, size);
+    memcpy(buf, &r, sizeof r);
+    size_t skip = offsetof(struct qimm_data_store_record, key_size);
+    r.crc = qimm_data_store_crc(buf + skip, record_size - skip);
+    memcpy(buf, &r, sizeof r);
+
+    pthread_mutex_lock(&store->append_mutex);
+    uint64_t offset = store->size;
+    int ret = qimm_data_store_write_all(store->fd, buf, record_size);
+    if (ret < 0) {
+        qimm_log("data store write (%s) error: %s", key, strerror(errno));
+        /* never leave a partial record before the next one */
+        if (ftruncate(store->fd, offset) < 0)
+            qimm_log("data store (%s) truncate error: %s",
+                     store->path, strerror(errno));
+    } else {
+        pthread_rwlock_wrlock(&store->lock);
+        store->size += record_size;
+        /* the record is read from file on next open if it is not mapped */
+        qimm_data_store_map(store, store->size);
+        ret = qimm_data_store_index(store, key, offset, &r);
+        store->dirty = true;
+        pthread_rwlock_unlock(&store->lock);
+    }
+    pthread_mutex_unlock(&store->append_mutex);
+
+    free(buf);
+    return ret;
+}
+
+/*
+ * rewrite live records to a new log, append mutex is held by caller
+ */
+static int
+qimm_data_store_compact(struct qimm_data_store *store) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    char *temp;
+    if (asprintf(&temp, "%s.compact", store->path) < 0)
+        return -1;
+
+    int fd = open(temp, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                  QIMM_DATA_FILE_MODE);
+    uint64_t *offsets = calloc(store->index.count + 1, sizeof *offsets);
+    if (fd < 0 || !offsets)
+        goto err;
+
+    /* the mapping is only changed by appender, read it without lock */
+    struct qimm_data_store_header header = {
+            QIMM_DATA_STORE_MAGIC, QIMM_DATA_STORE_VERSION
+    };
+    if (qimm_data_store_write_all(fd, &header, sizeof header) < 0)
+        goto err;
+    uint64_t size = sizeof header;
+    int i = 0;
+    struct qimm_data_store_entry *entry;
+    wl_list_for_each(entry, &store->entries, link) {
+        uint64_t record = entry->offset + entry->size - entry->record_size;
+        if (qimm_data_store_write_all(fd, store->map + record,
+                                      entry->record_size) < 0)
+            goto err;
+        offsets[i++] = size + entry->offset - record;
+        size += entry->record_size;
+    }
+    if (fsync(fd) < 0 || rename(temp, store->path) < 0)
+        goto err;
+    qimm_data_store_sync_dir(store->data_path);
+
+    pthread_rwlock_wrlock(&store->lock);
+    close(store->fd);
+    store->fd = fd;
+    munmap((void *) store->map, store->map_size);
+    store->map = NULL;
+    store->map_size = 0;
+    qimm_data_store_map(store, size);
+    i = 0;
+    wl_list_for_each(entry, &store->entries, link)
+        entry->offset = offsets[i++];
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    qimm_log("data store compacted %" PRIu64 " to %" PRIu64 " bytes "
+             "in %.3f ms", store->size, size,
+             timespec_sub_to_nsec(&now, &start) / 1000000.0);
+    store->size = size;
+    store->garbage = 0;
+    pthread_rwlock_unlock(&store->lock);
+
+    free(offsets);
+    free(temp);
+    return 0;
+
+err:
+    qimm_log("data store compact (%s) error: %s", store->path, strerror(errno));
+    if (fd >= 0) {
+        close(fd);
+        unlink(temp);
+    }
+    free(offsets);
+    free(temp);
+    return -1;
+}
+
+int
+qimm_data_store_commit(struct qimm_data_store *store) {
+    int ret = 0;
+
+    pthread_mutex_lock(&store->append_mutex);
+    if (store->dirty) {
+        ret = fdatasync(store->fd);
+        if (ret < 0)
+            qimm_log("data store sync (%s) error: %s",
+                     store->path, strerror(errno));
+        store->dirty = false;
+    }
+    if (ret == 0 && store->garbage > QIMM_DATA_STORE_COMPACT_MIN &&
+        store->garbage > store->size - store->garbage)
+        ret = qimm_data_store_compact(store);
+    pthread_mutex_unlock(&store->append_mutex);
+
+    return ret;
+}
+
+void *
+qimm_data_store_read(struct qimm_data_store *store, const char *key,
+                     qimm_data_store_read_func_t func, void *data) {
+    void *ret = NULL;
+
+    pthread_rwlock_rdlock(&store->lock);
+    struct qimm_data_store_entry *entry = qimm_data_store_find(store, key);
+    if (entry && store->map && entry->offset + entry->size <= store->map_size)
+        ret = func(store->map + entry->offset, entry->size, data);
+    pthread_rwlock_unlock(&store->lock);
+
+    return ret;
+}
+
+bool
+qimm_data_store_contains(struct qimm_data_store *store, const char *key) {
+    pthread_rwlock_rdlock(&store->lock);
+    bool ret = qimm_data_store_find(store, key) != NULL;
+    pthread_rwlock_unlock(&store->lock);
+    return ret;
+}
+
+int
+qimm_data_store_for_each(struct qimm_data_store *store,
+                         int (*func)(const char *key, void *data),
+                         void *data) {
+    int ret = 0;
+
+    pthread_rwlock_rdlock(&store->lock);
+    struct qimm_data_store_entry *entry;
+    wl_list_for_each(entry, &store->entries, link) {
+        if ((ret = func(entry->key, data)) < 0)
+            break;
+    }
+    pthread_rwlock_unlock(&store->lock);
+
+    return ret;
+}
+
+/* --------- yaml tree --------- */
+static int
+qimm_data_store_import_file(struct qimm_data_store *store,
+                            const char *project, const char *file) {
+    char *key, *path;
+    if (asprintf(&key, "%s/%s", project, file) < 0)
+        return -1;
+    if (asprintf(&path, "%s/%s", store->data_path, key) < 0) {
+        free(key);
+        return -1;
+    }
+
+    int ret = -1;
+    char *buf = NULL;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+        goto out;
+    buf = malloc(st.st_size ?: 1);
+    if (!buf || read(fd, buf, st.st_size) != st.st_size)
+        goto out;
+    ret = qimm_data_store_write(store, key, buf, st.st_size);
+
+out:
+    if (ret < 0)
+        qimm_log("data store import (%s) error: %s", path, strerror(errno));
+    if (fd >= 0)
+        close(fd);
+    free(buf);
+    free(path);
+    free(key);
+    return ret;
+}
+
+/*
+ * import yaml files in project directories of data directory
+ */
+static int
+qimm_data_store_import(struct qimm_data_store *store) {
+    DIR *dir = opendir(store->data_path);
+    if (!dir)
+        return 0;
+
+    int count = 0, ret = 0;
+    struct dirent *ent;
+    while (ret == 0 && (ent = readdir(dir))) {
+        if (ent->d_type != DT_DIR)
+            continue;
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+            continue;
+
+        char *path;
+        if (asprintf(&path, "%s/%s", store->data_path, ent->d_name) < 0) {
+            ret = -1;
+            break;
+        }
+        DIR *project = opendir(path);
+        free(path);
+        if (!project)
+            continue;
+
+        struct dirent *file;
+        while (ret == 0 && (file = readdir(project))) {
+            size_t len = strlen(file->d_name);
+            /* temp files of writer end with random suffix */
+            if (file->d_type != DT_REG || len <= 5 ||
+                strcmp(file->d_name + len - 5, ".yaml"))
+                continue;
+            ret = qimm_data_store_import_file(store, ent->d_name,
+                                              file->d_name);
+            count++;
+        }
+        closedir(project);
+    }
+    closedir(dir);
+
+    if (ret == 0)
+        qimm_log("data store imported %d files from %s",
+                 count, store->data_path);
+    return ret;
+}
+
+static int
+qimm_data_store_export_entry(struct qimm_data_store *store,
+                             struct qimm_data_store_entry *entry) {
+    char *path, *temp = NULL;
+    if (asprintf(&path, "%s/%s", store->data_path, entry->key) < 0)
+        return -1;
+
+    int ret = -1, fd = -1;
+    char *dir = strrchr(path, '/');
+    *dir = '\0';
+    if (mkdir(path, QIMM_DATA_DIR_MODE) < 0 && errno != EEXIST)
+        goto out;
+    *dir = '/';
+
+    if (asprintf(&temp, "%s.XXXXXX", path) < 0) {
+        temp = NULL;
+        goto out;
+    }
+    fd = mkostemp(temp, O_CLOEXEC);
+    if (fd < 0)
+        goto out;
+    fchmod(fd, QIMM_DATA_FILE_MODE);
+    if (qimm_data_store_write_all(fd, store->map + entry->offset,
+                                  entry->size) < 0 ||
+        fsync(fd) < 0 || rename(temp, path) < 0) {
+        unlink(temp);
+        goto out;
+    }
+
+    *dir = '\0';
+    qimm_data_store_sync_dir(path);
+    ret = 0;
+
+out:
+    if (ret < 0)
+        qimm_log("data store export (%s) error: %s",
+                 entry->key, strerror(errno));
+    if (fd >= 0)
+        close(fd);
+    free(temp);
+    free(path);
+    return ret;
+}
+
+/*
+ * write live records back to yaml files in data directory
+ */
+int
+qimm_data_store_export(struct qimm_data_store *store) {
+    int count = 0;
+
+    pthread_rwlock_rdlock(&store->lock);
+    struct qimm_data_store_entry *entry;
+    wl_list_for_each(entry, &store->entries, link) {
+        if (qimm_data_store_export_entry(store, entry) < 0)
+            break;
+        count++;
+    }
+    bool done = count == (int) store->index.count;
+    pthread_rwlock_unlock(&store->lock);
+
+    if (done)
+        qimm_log("data store exported %d files to %s",
+                 count, store->data_path);
+    return done ? 0 : -1;
+}
+
+/* --------- store --------- */
+void
+qimm_data_store_close(struct qimm_data_store *store) {
+    struct qimm_data_store_entry *entry, *tmp;
+    wl_list_for_each_safe(entry, tmp, &store->entries, link) {
+        free(entry->key);
+        free(entry);
+    }
+    qimm_hash_release(&store->index);
+
+    if (store->map)
+        munmap((void *) store->map, store->map_size);
+    if (store->fd >= 0)
+        close(store->fd);
+    pthread_mutex_destroy(&store->append_mutex);
+    pthread_rwlock_destroy(&store->lock);
+    free(store->path);
+    free(store->data_path);
+    free(store);
+}
+
+/*
+ * open the log in data directory, the yaml tree is imported to a new log
+ */
+struct qimm_data_store *
+qimm_data_store_open(const char *data_path) {
+    pthread_once(&qimm_data_store_crc_once, qimm_data_store_crc_init);
+
+    struct qimm_data_store *store = zalloc(sizeof *store);
+    if (!store)
+        return NULL;
+
+    store->fd = -1;
+    pthread_rwlock_init(&store->lock, NULL);
+    pthread_mutex_init(&store->append_mutex, NULL);
+    qimm_hash_init(&store->index, true);
+    wl_list_init(&store->entries);
+
+    char *temp = NULL;
+    store->data_path = strdup(data_path);
+    if (!store->data_path ||
+        asprintf(&store->path, "%s/%s", data_path, QIMM_DATA_STORE_FILE) < 0) {
+        store->path = NULL;
+        goto err;
+    }
+
+    store->fd = open(store->path, O_RDWR | O_APPEND | O_CLOEXEC);
+    bool import = store->fd < 0 && errno == ENOENT;
+    /* a log is complete once renamed, import it aside */
+    if (import) {
+        if (asprintf(&temp, "%s.import", store->path) < 0) {
+            temp = NULL;
+            goto err;
+        }
+        store->fd = open(temp, O_RDWR | O_CREAT | O_TRUNC | O_APPEND |
+                               O_CLOEXEC, QIMM_DATA_FILE_MODE);
+    }
+    if (store->fd < 0) {
+        qimm_log("data store open (%s) error: %s",
+                 store->path, strerror(errno));
+        goto err;
+    }
+
+    if (qimm_data_store_replay(store) < 0)
+        goto err;
+
+    if (import) {
+        if (qimm_data_store_import(store) < 0 || fsync(store->fd) < 0 ||
+            rename(temp, store->path) < 0)
+            goto err;
+        qimm_data_store_sync_dir(data_path);
+        store->dirty = false;
+    }
+
+    free(temp);
+    return store;
+
+err:
+    if (temp) {
+        unlink(temp);
+        free(temp);
+    }
+    qimm_data_store_close(store);
+    return NULL;
+}
+
+/*
+ * use the log store when QIMM_DATA_STORE is log,
+ * otherwise export the log left by last run back to yaml files.
+ */
+int
+qimm_data_store_init(struct qimm_shell *shell) {
+    const char *type = getenv(QIMM_DATA_STORE);
+
+    if (type && !strcmp(type, "log")) {
+        struct timespec start, now;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        shell->data_store = qimm_data_store_open(shell->data_path);
+        if (!shell->data_store)
+            return -1;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        qimm_log("data store opened %u files in %.3f ms",
+                 shell->data_store->index.count,
+                 timespec_sub_to_nsec(&now, &start) / 1000000.0);
+        return 0;
+    }
+
+    char *path;
+    if (asprintf(&path, "%s/%s", shell->data_path, QIMM_DATA_STORE_FILE) < 0)
+        return -1;
+    int ret = 0;
+    if (access(path, F_OK) == 0) {
+        struct qimm_data_store *store = qimm_data_store_open(shell->data_path);
+        ret = store ? qimm_data_store_export(store) : -1;
+        if (store)
+            qimm_data_store_close(store);
+        /* keep the log until all files are exported */
+        if (ret == 0)
+            unlink(path);
+    }
+    free(path);
+    return ret;
+}
+
+void
+qimm_data_store_release(struct qimm_shell *shell) {
+    if (!shell->data_store)
+        return;
+
+    qimm_data_store_commit(shell->data_store);
+    qimm_data_store_close(shell->data_store);
+    shell->data_store = NULL;
+}
@@ -0,0 +1,1429 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+
+#include <sys/un.h>
+
+/*
+ * Sync projects to other device as content addressed chunks.
+ *
+ * Each file of project is cut into chunks by a rolling gear hash, so an
+ * edit only changes the chunks around it. A chunk is named by sha256 of
+ * its content, and a manifest per project lists the chunks of each file:
+ *
+ *     qimm-manifest 1
+ *     file <size> <chunk count> <name>
+ *     <sha256 hex> <size>
+ *     ...
+ *
+ * Export asks the peer which chunks it misses and sends only those,
+ * import fetches only the chunks not in local files of the project.
+ *
+ * The peer is a directory, or a qimm-syncd serving a directory over
+ * a unix socket with "unix:<path>".
+ *
+ * Import and export run on a worker. weston_log is not thread-safe, the
+ * log of worker is kept by qimm_log_defer and written when it is joined.
+ */
+#define QIMM_SYNC_MANIFEST_MAGIC "qimm-manifest 1"
+#define QIMM_SYNC_CHUNK_MIN (2 << 10)
+#define QIMM_SYNC_CHUNK_MAX (64 << 10)
+/* 13 bits for chunks of 8 KiB in average */
+#define QIMM_SYNC_CHUNK_MASK 0xfff8000000000000ULL
+#define QIMM_SYNC_MESSAGE_MAX (256 << 20)
+/* a peer not answering in time is taken as failed */
+#define QIMM_SYNC_SOCKET_TIMEOUT_SEC 10
+
+struct qimm_sync_chunk {
+    struct qimm_hash_node node; /* qimm_sync_files::index */
+    char hex[QIMM_SHA256_SIZE * 2 + 1];
+    uint8_t id[QIMM_SHA256_SIZE];
+    const char *data; /* NULL when not fetched or local */
+    uint32_t size;
+    bool owned; /* data is fetched from peer */
+};
+
+struct qimm_sync_file {
+    char *name;
+    uint64_t size;
+    char *content; /* NULL when not local */
+    struct qimm_sync_chunk **chunks;
+    int chunk_count;
+};
+
+struct qimm_sync_files {
+    struct qimm_sync_file *files;
+    int count, alloc;
+    /* unique chunks of files, in order of first use */
+    struct qimm_hash index; /* qimm_sync_chunk::node */
+    struct qimm_sync_chunk **chunks;
+    uint32_t chunk_count, chunk_alloc;
+};
+
+struct qimm_sync_peer_interface {
+    /* set missing[i] when the chunk is not in peer */
+    int (*missing)(struct qimm_sync_peer *peer,
+                   const uint8_t (*ids)[QIMM_SHA256_SIZE], uint32_t count,
+                   bool *missing);
+    int (*put_chunk)(struct qimm_sync_peer *peer,
+                     const uint8_t id[QIMM_SHA256_SIZE],
+                     const void *data, size_t size);
+    char *(*get_chunk)(struct qimm_sync_peer *peer,
+                       const uint8_t id[QIMM_SHA256_SIZE], size_t *size);
+    /* the chunks put before are durable when manifest is put */
+    int (*put_manifest)(struct qimm_sync_peer *peer, const char *name,
+                        const char *data, size_t size);
+    char *(*get_manifest)(struct qimm_sync_peer *peer, const char *name,
+                          size_t *size);
+    /* names of projects, free with free_command_line */
+    char **(*list)(struct qimm_sync_peer *peer);
+    void (*destroy)(struct qimm_sync_peer *peer);
+};
+
+struct qimm_sync_peer {
+    const struct qimm_sync_peer_interface *impl;
+};
+
+/* --------- chunks --------- */
+static uint64_t qimm_sync_gear[256];
+static pthread_once_t qimm_sync_gear_once = PTHREAD_ONCE_INIT;
+
+/* the table must be the same on all devices */
+static void
+qimm_sync_gear_init(void) {
+    uint64_t x = 0x7169696d2d73796eULL;
+    for (int i = 0; i < 256; i++) {
+        /* splitmix64 */
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        qimm_sync_gear[i] = z ^ (z >> 31);
+    }
+}
+
+/*
+ * return size of the first chunk in data
+ */
+static size_t
+qimm_sync_chunk_cut(const uint8_t *data, size_t size) {
+    if (size <= QIMM_SYNC_CHUNK_MIN)
+        return size;
+
+    size_t max = MIN(size, QIMM_SYNC_CHUNK_MAX);
+    uint64_t h = 0;
+    for (size_t i = QIMM_SYNC_CHUNK_MIN; i < max; i++) {
+        h = (h << 1) + qimm_sync_gear[data[i]];
+        if (!(h & QIMM_SYNC_CHUNK_MASK))
+            return i + 1;
+    }
+    return max;
+}
+
+static void
+qimm_sync_hex(const uint8_t id[QIMM_SHA256_SIZE], char *hex) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < QIMM_SHA256_SIZE; i++) {
+        hex[i * 2] = digits[id[i] >> 4];
+        hex[i * 2 + 1] = digits[id[i] & 0xf];
+    }
+    hex[QIMM_SHA256_SIZE * 2] = '\0';
+}
+
+static int
+qimm_sync_unhex(const char *hex, uint8_t id[QIMM_SHA256_SIZE]) {
+    for (int i = 0; i < QIMM_SHA256_SIZE * 2; i++) {
+        char c = hex[i];
+        int v = c >= '0' && c <= '9' ? c - '0' :
+                c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (v < 0)
+            return -1;
+        if (i % 2 == 0)
+            id[i / 2] = v << 4;
+        else
+            id[i / 2] |= v;
+    }
+    return 0;
+}
+
+/*
+ * names from peer must stay in data directory
+ */
+static bool
+qimm_sync_name_valid(const char *name) {
+    return name[0] && name[0] != '.' && !strchr(name, '/');
+}
+
+/*
+ * find or add the chunk, data is kept for a new chunk
+ */
+static struct qimm_sync_chunk *
+qimm_sync_chunk_add(struct qimm_sync_files *files,
+                    const uint8_t id[QIMM_SHA256_SIZE],
+                    const char *data, uint32_t size) {
+    char hex[QIMM_SHA256_SIZE * 2 + 1];
+    qimm_sync_hex(id, hex);
+
+    struct qimm_hash_node *node = qimm_hash_find(&files->index, hex);
+    if (node)
+        return container_of(node, struct qimm_sync_chunk, node);
+
+    if (files->chunk_count == files->chunk_alloc) {
+        uint32_t alloc = files->chunk_alloc ? files->chunk_alloc * 2 : 64;
+        void *chunks = realloc(files->chunks, alloc * sizeof *files->chunks);
+        if (!chunks)
+            return NULL;
+        files->chunks = chunks;
+        files->chunk_alloc = alloc;
+    }
+
+    struct qimm_sync_chunk *chunk = zalloc(sizeof *chunk);
+    if (!chunk)
+        return NULL;
+    memcpy(chunk->id, id, sizeof chunk->id);
+    memcpy(chunk->hex, hex, sizeof chunk->hex);
+    chunk->data = data;
+    chunk->size = size;
+    if (qimm_hash_insert(&files->index, &chunk->node, chunk->hex) < 0) {
+        free(chunk);
+        return NULL;
+    }
+    files->chunks[files->chunk_count++] = chunk;
+    return chunk;
+}
+
+static struct qimm_sync_file *
+qimm_sync_file_add(struct qimm_sync_files *files, const char *name,
+                   uint64_t size) {
+    if (files->count == files->alloc) {
+        int alloc = files->alloc ? files->alloc * 2 : 16;
+        struct qimm_sync_file *f = realloc(files->files, alloc * sizeof *f);
+        if (!f)
+            return NULL;
+        files->files = f;
+        files->alloc = alloc;
+    }
+
+    struct qimm_sync_file *file = &files->files[files->count];
+    memset(file, 0, sizeof *file);
+    file->name = strdup(name);
+    if (!file->name)
+        return NULL;
+    file->size = size;
+    files->count++;
+    return file;
+}
+
+static int
+qimm_sync_file_add_chunk(struct qimm_sync_file *file,
+                         struct qimm_sync_chunk *chunk, int *alloc) {
+    if (file->chunk_count == *alloc) {
+        *alloc = *alloc ? *alloc * 2 : 4;
+        void *chunks = realloc(file->chunks, *alloc * sizeof *file->chunks);
+        if (!chunks)
+            return -1;
+        file->chunks = chunks;
+    }
+    file->chunks[file->chunk_count++] = chunk;
+    return 0;
+}
+
+static void
+qimm_sync_files_init(struct qimm_sync_files *files) {
+    memset(files, 0, sizeof *files);
+    qimm_hash_init(&files->index, true);
+}
+
+static void
+qimm_sync_files_release(struct qimm_sync_files *files) {
+    for (int i = 0; i < files->count; i++) {
+        free(files->files[i].name);
+        free(files->files[i].content);
+        free(files->files[i].chunks);
+    }
+    free(files->files);
+
+    for (uint32_t i = 0; i < files->chunk_count; i++) {
+        if (files->chunks[i]->owned)
+            free((char *) files->chunks[i]->data);
+        free(files->chunks[i]);
+    }
+    free(files->chunks);
+    qimm_hash_release(&files->index);
+}
+
+/*
+ * keep a copy of local file, cut into chunks
+ */
+static int
+qimm_sync_files_add_local(const char *name, const char *value, size_t size,
+                          void *data) {
+    struct qimm_sync_files *files = data;
+
+    struct qimm_sync_file *file = qimm_sync_file_add(files, name, size);
+    if (!file)
+        return -1;
+    file->content = malloc(size ?: 1);
+    if (!file->content)
+        return -1;
+    memcpy(file->content, value, size);
+
+    int alloc = 0;
+    const uint8_t *p = (const uint8_t *) file->content;
+    for (size_t offset = 0; offset < size;) {
+        size_t len = qimm_sync_chunk_cut(p + offset, size - offset);
+        uint8_t id[QIMM_SHA256_SIZE];
+        qimm_sha256(p + offset, len, id);
+        struct qimm_sync_chunk *chunk =
+                qimm_sync_chunk_add(files, id, file->content + offset, len);
+        if (!chunk || qimm_sync_file_add_chunk(file, chunk, &alloc) < 0)
+            return -1;
+        offset += len;
+    }
+    return 0;
+}
+
+static char *
+qimm_sync_manifest_write(struct qimm_sync_files *files, size_t *size) {
+    char *buf = NULL;
+    FILE *fp = open_memstream(&buf, size);
+    if (!fp)
+        return NULL;
+
+    fprintf(fp, "%s\n", QIMM_SYNC_MANIFEST_MAGIC);
+    for (int i = 0; i < files->count; i++) {
+        struct qimm_sync_file *file = &files->files[i];
+        fprintf(fp, "file %" PRIu64 " %d %s\n",
+                file->size, file->chunk_count, file->name);
+        for (int j = 0; j < file->chunk_count; j++)
+            fprintf(fp, "%s %u\n", file->chunks[j]->hex, file->chunks[j]->size);
+    }
+
+    if (fclose(fp) != 0) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+static int
+qimm_sync_manifest_read(struct qimm_sync_files *files, char *text) {
+    char *save = NULL;
+    char *line = strtok_r(text, "\n", &save);
+    if (!line || strcmp(line, QIMM_SYNC_MANIFEST_MAGIC))
+        return -1;
+
+    while ((line = strtok_r(NULL, "\n", &save))) {
+        uint64_t size;
+        int count, name_pos = 0;
+        if (sscanf(line, "file %" SCNu64 " %d %n", &size, &count,
+                   &name_pos) != 2 || name_pos == 0 || count < 0)
+            return -1;
+        const char *name = line + name_pos;
+        if (!qimm_sync_name_valid(name))
+            return -1;
+
+        struct qimm_sync_file *file = qimm_sync_file_add(files, name, size);
+        if (!file)
+            return -1;
+
+        int alloc = 0;
+        uint64_t total = 0;
+        for (int i = 0; i < count; i++) {
+            line = strtok_r(NULL, "\n", &save);
+            uint8_t id[QIMM_SHA256_SIZE];
+            unsigned int chunk_size;
+            if (!line || strlen(line) < QIMM_SHA256_SIZE * 2 + 2 ||
+                qimm_sync_unhex(line, id) < 0 ||
+                sscanf(line + QIMM_SHA256_SIZE * 2, " %u", &chunk_size) != 1 ||
+                chunk_size > QIMM_SYNC_CHUNK_MAX)
+                return -1;
+
+            struct qimm_sync_chunk *chunk =
+                    qimm_sync_chunk_add(files, id, NULL, chunk_size);
+            if (!chunk || chunk->size != chunk_size ||
+                qimm_sync_file_add_chunk(file, chunk, &alloc) < 0)
+                return -1;
+            total += chunk_size;
+        }
+        if (total != size)
+            return -1;
+    }
+    return 0;
+}
+
+/* --------- sync --------- */
+static uint64_t
+qimm_sync_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return timespec_to_nsec(&now);
+}
+
+int
+qimm_sync_project_export(struct qimm_shell *shell, const char *name,
+                         struct qimm_sync_peer *peer,
+                         struct qimm_sync_stat *stat) {
+    pthread_once(&qimm_sync_gear_once, qimm_sync_gear_init);
+    memset(stat, 0, sizeof *stat);
+    uint64_t start = qimm_sync_now();
+
+    struct qimm_sync_files files;
+    qimm_sync_files_init(&files);
+    uint8_t (*ids)[QIMM_SHA256_SIZE] = NULL;
+    bool *missing = NULL;
+    char *manifest = NULL;
+    int ret = -1;
+
+    if (qimm_data_for_each_file(shell, name, qimm_sync_files_add_local,
+                                &files) < 0)
+        goto out;
+    if (files.count == 0) {
+        qimm_log("project (%s) sync export: no files", name);
+        goto out;
+    }
+    for (int i = 0; i < files.count; i++)
+        stat->bytes += files.files[i].size;
+
+    /* ask peer for the unique chunks in one request */
+    uint32_t n = files.chunk_count;
+    ids = calloc(n, sizeof *ids);
+    missing = calloc(n, sizeof *missing);
+    if (!ids || !missing)
+        goto out;
+    for (uint32_t i = 0; i < n; i++)
+        memcpy(ids[i], files.chunks[i]->id, sizeof ids[i]);
+    stat->chunks = n;
+
+    if (peer->impl->missing(peer, (const uint8_t (*)[QIMM_SHA256_SIZE]) ids,
+                            n, missing) < 0)
+        goto out;
+    for (uint32_t i = 0; i < n; i++) {
+        struct qimm_sync_chunk *chunk = files.chunks[i];
+        if (!missing[i])
+            continue;
+        if (peer->impl->put_chunk(peer, chunk->id, chunk->data,
+                                  chunk->size) < 0)
+            goto out;
+        stat->chunks_sent++;
+        stat->bytes_sent += chunk->size;
+    }
+
+    size_t size;
+    manifest = qimm_sync_manifest_write(&files, &size);
+    if (!manifest || peer->impl->put_manifest(peer, name, manifest, size) < 0)
+        goto out;
+    ret = 0;
+
+out:
+    stat->nsec = qimm_sync_now() - start;
+    if (ret < 0)
+        qimm_log("project (%s) sync export failed", name);
+    free(manifest);
+    free(missing);
+    free(ids);
+    qimm_sync_files_release(&files);
+    return ret;
+}
+
+static bool
+qimm_sync_file_same(struct qimm_sync_files *local,
+                    struct qimm_sync_file *file) {
+    for (int i = 0; i < local->count; i++) {
+        struct qimm_sync_file *l = &local->files[i];
+        if (strcmp(l->name, file->name))
+            continue;
+        if (l->chunk_count != file->chunk_count)
+            return false;
+        for (int j = 0; j < l->chunk_count; j++) {
+            if (memcmp(l->chunks[j]->id, file->chunks[j]->id,
+                       QIMM_SHA256_SIZE))
+                return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+int
+qimm_sync_project_import(struct qimm_shell *shell, const char *name,
+                         struct qimm_sync_peer *peer,
+                         struct qimm_sync_stat *stat) {
+    pthread_once(&qimm_sync_gear_once, qimm_sync_gear_init);
+    memset(stat, 0, sizeof *stat);
+    uint64_t start = qimm_sync_now();
+
+    if (!qimm_sync_name_valid(name))
+        return -1;
+
+    /* the local chunks are found by remote manifest, in one table */
+    struct qimm_sync_files local, remote;
+    qimm_sync_files_init(&local);
+    qimm_sync_files_init(&remote);
+    char *manifest = NULL, *content = NULL;
+    int ret = -1;
+
+    size_t size;
+    manifest = peer->impl->get_manifest(peer, name, &size);
+    if (!manifest)
+        goto out;
+    if (qimm_sync_manifest_read(&remote, manifest) < 0) {
+        qimm_log("project (%s) sync import: bad manifest", name);
+        goto out;
+    }
+    if (qimm_data_for_each_file(shell, name, qimm_sync_files_add_local,
+                                &local) < 0)
+        goto out;
+
+    for (int i = 0; i < remote.count; i++) {
+        struct qimm_sync_file *file = &remote.files[i];
+        stat->bytes += file->size;
+        stat->chunks += file->chunk_count;
+        if (qimm_sync_file_same(&local, file))
+            continue;
+
+        content = malloc(file->size ?: 1);
+        if (!content)
+            goto out;
+        char *p = content;
+        for (int j = 0; j < file->chunk_count; j++) {
+            struct qimm_sync_chunk *chunk = file->chunks[j];
+            struct qimm_hash_node *node =
+                    qimm_hash_find(&local.index, chunk->hex);
+            if (node) {
+                chunk->data = container_of(node, struct qimm_sync_chunk,
+                                           node)->data;
+            } else if (!chunk->data) {
+                size_t chunk_size;
+                char *data = peer->impl->get_chunk(peer, chunk->id,
+                                                   &chunk_size);
+                uint8_t id[QIMM_SHA256_SIZE];
+                if (data)
+                    qimm_sha256(data, chunk_size, id);
+                if (!data || chunk_size != chunk->size ||
+                    memcmp(id, chunk->id, QIMM_SHA256_SIZE)) {
+                    qimm_log("project (%s) sync import: bad chunk %s",
+                             name, chunk->hex);
+                    free(data);
+                    goto out;
+                }
+                /* the fetched chunk is reused by following files */
+                chunk->data = data;
+                chunk->owned = true;
+                stat->chunks_sent++;
+                stat->bytes_sent += chunk_size;
+            }
+            memcpy(p, chunk->data, chunk->size);
+            p += chunk->size;
+        }
+
+        if (qimm_data_put_file(shell, name, file->name, content,
+                               file->size) < 0)
+            goto out;
+        free(content);
+        content = NULL;
+    }
+
+    if (shell->data_store && qimm_data_store_commit(shell->data_store) < 0)
+        goto out;
+    ret = 0;
+
+out:
+    stat->nsec = qimm_sync_now() - start;
+    if (ret < 0)
+        qimm_log("project (%s) sync import failed", name);
+    free(content);
+    free(manifest);
+    qimm_sync_files_release(&local);
+    qimm_sync_files_release(&remote);
+    return ret;
+}
+
+/* --------- directory peer --------- */
+/*
+ * <dir>/chunks/<first 2 hex>/<rest hex>
+ * <dir>/manifests/<project name>
+ */
+struct qimm_sync_dir {
+    struct qimm_sync_peer base;
+    int fd;
+};
+
+static void
+qimm_sync_dir_chunk_path(const uint8_t id[QIMM_SHA256_SIZE], char *path) {
+    char hex[QIMM_SHA256_SIZE * 2 + 1];
+    qimm_sync_hex(id, hex);
+    sprintf(path, "chunks/%.2s/%s", hex, hex + 2);
+}
+
+static int
+qimm_sync_write_all(int fd, const void *buf, size_t size) {
+    const char *p = buf;
+    while (size > 0) {
+        ssize_t len = write(fd, p, size);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += len;
+        size -= len;
+    }
+    return 0;
+}
+
+static int
+qimm_sync_read_all(int fd, void *buf, size_t size) {
+    char *p = buf;
+    while (size > 0) {
+        ssize_t len = read(fd, p, size);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            return -1;
+        p += len;
+        size -= len;
+    }
+    return 0;
+}
+
+/*
+ * write file in directory by rename, sync when asked
+ */
+static int
+qimm_sync_dir_write(struct qimm_sync_dir *dir, const char *path,
+                    const void *data, size_t size, bool sync) {
+    char temp[PATH_MAX];
+    snprintf(temp, sizeof temp, "%s.%d.tmp", path, (int) gettid());
+
+    int fd = openat(dir->fd, temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    QIMM_DATA_FILE_MODE);
+    if (fd < 0)
+        return -1;
+    int ret = qimm_sync_write_all(fd, data, size);
+    if (ret == 0 && sync)
+        ret = fsync(fd);
+    close(fd);
+    if (ret == 0)
+        ret = renameat(dir->fd, temp, dir->fd, path);
+    if (ret < 0)
+        unlinkat(dir->fd, temp, 0);
+    return ret;
+}
+
+static char *
+qimm_sync_dir_read(struct qimm_sync_dir *dir, const char *path, size_t *size) {
+    int fd = openat(dir->fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    char *data = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size < QIMM_SYNC_MESSAGE_MAX) {
+        /* one more byte for manifest text */
+        data = malloc(st.st_size + 1);
+        if (data && qimm_sync_read_all(fd, data, st.st_size) == 0) {
+            data[st.st_size] = '\0';
+            *size = st.st_size;
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+    close(fd);
+    return data;
+}
+
+static int
+qimm_sync_dir_missing(struct qimm_sync_peer *peer,
+                      const uint8_t (*ids)[QIMM_SHA256_SIZE], uint32_t count,
+                      bool *missing) {
+    struct qimm_sync_dir *dir = container_of(peer, struct qimm_sync_dir, base);
+    char path[QIMM_SHA256_SIZE * 2 + 16];
+    for (uint32_t i = 0; i < count; i++) {
+        qimm_sync_dir_chunk_path(ids[i], path);
+        missing[i] = faccessat(dir->fd, path, F_OK, 0) < 0;
+    }
+    return 0;
+}
+
+static int
+qimm_sync_dir_put_chunk(struct qimm_sync_peer *peer,
+                        const uint8_t id[QIMM_SHA256_SIZE],
+                        const void *data, size_t size) {
+    struct qimm_sync_dir *dir = container_of(peer, struct qimm_sync_dir, base);
+    char path[QIMM_SHA256_SIZE * 2 + 16];
+    qimm_sync_dir_chunk_path(id, path);
+
+    /* chunks/xx */
+    path[9] = '\0';
+    if (mkdirat(dir->fd, path, QIMM_DATA_DIR_MODE) < 0 && errno != EEXIST)
+        return -1;
+    path[9] = '/';
+
+    /* synced together when manifest is put */
+    return qimm_sync_dir_write(dir, path, data, size, false);
+}
+
+static char *
+qimm_sync_dir_get_chunk(struct qimm_sync_peer *peer,
+                        const uint8_t id[QIMM_SHA256_SIZE], size_t *size) {
+    struct qimm_sync_dir *dir = container_of(peer, struct qimm_sync_dir, base);
+    char path[QIMM_SHA256_SIZE * 2 + 16];
+    qimm_sync_dir_chunk_path(id, path);
+    return qimm_sync_dir_read(dir, path, size);
+}
+
+static int
+qimm_sync_dir_put_manifest(struct qimm_sync_peer *peer, const char *name,
+                           const char *data, size_t size) {
+    struct qimm_sync_dir *dir = container_of(peer, struct qimm_sync_dir, base);
+    if (!qimm_sync_name_valid(name))
+        return -1;
+
+    /* the chunks are durable before the manifest refers to them */
+    if (syncfs(dir->fd) < 0)
+        return -1;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "manifests/%s", name);
+    if (qimm_sync_dir_write(dir, path, data, size, true) < 0)
+        return -1;
+
+    int fd = openat(dir->fd, "manifests", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    return 0;
+}
+
+static char *
+qimm_sync_dir_get_manifest(struct qimm_sync_peer *peer, const char *name,
+                           size_t *size) {
+    struct qimm_sync_dir *dir = container_of(peer, struct qimm_sync_dir, base);
+    if (!qimm_sync_name_valid(name))
+        return NULL;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "manifests/%s", name);
+    return qimm_sync_dir_read(dir, path, size);
+}
+
+static char **
+qimm_sync_dir_list(struct qimm_sync_peer *peer) {
+    struct qimm_sync_dir *dir = container_of(peer, struct qimm_sync_dir, base);
+    int fd = openat(dir->fd, "manifests", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!d) {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    int count = 0, alloc = 8;
+    char **names = calloc(alloc, sizeof *names);
+    struct dirent *ent;
+    while (names && (ent = readdir(d))) {
+        /* skip temp files of manifests */
+        if (ent->d_type != DT_REG || !qimm_sync_name_valid(ent->d_name) ||
+            strstr(ent->d_name, ".tmp"))
+            continue;
+        if (count + 1 == alloc) {
+            alloc *= 2;
+            char **n = realloc(names, alloc * sizeof *names);
+            if (!n) {
+                names[count] = NULL;
+                free_command_line(names);
+                names = NULL;
+                break;
+            }
+            names = n;
+        }
+        names[count] = strdup(ent->d_name);
+        if (names[count])
+            names[++count] = NULL;
+    }
+    closedir(d);
+    return names;
+}
+
+static void
+qimm_sync_dir_destroy(struct qimm_sync_peer *peer) {
+    struct qimm_sync_dir *dir = container_of(peer, struct qimm_sync_dir, base);
+    close(dir->fd);
+    free(dir);
+}
+
+static const struct qimm_sync_peer_interface qimm_sync_dir_interface = {
+        qimm_sync_dir_missing,
+        qimm_sync_dir_put_chunk,
+        qimm_sync_dir_get_chunk,
+        qimm_sync_dir_put_manifest,
+        qimm_sync_dir_get_manifest,
+        qimm_sync_dir_list,
+        qimm_sync_dir_destroy,
+};
+
+static struct qimm_sync_peer *
+qimm_sync_dir_open(const char *path) {
+    struct qimm_sync_dir *dir = zalloc(sizeof *dir);
+    if (!dir)
+        return NULL;
+
+    mkdir(path, QIMM_DATA_DIR_MODE);
+    dir->fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir->fd < 0 ||
+        (mkdirat(dir->fd, "chunks", QIMM_DATA_DIR_MODE) < 0 &&
+         errno != EEXIST) ||
+        (mkdirat(dir->fd, "manifests", QIMM_DATA_DIR_MODE) < 0 &&
+         errno != EEXIST)) {
+        qimm_log("sync peer (%s) open error: %s", path, strerror(errno));
+        if (dir->fd >= 0)
+            close(dir->fd);
+        free(dir);
+        return NULL;
+    }
+
+    dir->base.impl = &qimm_sync_dir_interface;
+    return &dir->base;
+}
+
+/* --------- socket peer --------- */
+/*
+ * Each request gets one response:
+ *     MISSING       ids of count chunks      -> count bytes, 1 for missing
+ *     PUT_CHUNK     id, data                 -> none
+ *     GET_CHUNK     id                       -> data
+ *     PUT_MANIFEST  name, '\0', manifest     -> none
+ *     GET_MANIFEST  name                     -> manifest
+ *     LIST          none                     -> names ended by '\0'
+ */
+enum qimm_sync_op {
+    QIMM_SYNC_OP_MISSING = 1,
+    QIMM_SYNC_OP_PUT_CHUNK,
+    QIMM_SYNC_OP_GET_CHUNK,
+    QIMM_SYNC_OP_PUT_MANIFEST,
+    QIMM_SYNC_OP_GET_MANIFEST,
+    QIMM_SYNC_OP_LIST,
+};
+
+struct qimm_sync_request {
+    uint32_t op;
+    uint32_t count;
+    uint64_t size; /* of payload */
+};
+
+struct qimm_sync_response {
+    int32_t status; /* 0 or -1 */
+    uint32_t padding;
+    uint64_t size; /* of payload */
+};
+
+struct qimm_sync_socket {
+    struct qimm_sync_peer base;
+    int fd;
+};
+
+/*
+ * send request and return response payload, or NULL when failed.
+ * empty payload is returned as an empty string.
+ */
+static char *
+qimm_sync_socket_call(struct qimm_sync_socket *sock, uint32_t op,
+                      uint32_t count, const void *head, size_t head_size,
+                      const void *body, size_t body_size, size_t *size) {
+    struct qimm_sync_request request = {op, count, head_size + body_size};
+    struct qimm_sync_response response;
+
+    if (qimm_sync_write_all(sock->fd, &request, sizeof request) < 0 ||
+        qimm_sync_write_all(sock->fd, head, head_size) < 0 ||
+        qimm_sync_write_all(sock->fd, body, body_size) < 0 ||
+        qimm_sync_read_all(sock->fd, &response, sizeof response) < 0 ||
+        response.size >= QIMM_SYNC_MESSAGE_MAX) {
+        qimm_log("sync peer socket error: %s", strerror(errno));
+        return NULL;
+    }
+
+    /* one more byte for manifest text */
+    char *payload = malloc(response.size + 1);
+    if (!payload ||
+        qimm_sync_read_all(sock->fd, payload, response.size) < 0) {
+        free(payload);
+        return NULL;
+    }
+    payload[response.size] = '\0';
+    if (response.status < 0) {
+        free(payload);
+        return NULL;
+    }
+    if (size)
+        *size = response.size;
+    return payload;
+}
+
+static int
+qimm_sync_socket_missing(struct qimm_sync_peer *peer,
+                         const uint8_t (*ids)[QIMM_SHA256_SIZE],
+                         uint32_t count, bool *missing) {
+    struct qimm_sync_socket *sock =
+            container_of(peer, struct qimm_sync_socket, base);
+    size_t size;
+    char *flags = qimm_sync_socket_call(sock, QIMM_SYNC_OP_MISSING, count,
+                                        ids, count * QIMM_SHA256_SIZE,
+                                        NULL, 0, &size);
+    if (!flags || size != count) {
+        free(flags);
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++)
+        missing[i] = flags[i];
+    free(flags);
+    return 0;
+}
+
+static int
+qimm_sync_socket_put_chunk(struct qimm_sync_peer *peer,
+                           const uint8_t id[QIMM_SHA256_SIZE],
+                           const void *data, size_t size) {
+    struct qimm_sync_socket *sock =
+            container_of(peer, struct qimm_sync_socket, base);
+    char *ret = qimm_sync_socket_call(sock, QIMM_SYNC_OP_PUT_CHUNK, 1,
+                                      id, QIMM_SHA256_SIZE, data, size, NULL);
+    free(ret);
+    return ret ? 0 : -1;
+}
+
+static char *
+qimm_sync_socket_get_chunk(struct qimm_sync_peer *peer,
+                           const uint8_t id[QIMM_SHA256_SIZE], size_t *size) {
+    struct qimm_sync_socket *sock =
+            container_of(peer, struct qimm_sync_socket, base);
+    return qimm_sync_socket_call(sock, QIMM_SYNC_OP_GET_CHUNK, 1,
+                                 id, QIMM_SHA256_SIZE, NULL, 0, size);
+}
+
+static int
+qimm_sync_socket_put_manifest(struct qimm_sync_peer *peer, const char *name,
+                              const char *data, size_t size) {
+    struct qimm_sync_socket *sock =
+            container_of(peer, struct qimm_sync_socket, base);
+    char *ret = qimm_sync_socket_call(sock, QIMM_SYNC_OP_PUT_MANIFEST, 1,
+                                      name, strlen(name) + 1, data, size,
+                                      NULL);
+    free(ret);
+    return ret ? 0 : -1;
+}
+
+static char *
+qimm_sync_socket_get_manifest(struct qimm_sync_peer *peer, const char *name,
+                              size_t *size) {
+    struct qimm_sync_socket *sock =
+            container_of(peer, struct qimm_sync_socket, base);
+    return qimm_sync_socket_call(sock, QIMM_SYNC_OP_GET_MANIFEST, 1,
+                                 name, strlen(name), NULL, 0, size);
+}
+
+/*
+ * split '\0' ended strings into a NULL ended array
+ */
+static char **
+qimm_sync_split_names(const char *data, size_t size) {
+    int count = 0;
+    for (size_t i = 0; i < size; i++)
+        count += data[i] == '\0';
+
+    char **names = calloc(count + 1, sizeof *names);
+    if (!names)
+        return NULL;
+    const char *p = data;
+    for (int i = 0; i < count; i++) {
+        if (!(names[i] = strdup(p))) {
+            free_command_line(names);
+            return NULL;
+        }
+        p += strlen(p) + 1;
+    }
+    return names;
+}
+
+static char **
+qimm_sync_socket_list(struct qimm_sync_peer *peer) {
+    struct qimm_sync_socket *sock =
+            container_of(peer, struct qimm_sync_socket, base);
+    size_t size;
+    char *data = qimm_sync_socket_call(sock, QIMM_SYNC_OP_LIST, 0,
+                                       NULL, 0, NULL, 0, &size);
+    if (!data)
+        return NULL;
+    char **names = qimm_sync_split_names(data, size);
+    free(data);
+    return names;
+}
+
+static void
+qimm_sync_socket_destroy(struct qimm_sync_peer *peer) {
+    struct qimm_sync_socket *sock =
+            container_of(peer, struct qimm_sync_socket, base);
+    close(sock->fd);
+    free(sock);
+}
+
+static const struct qimm_sync_peer_interface qimm_sync_socket_interface = {
+        qimm_sync_socket_missing,
+        qimm_sync_socket_put_chunk,
+        qimm_sync_socket_get_chunk,
+        qimm_sync_socket_put_manifest,
+        qimm_sync_socket_get_manifest,
+        qimm_sync_socket_list,
+        qimm_sync_socket_destroy,
+};
+
+static struct qimm_sync_peer *
+qimm_sync_socket_open(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof addr.sun_path)
+        return NULL;
+    strcpy(addr.sun_path, path);
+
+    struct qimm_sync_socket *sock = zalloc(sizeof *sock);
+    if (!sock)
+        return NULL;
+    sock->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock->fd < 0 ||
+        connect(sock->fd, (struct sockaddr *) &addr, sizeof addr) < 0) {
+        qimm_log("sync peer (%s) connect error: %s", path, strerror(errno));
+        if (sock->fd >= 0)
+            close(sock->fd);
+        free(sock);
+        return NULL;
+    }
+
+    struct timeval timeout = {.tv_sec = QIMM_SYNC_SOCKET_TIMEOUT_SEC};
+    if (setsockopt(sock->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                   sizeof timeout) < 0 ||
+        setsockopt(sock->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                   sizeof timeout) < 0)
+        qimm_log("sync peer (%s) timeout error: %s", path, strerror(errno));
+
+    sock->base.impl = &qimm_sync_socket_interface;
+    return &sock->base;
+}
+
+int
+qimm_sync_peer_serve(struct qimm_sync_peer *peer, int fd) {
+    for (;;) {
+        struct qimm_sync_request request;
+        ssize_t len;
+        do {
+            len = read(fd, &request, sizeof request);
+        } while (len < 0 && errno == EINTR);
+        if (len == 0)
+            return 0;
+        if (len != sizeof request &&
+            (len < 0 || qimm_sync_read_all(fd, (char *) &request + len,
+                                           sizeof request - len) < 0))
+            return -1;
+        if (request.size >= QIMM_SYNC_MESSAGE_MAX)
+            return -1;
+
+        char *payload = malloc(request.size + 1);
+        if (!payload || qimm_sync_read_all(fd, payload, request.size) < 0) {
+            free(payload);
+            return -1;
+        }
+        payload[request.size] = '\0';
+
+        char *reply = NULL;
+        size_t reply_size = 0;
+        int status = -1;
+        switch (request.op) {
+            case QIMM_SYNC_OP_MISSING: {
+                if (request.size != (uint64_t) request.count * QIMM_SHA256_SIZE)
+                    break;
+                bool *missing = calloc(request.count ?: 1, sizeof *missing);
+                reply = malloc(request.count ?: 1);
+                if (missing && reply &&
+                    peer->impl->missing(peer, (const void *) payload,
+                                        request.count, missing) == 0) {
+                    for (uint32_t i = 0; i < request.count; i++)
+                        reply[i] = missing[i];
+                    reply_size = request.count;
+                    status = 0;
+                }
+                free(missing);
+                break;
+            }
+            case QIMM_SYNC_OP_PUT_CHUNK: {
+                uint8_t id[QIMM_SHA256_SIZE];
+                if (request.size < QIMM_SHA256_SIZE)
+                    break;
+                /* never keep a chunk under a wrong name */
+                qimm_sha256(payload + QIMM_SHA256_SIZE,
+                            request.size - QIMM_SHA256_SIZE, id);
+                if (memcmp(id, payload, QIMM_SHA256_SIZE))
+                    break;
+                status = peer->impl->put_chunk(peer, id,
+                                               payload + QIMM_SHA256_SIZE,
+                                               request.size - QIMM_SHA256_SIZE);
+                break;
+            }
+            case QIMM_SYNC_OP_GET_CHUNK:
+                if (request.size != QIMM_SHA256_SIZE)
+                    break;
+                reply = peer->impl->get_chunk(peer, (uint8_t *) payload,
+                                              &reply_size);
+                status = reply ? 0 : -1;
+                break;
+            case QIMM_SYNC_OP_PUT_MANIFEST: {
+                size_t name_len = strnlen(payload, request.size);
+                if (name_len == request.size)
+                    break;
+                status = peer->impl->put_manifest(peer, payload,
+                                                  payload + name_len + 1,
+                                                  request.size - name_len - 1);
+                break;
+            }
+            case QIMM_SYNC_OP_GET_MANIFEST:
+                reply = peer->impl->get_manifest(peer, payload, &reply_size);
+                status = reply ? 0 : -1;
+                break;
+            case QIMM_SYNC_OP_LIST: {
+                char **names = peer->impl->list(peer);
+                FILE *fp = names ? open_memstream(&reply, &reply_size) : NULL;
+                if (fp) {
+                    for (char **n = names; *n; n++)
+                        fwrite(*n, 1, strlen(*n) + 1, fp);
+                    status = fclose(fp) == 0 ? 0 : -1;
+                }
+                if (names)
+                    free_command_line(names);
+                break;
+            }
+        }
+        free(payload);
+
+        if (status < 0)
+            reply_size = 0;
+        struct qimm_sync_response response = {status, 0, reply_size};
+        int ret = qimm_sync_write_all(fd, &response, sizeof response);
+        if (ret == 0)
+            ret = qimm_sync_write_all(fd, reply, reply_size);
+        free(reply);
+        if (ret < 0)
+            return -1;
+    }
+}
+
+/* --------- peer --------- */
+struct qimm_sync_peer *
+qimm_sync_peer_open(const char *spec) {
+    if (!strncmp(spec, "unix:", 5))
+        return qimm_sync_socket_open(spec + 5);
+    return qimm_sync_dir_open(spec);
+}
+
+void
+qimm_sync_peer_close(struct qimm_sync_peer *peer) {
+    peer->impl->destroy(peer);
+}
+
+char **
+qimm_sync_peer_list(struct qimm_sync_peer *peer) {
+    return peer->impl->list(peer);
+}
+
+/* --------- shell --------- */
+struct qimm_sync {
+    struct qimm_shell *shell;
+    struct qimm_sync_peer *peer;
+
+    /* the import or export in progress, one at a time */
+    pthread_mutex_t mutex;
+    pthread_t thread;
+    bool running;
+    bool joinable;
+    char *name; /* of project exported, NULL when importing */
+    /* the log of worker, written when joined */
+    struct qimm_log_defer log;
+    int notify_error; /* errno of the failed notify, under mutex */
+
+    /* names of projects imported at startup, to load when done */
+    char **imported;
+    /* the worker notifies when done */
+    int event_fd;
+    struct wl_event_source *source;
+};
+
+static void
+qimm_sync_join(struct qimm_sync *sync) {
+    if (sync->joinable) {
+        pthread_join(sync->thread, NULL);
+        sync->joinable = false;
+        free(sync->name);
+        sync->name = NULL;
+    }
+
+    qimm_log_defer_flush(&sync->log);
+    if (sync->notify_error)
+        qimm_log("sync notify error: %s", strerror(sync->notify_error));
+    sync->notify_error = 0;
+}
+
+/* worker, under mutex */
+static void
+qimm_sync_notify(struct qimm_sync *sync) {
+    if (sync->event_fd >= 0) {
+        uint64_t one = 1;
+        if (write(sync->event_fd, &one, sizeof one) < 0 && errno != EAGAIN)
+            sync->notify_error = errno;
+    }
+}
+
+static void
+qimm_sync_import_done(struct qimm_sync *sync) {
+    if (sync->imported) {
+        free_command_line(sync->imported);
+        sync->imported = NULL;
+    }
+}
+
+static bool
+qimm_sync_project_loaded(struct qimm_shell *shell, const char *name) {
+    struct qimm_output *output;
+    wl_list_for_each(output, &shell->outputs, link) {
+        struct qimm_project *project;
+        wl_list_for_each(project, &output->projects, link) {
+            if (project->name && !strcmp(project->name, name))
+                return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * the local projects may be changed since last sync,
+ * so only the new projects are imported here
+ */
+static void *
+qimm_sync_import_thread(void *data) {
+    struct qimm_sync *sync = data;
+    qimm_log_defer_begin(&sync->log);
+    char **names = qimm_sync_peer_list(sync->peer);
+    int count = 0;
+
+    for (char **n = names; n && *n; n++) {
+        struct qimm_sync_stat stat;
+        if (!qimm_data_project_exists(sync->shell, *n) &&
+            qimm_sync_project_import(sync->shell, *n, sync->peer,
+                                     &stat) == 0) {
+            qimm_log("project (%s) imported: %" PRIu64 " bytes in %" PRIu64
+                     " ms", *n, stat.bytes_sent, stat.nsec / 1000000);
+            names[count++] = *n;
+        } else {
+            free(*n);
+        }
+    }
+    if (names)
+        names[count] = NULL;
+    qimm_log_defer_end(&sync->log);
+
+    pthread_mutex_lock(&sync->mutex);
+    sync->imported = names;
+    sync->running = false;
+    qimm_sync_notify(sync);
+    pthread_mutex_unlock(&sync->mutex);
+    return NULL;
+}
+
+static void
+qimm_sync_import_load(struct qimm_sync *sync) {
+    for (char **n = sync->imported; n && *n; n++) {
+        if (qimm_sync_project_loaded(sync->shell, *n))
+            continue;
+        if (!qimm_project_loader_load(sync->shell, *n))
+            qimm_log("project (%s) load failed", *n);
+    }
+    qimm_sync_import_done(sync);
+}
+
+static int
+qimm_sync_handle_event(int fd, uint32_t mask, void *data) {
+    struct qimm_sync *sync = data;
+
+    uint64_t count;
+    if (read(fd, &count, sizeof count) < 0 && errno != EAGAIN)
+        qimm_log("sync event error: %s", strerror(errno));
+
+    pthread_mutex_lock(&sync->mutex);
+    bool running = sync->running;
+    pthread_mutex_unlock(&sync->mutex);
+    if (running)
+        return 0;
+
+    qimm_sync_join(sync);
+    qimm_sync_import_load(sync);
+    return 0;
+}
+
+static int
+qimm_sync_event_init(struct qimm_sync *sync) {
+    struct wl_event_loop *loop =
+            wl_display_get_event_loop(sync->shell->compositor->wl_display);
+    sync->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (sync->event_fd >= 0)
+        sync->source = wl_event_loop_add_fd(loop, sync->event_fd,
+                                            WL_EVENT_READABLE,
+                                            qimm_sync_handle_event, sync);
+    if (!sync->source) {
+        qimm_log("sync event error: %s", strerror(errno));
+        if (sync->event_fd >= 0)
+            close(sync->event_fd);
+        sync->event_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static void
+qimm_sync_event_release(struct qimm_sync *sync) {
+    if (sync->source) {
+        wl_event_source_remove(sync->source);
+        sync->source = NULL;
+    }
+    if (sync->event_fd >= 0) {
+        close(sync->event_fd);
+        sync->event_fd = -1;
+    }
+}
+
+/*
+ * import on a worker, the peer may be slow or not answering,
+ * the imported projects are loaded in event loop when done
+ */
+static int
+qimm_sync_import_start(struct qimm_sync *sync) {
+    /* no way to know when done */
+    if (!sync->source)
+        return -1;
+
+    sync->running = true;
+    if (create_worker_thread(&sync->thread, qimm_sync_import_thread,
+                             sync) < 0) {
+        sync->running = false;
+        return -1;
+    }
+    sync->joinable = true;
+    return 0;
+}
+
+int
+qimm_sync_init(struct qimm_shell *shell) {
+    const char *spec = getenv(QIMM_SYNC_PEER);
+    if (!spec || !*spec)
+        return 0;
+
+    struct qimm_sync *sync = zalloc(sizeof *sync);
+    if (!sync)
+        return -1;
+    sync->shell = shell;
+    sync->event_fd = -1;
+    pthread_mutex_init(&sync->mutex, NULL);
+    sync->peer = qimm_sync_peer_open(spec);
+    if (!sync->peer) {
+        pthread_mutex_destroy(&sync->mutex);
+        free(sync);
+        return -1;
+    }
+    shell->sync = sync;
+
+    /* without it the log of export is written at next join */
+    qimm_sync_event_init(sync);
+    if (qimm_sync_import_start(sync) < 0)
+        qimm_log("failed to import projects from peer");
+    return 0;
+}
+
+void
+qimm_sync_release(struct qimm_shell *shell) {
+    struct qimm_sync *sync = shell->sync;
+    if (!sync)
+        return;
+
+    qimm_sync_join(sync);
+    qimm_sync_import_done(sync);
+    qimm_sync_event_release(sync);
+    qimm_sync_peer_close(sync->peer);
+    pthread_mutex_destroy(&sync->mutex);
+    free(sync);
+    shell->sync = NULL;
+}
+
+static void *
+qimm_sync_push_thread(void *data) {
+    struct qimm_sync *sync = data;
+    struct qimm_sync_stat stat;
+
+    qimm_log_defer_begin(&sync->log);
+    if (qimm_sync_project_export(sync->shell, sync->name, sync->peer,
+                                 &stat) == 0)
+        qimm_log("project (%s) exported: %" PRIu64 " of %" PRIu64
+                 " bytes in %" PRIu64 " ms", sync->name, stat.bytes_sent,
+                 stat.bytes, stat.nsec / 1000000);
+    qimm_log_defer_end(&sync->log);
+
+    pthread_mutex_lock(&sync->mutex);
+    sync->running = false;
+    qimm_sync_notify(sync);
+    pthread_mutex_unlock(&sync->mutex);
+    return NULL;
+}
+
+int
+qimm_sync_project_push(struct qimm_project *project) {
+    struct qimm_sync *sync = project->shell->sync;
+    if (!sync)
+        return -1;
+
+    pthread_mutex_lock(&sync->mutex);
+    bool running = sync->running;
+    pthread_mutex_unlock(&sync->mutex);
+    if (running) {
+        if (sync->name)
+            qimm_log("project (%s) export skipped: %s is exporting",
+                     project->name, sync->name);
+        else
+            qimm_log("project (%s) export skipped: importing",
+                     project->name);
+        return -1;
+    }
+    qimm_sync_join(sync);
+
+    sync->name = strdup(project->name);
+    if (!sync->name)
+        return -1;
+    sync->running = true;
+    if (create_worker_thread(&sync->thread, qimm_sync_push_thread,
+                             sync) < 0) {
+        sync->running = false;
+        free(sync->name);
+        sync->name = NULL;
+        return -1;
+    }
+    sync->joinable = true;
+    return 0;
+}
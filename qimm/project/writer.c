@@ -0,0 +1,489 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+
+/*
+ * The data writer saves project datas in background.
+ *
+ * Each save takes a snapshot of the data on the compositor thread and
+ * marks its file dirty. Saves of the same file within QIMM_DATA_SAVE_DELAY
+ * are merged, only the last snapshot is written.
+ *
+ * The writer thread serializes yaml and writes each file atomically:
+ *     write to temp file -> fsync -> rename -> fsync directory
+ * The fsyncs are batched, all files in a batch start writeback together
+ * and each directory is synced once.
+ *
+ * With the log store, files of a batch are appended to the log and
+ * committed by one sync.
+ *
+ * weston_log is not thread-safe, the log of writer thread is kept by
+ * qimm_log_defer and written by the compositor thread when notified.
+ */
+#define QIMM_DATA_SAVE_DELAY 300 /* ms */
+#define QIMM_DATA_BATCH_MAX 64
+
+struct qimm_data_entry {
+    struct wl_list link; /* qimm_data_writer::dirty or queue */
+
+    char *path; /* the file to write */
+    qimm_yaml_write_data_func_t func;
+    void *data; /* snapshot owned by entry */
+    void (*free)(void *data);
+
+    /* used by writer thread */
+    char *temp;
+    FILE *file;
+};
+
+struct qimm_data_writer {
+    /* dirty files in save window, compositor thread only */
+    struct wl_list dirty; /* qimm_data_entry::link */
+    struct wl_event_source *timer;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct wl_list queue; /* qimm_data_entry::link, under mutex */
+    bool stop;
+
+    /* the log of writer thread, under mutex */
+    struct qimm_log_defer log;
+    int notify_error; /* errno of the last failed notify */
+    int event_fd;
+    struct wl_event_source *event_source;
+
+    struct qimm_data_store *store; /* NULL for yaml files */
+};
+
+static void
+qimm_data_entry_free(struct qimm_data_entry *entry) {
+    if (entry->data)
+        entry->free(entry->data);
+    free(entry->path);
+    free(entry->temp);
+    free(entry);
+}
+
+/*
+ * add entry to list, replace the old one for same file
+ */
+static void
+qimm_data_entry_merge(struct wl_list *list, struct qimm_data_entry *entry) {
+    struct qimm_data_entry *old;
+    wl_list_for_each(old, list, link) {
+        if (!strcmp(old->path, entry->path)) {
+            wl_list_insert(&old->link, &entry->link);
+            wl_list_remove(&old->link);
+            qimm_data_entry_free(old);
+            return;
+        }
+    }
+    wl_list_insert(list->prev, &entry->link);
+}
+
+/* --------- writer thread --------- */
+/*
+ * the data directory exists, make the directory of project for file
+ */
+static int
+qimm_data_make_dir(const char *path) {
+    char *dir = strdup(path);
+    if (!dir)
+        return -1;
+
+    int ret = 0;
+    char *pos = strrchr(dir, '/');
+    if (pos) {
+        *pos = '\0';
+        if (mkdir(dir, QIMM_DATA_DIR_MODE) < 0 && errno != EEXIST) {
+            qimm_log("data make dir (%s) error: %s", dir, strerror(errno));
+            ret = -1;
+        }
+    }
+
+    free(dir);
+    return ret;
+}
+
+static int
+qimm_data_entry_write_temp(struct qimm_data_entry *entry) {
+    if (qimm_data_make_dir(entry->path) < 0)
+        return -1;
+
+    if (asprintf(&entry->temp, "%s.XXXXXX", entry->path) < 0) {
+        entry->temp = NULL;
+        return -1;
+    }
+
+    int fd = mkostemp(entry->temp, O_CLOEXEC);
+    if (fd < 0) {
+        qimm_log("data write (%s) error: %s", entry->path, strerror(errno));
+        free(entry->temp);
+        entry->temp = NULL;
+        return -1;
+    }
+
+    /* same as files created by fopen */
+    fchmod(fd, QIMM_DATA_FILE_MODE);
+
+    entry->file = fdopen(fd, "wb");
+    if (!entry->file) {
+        close(fd);
+        goto err;
+    }
+
+    if (qimm_yaml_write_file(entry->file, entry->func, entry->data) < 0 ||
+        fflush(entry->file) != 0)
+        goto err;
+
+    /* start writeback now, wait for it later with the batch */
+    sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+    return 0;
+
+err:
+    qimm_log("data write (%s) error: serialize failed", entry->path);
+    if (entry->file)
+        fclose(entry->file);
+    entry->file = NULL;
+    unlink(entry->temp);
+    return -1;
+}
+
+static void
+qimm_data_sync_dir(const char *path) {
+    char *dir = strdup(path);
+    if (!dir)
+        return;
+    char *pos = strrchr(dir, '/');
+    if (pos)
+        *pos = '\0';
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(dir);
+}
+
+static bool
+qimm_data_same_dir(const char *a, const char *b) {
+    const char *sa = strrchr(a, '/'), *sb = strrchr(b, '/');
+    return sa - a == sb - b && !strncmp(a, b, sa - a);
+}
+
+static int
+qimm_data_entry_append(struct qimm_data_store *store,
+                       struct qimm_data_entry *entry) {
+    const char *key = qimm_data_store_key(store, entry->path);
+    if (!key) {
+        qimm_log("data write (%s) error: not in data directory", entry->path);
+        return -1;
+    }
+
+    char *buf = NULL;
+    size_t size = 0;
+    FILE *file = open_memstream(&buf, &size);
+    if (!file)
+        return -1;
+    int ret = qimm_yaml_write_file(file, entry->func, entry->data);
+    if (fclose(file) != 0)
+        ret = -1;
+
+    if (ret == 0)
+        ret = qimm_data_store_write(store, key, buf, size);
+    else
+        qimm_log("data write (%s) error: serialize failed", entry->path);
+    free(buf);
+    return ret;
+}
+
+/*
+ * append entries in batch to log store, and commit them together
+ */
+static int
+qimm_data_append_batch(struct qimm_data_store *store, struct wl_list *batch) {
+    struct qimm_data_entry *entry, *tmp;
+    int ret = 0;
+
+    wl_list_for_each(entry, batch, link)
+        if (qimm_data_entry_append(store, entry) < 0)
+            ret = -1;
+    if (qimm_data_store_commit(store) < 0)
+        ret = -1;
+
+    wl_list_for_each_safe(entry, tmp, batch, link) {
+        wl_list_remove(&entry->link);
+        qimm_data_entry_free(entry);
+    }
+    return ret;
+}
+
+/*
+ * write and free entries in batch, return -1 if any failed
+ */
+static int
+qimm_data_write_batch(struct qimm_data_store *store, struct wl_list *batch) {
+    struct qimm_data_entry *entry, *tmp;
+    int ret = 0;
+
+    if (store)
+        return qimm_data_append_batch(store, batch);
+
+    wl_list_for_each(entry, batch, link)
+        if (qimm_data_entry_write_temp(entry) < 0)
+            ret = -1;
+
+    /* wait for data of temp files, then replace files */
+    wl_list_for_each(entry, batch, link) {
+        if (!entry->file)
+            continue;
+
+        int synced = fsync(fileno(entry->file));
+        if (fclose(entry->file) != 0)
+            synced = -1;
+        entry->file = NULL;
+
+        if (synced < 0 || rename(entry->temp, entry->path) < 0) {
+            qimm_log("data write (%s) error: %s", entry->path, strerror(errno));
+            unlink(entry->temp);
+            free(entry->temp);
+            entry->temp = NULL;
+            ret = -1;
+        }
+    }
+
+    /* make renames durable, once for each directory */
+    wl_list_for_each(entry, batch, link) {
+        if (!entry->temp)
+            continue;
+
+        bool synced = false;
+        struct qimm_data_entry *prev;
+        wl_list_for_each(prev, batch, link) {
+            if (prev == entry)
+                break;
+            if (prev->temp && qimm_data_same_dir(prev->path, entry->path)) {
+                synced = true;
+                break;
+            }
+        }
+        if (!synced)
+            qimm_data_sync_dir(entry->path);
+    }
+
+    wl_list_for_each_safe(entry, tmp, batch, link) {
+        wl_list_remove(&entry->link);
+        qimm_data_entry_free(entry);
+    }
+    return ret;
+}
+
+static void *
+qimm_data_writer_thread(void *data) {
+    struct qimm_data_writer *writer = data;
+
+    pthread_mutex_lock(&writer->mutex);
+    for (;;) {
+        while (!writer->stop && wl_list_empty(&writer->queue))
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+        /* write all queued files before stop */
+        if (wl_list_empty(&writer->queue))
+            break;
+
+        struct wl_list batch;
+        wl_list_init(&batch);
+        for (int i = 0; i < QIMM_DATA_BATCH_MAX &&
+                        !wl_list_empty(&writer->queue); i++) {
+            struct wl_list *link = writer->queue.next;
+            wl_list_remove(link);
+            wl_list_insert(batch.prev, link);
+        }
+        qimm_log_defer_begin(&writer->log);
+        pthread_mutex_unlock(&writer->mutex);
+
+        qimm_data_write_batch(writer->store, &batch);
+
+        pthread_mutex_lock(&writer->mutex);
+        qimm_log_defer_end(&writer->log);
+        if (writer->log.size > 0 && writer->event_fd >= 0) {
+            uint64_t one = 1;
+            if (write(writer->event_fd, &one, sizeof one) < 0 &&
+                errno != EAGAIN)
+                writer->notify_error = errno;
+        }
+    }
+    pthread_mutex_unlock(&writer->mutex);
+
+    return NULL;
+}
+
+/* --------- compositor thread --------- */
+static void
+qimm_data_writer_commit(struct qimm_data_writer *writer) {
+    if (wl_list_empty(&writer->dirty))
+        return;
+
+    pthread_mutex_lock(&writer->mutex);
+    struct qimm_data_entry *entry, *tmp;
+    wl_list_for_each_safe(entry, tmp, &writer->dirty, link) {
+        wl_list_remove(&entry->link);
+        qimm_data_entry_merge(&writer->queue, entry);
+    }
+    pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+}
+
+static int
+qimm_data_writer_handle_timer(void *data) {
+    qimm_data_writer_commit(data);
+    return 0;
+}
+
+static void
+qimm_data_writer_flush_log(struct qimm_data_writer *writer) {
+    /* the log of the batch in writing is written next time */
+    pthread_mutex_lock(&writer->mutex);
+    if (writer->notify_error)
+        qimm_log("data writer notify error: %s",
+                 strerror(writer->notify_error));
+    writer->notify_error = 0;
+    if (!writer->log.fp)
+        qimm_log_defer_flush(&writer->log);
+    pthread_mutex_unlock(&writer->mutex);
+}
+
+static int
+qimm_data_writer_handle_log(int fd, uint32_t mask, void *data) {
+    uint64_t count;
+    if (read(fd, &count, sizeof count) < 0 && errno != EAGAIN)
+        qimm_log("data writer event error: %s", strerror(errno));
+
+    qimm_data_writer_flush_log(data);
+    return 0;
+}
+
+int
+qimm_data_writer_init(struct qimm_shell *shell) {
+    struct qimm_data_writer *writer = zalloc(sizeof *writer);
+    if (!writer)
+        return -1;
+
+    wl_list_init(&writer->dirty);
+    wl_list_init(&writer->queue);
+    writer->store = shell->data_store;
+    writer->event_fd = -1;
+    pthread_mutex_init(&writer->mutex, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+
+    struct wl_event_loop *loop =
+            wl_display_get_event_loop(shell->compositor->wl_display);
+    writer->timer = wl_event_loop_add_timer(loop,
+                                            qimm_data_writer_handle_timer,
+                                            writer);
+    if (!writer->timer)
+        goto err;
+
+    /* without it, the log of writer thread is written on release */
+    writer->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (writer->event_fd >= 0)
+        writer->event_source = wl_event_loop_add_fd(loop, writer->event_fd,
+                                                    WL_EVENT_READABLE,
+                                                    qimm_data_writer_handle_log,
+                                                    writer);
+
+    if (create_worker_thread(&writer->thread,
+                             qimm_data_writer_thread, writer) < 0) {
+        qimm_log("data writer thread error: %s", strerror(errno));
+        goto err;
+    }
+
+    shell->data_writer = writer;
+    return 0;
+
+err:
+    if (writer->event_source)
+        wl_event_source_remove(writer->event_source);
+    if (writer->event_fd >= 0)
+        close(writer->event_fd);
+    if (writer->timer)
+        wl_event_source_remove(writer->timer);
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->mutex);
+    free(writer);
+    return -1;
+}
+
+void
+qimm_data_writer_release(struct qimm_shell *shell) {
+    struct qimm_data_writer *writer = shell->data_writer;
+    if (!writer)
+        return;
+
+    /* flush dirty files and wait for writer */
+    qimm_data_writer_commit(writer);
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->stop = true;
+    pthread_cond_signal(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+    pthread_join(writer->thread, NULL);
+    qimm_data_writer_flush_log(writer);
+
+    if (writer->event_source)
+        wl_event_source_remove(writer->event_source);
+    if (writer->event_fd >= 0)
+        close(writer->event_fd);
+    wl_event_source_remove(writer->timer);
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->mutex);
+    free(writer);
+    shell->data_writer = NULL;
+}
+
+int
+qimm_data_writer_save(struct qimm_shell *shell, char *path,
+                      qimm_yaml_write_data_func_t func,
+                      void *data, void (*free_data)(void *data)) {
+    struct qimm_data_entry *entry = zalloc(sizeof *entry);
+    if (!entry) {
+        free(path);
+        free_data(data);
+        return -1;
+    }
+    entry->path = path;
+    entry->func = func;
+    entry->data = data;
+    entry->free = free_data;
+
+    struct qimm_data_writer *writer = shell->data_writer;
+    if (!writer) {
+        /* no writer thread, write it now */
+        struct wl_list batch;
+        wl_list_init(&batch);
+        wl_list_insert(&batch, &entry->link);
+        return qimm_data_write_batch(shell->data_store, &batch);
+    }
+
+    /* the window starts from the first save */
+    if (wl_list_empty(&writer->dirty))
+        wl_event_source_timer_update(writer->timer, QIMM_DATA_SAVE_DELAY);
+    qimm_data_entry_merge(&writer->dirty, entry);
+    return 0;
+}
@@ -0,0 +1,165 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "share.h"
+
+#define QIMM_HASH_MIN_SIZE 16
+
+/* FNV-1a */
+static uint32_t
+qimm_hash_string(const char *str) {
+    uint32_t hash = 0x811c9dc5;
+    for (const unsigned char *p = (const unsigned char *) str; *p; p++) {
+        hash ^= *p;
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
+/* fibonacci hashing, the low bits of pointers are always zero */
+static uint32_t
+qimm_hash_pointer(const void *ptr) {
+    uint64_t hash = (uintptr_t) ptr * 0x9e3779b97f4a7c15ULL;
+    return (uint32_t) (hash >> 32);
+}
+
+static uint32_t
+qimm_hash_key(struct qimm_hash *hash, const void *key) {
+    return hash->string_key ? qimm_hash_string(key) : qimm_hash_pointer(key);
+}
+
+static bool
+qimm_hash_key_equal(struct qimm_hash *hash,
+                    struct qimm_hash_node *node,
+                    uint32_t value, const void *key) {
+    if (node->hash != value)
+        return false;
+    return hash->string_key ? !strcmp(node->key, key) : node->key == key;
+}
+
+void
+qimm_hash_init(struct qimm_hash *hash, bool string_key) {
+    hash->buckets = NULL;
+    hash->size = 0;
+    hash->count = 0;
+    hash->string_key = string_key;
+}
+
+void
+qimm_hash_release(struct qimm_hash *hash) {
+    free(hash->buckets);
+    hash->buckets = NULL;
+    hash->size = 0;
+    hash->count = 0;
+}
+
+/*
+ * rehash all nodes to new buckets, keep the order of nodes
+ * with the same key, so the first inserted one is found.
+ */
+static int
+qimm_hash_resize(struct qimm_hash *hash, uint32_t size) {
+    struct qimm_hash_node **buckets = calloc(size, sizeof *buckets);
+    if (!buckets)
+        return -1;
+
+    for (uint32_t i = 0; i < hash->size; i++) {
+        struct qimm_hash_node *node = hash->buckets[i], *next;
+        for (; node; node = next) {
+            next = node->next;
+
+            struct qimm_hash_node **pos = &buckets[node->hash & (size - 1)];
+            while (*pos)
+                pos = &(*pos)->next;
+            node->next = NULL;
+            *pos = node;
+        }
+    }
+
+    free(hash->buckets);
+    hash->buckets = buckets;
+    hash->size = size;
+    return 0;
+}
+
+int
+qimm_hash_insert(struct qimm_hash *hash, struct qimm_hash_node *node,
+                 const void *key) {
+    /* keep load factor under 1 */
+    if (hash->count >= hash->size) {
+        uint32_t size = hash->size ? hash->size * 2 : QIMM_HASH_MIN_SIZE;
+        if (qimm_hash_resize(hash, size) < 0 && !hash->buckets)
+            return -1;
+    }
+
+    node->key = key;
+    node->hash = qimm_hash_key(hash, key);
+
+    /* append to the bucket, see qimm_hash_resize */
+    struct qimm_hash_node **pos = &hash->buckets[node->hash & (hash->size - 1)];
+    while (*pos)
+        pos = &(*pos)->next;
+    node->next = NULL;
+    *pos = node;
+
+    hash->count++;
+    return 0;
+}
+
+void
+qimm_hash_remove(struct qimm_hash *hash, struct qimm_hash_node *node) {
+    if (!hash->buckets)
+        return;
+
+    struct qimm_hash_node **pos = &hash->buckets[node->hash & (hash->size - 1)];
+    for (; *pos; pos = &(*pos)->next) {
+        if (*pos == node) {
+            *pos = node->next;
+            node->next = NULL;
+            hash->count--;
+            return;
+        }
+    }
+}
+
+struct qimm_hash_node *
+qimm_hash_find(struct qimm_hash *hash, const void *key) {
+    if (!hash->count)
+        return NULL;
+
+    uint32_t value = qimm_hash_key(hash, key);
+    struct qimm_hash_node *node = hash->buckets[value & (hash->size - 1)];
+    for (; node; node = node->next) {
+        if (qimm_hash_key_equal(hash, node, value, key))
+            return node;
+    }
+    return NULL;
+}
+
+struct qimm_hash_node *
+qimm_hash_pop(struct qimm_hash *hash) {
+    for (uint32_t i = 0; hash->count && i < hash->size; i++) {
+        struct qimm_hash_node *node = hash->buckets[i];
+        if (node) {
+            hash->buckets[i] = node->next;
+            node->next = NULL;
+            hash->count--;
+            return node;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,127 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "share.h"
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+/* retry to read a slot which is rewritten while reading */
+#define QIMM_METRICS_READ_RETRY 16
+
+struct qimm_metrics_ring *
+qimm_metrics_ring_create(int *fd, size_t *size) {
+    size_t len = sizeof(struct qimm_metrics_ring) +
+                 QIMM_METRICS_SLOTS * sizeof(struct qimm_metrics_slot);
+
+    int memfd = memfd_create("qimm-metrics", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0)
+        return NULL;
+    if (ftruncate(memfd, len) < 0)
+        goto err;
+
+    struct qimm_metrics_ring *ring =
+            mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (ring == MAP_FAILED)
+        goto err;
+
+    ring->magic = QIMM_METRICS_MAGIC;
+    ring->version = QIMM_METRICS_VERSION;
+    ring->slot_count = QIMM_METRICS_SLOTS;
+    ring->slot_size = sizeof(struct qimm_metrics_slot);
+    ring->interval = QIMM_METRICS_INTERVAL;
+
+    /*
+     * clients can not resize the ring under the shell,
+     * nor write it by new mappings on kernel with future write seal.
+     */
+    fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW);
+    fcntl(memfd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE);
+    fcntl(memfd, F_ADD_SEALS, F_SEAL_SEAL);
+
+    *fd = memfd;
+    *size = len;
+    return ring;
+
+err:
+    close(memfd);
+    return NULL;
+}
+
+/*
+ * open the memfd again read-only, the clients can not map it writable
+ */
+int
+qimm_metrics_ring_reader_fd(int fd) {
+    char path[64];
+    snprintf(path, sizeof path, "/proc/self/fd/%d", fd);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+const struct qimm_metrics_ring *
+qimm_metrics_ring_check(const void *map, size_t size) {
+    const struct qimm_metrics_ring *ring = map;
+    if (size < sizeof *ring ||
+        ring->magic != QIMM_METRICS_MAGIC ||
+        ring->version != QIMM_METRICS_VERSION ||
+        ring->slot_size != sizeof(struct qimm_metrics_slot) ||
+        ring->slot_count == 0 ||
+        size < sizeof *ring + (size_t) ring->slot_count * ring->slot_size)
+        return NULL;
+    return ring;
+}
+
+void
+qimm_metrics_ring_write(struct qimm_metrics_ring *ring,
+                        struct qimm_metrics_sample *sample) {
+    uint64_t number = ring->head + 1;
+    struct qimm_metrics_slot *slot = &ring->slots[number % ring->slot_count];
+
+    uint32_t seq = slot->seq;
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    sample->number = number;
+    slot->sample = *sample;
+
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->head, number, __ATOMIC_RELEASE);
+}
+
+int
+qimm_metrics_ring_read(const struct qimm_metrics_ring *ring,
+                       struct qimm_metrics_sample *sample) {
+    uint64_t number = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (number == 0)
+        return -1;
+
+    const struct qimm_metrics_slot *slot =
+            &ring->slots[number % ring->slot_count];
+    for (int i = 0; i < QIMM_METRICS_READ_RETRY; i++) {
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+
+        *sample = slot->sample;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq)
+            return 0;
+    }
+    return -1;
+}
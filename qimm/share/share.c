@@ -17,6 +17,67 @@
  */
 #include "share.h"
 
+/* --------- log --------- */
+/* the defer of this thread between begin and end */
+static __thread struct qimm_log_defer *qimm_log_deferred;
+
+void
+qimm_log_print(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    struct qimm_log_defer *defer = qimm_log_deferred;
+    if (defer && defer->fp) {
+        vfprintf(defer->fp, fmt, ap);
+    } else {
+        char *str;
+        if (vasprintf(&str, fmt, ap) >= 0) {
+            weston_log("%s", str);
+            free(str);
+        }
+    }
+    va_end(ap);
+}
+
+void
+qimm_log_defer_begin(struct qimm_log_defer *defer) {
+    assert(!defer->fp);
+
+    /* a stream always starts empty, keep the log of last begin */
+    char *last = defer->buf;
+    defer->buf = NULL;
+    defer->size = 0;
+    defer->fp = open_memstream(&defer->buf, &defer->size);
+    if (defer->fp && last)
+        fputs(last, defer->fp);
+    free(last);
+    qimm_log_deferred = defer;
+}
+
+void
+qimm_log_defer_end(struct qimm_log_defer *defer) {
+    if (defer->fp)
+        fclose(defer->fp);
+    defer->fp = NULL;
+    qimm_log_deferred = NULL;
+}
+
+void
+qimm_log_defer_flush(struct qimm_log_defer *defer) {
+    assert(!defer->fp);
+
+    /* a line each, like the lines logged in place */
+    for (char *line = defer->buf; line && *line;) {
+        char *end = strchrnul(line, '\n');
+        if (*end)
+            end++;
+        weston_log("%.*s", (int) (end - line), line);
+        line = end;
+    }
+    free(defer->buf);
+    defer->buf = NULL;
+    defer->size = 0;
+}
+
 char *
 get_command_line(char *const argv[]) {
     char *str = NULL;
@@ -90,3 +151,19 @@ random_rgb(float rgb[3]) {
     rgb[1] = rand() % 255 / 255.;
     rgb[2] = rand() % 255 / 255.;
 }
+
+int
+create_worker_thread(pthread_t *thread, void *(*func)(void *), void *data) {
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    int ret = pthread_create(thread, NULL, func, data);
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+        errno = ret;
+        return -1;
+    }
+    return 0;
+}
@@ -207,37 +207,47 @@ qimm_yaml_read_sequence(yaml_parser_t *parser, yaml_event_t *event,
 }
 
 int
-qimm_yaml_write_document(const char *path,
-                         qimm_yaml_write_data_func_t func,
-                         void *data) {
-    FILE *file;
+qimm_yaml_write_file(FILE *file,
+                     qimm_yaml_write_data_func_t func,
+                     void *data) {
     yaml_emitter_t emitter;
     yaml_event_t event;
     int ret = -1;
 
-    file = fopen(path, "wb");
-    if (file) {
-        yaml_emitter_initialize(&emitter);
-        yaml_emitter_set_output_file(&emitter, file);
+    yaml_emitter_initialize(&emitter);
+    yaml_emitter_set_output_file(&emitter, file);
 
-        yaml_stream_start_event_initialize(&event, YAML_UTF8_ENCODING);
-        if (!yaml_emitter_emit(&emitter, &event)) goto err;
+    yaml_stream_start_event_initialize(&event, YAML_UTF8_ENCODING);
+    if (!yaml_emitter_emit(&emitter, &event)) goto err;
 
-        yaml_document_start_event_initialize(&event, NULL, NULL, NULL, 0);
-        if (!yaml_emitter_emit(&emitter, &event)) goto err;
+    yaml_document_start_event_initialize(&event, NULL, NULL, NULL, 0);
+    if (!yaml_emitter_emit(&emitter, &event)) goto err;
 
-        if (func(&emitter, data) < 0) goto err;
+    if (func(&emitter, data) < 0) goto err;
 
-        yaml_document_end_event_initialize(&event, 0);
-        if (!yaml_emitter_emit(&emitter, &event)) goto err;
+    yaml_document_end_event_initialize(&event, 0);
+    if (!yaml_emitter_emit(&emitter, &event)) goto err;
 
-        yaml_stream_end_event_initialize(&event);
-        if (!yaml_emitter_emit(&emitter, &event)) goto err;
+    yaml_stream_end_event_initialize(&event);
+    if (!yaml_emitter_emit(&emitter, &event)) goto err;
 
-        ret = 0;
+    ret = 0;
 
 err:
-        yaml_emitter_delete(&emitter);
+    yaml_emitter_delete(&emitter);
+    return ret;
+}
+
+int
+qimm_yaml_write_document(const char *path,
+                         qimm_yaml_write_data_func_t func,
+                         void *data) {
+    FILE *file;
+    int ret = -1;
+
+    file = fopen(path, "wb");
+    if (file) {
+        ret = qimm_yaml_write_file(file, func, data);
         fclose(file);
     }
     return ret;
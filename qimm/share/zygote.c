@@ -0,0 +1,142 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "share.h"
+
+/*
+ * The zygote control socket is a SOCK_SEQPACKET pair, so each request is
+ * one message:
+ *     the command line args joined by '\0' as payload
+ *     the wayland socket for new client as SCM_RIGHTS
+ * and each reply is one message with the pid of new client.
+ */
+#define QIMM_ZYGOTE_ARGS_MAX 256
+
+int
+qimm_zygote_send_request(int sock, int fd, char *const argv[]) {
+    char buf[QIMM_ZYGOTE_MSG_MAX];
+    size_t len = 0;
+
+    for (int i = 0; argv[i]; ++i) {
+        size_t n = strlen(argv[i]) + 1;
+        if (i >= QIMM_ZYGOTE_ARGS_MAX - 1) {
+            qimm_log("zygote send error: more than %d args",
+                     QIMM_ZYGOTE_ARGS_MAX - 1);
+            return -1;
+        }
+        if (len + n > sizeof buf) {
+            qimm_log("zygote send error: command line over %zu bytes",
+                     sizeof buf);
+            return -1;
+        }
+        memcpy(buf + len, argv[i], n);
+        len += n;
+    }
+
+    struct iovec iov = {buf, len};
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    ssize_t ret;
+    do {
+        ret = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        qimm_log("zygote send error: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+char **
+qimm_zygote_recv_request(int sock, int *fd) {
+    char buf[QIMM_ZYGOTE_MSG_MAX];
+    struct iovec iov = {buf, sizeof buf};
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+
+    ssize_t len;
+    do {
+        len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (len < 0 && errno == EINTR);
+    if (len <= 0) /* error or shell has gone */
+        return NULL;
+
+    *fd = -1;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+        cmsg->cmsg_type == SCM_RIGHTS)
+        memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+    if (*fd < 0 || (msg.msg_flags & MSG_TRUNC) || buf[len - 1] != '\0')
+        goto err;
+
+    char **argv = zalloc(QIMM_ZYGOTE_ARGS_MAX * sizeof(char *));
+    if (!argv)
+        goto err;
+    int argc = 0;
+    for (char *pos = buf; pos < buf + len; pos += strlen(pos) + 1) {
+        if (argc >= QIMM_ZYGOTE_ARGS_MAX - 1)
+            break;
+        argv[argc++] = strdup(pos);
+    }
+    return argv;
+
+err:
+    if (*fd >= 0)
+        close(*fd);
+    *fd = -1;
+    return NULL;
+}
+
+int
+qimm_zygote_send_reply(int sock, pid_t pid) {
+    ssize_t ret;
+    do {
+        ret = send(sock, &pid, sizeof pid, MSG_NOSIGNAL);
+    } while (ret < 0 && errno == EINTR);
+    return ret == sizeof pid ? 0 : -1;
+}
+
+pid_t
+qimm_zygote_recv_reply(int sock) {
+    pid_t pid;
+    ssize_t ret;
+    do {
+        ret = recv(sock, &pid, sizeof pid, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret == sizeof pid ? pid : -1;
+}
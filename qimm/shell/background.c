@@ -0,0 +1,633 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+#include "shared/image-loader.h"
+
+/*
+ * Background images of projects are decoded once and shared by outputs.
+ *
+ * A variant is the image scaled for an output size and background type,
+ * rendered into a buffer of the internal client by the worker thread.
+ * Outputs of the same size show the same buffer, so hot-plugging an output
+ * of a known size costs nothing, and a new size only scales the decoded
+ * image again.
+ *
+ * Images and variants stay cached when unused, the least recently used
+ * are dropped when they take more than QIMM_BACKGROUND_MEMORY_MAX.
+ */
+#define QIMM_BACKGROUND_MEMORY_MAX (128 << 20) /* bytes */
+
+struct qimm_background_image {
+    struct wl_list link; /* qimm_background_cache::images, recent first */
+    char *path;
+    int refcount; /* variants of this image */
+    size_t size; /* bytes of decoded pixels, 0 before decoded */
+
+    /* written by worker only, read by main thread after the job is done */
+    pixman_image_t *pixman;
+    bool decoded;
+};
+
+struct qimm_background_variant {
+    struct wl_list link; /* qimm_background_cache::variants, recent first */
+    struct wl_list job_link; /* qimm_background_cache::jobs or done */
+    struct qimm_background_image *image; /* NULL for color only */
+    int32_t width, height;
+    int type;
+    uint32_t color;
+
+    struct qimm_buffer *buffer;
+    void *data; /* pixels of buffer, written by worker until ready */
+    int refcount; /* outputs showing it and the pending job */
+    bool ready;
+    bool failed;
+};
+
+/* the background of an output */
+struct qimm_background_view {
+    struct qimm_background_cache *cache;
+    struct qimm_output *output;
+    struct qimm_buffer_surface *surface;
+    struct weston_view *view; /* NULL until the first buffer is committed */
+    struct qimm_background_variant *variant; /* on show */
+    struct qimm_background_variant *pending; /* to show when ready */
+};
+
+struct qimm_background_cache {
+    struct qimm_shell *shell;
+    struct wl_list images; /* qimm_background_image::link */
+    struct wl_list variants; /* qimm_background_variant::link */
+    size_t size; /* bytes of all images and variants */
+
+    pthread_t thread;
+    bool thread_started;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    /* guarded by mutex */
+    struct wl_list jobs; /* qimm_background_variant::job_link */
+    struct wl_list done; /* qimm_background_variant::job_link */
+    int notify_error; /* errno of the last failed notify, 0 for none */
+    bool stop;
+
+    /* notify main thread that jobs are done */
+    int event_fd;
+    struct wl_event_source *event_source;
+};
+
+static void
+qimm_background_image_unref(struct qimm_background_cache *cache,
+                            struct qimm_background_image *image) {
+    if (image)
+        image->refcount--;
+}
+
+static void
+qimm_background_image_destroy(struct qimm_background_cache *cache,
+                              struct qimm_background_image *image) {
+    assert(image->refcount == 0);
+    cache->size -= image->size;
+    if (image->pixman)
+        pixman_image_unref(image->pixman);
+    wl_list_remove(&image->link);
+    free(image->path);
+    free(image);
+}
+
+static void
+qimm_background_variant_destroy(struct qimm_background_cache *cache,
+                                struct qimm_background_variant *variant) {
+    assert(variant->refcount == 0);
+    cache->size -= (size_t) variant->width * variant->height * 4;
+    qimm_background_image_unref(cache, variant->image);
+    if (variant->buffer)
+        qimm_buffer_destroy(variant->buffer);
+    wl_list_remove(&variant->link);
+    free(variant);
+}
+
+/*
+ * drop the least recently used images and variants which are not shown
+ */
+static void
+qimm_background_trim(struct qimm_background_cache *cache) {
+    struct qimm_background_variant *variant, *vtmp;
+    wl_list_for_each_reverse_safe(variant, vtmp, &cache->variants, link) {
+        if (cache->size <= QIMM_BACKGROUND_MEMORY_MAX)
+            return;
+        if (variant->refcount == 0)
+            qimm_background_variant_destroy(cache, variant);
+    }
+
+    struct qimm_background_image *image, *itmp;
+    wl_list_for_each_reverse_safe(image, itmp, &cache->images, link) {
+        if (cache->size <= QIMM_BACKGROUND_MEMORY_MAX)
+            return;
+        if (image->refcount == 0)
+            qimm_background_image_destroy(cache, image);
+    }
+}
+
+static void
+qimm_background_variant_unref(struct qimm_background_cache *cache,
+                              struct qimm_background_variant *variant) {
+    if (!variant)
+        return;
+    if (--variant->refcount == 0 && variant->failed)
+        qimm_background_variant_destroy(cache, variant);
+}
+
+/* --------- worker --------- */
+static void
+qimm_background_render(struct qimm_background_variant *variant,
+                       pixman_image_t *src) {
+    int32_t w = variant->width, h = variant->height;
+    pixman_image_t *dst = pixman_image_create_bits(PIXMAN_a8r8g8b8, w, h,
+                                                   variant->data, w * 4);
+    if (!dst) {
+        variant->failed = true;
+        return;
+    }
+
+    /* the background is opaque, fill the uncovered area with color */
+    uint32_t c = variant->color;
+    pixman_color_t color = {
+            .red = ((c >> 16) & 0xff) * 0x101,
+            .green = ((c >> 8) & 0xff) * 0x101,
+            .blue = (c & 0xff) * 0x101,
+            .alpha = 0xffff,
+    };
+    pixman_box32_t box = {0, 0, w, h};
+    pixman_image_fill_boxes(PIXMAN_OP_SRC, dst, &color, 1, &box);
+    if (!src)
+        goto out;
+
+    int32_t iw = pixman_image_get_width(src);
+    int32_t ih = pixman_image_get_height(src);
+    int32_t src_x = 0, src_y = 0, dst_x = 0, dst_y = 0;
+    int32_t cw = w, ch = h;
+    pixman_transform_t transform;
+    pixman_transform_init_identity(&transform);
+
+    switch (variant->type) {
+        case CROP: {
+            /* fill the output, cut the overflow of the longer side */
+            double s = MIN((double) iw / w, (double) ih / h);
+            pixman_transform_init_scale(&transform,
+                                        pixman_double_to_fixed(s),
+                                        pixman_double_to_fixed(s));
+            pixman_transform_translate(&transform, NULL,
+                                       pixman_double_to_fixed((iw - w * s) / 2),
+                                       pixman_double_to_fixed((ih - h * s) / 2));
+            break;
+        }
+        case TILE:
+            pixman_image_set_repeat(src, PIXMAN_REPEAT_NORMAL);
+            break;
+        case CENTERED:
+            if (iw > w)
+                src_x = (iw - w) / 2;
+            else
+                dst_x = (w - iw) / 2, cw = iw;
+            if (ih > h)
+                src_y = (ih - h) / 2;
+            else
+                dst_y = (h - ih) / 2, ch = ih;
+            break;
+        case SCALE:
+        default:
+            pixman_transform_init_scale(&transform,
+                                        pixman_double_to_fixed((double) iw / w),
+                                        pixman_double_to_fixed((double) ih / h));
+            break;
+    }
+
+    pixman_image_set_transform(src, &transform);
+    pixman_image_set_filter(src, PIXMAN_FILTER_BILINEAR, NULL, 0);
+    pixman_image_composite32(PIXMAN_OP_OVER, src, NULL, dst,
+                             src_x, src_y, 0, 0, dst_x, dst_y, cw, ch);
+
+    /* the decoded image is shared by variants */
+    pixman_image_set_transform(src, NULL);
+    pixman_image_set_repeat(src, PIXMAN_REPEAT_NONE);
+
+out:
+    pixman_image_unref(dst);
+}
+
+static void *
+qimm_background_worker(void *data) {
+    struct qimm_background_cache *cache = data;
+
+    pthread_mutex_lock(&cache->mutex);
+    while (!cache->stop) {
+        if (wl_list_empty(&cache->jobs)) {
+            pthread_cond_wait(&cache->cond, &cache->mutex);
+            continue;
+        }
+        struct qimm_background_variant *variant =
+                container_of(cache->jobs.next, struct qimm_background_variant,
+                             job_link);
+        wl_list_remove(&variant->job_link);
+        pthread_mutex_unlock(&cache->mutex);
+
+        /* only this thread decodes, each image is decoded once */
+        struct qimm_background_image *image = variant->image;
+        if (image && !image->decoded) {
+            image->pixman = load_image(image->path);
+            image->decoded = true;
+        }
+        if (image && !image->pixman)
+            variant->failed = true;
+        else
+            qimm_background_render(variant, image ? image->pixman : NULL);
+
+        /* errors are logged by main thread, weston_log is not thread-safe */
+        pthread_mutex_lock(&cache->mutex);
+        wl_list_insert(cache->done.prev, &variant->job_link);
+        uint64_t one = 1;
+        if (write(cache->event_fd, &one, sizeof one) < 0 && errno != EAGAIN)
+            cache->notify_error = errno;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    return NULL;
+}
+
+/* --------- view --------- */
+static void
+qimm_background_view_committed(struct weston_surface *surface, void *data) {
+    struct qimm_background_view *bg = data;
+    struct weston_output *output = bg->output->output;
+
+    if (!bg->view) {
+        bg->view = weston_view_create(surface);
+        if (!bg->view)
+            return;
+
+        /* under the first layout of project, which is in the same layer */
+        struct weston_layer *layer = &bg->cache->shell->background_layer;
+        struct weston_layer_entry *last =
+                container_of(layer->view_list.link.prev,
+                             struct weston_layer_entry, link);
+        weston_layer_entry_insert(last, &bg->view->layer_link);
+        surface->is_mapped = true;
+        bg->view->is_mapped = true;
+    }
+    weston_view_set_position(bg->view, output->x, output->y);
+    weston_view_geometry_dirty(bg->view);
+    weston_view_update_transform(bg->view);
+    weston_surface_damage(surface);
+}
+
+static struct qimm_background_view *
+qimm_background_view_create(struct qimm_background_cache *cache,
+                            struct qimm_output *output) {
+    struct qimm_background_view *bg = zalloc(sizeof *bg);
+    if (!bg)
+        return NULL;
+
+    bg->cache = cache;
+    bg->output = output;
+    /* the view is made when compositor handled the first commit */
+    bg->surface = qimm_buffer_surface_create(cache->shell,
+                                             qimm_background_view_committed,
+                                             bg);
+    if (!bg->surface) {
+        free(bg);
+        return NULL;
+    }
+    return bg;
+}
+
+static void
+qimm_background_view_destroy(struct qimm_background_cache *cache,
+                             struct qimm_background_view *bg) {
+    /* unmap at once, the surface is destroyed by compositor later */
+    if (bg->view)
+        weston_view_destroy(bg->view);
+    qimm_buffer_surface_destroy(bg->surface);
+    qimm_background_variant_unref(cache, bg->pending);
+    qimm_background_variant_unref(cache, bg->variant);
+    free(bg);
+}
+
+static void
+qimm_background_view_show(struct qimm_background_cache *cache,
+                          struct qimm_output *output,
+                          struct qimm_background_variant *variant) {
+    struct qimm_background_view *bg = output->background;
+    /* the view is placed when compositor handled the commit */
+    qimm_buffer_surface_attach(bg->surface, variant->buffer);
+
+    qimm_background_variant_unref(cache, bg->variant);
+    bg->variant = variant;
+    variant->refcount++;
+}
+
+static void
+qimm_background_view_hide(struct qimm_background_cache *cache,
+                          struct qimm_output *output) {
+    struct qimm_background_view *bg = output->background;
+    if (!bg)
+        return;
+
+    qimm_background_view_destroy(cache, bg);
+    output->background = NULL;
+}
+
+/* --------- cache --------- */
+static int
+qimm_background_handle_done(int fd, uint32_t mask, void *data) {
+    struct qimm_background_cache *cache = data;
+    uint64_t count;
+    if (read(fd, &count, sizeof count) < 0 && errno != EAGAIN)
+        qimm_log("failed to read background event: %s", strerror(errno));
+
+    struct wl_list done;
+    wl_list_init(&done);
+    pthread_mutex_lock(&cache->mutex);
+    wl_list_insert_list(&done, &cache->done);
+    wl_list_init(&cache->done);
+    int notify_error = cache->notify_error;
+    cache->notify_error = 0;
+    pthread_mutex_unlock(&cache->mutex);
+
+    if (notify_error)
+        qimm_log("failed to notify background: %s", strerror(notify_error));
+
+    struct qimm_background_variant *variant, *tmp;
+    wl_list_for_each_safe(variant, tmp, &done, job_link) {
+        wl_list_remove(&variant->job_link);
+
+        struct qimm_background_image *image = variant->image;
+        if (image && image->pixman && image->size == 0) {
+            image->size = (size_t) pixman_image_get_stride(image->pixman) *
+                          pixman_image_get_height(image->pixman);
+            cache->size += image->size;
+        }
+        if (variant->failed) {
+            qimm_log("failed to load background %s",
+                     image ? image->path : "color");
+        } else {
+            variant->ready = true;
+        }
+
+        struct qimm_output *output;
+        wl_list_for_each(output, &cache->shell->outputs, link) {
+            struct qimm_background_view *bg = output->background;
+            if (!bg || bg->pending != variant)
+                continue;
+            bg->pending = NULL;
+            if (variant->ready)
+                qimm_background_view_show(cache, output, variant);
+            qimm_background_variant_unref(cache, variant);
+        }
+
+        /* the job reference */
+        qimm_background_variant_unref(cache, variant);
+    }
+
+    qimm_background_trim(cache);
+    return 0;
+}
+
+static struct qimm_background_image *
+qimm_background_image_get(struct qimm_background_cache *cache,
+                          const char *path) {
+    struct qimm_background_image *image;
+    wl_list_for_each(image, &cache->images, link) {
+        if (!strcmp(image->path, path))
+            goto found;
+    }
+
+    image = zalloc(sizeof *image);
+    if (!image)
+        return NULL;
+    image->path = strdup(path);
+    if (!image->path) {
+        free(image);
+        return NULL;
+    }
+    wl_list_insert(&cache->images, &image->link);
+
+found:
+    wl_list_remove(&image->link);
+    wl_list_insert(&cache->images, &image->link);
+    image->refcount++;
+    return image;
+}
+
+/*
+ * find or make the variant of background for size,
+ * the variant is referenced for caller, and may be not ready.
+ */
+static struct qimm_background_variant *
+qimm_background_variant_get(struct qimm_background_cache *cache,
+                            struct qimm_data_background *background,
+                            int32_t width, int32_t height) {
+    const char *path = background->image;
+    uint32_t color = background->color & 0xffffff;
+    /* the fill color is not shown in scaled and tiled images */
+    int type = path ? background->type_e : CENTERED;
+
+    struct qimm_background_variant *variant;
+    wl_list_for_each(variant, &cache->variants, link) {
+        if (variant->failed || variant->width != width ||
+            variant->height != height || variant->type != type ||
+            variant->color != color)
+            continue;
+        if (!variant->image != !path ||
+            (path && strcmp(variant->image->path, path)))
+            continue;
+
+        wl_list_remove(&variant->link);
+        wl_list_insert(&cache->variants, &variant->link);
+        if (variant->image) {
+            wl_list_remove(&variant->image->link);
+            wl_list_insert(&cache->images, &variant->image->link);
+        }
+        variant->refcount++;
+        return variant;
+    }
+
+    variant = zalloc(sizeof *variant);
+    if (!variant)
+        return NULL;
+    variant->width = width;
+    variant->height = height;
+    variant->type = type;
+    variant->color = color;
+    wl_list_init(&variant->job_link);
+
+    if (path && !(variant->image = qimm_background_image_get(cache, path)))
+        goto err;
+
+    variant->buffer = qimm_buffer_create(cache->shell, width, height);
+    if (!variant->buffer)
+        goto err;
+    variant->data = qimm_buffer_get_data(variant->buffer);
+
+    wl_list_insert(&cache->variants, &variant->link);
+    cache->size += (size_t) width * height * 4;
+
+    /* referenced by caller and the job */
+    variant->refcount = 2;
+    pthread_mutex_lock(&cache->mutex);
+    wl_list_insert(cache->jobs.prev, &variant->job_link);
+    pthread_cond_signal(&cache->cond);
+    pthread_mutex_unlock(&cache->mutex);
+    return variant;
+
+err:
+    qimm_background_image_unref(cache, variant->image);
+    free(variant);
+    return NULL;
+}
+
+void
+qimm_background_output_update(struct qimm_output *output) {
+    struct qimm_background_cache *cache = output->shell->background;
+    if (!cache)
+        return;
+
+    struct qimm_project *project = output->project_cur;
+    struct qimm_data_background *background =
+            project ? project->background : NULL;
+    if (!background) {
+        qimm_background_view_hide(cache, output);
+        return;
+    }
+
+    if (!output->background) {
+        output->background = qimm_background_view_create(cache, output);
+        if (!output->background)
+            return;
+    }
+
+    struct qimm_background_view *bg = output->background;
+    struct qimm_background_variant *variant =
+            qimm_background_variant_get(cache, background,
+                                        output->output->width,
+                                        output->output->height);
+    if (!variant)
+        return;
+
+    /* the last background is kept until the new one is ready */
+    qimm_background_variant_unref(cache, bg->pending);
+    bg->pending = NULL;
+    if (variant->ready) {
+        if (variant != bg->variant)
+            qimm_background_view_show(cache, output, variant);
+        qimm_background_variant_unref(cache, variant);
+    } else {
+        bg->pending = variant;
+    }
+
+    qimm_background_trim(cache);
+}
+
+void
+qimm_background_output_remove(struct qimm_output *output) {
+    struct qimm_background_cache *cache = output->shell->background;
+    if (cache)
+        qimm_background_view_hide(cache, output);
+}
+
+int
+qimm_background_init(struct qimm_shell *shell) {
+    struct qimm_background_cache *cache = zalloc(sizeof *cache);
+    if (!cache)
+        return -1;
+
+    cache->shell = shell;
+    wl_list_init(&cache->images);
+    wl_list_init(&cache->variants);
+    wl_list_init(&cache->jobs);
+    wl_list_init(&cache->done);
+    pthread_mutex_init(&cache->mutex, NULL);
+    pthread_cond_init(&cache->cond, NULL);
+
+    cache->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (cache->event_fd < 0)
+        goto err;
+
+    struct wl_event_loop *loop =
+            wl_display_get_event_loop(shell->compositor->wl_display);
+    cache->event_source = wl_event_loop_add_fd(loop, cache->event_fd,
+                                               WL_EVENT_READABLE,
+                                               qimm_background_handle_done,
+                                               cache);
+    if (!cache->event_source)
+        goto err;
+
+    if (create_worker_thread(&cache->thread, qimm_background_worker,
+                             cache) < 0)
+        goto err;
+    cache->thread_started = true;
+
+    shell->background = cache;
+    return 0;
+
+err:
+    if (cache->event_source)
+        wl_event_source_remove(cache->event_source);
+    if (cache->event_fd >= 0)
+        close(cache->event_fd);
+    pthread_cond_destroy(&cache->cond);
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache);
+    return -1;
+}
+
+void
+qimm_background_release(struct qimm_shell *shell) {
+    struct qimm_background_cache *cache = shell->background;
+    if (!cache)
+        return;
+
+    pthread_mutex_lock(&cache->mutex);
+    cache->stop = true;
+    pthread_cond_signal(&cache->cond);
+    pthread_mutex_unlock(&cache->mutex);
+    if (cache->thread_started)
+        pthread_join(cache->thread, NULL);
+
+    struct qimm_output *output;
+    wl_list_for_each(output, &shell->outputs, link)
+        qimm_background_view_hide(cache, output);
+
+    /* drop the references of jobs never done */
+    wl_list_insert_list(&cache->jobs, &cache->done);
+    struct qimm_background_variant *variant, *vtmp;
+    wl_list_for_each_safe(variant, vtmp, &cache->jobs, job_link) {
+        wl_list_remove(&variant->job_link);
+        variant->refcount--;
+    }
+    wl_list_for_each_safe(variant, vtmp, &cache->variants, link)
+        qimm_background_variant_destroy(cache, variant);
+
+    struct qimm_background_image *image, *itmp;
+    wl_list_for_each_safe(image, itmp, &cache->images, link)
+        qimm_background_image_destroy(cache, image);
+
+    wl_event_source_remove(cache->event_source);
+    close(cache->event_fd);
+    pthread_cond_destroy(&cache->cond);
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache);
+    shell->background = NULL;
+}
@@ -0,0 +1,433 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+
+#include <wayland-client.h>
+
+/*
+ * The pixels of surfaces painted by shell, e.g. snapshot placeholders and
+ * backgrounds, are shown by an internal wayland client of the compositor,
+ * connected with a socketpair and dispatched in the compositor event loop.
+ * Its surfaces are made and committed through the protocol like other
+ * clients, so libweston attaches their shm buffers in the usual way.
+ *
+ * Requests are handled by compositor in a later dispatch, so the weston
+ * surface of a buffer surface is given to its owner on each commit.
+ * Buffers and surfaces made before the globals are bound wait for them.
+ */
+struct qimm_buffer_client {
+    struct qimm_shell *shell;
+    struct wl_client *client; /* the compositor side, NULL when lost */
+    struct wl_listener client_destroy_listener;
+    struct wl_listener create_surface_listener;
+
+    struct wl_display *display; /* the client side */
+    struct wl_event_source *source;
+    struct wl_registry *registry;
+    struct wl_compositor *compositor;
+    struct wl_shm *shm;
+
+    struct wl_list buffers; /* qimm_buffer::link */
+    struct wl_list surfaces; /* qimm_buffer_surface::link */
+};
+
+struct qimm_buffer {
+    struct qimm_buffer_client *buffers;
+    struct wl_list link; /* qimm_buffer_client::buffers */
+    int32_t width, height;
+
+    int fd;
+    void *data;
+    size_t size;
+    struct wl_buffer *buffer; /* NULL until wl_shm is bound */
+};
+
+struct qimm_buffer_surface {
+    struct qimm_buffer_client *buffers;
+    struct wl_list link; /* qimm_buffer_client::surfaces */
+
+    struct wl_surface *proxy; /* NULL until wl_compositor is bound */
+    struct qimm_buffer *pending; /* to attach when both are made */
+
+    /* NULL until compositor handled the request */
+    struct weston_surface *surface;
+    struct wl_listener commit_listener;
+    struct wl_listener destroy_listener;
+
+    qimm_buffer_committed_func_t committed;
+    void *data;
+};
+
+/* --------- client --------- */
+static void
+qimm_buffer_client_flush(struct qimm_buffer_client *buffers) {
+    if (!buffers->source)
+        return;
+
+    /* the rest is sent when the socket is writable again */
+    uint32_t mask = WL_EVENT_READABLE;
+    if (wl_display_flush(buffers->display) < 0 && errno == EAGAIN)
+        mask |= WL_EVENT_WRITABLE;
+    wl_event_source_fd_update(buffers->source, mask);
+}
+
+static void
+qimm_buffer_client_lost(struct qimm_buffer_client *buffers) {
+    qimm_log("internal buffer client is lost, "
+             "snapshots and backgrounds are not shown");
+    if (buffers->source) {
+        wl_event_source_remove(buffers->source);
+        buffers->source = NULL;
+    }
+}
+
+static int
+qimm_buffer_client_handle_event(int fd, uint32_t mask, void *data) {
+    struct qimm_buffer_client *buffers = data;
+
+    if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) {
+        qimm_buffer_client_lost(buffers);
+        return 0;
+    }
+    if ((mask & WL_EVENT_READABLE) &&
+        wl_display_dispatch(buffers->display) < 0) {
+        qimm_buffer_client_lost(buffers);
+        return 0;
+    }
+
+    qimm_buffer_client_flush(buffers);
+    return 0;
+}
+
+static void
+qimm_buffer_realize(struct qimm_buffer *buffer) {
+    struct qimm_buffer_client *buffers = buffer->buffers;
+    if (buffer->buffer || !buffers->shm)
+        return;
+
+    struct wl_shm_pool *pool = wl_shm_create_pool(buffers->shm, buffer->fd,
+                                                  buffer->size);
+    buffer->buffer = wl_shm_pool_create_buffer(pool, 0, buffer->width,
+                                               buffer->height,
+                                               buffer->width * 4,
+                                               WL_SHM_FORMAT_ARGB8888);
+    wl_shm_pool_destroy(pool);
+}
+
+static void
+qimm_buffer_surface_commit(struct qimm_buffer_surface *surface) {
+    struct qimm_buffer *buffer = surface->pending;
+    if (!buffer || !surface->proxy || !buffer->buffer)
+        return;
+
+    wl_surface_attach(surface->proxy, buffer->buffer, 0, 0);
+    wl_surface_damage(surface->proxy, 0, 0, INT32_MAX, INT32_MAX);
+    wl_surface_commit(surface->proxy);
+    surface->pending = NULL;
+}
+
+static void
+qimm_buffer_surface_realize(struct qimm_buffer_surface *surface) {
+    struct qimm_buffer_client *buffers = surface->buffers;
+    if (!surface->proxy && buffers->compositor)
+        surface->proxy = wl_compositor_create_surface(buffers->compositor);
+    qimm_buffer_surface_commit(surface);
+}
+
+static void
+qimm_buffer_registry_handle_global(void *data, struct wl_registry *registry,
+                                   uint32_t name, const char *interface,
+                                   uint32_t version) {
+    struct qimm_buffer_client *buffers = data;
+
+    if (!strcmp(interface, wl_compositor_interface.name) &&
+        !buffers->compositor)
+        buffers->compositor = wl_registry_bind(registry, name,
+                                               &wl_compositor_interface, 1);
+    else if (!strcmp(interface, wl_shm_interface.name) && !buffers->shm)
+        buffers->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+    else
+        return;
+
+    /* make what was asked before the globals */
+    struct qimm_buffer *buffer;
+    wl_list_for_each(buffer, &buffers->buffers, link)
+        qimm_buffer_realize(buffer);
+    struct qimm_buffer_surface *surface;
+    wl_list_for_each(surface, &buffers->surfaces, link)
+        qimm_buffer_surface_realize(surface);
+}
+
+static void
+qimm_buffer_registry_handle_global_remove(void *data,
+                                          struct wl_registry *registry,
+                                          uint32_t name) {
+}
+
+static const struct wl_registry_listener qimm_buffer_registry_listener = {
+        qimm_buffer_registry_handle_global,
+        qimm_buffer_registry_handle_global_remove,
+};
+
+static void
+qimm_buffer_surface_handle_commit(struct wl_listener *listener, void *data) {
+    struct qimm_buffer_surface *surface =
+            container_of(listener, struct qimm_buffer_surface,
+                         commit_listener);
+    surface->committed(surface->surface, surface->data);
+}
+
+static void
+qimm_buffer_surface_handle_destroy(struct wl_listener *listener,
+                                   void *data) {
+    struct qimm_buffer_surface *surface =
+            container_of(listener, struct qimm_buffer_surface,
+                         destroy_listener);
+    wl_list_remove(&surface->commit_listener.link);
+    wl_list_remove(&surface->destroy_listener.link);
+    surface->surface = NULL;
+}
+
+static void
+qimm_buffer_client_handle_create_surface(struct wl_listener *listener,
+                                         void *data) {
+    struct qimm_buffer_client *buffers =
+            container_of(listener, struct qimm_buffer_client,
+                         create_surface_listener);
+    struct weston_surface *wsurface = data;
+    if (!wsurface->resource ||
+        wl_resource_get_client(wsurface->resource) != buffers->client)
+        return;
+
+    uint32_t id = wl_resource_get_id(wsurface->resource);
+    struct qimm_buffer_surface *surface;
+    wl_list_for_each(surface, &buffers->surfaces, link) {
+        if (surface->surface || !surface->proxy ||
+            wl_proxy_get_id((struct wl_proxy *) surface->proxy) != id)
+            continue;
+
+        surface->surface = wsurface;
+        surface->commit_listener.notify = qimm_buffer_surface_handle_commit;
+        wl_signal_add(&wsurface->commit_signal, &surface->commit_listener);
+        surface->destroy_listener.notify = qimm_buffer_surface_handle_destroy;
+        wl_signal_add(&wsurface->destroy_signal, &surface->destroy_listener);
+        return;
+    }
+}
+
+static void
+qimm_buffer_client_handle_destroy(struct wl_listener *listener, void *data) {
+    struct qimm_buffer_client *buffers =
+            container_of(listener, struct qimm_buffer_client,
+                         client_destroy_listener);
+    wl_list_remove(&buffers->client_destroy_listener.link);
+    buffers->client = NULL;
+    qimm_buffer_client_lost(buffers);
+}
+
+int
+qimm_buffer_init(struct qimm_shell *shell) {
+    struct qimm_buffer_client *buffers = zalloc(sizeof *buffers);
+    if (!buffers)
+        return -1;
+
+    buffers->shell = shell;
+    wl_list_init(&buffers->buffers);
+    wl_list_init(&buffers->surfaces);
+
+    int sv[2];
+    if (os_socketpair_cloexec(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        free(buffers);
+        return -1;
+    }
+
+    buffers->client = wl_client_create(shell->compositor->wl_display, sv[0]);
+    if (!buffers->client) {
+        close(sv[0]);
+        close(sv[1]);
+        free(buffers);
+        return -1;
+    }
+    buffers->client_destroy_listener.notify = qimm_buffer_client_handle_destroy;
+    wl_client_add_destroy_listener(buffers->client,
+                                   &buffers->client_destroy_listener);
+
+    /* the display owns the fd from now, even if failed */
+    buffers->display = wl_display_connect_to_fd(sv[1]);
+    if (!buffers->display)
+        goto err;
+
+    struct wl_event_loop *loop =
+            wl_display_get_event_loop(shell->compositor->wl_display);
+    buffers->source = wl_event_loop_add_fd(loop, sv[1], WL_EVENT_READABLE,
+                                           qimm_buffer_client_handle_event,
+                                           buffers);
+    if (!buffers->source)
+        goto err;
+
+    buffers->registry = wl_display_get_registry(buffers->display);
+    wl_registry_add_listener(buffers->registry,
+                             &qimm_buffer_registry_listener, buffers);
+    qimm_buffer_client_flush(buffers);
+
+    buffers->create_surface_listener.notify =
+            qimm_buffer_client_handle_create_surface;
+    wl_signal_add(&shell->compositor->create_surface_signal,
+                  &buffers->create_surface_listener);
+
+    shell->buffers = buffers;
+    return 0;
+
+err:
+    if (buffers->display)
+        wl_display_disconnect(buffers->display);
+    wl_list_remove(&buffers->client_destroy_listener.link);
+    wl_client_destroy(buffers->client);
+    free(buffers);
+    return -1;
+}
+
+void
+qimm_buffer_release(struct qimm_shell *shell) {
+    struct qimm_buffer_client *buffers = shell->buffers;
+    if (!buffers)
+        return;
+
+    /* buffers and surfaces are released by their owners before */
+    assert(wl_list_empty(&buffers->buffers));
+    assert(wl_list_empty(&buffers->surfaces));
+
+    wl_list_remove(&buffers->create_surface_listener.link);
+    if (buffers->source)
+        wl_event_source_remove(buffers->source);
+    if (buffers->shm)
+        wl_shm_destroy(buffers->shm);
+    if (buffers->compositor)
+        wl_compositor_destroy(buffers->compositor);
+    wl_registry_destroy(buffers->registry);
+    wl_display_disconnect(buffers->display);
+    if (buffers->client) {
+        wl_list_remove(&buffers->client_destroy_listener.link);
+        wl_client_destroy(buffers->client);
+    }
+    free(buffers);
+    shell->buffers = NULL;
+}
+
+/* --------- buffer --------- */
+struct qimm_buffer *
+qimm_buffer_create(struct qimm_shell *shell, int32_t width, int32_t height) {
+    struct qimm_buffer_client *buffers = shell->buffers;
+    if (!buffers || width <= 0 || height <= 0)
+        return NULL;
+
+    struct qimm_buffer *buffer = zalloc(sizeof *buffer);
+    if (!buffer)
+        return NULL;
+    buffer->buffers = buffers;
+    buffer->width = width;
+    buffer->height = height;
+    buffer->size = (size_t) width * height * 4;
+
+    buffer->fd = os_create_anonymous_file(buffer->size);
+    if (buffer->fd < 0) {
+        free(buffer);
+        return NULL;
+    }
+    buffer->data = mmap(NULL, buffer->size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, buffer->fd, 0);
+    if (buffer->data == MAP_FAILED) {
+        close(buffer->fd);
+        free(buffer);
+        return NULL;
+    }
+
+    wl_list_insert(&buffers->buffers, &buffer->link);
+    qimm_buffer_realize(buffer);
+    qimm_buffer_client_flush(buffers);
+    return buffer;
+}
+
+void *
+qimm_buffer_get_data(struct qimm_buffer *buffer) {
+    return buffer->data;
+}
+
+void
+qimm_buffer_destroy(struct qimm_buffer *buffer) {
+    struct qimm_buffer_client *buffers = buffer->buffers;
+
+    struct qimm_buffer_surface *surface;
+    wl_list_for_each(surface, &buffers->surfaces, link) {
+        if (surface->pending == buffer)
+            surface->pending = NULL;
+    }
+
+    if (buffer->buffer) {
+        wl_buffer_destroy(buffer->buffer);
+        qimm_buffer_client_flush(buffers);
+    }
+    munmap(buffer->data, buffer->size);
+    close(buffer->fd);
+    wl_list_remove(&buffer->link);
+    free(buffer);
+}
+
+/* --------- surface --------- */
+struct qimm_buffer_surface *
+qimm_buffer_surface_create(struct qimm_shell *shell,
+                           qimm_buffer_committed_func_t committed,
+                           void *data) {
+    struct qimm_buffer_client *buffers = shell->buffers;
+    if (!buffers)
+        return NULL;
+
+    struct qimm_buffer_surface *surface = zalloc(sizeof *surface);
+    if (!surface)
+        return NULL;
+    surface->buffers = buffers;
+    surface->committed = committed;
+    surface->data = data;
+
+    wl_list_insert(&buffers->surfaces, &surface->link);
+    qimm_buffer_surface_realize(surface);
+    qimm_buffer_client_flush(buffers);
+    return surface;
+}
+
+void
+qimm_buffer_surface_attach(struct qimm_buffer_surface *surface,
+                           struct qimm_buffer *buffer) {
+    surface->pending = buffer;
+    qimm_buffer_surface_commit(surface);
+    qimm_buffer_client_flush(surface->buffers);
+}
+
+void
+qimm_buffer_surface_destroy(struct qimm_buffer_surface *surface) {
+    if (surface->surface) {
+        wl_list_remove(&surface->commit_listener.link);
+        wl_list_remove(&surface->destroy_listener.link);
+    }
+    if (surface->proxy) {
+        wl_surface_destroy(surface->proxy);
+        qimm_buffer_client_flush(surface->buffers);
+    }
+    wl_list_remove(&surface->link);
+    free(surface);
+}
@@ -18,14 +18,60 @@
 #include "qimm.h"
 #include "qimm-desktop-shell-server-protocol.h"
 
+#define QIMM_SEARCH_LIMIT 256
+
 static void
 desktop_shell_test(struct wl_client *client,
                    struct wl_resource *resource) {
     qimm_log("desktop_shell_set_background ...");
 }
 
+static void
+desktop_shell_get_metrics(struct wl_client *client,
+                          struct wl_resource *resource,
+                          uint32_t id) {
+    struct qimm_shell *shell = wl_resource_get_user_data(resource);
+    qimm_metrics_add_client(shell, client, 1, id);
+}
+
+static void
+desktop_shell_ack_layout_transaction(struct wl_client *client,
+                                     struct wl_resource *resource,
+                                     uint32_t serial) {
+    struct qimm_shell *shell = wl_resource_get_user_data(resource);
+    qimm_transaction_ack(shell, qimm_index_find_client(shell, client), serial);
+}
+
+static void
+desktop_shell_search(struct wl_client *client,
+                     struct wl_resource *resource,
+                     uint32_t id, const char *query, uint32_t limit) {
+    struct qimm_shell *shell = wl_resource_get_user_data(resource);
+
+    struct wl_resource *search =
+            wl_resource_create(client, &qimm_desktop_search_interface, 1, id);
+    if (!search) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    struct qimm_search_result results[QIMM_SEARCH_LIMIT];
+    int count = 0;
+    if (shell->search)
+        count = qimm_search_query(shell->search, query, results,
+                                  MIN(limit, QIMM_SEARCH_LIMIT));
+    for (int i = 0; i < count; i++)
+        qimm_desktop_search_send_project(search, results[i].name,
+                                         results[i].score);
+    qimm_desktop_search_send_done(search, MAX(count, 0));
+    wl_resource_destroy(search);
+}
+
 static const struct qimm_desktop_shell_interface desktop_shell_implementation = {
-        desktop_shell_test,
+        .test = desktop_shell_test,
+        .get_metrics = desktop_shell_get_metrics,
+        .ack_layout_transaction = desktop_shell_ack_layout_transaction,
+        .search = desktop_shell_search,
 };
 
 static void
@@ -39,6 +85,16 @@ unbind_desktop_shell(struct wl_resource *resource) {
 //    shell->prepare_event_sent = false;
 }
 
+static void
+handle_client_resource_destroy(struct wl_listener *listener, void *data) {
+    struct qimm_client *qimm_client =
+            container_of(listener, struct qimm_client,
+                         resource_destroy_listener);
+
+    wl_list_remove(&qimm_client->resource_destroy_listener.link);
+    qimm_client->resource = NULL;
+}
+
 static void
 bind_desktop_shell(struct wl_client *client,
                    void *data, uint32_t version, uint32_t id) {
@@ -46,12 +102,26 @@ bind_desktop_shell(struct wl_client *client,
     struct wl_resource *resource;
 
     resource = wl_resource_create(client, &qimm_desktop_shell_interface,
-                                  1, id);
+                                  MIN(version, 5), id);
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
 
 //    if (client == shell->child.client) {
     wl_resource_set_implementation(resource,
                                    &desktop_shell_implementation,
                                    shell, unbind_desktop_shell);
+
+    /* layout transactions are sent to the clients of layouts */
+    struct qimm_client *qimm_client = qimm_index_find_client(shell, client);
+    if (qimm_client && !qimm_client->resource && version >= 3) {
+        qimm_client->resource = resource;
+        qimm_client->resource_destroy_listener.notify =
+                handle_client_resource_destroy;
+        wl_resource_add_destroy_listener(resource,
+                                         &qimm_client->resource_destroy_listener);
+    }
     // shell->child.desktop_shell = resource;
 //        return;
 //    }
@@ -66,9 +136,17 @@ qimm_client_init(struct qimm_shell *shell) {
     if (shell->client_path == NULL)
         return -1;
 
+    if (qimm_zygote_init(shell) < 0)
+        return -1;
+
+    const char *share = getenv(QIMM_CLIENT_SHARE);
+    shell->client_share = share && !strcmp(share, "1");
+    if (shell->client_share)
+        qimm_log("client start one for each project");
+
     shell->global_shell_iface = wl_global_create(shell->compositor->wl_display,
                                                  &qimm_desktop_shell_interface,
-                                                 1,
+                                                 5,
                                                  shell, bind_desktop_shell);
     if (!shell->global_shell_iface) {
         qimm_log("failed to create global shell interface");
@@ -80,6 +158,7 @@ qimm_client_init(struct qimm_shell *shell) {
 
 void
 qimm_client_release(struct qimm_shell *shell) {
+    qimm_zygote_release(shell);
     free(shell->client_path);
 
     if (shell->global_shell_iface)
@@ -92,29 +171,76 @@ destroy_shell_client_process(struct wl_listener *listener, void *data) {
             container_of(listener, struct qimm_client, destroy_listener);
 
     wl_list_remove(&qimm_client->destroy_listener.link);
+    if (qimm_client->shell)
+        qimm_index_client_remove(qimm_client);
 
-    if (qimm_client->resource)
+    if (qimm_client->resource) {
+        wl_list_remove(&qimm_client->resource_destroy_listener.link);
         wl_resource_destroy(qimm_client->resource);
+    }
 
-    if (qimm_client->layout)
-        qimm_client->layout->client = NULL;
+    struct qimm_layout *layout, *tmp;
+    wl_list_for_each_safe(layout, tmp, &qimm_client->layouts, client_link) {
+        layout->client = NULL;
+        wl_list_remove(&layout->client_link);
+        wl_list_init(&layout->client_link);
+    }
 
     free(qimm_client);
 }
 
+/*
+ * trace the launch with project and first layout of client
+ */
+static void
+qimm_client_startup_mark(struct qimm_client_startup *startup) {
+    char *const *argv = startup->agrv;
+    char *detail;
+    if (asprintf(&detail, "%s/%s", argv[2], argv[3] ? argv[4] : "") < 0)
+        return;
+    qimm_startup_mark(startup->shell, "client_launch", detail);
+    free(detail);
+}
+
 static void
 qimm_client_launch_process(void *data) {
     struct qimm_client_startup *startup = data;
     struct qimm_shell *shell = startup->shell;
     struct qimm_client *qimm_client = NULL;
 
-    struct wl_client *client =
-            qimm_process_launch(shell->compositor, startup->agrv);
+    struct timespec launch_time, now;
+    clock_gettime(CLOCK_MONOTONIC, &launch_time);
+
+    pid_t pid = -1;
+    struct wl_client *client = NULL;
+    bool zygote = shell->zygote != NULL;
+    if (zygote) {
+        client = qimm_zygote_launch(shell, startup->agrv, &pid);
+        /* the zygote logged why, exec the client instead */
+        if (!client) {
+            qimm_log("zygote launch failed, falling back to exec");
+            zygote = false;
+        }
+    }
+    if (!client)
+        client = qimm_process_launch(shell->compositor, startup->agrv, &pid);
     if (client) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        qimm_log("client launched in %.3f ms (%s mode)",
+                 timespec_sub_to_nsec(&now, &launch_time) / 1000000.0,
+                 zygote ? "zygote" : "exec");
+        qimm_client_startup_mark(startup);
+
         qimm_client = zalloc(sizeof *qimm_client);
+        qimm_client->shell = shell;
         qimm_client->client = client;
+        qimm_client->pid = pid;
+        qimm_client->launch_time = launch_time;
+        wl_list_init(&qimm_client->layouts);
         qimm_client->destroy_listener.notify = destroy_shell_client_process;
         wl_client_add_destroy_listener(client, &qimm_client->destroy_listener);
+        if (qimm_index_client_add(qimm_client) < 0)
+            qimm_log("failed to index client, its surfaces have no layout");
     }
 
     startup->func(shell, qimm_client, startup->data);
@@ -139,15 +265,26 @@ qimm_client_start(struct qimm_client_startup *startup) {
     free(startup);
 }
 
+static void
+qimm_client_add_layout(struct qimm_client *client, struct qimm_layout *layout) {
+    layout->client = client;
+    wl_list_insert(client->layouts.prev, &layout->client_link);
+}
+
 static void
 qimm_client_start_layout_func(struct qimm_shell *shell,
                               struct qimm_client *client, void *data) {
-    if (client) { /* success launch client */
-        struct qimm_layout *layout = data;
-
-        layout->client = client;
-        client->layout = layout;
+    struct qimm_layout *layout = data;
+    /* the layout is removed before launched */
+    if (!layout) {
+        if (client)
+            wl_client_destroy(client->client);
+        return;
     }
+
+    layout->startup = NULL;
+    if (client) /* success launch client */
+        qimm_client_add_layout(client, layout);
 }
 
 static void
@@ -162,6 +299,53 @@ qimm_client_start_layout(struct qimm_project *project, struct qimm_layout *layou
     startup->agrv[4] = strdup(layout->config_layout->name);
     startup->func = qimm_client_start_layout_func;
     startup->data = layout;
+    layout->startup = startup;
+    qimm_client_start(startup);
+}
+
+static void
+qimm_client_start_project_func(struct qimm_shell *shell,
+                               struct qimm_client *client, void *data) {
+    if (client) { /* success launch client */
+        struct qimm_project *project = data;
+
+        struct qimm_layout *layout;
+        wl_list_for_each(layout, &project->layouts, link) {
+            if (!layout->client)
+                qimm_client_add_layout(client, layout);
+        }
+    }
+}
+
+/*
+ * start one client for all layouts without client in project
+ */
+static void
+qimm_client_start_project(struct qimm_project *project) {
+    int count = 0;
+    struct qimm_layout *layout;
+    wl_list_for_each(layout, &project->layouts, link) {
+        if (!layout->client)
+            count++;
+    }
+    if (count == 0)
+        return;
+
+    struct qimm_client_startup *startup = zalloc(sizeof *startup);
+    startup->shell = project->shell;
+    startup->agrv = zalloc((4 + count * 2) * sizeof(char *));
+    startup->agrv[0] = strdup(project->shell->client_path);
+    startup->agrv[1] = strdup("-p");
+    startup->agrv[2] = strdup(project->name);
+    int i = 3;
+    wl_list_for_each(layout, &project->layouts, link) {
+        if (!layout->client) {
+            startup->agrv[i++] = strdup("-a");
+            startup->agrv[i++] = strdup(layout->config_layout->name);
+        }
+    }
+    startup->func = qimm_client_start_project_func;
+    startup->data = project;
     qimm_client_start(startup);
 }
 
@@ -173,9 +357,27 @@ qimm_client_project_start(struct qimm_project *project) {
         return;
     }
 
+    if (project->shell->client_share) {
+        qimm_client_start_project(project);
+        return;
+    }
+
     struct qimm_layout *layout;
     wl_list_for_each(layout, &project->layouts, link) {
         if (!layout->client)
             qimm_client_start_layout(project, layout);
     }
 }
+
+struct qimm_layout *
+qimm_client_find_layout(struct qimm_client *client, const char *app_id) {
+    struct qimm_layout *layout, *free_layout = NULL;
+    wl_list_for_each(layout, &client->layouts, client_link) {
+        if (app_id && !strcmp(layout->config_layout->name, app_id))
+            return layout;
+        /* the client creates surfaces in the order of layouts */
+        if (!free_layout && !layout->surface)
+            free_layout = layout;
+    }
+    return free_layout;
+}
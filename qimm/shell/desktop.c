@@ -103,9 +103,10 @@ qimm_surface_update_layer(struct qimm_surface *qimm_surface) {
     if (!qimm_surface->layout)
         return;
     struct qimm_project *project = qimm_surface->layout->project;
-    /* the first layout is for background */
+    /* the first layout of current project is for background */
     struct weston_layer_entry *new_layer_link;
-    if (project->layouts.next == &qimm_surface->layout->link)
+    if (project->layouts.next == &qimm_surface->layout->link &&
+        project->output && project->output->project_cur == project)
         new_layer_link = &project->output->shell->background_layer.view_list;
     else
         new_layer_link = &project->layer.view_list;
@@ -124,6 +125,15 @@ qimm_surface_update_layer(struct qimm_surface *qimm_surface) {
     weston_desktop_surface_propagate_layer(qimm_surface->desktop_surface);
 }
 
+void
+qimm_surface_project_update_layer(struct qimm_project *project) {
+    struct qimm_layout *layout;
+    wl_list_for_each(layout, &project->layouts, link) {
+        if (layout->surface && weston_view_is_mapped(layout->surface->view))
+            qimm_surface_update_layer(layout->surface);
+    }
+}
+
 static struct qimm_surface *
 get_qimm_surface(struct weston_surface *surface) {
     if (weston_surface_is_desktop_surface(surface)) {
@@ -183,9 +193,111 @@ get_default_view(struct weston_surface *surface) {
     return container_of(surface->views.next, struct weston_view, surface_link);
 }
 
+static void
+qimm_surface_set_layout(struct qimm_surface *qimm_surface,
+                        struct qimm_layout *layout) {
+    if (qimm_surface->layout)
+        qimm_surface->layout->surface = NULL;
+
+    qimm_surface->layout = layout;
+    if (!layout)
+        return;
+
+    layout->surface = qimm_surface;
+    weston_desktop_surface_set_size(qimm_surface->desktop_surface,
+                                    layout->w, layout->h);
+    layout->sent_w = layout->w;
+    layout->sent_h = layout->h;
+}
+
+void
+qimm_surface_layout_update(struct qimm_layout *layout) {
+    struct qimm_surface *qimm_surface = layout->surface;
+    if (!qimm_surface)
+        return;
+
+    if (layout->w != layout->sent_w || layout->h != layout->sent_h) {
+        weston_desktop_surface_set_size(qimm_surface->desktop_surface,
+                                        layout->w, layout->h);
+        layout->sent_w = layout->w;
+        layout->sent_h = layout->h;
+        qimm_transaction_layout_add(layout);
+    }
+
+    /* unmapped view is positioned when mapped */
+    struct weston_view *view = qimm_surface->view;
+    if (weston_view_is_mapped(view) &&
+        (view->geometry.x != layout->x || view->geometry.y != layout->y))
+        weston_view_set_position(view, layout->x, layout->y);
+}
+
+void
+qimm_surface_layout_remove(struct qimm_layout *layout) {
+    struct qimm_surface *qimm_surface = layout->surface;
+    if (!qimm_surface)
+        return;
+
+    /* out of layers, commits of the surface do not map it again */
+    qimm_surface_set_layout(qimm_surface, NULL);
+    weston_view_unmap(qimm_surface->view);
+}
+
+/*
+ * the layout is guessed by surface order when surface added,
+ * correct it by app id which is known on first commit.
+ */
+static void
+qimm_surface_check_layout(struct qimm_surface *qimm_surface) {
+    struct qimm_layout *layout = qimm_surface->layout;
+    if (!layout || !layout->client)
+        return;
+
+    const char *app_id =
+            weston_desktop_surface_get_app_id(qimm_surface->desktop_surface);
+    if (!app_id || !strcmp(app_id, layout->config_layout->name))
+        return;
+
+    struct qimm_layout *match =
+            qimm_client_find_layout(layout->client, app_id);
+    if (!match || match == layout)
+        return;
+
+    /* swap with the surface which took the layout */
+    struct qimm_surface *other = match->surface;
+    qimm_surface_set_layout(qimm_surface, match);
+    if (other) {
+        other->layout = NULL;
+        qimm_surface_set_layout(other, layout);
+    }
+}
+
+static void
+qimm_surface_first_commit(struct qimm_surface *qimm_surface) {
+    if (!qimm_surface->layout || !qimm_surface->layout->client)
+        return;
+
+    struct qimm_client *client = qimm_surface->layout->client;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    qimm_log("client (%s) first commit after %.3f ms",
+             qimm_surface->layout->config_layout->name,
+             timespec_sub_to_nsec(&now, &client->launch_time) / 1000000.0);
+
+    struct qimm_layout *layout = qimm_surface->layout;
+    char *detail;
+    if (asprintf(&detail, "%s/%s", layout->project->name,
+                 layout->config_layout->name) < 0)
+        return;
+    qimm_startup_mark(layout->project->shell, "client_commit", detail);
+    free(detail);
+}
+
 static void
 map(struct qimm_shell *shell, struct qimm_surface *qimm_surface,
         int32_t sx, int32_t sy) {
+    qimm_surface_check_layout(qimm_surface);
+    qimm_surface_first_commit(qimm_surface);
+
     qimm_view_set_position(qimm_surface->view, qimm_surface->layout, shell);
 
     qimm_surface_update_layer(qimm_surface);
@@ -193,6 +305,10 @@ map(struct qimm_shell *shell, struct qimm_surface *qimm_surface,
     weston_view_update_transform(qimm_surface->view);
     qimm_surface->view->is_mapped = true;
 
+    /* replace the last frame in the same repaint */
+    if (qimm_surface->layout)
+        qimm_snapshot_layout_release(qimm_surface->layout);
+
     if (!shell->locked) {
         struct weston_seat *seat;
         wl_list_for_each(seat, &shell->compositor->seat_list, link) {
@@ -240,11 +356,10 @@ desktop_surface_added(struct weston_desktop_surface *desktop_surface,
     wl_list_init(&qimm_surface->children_list);
     wl_list_init(&qimm_surface->children_link);
 
-    qimm_surface->layout = qimm_layout_find_by_client(shell, wl_client);
-    if (qimm_surface->layout)
-        weston_desktop_surface_set_size(desktop_surface,
-                qimm_surface->layout->w, qimm_surface->layout->h);
-    else
+    const char *app_id = weston_desktop_surface_get_app_id(desktop_surface);
+    qimm_surface_set_layout(qimm_surface,
+            qimm_layout_find_by_client(shell, wl_client, app_id));
+    if (!qimm_surface->layout)
         qimm_log("freedom surface %p %s",
                 desktop_surface,
                 weston_desktop_surface_get_title(desktop_surface));
@@ -274,6 +389,11 @@ desktop_surface_removed(struct weston_desktop_surface *desktop_surface,
 
     wl_signal_emit(&qimm_surface->destroy_signal, qimm_surface);
 
+    if (qimm_surface->layout) {
+        qimm_transaction_layout_remove(qimm_surface->layout);
+        qimm_surface->layout->surface = NULL;
+    }
+
     weston_surface_set_label_func(surface, NULL);
     weston_desktop_surface_set_user_data(qimm_surface->desktop_surface, NULL);
 
@@ -296,6 +416,11 @@ desktop_surface_committed(struct weston_desktop_surface *desktop_surface,
     if (surface->width == 0)
         return;
 
+    if (qimm_surface->layout) {
+        qimm_throttle_layout_committed(qimm_surface->layout, surface);
+        qimm_transaction_layout_committed(qimm_surface->layout);
+    }
+
     if (!weston_surface_is_mapped(surface)) {
         map(shell, qimm_surface, sx, sy);
         surface->is_mapped = true;
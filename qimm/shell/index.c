@@ -0,0 +1,184 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+
+/*
+ * The types of a config in index, by name in each config,
+ * because projects with the same config have the same type names.
+ */
+struct qimm_index_type {
+    struct qimm_hash_node node; /* qimm_index_config::types */
+    struct qimm_project_config_type *type;
+};
+struct qimm_index_config {
+    struct qimm_hash_node node; /* qimm_index::configs */
+    struct qimm_hash types;
+    struct qimm_index_type entries[];
+};
+
+static void
+qimm_index_config_free(struct qimm_index_config *ic) {
+    qimm_hash_release(&ic->types);
+    free(ic);
+}
+
+void
+qimm_index_init(struct qimm_shell *shell) {
+    struct qimm_index *index = &shell->index;
+    qimm_hash_init(&index->clients, false);
+    qimm_hash_init(&index->outputs, true);
+    qimm_hash_init(&index->configs, false);
+}
+
+void
+qimm_index_release(struct qimm_shell *shell) {
+    struct qimm_index *index = &shell->index;
+
+    /* clients may be destroyed after shell, see destroy_shell_client_process */
+    struct qimm_hash_node *node;
+    while ((node = qimm_hash_pop(&index->clients))) {
+        struct qimm_client *client =
+                container_of(node, struct qimm_client, index_node);
+        client->shell = NULL;
+    }
+
+    while ((node = qimm_hash_pop(&index->configs)))
+        qimm_index_config_free(container_of(node, struct qimm_index_config,
+                                            node));
+
+    qimm_hash_release(&index->clients);
+    qimm_hash_release(&index->outputs);
+    qimm_hash_release(&index->configs);
+}
+
+/* --------- client --------- */
+int
+qimm_index_client_add(struct qimm_client *client) {
+    struct qimm_index *index = &client->shell->index;
+    return qimm_hash_insert(&index->clients, &client->index_node,
+                            client->client);
+}
+
+void
+qimm_index_client_remove(struct qimm_client *client) {
+    struct qimm_index *index = &client->shell->index;
+    qimm_hash_remove(&index->clients, &client->index_node);
+}
+
+struct qimm_client *
+qimm_index_find_client(struct qimm_shell *shell, struct wl_client *client) {
+    struct qimm_hash_node *node = qimm_hash_find(&shell->index.clients, client);
+    if (!node)
+        return NULL;
+    return container_of(node, struct qimm_client, index_node);
+}
+
+/* --------- output --------- */
+int
+qimm_index_output_add(struct qimm_output *output) {
+    struct qimm_index *index = &output->shell->index;
+    return qimm_hash_insert(&index->outputs, &output->index_node,
+                            output->output->name);
+}
+
+void
+qimm_index_output_remove(struct qimm_output *output) {
+    struct qimm_index *index = &output->shell->index;
+    qimm_hash_remove(&index->outputs, &output->index_node);
+}
+
+struct qimm_output *
+qimm_index_find_output(struct qimm_shell *shell, const char *name) {
+    struct qimm_hash_node *node = qimm_hash_find(&shell->index.outputs, name);
+    if (!node)
+        return NULL;
+    return container_of(node, struct qimm_output, index_node);
+}
+
+/* --------- type --------- */
+int
+qimm_index_config_add(struct qimm_shell *shell,
+                      struct qimm_project_config *config) {
+    struct qimm_index *index = &shell->index;
+
+    int count = wl_list_length(&config->types);
+    struct qimm_index_config *ic =
+            zalloc(sizeof *ic + count * sizeof(struct qimm_index_type));
+    if (!ic)
+        return -1;
+    qimm_hash_init(&ic->types, true);
+
+    int i = 0;
+    struct qimm_project_config_type *type;
+    wl_list_for_each(type, &config->types, link) {
+        struct qimm_index_type *it = &ic->entries[i++];
+        it->type = type;
+        if (qimm_hash_insert(&ic->types, &it->node, type->name) < 0)
+            goto err;
+    }
+
+    if (qimm_hash_insert(&index->configs, &ic->node, config) < 0)
+        goto err;
+    return 0;
+
+err:
+    qimm_index_config_free(ic);
+    return -1;
+}
+
+void
+qimm_index_config_remove(struct qimm_shell *shell,
+                         struct qimm_project_config *config) {
+    struct qimm_index *index = &shell->index;
+
+    struct qimm_hash_node *node = qimm_hash_find(&index->configs, config);
+    if (!node)
+        return;
+
+    qimm_hash_remove(&index->configs, node);
+    qimm_index_config_free(container_of(node, struct qimm_index_config, node));
+}
+
+/*
+ * search types of config not in index, e.g. failed to add it
+ */
+static struct qimm_project_config_type *
+qimm_index_search_type(struct qimm_project_config *config, const char *name) {
+    struct qimm_project_config_type *type;
+    wl_list_for_each(type, &config->types, link) {
+        if (!strcmp(type->name, name))
+            return type;
+    }
+    return NULL;
+}
+
+struct qimm_project_config_type *
+qimm_index_find_type(struct qimm_shell *shell,
+                     struct qimm_project_config *config,
+                     const char *name) {
+    struct qimm_hash_node *node = qimm_hash_find(&shell->index.configs, config);
+    if (!node)
+        return qimm_index_search_type(config, name);
+    struct qimm_index_config *ic =
+            container_of(node, struct qimm_index_config, node);
+
+    node = qimm_hash_find(&ic->types, name);
+    if (!node)
+        return NULL;
+    return container_of(node, struct qimm_index_type, node)->type;
+}
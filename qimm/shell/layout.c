@@ -17,75 +17,112 @@
  */
 #include "qimm.h"
 
-static struct qimm_project_config_type *
-qimm_layout_types_find_type(struct wl_list *types, const char *name) {
-    struct qimm_project_config_type *type;
-    wl_list_for_each(type, types, link) {
-        if (!strcmp(type->name, name))
-            return type;
-    }
-    return NULL;
-}
-
 static struct qimm_project_config_type *
 qimm_layout_project_find_type(struct qimm_project *project, const char *name) {
+    struct qimm_shell *shell = project->shell;
     struct qimm_project_config_type *type = NULL;
 
     if (project->config)
-        type = qimm_layout_types_find_type(&project->config->types, name);
+        type = qimm_index_find_type(shell, project->config, name);
 
-    if (!type && project->shell->config) {
-        struct wl_list *types = &project->shell->config->types;
-        type = qimm_layout_types_find_type(types, name);
-    }
+    if (!type && shell->config)
+        type = qimm_index_find_type(shell, shell->config, name);
 
     return type;
 }
 
+static void
+qimm_layout_mark_dirty(struct qimm_layout *layout) {
+    struct qimm_project *project = layout->project;
+    if (layout->dirty)
+        return;
+
+    layout->dirty = true;
+    project->dirty_count++;
+    if (!project->dirty_first || layout->index < project->dirty_first->index)
+        project->dirty_first = layout;
+}
+
+static struct qimm_layout *
+qimm_layout_create(struct qimm_project *project,
+                   struct qimm_project_config_layout *config_layout) {
+    struct qimm_project_config_type *type =
+            qimm_layout_project_find_type(project, config_layout->name);
+    if (!type) {
+        qimm_log("layout init error: project (%s) no matching type "
+                 "for layout (%s)",
+                 project->name, config_layout->name);
+        return NULL;
+    }
+
+    struct qimm_layout *layout = zalloc(sizeof *layout);
+    if (!layout)
+        return NULL;
+    layout->project = project;
+    layout->config_layout = config_layout;
+    wl_list_init(&layout->client_link);
+    wl_list_init(&layout->transaction_link);
+    return layout;
+}
+
+static int
+qimm_layout_project_add(struct qimm_project *project,
+                        struct qimm_project_config_layout *config_layout) {
+    struct qimm_layout *layout = qimm_layout_create(project, config_layout);
+    if (!layout)
+        return -1;
+    if (!wl_list_empty(&project->layouts))
+        layout->index = container_of(project->layouts.prev,
+                                     struct qimm_layout, link)->index + 1;
+    wl_list_insert(project->layouts.prev, &layout->link);
+
+    qimm_layout_mark_dirty(layout);
+    return 0;
+}
+
 int
 qimm_layout_project_init(struct qimm_project *project) {
-    struct qimm_layout *layout;
     struct qimm_project_config_layout *config_layout;
-    struct qimm_project_config_type *type;
+
+    /* new layouts have no flow */
+    qimm_layout_project_invalidate(project);
 
     if (project->shell->config) {
         struct wl_list *layouts = &project->shell->config->layouts;
         wl_list_for_each(config_layout, layouts, link) {
-            type = qimm_layout_project_find_type(project, config_layout->name);
-            if (!type) {
-                qimm_log("layout init error: project (%s) no matching type "
-                         "for layout (%s)",
-                        project->name, config_layout->name);
+            if (qimm_layout_project_add(project, config_layout) < 0)
                 return -1;
-            }
-
-            layout = zalloc(sizeof *layout);
-            layout->project = project;
-            layout->config_layout = config_layout;
-            wl_list_insert(project->layouts.prev, &layout->link);
         }
     }
 
     if (project->config) {
         wl_list_for_each(config_layout, &project->config->layouts, link) {
-            type = qimm_layout_project_find_type(project, config_layout->name);
-            if (!type) {
-                qimm_log("layout init error: project (%s) no matching type "
-                         "for layout (%s)",
-                         project->name, config_layout->name);
+            if (qimm_layout_project_add(project, config_layout) < 0)
                 return -1;
-            }
-
-            layout = zalloc(sizeof *layout);
-            layout->project = project;
-            layout->config_layout = config_layout;
-            wl_list_insert(project->layouts.prev, &layout->link);
         }
     }
 
     return 0;
 }
 
+/*
+ * free layout after its client is stopped or detached
+ */
+static void
+qimm_layout_free(struct qimm_layout *layout) {
+    /* the client launched later is stopped, see qimm_client_start */
+    if (layout->startup)
+        layout->startup->data = NULL;
+    if (layout->surface)
+        layout->surface->layout = NULL;
+    qimm_snapshot_layout_release(layout);
+    qimm_transaction_layout_remove(layout);
+    qimm_throttle_layout_release(layout);
+
+    wl_list_remove(&layout->link);
+    free(layout);
+}
+
 void
 qimm_layout_project_clear(struct qimm_project *project) {
     struct qimm_layout *layout, *tmp;
@@ -93,28 +130,365 @@ qimm_layout_project_clear(struct qimm_project *project) {
         if (layout->client)
             wl_client_destroy(layout->client->client);
         assert(layout->client == NULL);
+        qimm_layout_free(layout);
+    }
+    project->dirty_first = NULL;
+    project->dirty_count = 0;
+}
 
-        wl_list_remove(&layout->link);
-        free(layout);
+/* --------- layout reload --------- */
+static bool
+qimm_layout_config_in(struct qimm_project_config *config,
+                      struct qimm_project_config_layout *config_layout) {
+    struct qimm_project_config_layout *cl;
+    wl_list_for_each(cl, &config->layouts, link) {
+        if (cl == config_layout)
+            return true;
     }
+    return false;
 }
 
-struct qimm_layout *
-qimm_layout_find_by_client(struct qimm_shell *shell, struct wl_client *client) {
-    struct qimm_output *output;
-    wl_list_for_each(output, &shell->outputs, link) {
-        struct qimm_project *project;
-        wl_list_for_each(project, &output->projects, link) {
-            struct qimm_layout *layout;
-            wl_list_for_each(layout, &project->layouts, link) {
-                if (layout->client->client == client)
-                    return layout;
-            }
+static bool
+qimm_layout_config_equal(const struct qimm_project_config_layout *a,
+                         const struct qimm_project_config_layout *b) {
+    return a->x == b->x && a->y == b->y && a->w == b->w && a->h == b->h &&
+           a->min_w == b->min_w && a->min_h == b->min_h &&
+           a->max_w == b->max_w && a->max_h == b->max_h &&
+           a->weight == b->weight;
+}
+
+/*
+ * the layout of config replaced by config_layout, the same name
+ * in the same order, NULL for a new one
+ */
+static struct qimm_layout *
+qimm_layout_reload_match(struct qimm_project *project,
+                         struct qimm_project_config *replaced,
+                         struct qimm_project_config_layout *config_layout) {
+    struct qimm_layout *layout;
+    wl_list_for_each(layout, &project->layouts, link) {
+        if (replaced) {
+            if (!layout->reload_matched &&
+                !strcmp(layout->config_layout->name, config_layout->name) &&
+                qimm_layout_config_in(replaced, layout->config_layout))
+                return layout;
+        } else if (layout->config_layout == config_layout) {
+            return layout;
         }
     }
     return NULL;
 }
 
+/*
+ * stop client of removed layout, a shared client is stopped
+ * with its last layout
+ */
+static void
+qimm_layout_reload_remove(struct qimm_layout *layout) {
+    struct qimm_client *client = layout->client;
+    if (client && client->layouts.next == &layout->client_link &&
+        client->layouts.prev == &layout->client_link) {
+        wl_client_destroy(client->client);
+        assert(layout->client == NULL);
+    } else if (client) {
+        wl_list_remove(&layout->client_link);
+        wl_list_init(&layout->client_link);
+        layout->client = NULL;
+        qimm_surface_layout_remove(layout);
+    }
+    qimm_log("project (%s) layout (%s) removed",
+             layout->project->name, layout->config_layout->name);
+    qimm_layout_free(layout);
+}
+
+static void
+qimm_layout_reload_place(struct qimm_project *project,
+                         struct qimm_project_config *config,
+                         struct qimm_project_config *replaced,
+                         struct wl_list *layouts, bool *structure) {
+    struct qimm_project_config_layout *cl;
+    wl_list_for_each(cl, &config->layouts, link) {
+        struct qimm_layout *layout =
+                qimm_layout_reload_match(project, replaced, cl);
+        /* the kept layout is removed with its type */
+        if (layout && !qimm_layout_project_find_type(project, cl->name))
+            continue;
+        if (!layout) {
+            /* the client is started when project shown */
+            layout = qimm_layout_create(project, cl);
+            if (!layout)
+                continue;
+            layout->dirty = true;
+            *structure = true;
+            qimm_log("project (%s) layout (%s) added",
+                     project->name, cl->name);
+        } else {
+            wl_list_remove(&layout->link);
+            if (!qimm_layout_config_equal(layout->config_layout, cl))
+                layout->dirty = true;
+            layout->config_layout = cl;
+            layout->reload_matched = true;
+        }
+        wl_list_insert(layouts->prev, &layout->link);
+    }
+}
+
+bool
+qimm_layout_project_reload(struct qimm_project *project,
+                           struct qimm_project_config *common,
+                           struct qimm_project_config *config) {
+    struct qimm_shell *shell = project->shell;
+    struct wl_list layouts;
+    wl_list_init(&layouts);
+
+    /* dirty marks the changed layouts from now */
+    struct qimm_layout *layout, *tmp;
+    int count = 0;
+    wl_list_for_each(layout, &project->layouts, link) {
+        layout->reload_matched = false;
+        layout->dirty = false;
+        count++;
+    }
+
+    /* move the kept and new layouts to list in order of configs */
+    bool structure = false;
+    if (shell->config)
+        qimm_layout_reload_place(project, shell->config, common,
+                                 &layouts, &structure);
+    if (project->config)
+        qimm_layout_reload_place(project, project->config, config,
+                                 &layouts, &structure);
+
+    /* the layouts left are removed from configs */
+    wl_list_for_each_safe(layout, tmp, &project->layouts, link) {
+        qimm_layout_reload_remove(layout);
+        structure = true;
+    }
+    wl_list_insert_list(&project->layouts, &layouts);
+
+    int index = 0;
+    project->dirty_first = NULL;
+    project->dirty_count = 0;
+    wl_list_for_each(layout, &project->layouts, link) {
+        structure = structure || layout->index != index;
+        layout->index = index++;
+        if (layout->dirty) {
+            project->dirty_count++;
+            if (!project->dirty_first)
+                project->dirty_first = layout;
+        }
+    }
+    structure = structure || index != count;
+
+    /* the rows of moved layouts are not known, place them all */
+    if (structure)
+        qimm_layout_project_invalidate(project);
+    return structure || project->dirty_count > 0;
+}
+
+struct qimm_layout *
+qimm_layout_find_by_client(struct qimm_shell *shell,
+                           struct wl_client *client,
+                           const char *app_id) {
+    struct qimm_client *qimm_client = qimm_index_find_client(shell, client);
+    if (!qimm_client)
+        return NULL;
+    return qimm_client_find_layout(qimm_client, app_id);
+}
+
+/* --------- layout flow --------- */
+/*
+ * Layouts flow in rows from left to right, top to bottom, like text:
+ * - x or y < 0 follows the flow, otherwise it is fixed in output;
+ * - w or h < 0 is 1/n of output, clamped by min and max;
+ * - a layout out of output starts a new row, or ends the row
+ *   when it is at left of output;
+ * - free width of a row is shared by weight of its layouts.
+ *
+ * The flow of a row only depends on the flow before its first layout,
+ * so an update recomputes from the row of the first dirty layout, and
+ * stops when the flow before a row is the same as last update.
+ * The geometry of layouts is relative to output until the row is done.
+ */
+enum qimm_layout_place {
+    QIMM_LAYOUT_PLACE_ROW, /* in the row */
+    QIMM_LAYOUT_PLACE_WRAP, /* moved to a new row */
+    QIMM_LAYOUT_PLACE_END, /* ends the row */
+};
+
+static int32_t
+qimm_layout_size(int32_t size, int32_t request, int32_t output,
+                 int32_t min, int32_t max) {
+    if (request > 0)
+        size = request;
+    else if (size < 0)
+        size = div(output, abs(size)).quot;
+
+    if (max > 0 && size > max)
+        size = max;
+    if (min > 0 && size < min)
+        size = min;
+    return size;
+}
+
+/*
+ * place layout by flow, the flow is updated to the next layout
+ */
+static enum qimm_layout_place
+qimm_layout_place(struct qimm_layout *layout, struct qimm_layout_flow *flow,
+                  int32_t w, int32_t h) {
+    struct qimm_project_config_layout *cl = layout->config_layout;
+    enum qimm_layout_place place = QIMM_LAYOUT_PLACE_ROW;
+
+    layout->x = cl->x < 0 ? flow->dx : cl->x;
+    layout->y = cl->y < 0 ? flow->dy : cl->y;
+    layout->w = qimm_layout_size(cl->w, layout->request_w, w,
+                                 cl->min_w, cl->max_w);
+    layout->h = qimm_layout_size(cl->h, layout->request_h, h,
+                                 cl->min_h, cl->max_h);
+
+    flow->dx = layout->x + layout->w;
+    if (flow->dx >= w) { /* out of screen */
+        if (layout->x > 0) { /* move layout to next row */
+            flow->dx = layout->w;
+            flow->dy = flow->dy2;
+            flow->dy2 = flow->dy + layout->h;
+            layout->x = 0;
+            layout->y = flow->dy;
+            place = QIMM_LAYOUT_PLACE_WRAP;
+        } else { /* move pointer to next row */
+            flow->dx = 0;
+            if (cl->y < 0)
+                flow->dy = MAX(flow->dy2, layout->y + layout->h);
+            else
+                flow->dy = layout->y + layout->h;
+            flow->dy2 = flow->dy;
+            place = QIMM_LAYOUT_PLACE_END;
+        }
+    } else {
+        flow->dy = layout->y;
+        flow->dy2 = MAX(flow->dy2, layout->y + layout->h);
+    }
+    return place;
+}
+
+static struct qimm_layout *
+qimm_layout_next(struct qimm_layout *layout) {
+    if (layout->link.next == &layout->project->layouts)
+        return NULL;
+    return container_of(layout->link.next, struct qimm_layout, link);
+}
+
+/*
+ * share free width of row by weight, the layouts following the flow
+ * after a grown layout are moved right.
+ */
+static void
+qimm_layout_row_grow(struct qimm_layout *first, struct qimm_layout *end,
+                     int32_t w) {
+    int32_t right = 0, weight = 0;
+    struct qimm_layout *layout;
+    for (layout = first; layout != end; layout = qimm_layout_next(layout)) {
+        right = MAX(right, layout->x + layout->w);
+        if (layout->config_layout->weight > 0)
+            weight += layout->config_layout->weight;
+    }
+    if (weight == 0 || right >= w)
+        return;
+
+    int32_t free_w = w - right, shift = 0;
+    for (layout = first; layout != end; layout = qimm_layout_next(layout)) {
+        struct qimm_project_config_layout *cl = layout->config_layout;
+        if (cl->x < 0)
+            layout->x += shift;
+        if (cl->weight <= 0)
+            continue;
+
+        int32_t grow = (int32_t) ((int64_t) free_w * cl->weight / weight);
+        if (cl->max_w > 0)
+            grow = MAX(0, MIN(grow, cl->max_w - layout->w));
+        layout->w += grow;
+        shift += grow;
+    }
+}
+
+/*
+ * recompute the row from first layout with its flow,
+ * return the first layout of next row, NULL at the end of layouts.
+ */
+static struct qimm_layout *
+qimm_layout_row_update(struct qimm_layout *first,
+                       struct qimm_layout_flow *flow,
+                       const struct weston_geometry *area) {
+    struct qimm_project *project = first->project;
+    struct qimm_layout *layout = first, *end;
+
+    first->row_start = true;
+    first->flow = *flow;
+    for (;;) {
+        struct qimm_layout_flow before = *flow;
+        enum qimm_layout_place place =
+                qimm_layout_place(layout, flow, area->width, area->height);
+        if (place == QIMM_LAYOUT_PLACE_WRAP && layout != first) {
+            /* place it again as the first of next row */
+            *flow = before;
+            end = layout;
+            break;
+        }
+        if (layout != first)
+            layout->row_start = false;
+        if (layout->dirty) {
+            layout->dirty = false;
+            project->dirty_count--;
+        }
+
+        end = qimm_layout_next(layout);
+        if (!end || place == QIMM_LAYOUT_PLACE_END)
+            break;
+        layout = end;
+    }
+
+    qimm_layout_row_grow(first, end, area->width);
+
+    /* postion layouts to output, configure changed surfaces */
+    for (layout = first; layout != end; layout = qimm_layout_next(layout)) {
+        layout->x += area->x;
+        layout->y += area->y;
+        qimm_surface_layout_update(layout);
+    }
+    return end;
+}
+
+static bool
+qimm_layout_flow_equal(const struct qimm_layout_flow *a,
+                       const struct qimm_layout_flow *b) {
+    return a->dx == b->dx && a->dy == b->dy && a->dy2 == b->dy2;
+}
+
+/*
+ * the first layout of row containing the dirty layout
+ */
+static struct qimm_layout *
+qimm_layout_row_of(struct qimm_layout *layout) {
+    while (!layout->row_start)
+        layout = container_of(layout->link.prev, struct qimm_layout, link);
+    return layout;
+}
+
+/*
+ * move layouts with output, the flow relative to output is not changed
+ */
+static void
+qimm_layout_project_move(struct qimm_project *project,
+                         int32_t dx, int32_t dy) {
+    struct qimm_layout *layout;
+    wl_list_for_each(layout, &project->layouts, link) {
+        layout->x += dx;
+        layout->y += dy;
+        qimm_surface_layout_update(layout);
+    }
+}
+
 int
 qimm_layout_project_update(struct qimm_project *project) {
     struct qimm_output *output = project->output;
@@ -122,54 +496,64 @@ qimm_layout_project_update(struct qimm_project *project) {
         qimm_log("layout update error: project (%s) no output", project->name);
         return -1;
     }
+    if (wl_list_empty(&project->layouts))
+        return 0;
 
-    if (project->output_layouted != output) {
-        int32_t x = output->output->x;
-        int32_t y = output->output->y;
-        int32_t w = output->output->width;
-        int32_t h = output->output->height;
-
-        /* pointer in current row */
-        int32_t dx = 0; /* right */
-        int32_t dy = 0, dy2 = 0; /* top and bottom */
-
-        struct qimm_layout *layout;
-        struct qimm_project_config_layout *cl;
-        wl_list_for_each(layout, &project->layouts, link) {
-            cl = layout->config_layout;
-
-            layout->x = cl->x < 0 ? dx : cl->x;
-            layout->y = cl->y < 0 ? dy : cl->y;
-            layout->w = cl->w < 0 ? div(w, abs(cl->w)).quot : cl->w;
-            layout->h = cl->h < 0 ? div(h, abs(cl->h)).quot : cl->h;
-
-            dx = layout->x + layout->w;
-            if (dx >= w) { /* out of screen */
-                if (layout->x > 0) { /* move layout to next row */
-                    dx = layout->w;
-                    dy = dy2;
-                    dy2 = dy + layout->h;
-                    layout->x = 0;
-                    layout->y = dy;
-                } else { /* move pointer to next row */
-                    dx = 0;
-                    if (cl->y < 0)
-                        dy = MAX(dy2, layout->y + layout->h);
-                    else
-                        dy = layout->y + layout->h;
-                    dy2 = dy;
-                }
-            } else {
-                dy = layout->y;
-                dy2 = MAX(dy2, layout->y + layout->h);
-            }
-
-            /* postion layout to output */
-            layout->x += x;
-            layout->y += y;
-        }
+    struct weston_geometry area = {
+            output->output->x, output->output->y,
+            output->output->width, output->output->height,
+    };
+    struct weston_geometry *last = &project->area_layouted;
+    bool all = project->output_layouted != output ||
+               last->width != area.width || last->height != area.height;
+    if (!all && (last->x != area.x || last->y != area.y))
+        qimm_layout_project_move(project, area.x - last->x, area.y - last->y);
+    project->output_layouted = output;
+    project->area_layouted = area;
 
-        project->output_layouted = output;
+    struct qimm_layout *layout;
+    struct qimm_layout_flow flow = {0};
+    if (all) {
+        layout = container_of(project->layouts.next, struct qimm_layout, link);
+        while (layout)
+            layout = qimm_layout_row_update(layout, &flow, &area);
+    } else if (project->dirty_first) {
+        layout = qimm_layout_row_of(project->dirty_first);
+        flow = layout->flow;
+        while (layout) {
+            layout = qimm_layout_row_update(layout, &flow, &area);
+            if (!layout || layout->dirty || !layout->row_start ||
+                !qimm_layout_flow_equal(&layout->flow, &flow))
+                continue;
+
+            /* the rows after are not changed, skip to next dirty one */
+            while (layout && project->dirty_count > 0 && !layout->dirty)
+                layout = qimm_layout_next(layout);
+            if (!layout || project->dirty_count == 0)
+                break;
+            layout = qimm_layout_row_of(layout);
+            flow = layout->flow;
+        }
     }
+
+    assert(project->dirty_count == 0);
+    project->dirty_first = NULL;
     return 0;
 }
+
+void
+qimm_layout_project_invalidate(struct qimm_project *project) {
+    project->output_layouted = NULL;
+}
+
+void
+qimm_layout_resize(struct qimm_layout *layout, int32_t w, int32_t h) {
+    layout->request_w = MAX(w, 0);
+    layout->request_h = MAX(h, 0);
+    qimm_layout_mark_dirty(layout);
+
+    /* the project not placed yet is updated when shown */
+    struct qimm_project *project = layout->project;
+    if (project->output_layouted)
+        qimm_layout_project_update(project);
+}
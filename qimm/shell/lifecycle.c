@@ -0,0 +1,354 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+
+#define QIMM_LIFECYCLE_TICK 1000 /* ms */
+#define QIMM_LIFECYCLE_FREEZE_DELAY 10 /* s */
+#define QIMM_LIFECYCLE_MEMORY_BUDGET 512 /* MiB */
+#define QIMM_LIFECYCLE_CPU_BUDGET 5 /* percent */
+
+static int
+qimm_lifecycle_env(const char *name, int value) {
+    const char *env = getenv(name);
+    if (!env || !*env)
+        return value;
+
+    char *end;
+    long l = strtol(env, &end, 10);
+    if (*end || l < -1 || l > INT_MAX) {
+        qimm_log("lifecycle: ignore invalid %s=%s", name, env);
+        return value;
+    }
+    return l;
+}
+
+/* --------- clients of project --------- */
+/*
+ * call func for each client process in project once,
+ * layouts share one client when client_share is set
+ */
+static void
+qimm_lifecycle_for_each_pid(struct qimm_project *project,
+                            void (*func)(pid_t pid, void *data), void *data) {
+    struct qimm_layout *layout, *prev;
+    wl_list_for_each(layout, &project->layouts, link) {
+        if (!layout->client || layout->client->pid <= 0)
+            continue;
+
+        bool done = false;
+        wl_list_for_each(prev, &project->layouts, link) {
+            if (prev == layout)
+                break;
+            if (prev->client == layout->client) {
+                done = true;
+                break;
+            }
+        }
+        if (!done)
+            func(layout->client->pid, data);
+    }
+}
+
+static void
+qimm_lifecycle_signal_func(pid_t pid, void *data) {
+    int sig = *(int *) data;
+    if (kill(pid, sig) < 0 && errno != ESRCH)
+        qimm_log("lifecycle: signal %d to %d error: %s",
+                 sig, pid, strerror(errno));
+}
+
+static void
+qimm_lifecycle_project_signal(struct qimm_project *project, int sig) {
+    qimm_lifecycle_for_each_pid(project, qimm_lifecycle_signal_func, &sig);
+}
+
+struct qimm_lifecycle_usage {
+    uint64_t memory; /* bytes resident */
+    uint64_t cpu_time; /* user and system ticks */
+};
+
+static void
+qimm_lifecycle_usage_func(pid_t pid, void *data) {
+    struct qimm_lifecycle_usage *usage = data;
+    char path[64];
+    FILE *fp;
+
+    snprintf(path, sizeof path, "/proc/%d/statm", pid);
+    fp = fopen(path, "r");
+    if (fp) {
+        unsigned long size, resident;
+        if (fscanf(fp, "%lu %lu", &size, &resident) == 2)
+            usage->memory += (uint64_t) resident * sysconf(_SC_PAGESIZE);
+        fclose(fp);
+    }
+
+    usage->cpu_time += qimm_process_cpu_time(pid);
+}
+
+static struct qimm_lifecycle_usage
+qimm_lifecycle_project_usage(struct qimm_project *project) {
+    struct qimm_lifecycle_usage usage = {0};
+    qimm_lifecycle_for_each_pid(project, qimm_lifecycle_usage_func, &usage);
+    return usage;
+}
+
+/* --------- state --------- */
+static void
+qimm_lifecycle_schedule(struct qimm_lifecycle *lifecycle) {
+    if (lifecycle->timer && !wl_list_empty(&lifecycle->lru))
+        wl_event_source_timer_update(lifecycle->timer, QIMM_LIFECYCLE_TICK);
+}
+
+static void
+qimm_lifecycle_freeze(struct qimm_project *project) {
+    if (project->state != QIMM_PROJECT_IDLE)
+        return;
+
+    qimm_log("lifecycle: project (%s) frozen", project->name);
+    qimm_lifecycle_project_signal(project, SIGSTOP);
+    project->state = QIMM_PROJECT_FROZEN;
+}
+
+static void
+qimm_lifecycle_resume(struct qimm_project *project) {
+    if (project->state == QIMM_PROJECT_FROZEN) {
+        qimm_log("lifecycle: project (%s) resumed", project->name);
+        qimm_lifecycle_project_signal(project, SIGCONT);
+    }
+    project->state = QIMM_PROJECT_IDLE;
+}
+
+static void
+qimm_lifecycle_evict(struct qimm_project *project) {
+    qimm_log("lifecycle: project (%s) evicted", project->name);
+
+    if (qimm_data_save_project(project) < 0)
+        qimm_log("project (%s) save failed", project->name);
+    qimm_snapshot_project_capture(project);
+
+    /* stopped clients can not see the hangup, let them go */
+    int sig = SIGTERM;
+    qimm_lifecycle_for_each_pid(project, qimm_lifecycle_signal_func, &sig);
+    qimm_lifecycle_resume(project);
+
+    qimm_layout_project_clear(project);
+    /* layouts without client are started again when shown */
+    if (qimm_layout_project_init(project) < 0)
+        qimm_log("lifecycle: project (%s) layout init failed", project->name);
+
+    project->state = QIMM_PROJECT_STOPPED;
+    wl_list_remove(&project->lru_link);
+    wl_list_init(&project->lru_link);
+}
+
+static bool
+qimm_lifecycle_is_prefetched(struct qimm_project *project) {
+    return project->output && project->output->project_next == project;
+}
+
+static int
+qimm_lifecycle_handle_timer(void *data) {
+    struct qimm_lifecycle *lifecycle = data;
+    struct qimm_project *project, *tmp;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    /* sample hidden projects */
+    uint64_t memory = 0, cpu_time = 0;
+    wl_list_for_each(project, &lifecycle->lru, lru_link) {
+        struct qimm_lifecycle_usage usage =
+                qimm_lifecycle_project_usage(project);
+        memory += usage.memory;
+        if (project->state == QIMM_PROJECT_IDLE && project->cpu_time)
+            cpu_time += usage.cpu_time - MIN(usage.cpu_time, project->cpu_time);
+        project->cpu_time = usage.cpu_time;
+    }
+
+    /* freeze idle projects from least recently shown one */
+    int cpu = cpu_time * 100 * 1000 /
+              (sysconf(_SC_CLK_TCK) * QIMM_LIFECYCLE_TICK);
+    bool over_cpu = lifecycle->cpu_budget > 0 && cpu > lifecycle->cpu_budget;
+    wl_list_for_each_reverse(project, &lifecycle->lru, lru_link) {
+        if (project->state != QIMM_PROJECT_IDLE ||
+            qimm_lifecycle_is_prefetched(project))
+            continue;
+
+        bool expired = lifecycle->freeze_delay >= 0 &&
+                       timespec_sub_to_msec(&now, &project->hide_time) >=
+                       lifecycle->freeze_delay;
+        if (expired || over_cpu) {
+            if (!expired)
+                qimm_log("lifecycle: hidden projects use %d%% cpu", cpu);
+            qimm_lifecycle_freeze(project);
+            /* cpu usage is unknown until next sample, freeze one at a time */
+            over_cpu = false;
+        }
+    }
+
+    /* evict projects from least recently shown one */
+    if (lifecycle->memory_budget > 0 && memory > lifecycle->memory_budget) {
+        qimm_log("lifecycle: hidden projects use %" PRIu64 " MiB memory",
+                 memory >> 20);
+        wl_list_for_each_reverse_safe(project, tmp, &lifecycle->lru, lru_link) {
+            if (memory <= lifecycle->memory_budget)
+                break;
+            if (qimm_lifecycle_is_prefetched(project))
+                continue;
+
+            struct qimm_lifecycle_usage usage =
+                    qimm_lifecycle_project_usage(project);
+            qimm_lifecycle_evict(project);
+            memory -= MIN(memory, usage.memory);
+        }
+    }
+
+    qimm_lifecycle_schedule(lifecycle);
+    return 0;
+}
+
+/*
+ * the project becomes the most recently hidden one
+ */
+static void
+qimm_lifecycle_touch(struct qimm_lifecycle *lifecycle,
+                     struct qimm_project *project) {
+    clock_gettime(CLOCK_MONOTONIC, &project->hide_time);
+    project->cpu_time = 0;
+    wl_list_remove(&project->lru_link);
+    wl_list_insert(&lifecycle->lru, &project->lru_link);
+
+    qimm_lifecycle_schedule(lifecycle);
+}
+
+/* --------- interface --------- */
+int
+qimm_lifecycle_init(struct qimm_shell *shell) {
+    struct qimm_lifecycle *lifecycle = zalloc(sizeof *lifecycle);
+    if (!lifecycle)
+        return -1;
+
+    lifecycle->shell = shell;
+    wl_list_init(&lifecycle->lru);
+
+    int delay = qimm_lifecycle_env(QIMM_FREEZE_DELAY,
+                                   QIMM_LIFECYCLE_FREEZE_DELAY);
+    lifecycle->freeze_delay = delay < 0 ? -1 : delay * 1000;
+    lifecycle->memory_budget = (uint64_t) MAX(0,
+            qimm_lifecycle_env(QIMM_HIDDEN_MEMORY,
+                               QIMM_LIFECYCLE_MEMORY_BUDGET)) << 20;
+    lifecycle->cpu_budget = MAX(0, qimm_lifecycle_env(QIMM_HIDDEN_CPU,
+                                                      QIMM_LIFECYCLE_CPU_BUDGET));
+
+    struct wl_event_loop *loop =
+            wl_display_get_event_loop(shell->compositor->wl_display);
+    lifecycle->timer = wl_event_loop_add_timer(loop,
+                                               qimm_lifecycle_handle_timer,
+                                               lifecycle);
+    if (!lifecycle->timer) {
+        free(lifecycle);
+        return -1;
+    }
+
+    qimm_log("lifecycle: freeze after %d s, budget %" PRIu64 " MiB, %d%% cpu",
+             delay, lifecycle->memory_budget >> 20, lifecycle->cpu_budget);
+    shell->lifecycle = lifecycle;
+    return 0;
+}
+
+void
+qimm_lifecycle_release(struct qimm_shell *shell) {
+    struct qimm_lifecycle *lifecycle = shell->lifecycle;
+    if (!lifecycle)
+        return;
+
+    /* projects are removed from lru when destroyed */
+    assert(wl_list_empty(&lifecycle->lru));
+
+    wl_event_source_remove(lifecycle->timer);
+    free(lifecycle);
+    shell->lifecycle = NULL;
+}
+
+void
+qimm_lifecycle_project_show(struct qimm_project *project) {
+    struct qimm_lifecycle *lifecycle = project->shell->lifecycle;
+    struct qimm_output *output = project->output;
+
+    struct qimm_project *cur = output->project_cur;
+    if (lifecycle && cur && cur != project &&
+        cur->state == QIMM_PROJECT_ACTIVE) {
+        cur->state = QIMM_PROJECT_IDLE;
+        qimm_lifecycle_touch(lifecycle, cur);
+    }
+
+    /* stopped project starts clients from zygote when it is shown */
+    if (project->state != QIMM_PROJECT_STOPPED)
+        qimm_lifecycle_resume(project);
+    project->state = QIMM_PROJECT_ACTIVE;
+    wl_list_remove(&project->lru_link);
+    wl_list_init(&project->lru_link);
+
+    if (output->project_next == project)
+        output->project_next = NULL;
+}
+
+void
+qimm_lifecycle_project_remove(struct qimm_project *project) {
+    if (project->state == QIMM_PROJECT_FROZEN)
+        qimm_lifecycle_resume(project);
+
+    wl_list_remove(&project->lru_link);
+    wl_list_init(&project->lru_link);
+
+    if (project->output && project->output->project_next == project)
+        project->output->project_next = NULL;
+}
+
+/*
+ * the next project in output is most likely shown next
+ */
+void
+qimm_lifecycle_output_prefetch(struct qimm_output *output) {
+    struct qimm_shell *shell = output->shell;
+    struct qimm_project *cur = output->project_cur;
+    if (!shell->lifecycle || !cur)
+        return;
+
+    struct wl_list *next = cur->link.next;
+    if (next == &output->projects)
+        next = output->projects.next;
+    struct qimm_project *project =
+            container_of(next, struct qimm_project, link);
+    if (project == cur || project == output->project_next)
+        return;
+
+    output->project_next = project;
+    if (project->state == QIMM_PROJECT_IDLE)
+        return;
+
+    qimm_log("lifecycle: project (%s) prefetched", project->name);
+    if (project->state == QIMM_PROJECT_STOPPED) {
+        qimm_layout_project_update(project);
+        qimm_client_project_start(project);
+    }
+    qimm_lifecycle_resume(project);
+
+    /* hidden project is managed in lru after prefetched */
+    qimm_lifecycle_touch(shell->lifecycle, project);
+}
@@ -0,0 +1,363 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+#include "qimm-desktop-shell-server-protocol.h"
+
+#define QIMM_METRICS_BUF_SIZE 65536
+#define QIMM_METRICS_SECTOR 512 /* bytes of sector in diskstats */
+
+/* --------- procfs --------- */
+/*
+ * read the whole file from start, procfs generates it again
+ */
+static char *
+qimm_metrics_read_proc(struct qimm_metrics *metrics, int fd) {
+    if (fd < 0)
+        return NULL;
+
+    size_t len = 0;
+    while (len < QIMM_METRICS_BUF_SIZE - 1) {
+        ssize_t n = pread(fd, metrics->buf + len,
+                          QIMM_METRICS_BUF_SIZE - 1 - len, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        len += n;
+    }
+    metrics->buf[len] = '\0';
+    return len ? metrics->buf : NULL;
+}
+
+static void
+qimm_metrics_read_cpu(struct qimm_metrics *metrics,
+                      struct qimm_metrics_sample *sample) {
+    char *buf = qimm_metrics_read_proc(metrics, metrics->stat_fd);
+    if (!buf)
+        return;
+
+    /* cpu user nice system idle iowait irq softirq steal */
+    uint64_t t[8] = {0};
+    if (sscanf(buf, "cpu %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+                    " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+               &t[0], &t[1], &t[2], &t[3],
+               &t[4], &t[5], &t[6], &t[7]) < 4)
+        return;
+
+    for (int i = 0; i < 8; i++)
+        sample->cpu_total += t[i];
+    sample->cpu_idle = t[3] + t[4];
+}
+
+static void
+qimm_metrics_read_memory(struct qimm_metrics *metrics,
+                         struct qimm_metrics_sample *sample) {
+    char *buf = qimm_metrics_read_proc(metrics, metrics->meminfo_fd);
+    if (!buf)
+        return;
+
+    char *line, *save = NULL;
+    uint64_t kb;
+    for (line = strtok_r(buf, "\n", &save); line;
+         line = strtok_r(NULL, "\n", &save)) {
+        if (sscanf(line, "MemTotal: %" SCNu64, &kb) == 1)
+            sample->mem_total = kb * 1024;
+        else if (sscanf(line, "MemAvailable: %" SCNu64, &kb) == 1)
+            sample->mem_available = kb * 1024;
+        if (sample->mem_total && sample->mem_available)
+            break;
+    }
+}
+
+static void
+qimm_metrics_read_network(struct qimm_metrics *metrics,
+                          struct qimm_metrics_sample *sample) {
+    char *buf = qimm_metrics_read_proc(metrics, metrics->netdev_fd);
+    if (!buf)
+        return;
+
+    /* two lines of header, then "name: rx_bytes 7 fields tx_bytes ..." */
+    char *line, *save = NULL;
+    int n = 0;
+    for (line = strtok_r(buf, "\n", &save); line;
+         line = strtok_r(NULL, "\n", &save)) {
+        if (n++ < 2)
+            continue;
+
+        char *colon = strchr(line, ':');
+        if (!colon)
+            continue;
+        *colon = '\0';
+        while (*line == ' ')
+            line++;
+        if (!strcmp(line, "lo"))
+            continue;
+
+        uint64_t rx, tx;
+        if (sscanf(colon + 1, " %" SCNu64 " %*u %*u %*u %*u %*u %*u %*u"
+                              " %" SCNu64, &rx, &tx) == 2) {
+            sample->net_rx += rx;
+            sample->net_tx += tx;
+        }
+    }
+}
+
+static bool
+qimm_metrics_is_disk(struct qimm_metrics *metrics, const char *name) {
+    for (char **disk = metrics->disks; disk && *disk; disk++) {
+        if (!strcmp(*disk, name))
+            return true;
+    }
+    return false;
+}
+
+static void
+qimm_metrics_read_disk(struct qimm_metrics *metrics,
+                       struct qimm_metrics_sample *sample) {
+    char *buf = qimm_metrics_read_proc(metrics, metrics->diskstats_fd);
+    if (!buf)
+        return;
+
+    /* major minor name reads merged sectors ms writes merged sectors ... */
+    char *line, *save = NULL;
+    for (line = strtok_r(buf, "\n", &save); line;
+         line = strtok_r(NULL, "\n", &save)) {
+        char name[64];
+        uint64_t read, written;
+        if (sscanf(line, " %*u %*u %63s %*u %*u %" SCNu64 " %*u %*u %*u %"
+                         SCNu64, name, &read, &written) != 3)
+            continue;
+        if (!qimm_metrics_is_disk(metrics, name))
+            continue;
+
+        sample->disk_read += read * QIMM_METRICS_SECTOR;
+        sample->disk_write += written * QIMM_METRICS_SECTOR;
+    }
+}
+
+/*
+ * the block devices with a device, partitions and virtual devices
+ * like loop and device mapper are not counted twice.
+ */
+static char **
+qimm_metrics_find_disks(void) {
+    DIR *dir = opendir("/sys/block");
+    if (!dir)
+        return NULL;
+
+    char **disks = NULL;
+    size_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        char path[PATH_MAX];
+        struct stat st;
+        snprintf(path, sizeof path, "/sys/block/%s/device", entry->d_name);
+        if (stat(path, &st) < 0)
+            continue;
+
+        char **tmp = realloc(disks, (count + 2) * sizeof *disks);
+        if (!tmp)
+            break;
+        disks = tmp;
+        disks[count++] = strdup(entry->d_name);
+        disks[count] = NULL;
+    }
+    closedir(dir);
+    return disks;
+}
+
+/* --------- sampler --------- */
+static void
+qimm_metrics_sample(struct qimm_metrics *metrics) {
+    struct qimm_metrics_sample sample = {0};
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    sample.time = timespec_to_msec(&now);
+    qimm_metrics_read_cpu(metrics, &sample);
+    qimm_metrics_read_memory(metrics, &sample);
+    qimm_metrics_read_network(metrics, &sample);
+    qimm_metrics_read_disk(metrics, &sample);
+
+    qimm_metrics_ring_write(metrics->ring, &sample);
+
+    /* one event for each client, however many widgets it shows */
+    struct wl_resource *resource;
+    wl_resource_for_each(resource, &metrics->resources) {
+        qimm_desktop_metrics_send_update(resource,
+                                         (uint32_t) metrics->ring->head);
+    }
+}
+
+static int
+qimm_metrics_tick(void *data) {
+    struct qimm_metrics *metrics = data;
+
+    qimm_metrics_sample(metrics);
+    wl_event_source_timer_update(metrics->timer, QIMM_METRICS_INTERVAL);
+    return 0;
+}
+
+/* --------- clients --------- */
+static void
+qimm_metrics_handle_destroy(struct wl_client *client,
+                            struct wl_resource *resource) {
+    wl_resource_destroy(resource);
+}
+
+static const struct qimm_desktop_metrics_interface qimm_metrics_implementation = {
+        qimm_metrics_handle_destroy,
+};
+
+static void
+qimm_metrics_destroy_resource(struct wl_resource *resource) {
+    struct qimm_metrics *metrics = wl_resource_get_user_data(resource);
+
+    wl_list_remove(wl_resource_get_link(resource));
+    /* no more readers, stop sampling */
+    if (metrics && wl_list_empty(&metrics->resources))
+        wl_event_source_timer_update(metrics->timer, 0);
+}
+
+void
+qimm_metrics_add_client(struct qimm_shell *shell,
+                        struct wl_client *client,
+                        uint32_t version, uint32_t id) {
+    struct qimm_metrics *metrics = shell->metrics;
+
+    struct wl_resource *resource =
+            wl_resource_create(client, &qimm_desktop_metrics_interface,
+                               version, id);
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &qimm_metrics_implementation,
+                                   metrics, qimm_metrics_destroy_resource);
+
+    /* the feed is empty without sampler */
+    if (!metrics) {
+        wl_list_init(wl_resource_get_link(resource));
+        return;
+    }
+
+    bool first = wl_list_empty(&metrics->resources);
+    wl_list_insert(&metrics->resources, wl_resource_get_link(resource));
+    qimm_desktop_metrics_send_ring(resource, metrics->reader_fd,
+                                   metrics->size);
+
+    if (first) {
+        qimm_metrics_sample(metrics);
+        wl_event_source_timer_update(metrics->timer, QIMM_METRICS_INTERVAL);
+    } else {
+        qimm_desktop_metrics_send_update(resource,
+                                         (uint32_t) metrics->ring->head);
+    }
+}
+
+/* --------- metrics --------- */
+static void
+qimm_metrics_destroy(struct qimm_metrics *metrics) {
+    if (metrics->timer)
+        wl_event_source_remove(metrics->timer);
+    if (metrics->ring)
+        munmap(metrics->ring, metrics->size);
+    if (metrics->fd >= 0)
+        close(metrics->fd);
+    if (metrics->reader_fd >= 0)
+        close(metrics->reader_fd);
+
+    int fds[] = {metrics->stat_fd, metrics->meminfo_fd,
+                 metrics->netdev_fd, metrics->diskstats_fd};
+    for (size_t i = 0; i < ARRAY_LENGTH(fds); i++) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+    for (char **disk = metrics->disks; disk && *disk; disk++)
+        free(*disk);
+    free(metrics->disks);
+    free(metrics->buf);
+    free(metrics);
+}
+
+int
+qimm_metrics_init(struct qimm_shell *shell) {
+    struct qimm_metrics *metrics = zalloc(sizeof *metrics);
+    if (!metrics)
+        return -1;
+    metrics->shell = shell;
+    wl_list_init(&metrics->resources);
+    metrics->fd = metrics->reader_fd = -1;
+
+    /* keep procfs files open, no open and close at each tick */
+    metrics->stat_fd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    metrics->meminfo_fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    metrics->netdev_fd = open("/proc/net/dev", O_RDONLY | O_CLOEXEC);
+    metrics->diskstats_fd = open("/proc/diskstats", O_RDONLY | O_CLOEXEC);
+    metrics->disks = qimm_metrics_find_disks();
+
+    metrics->buf = malloc(QIMM_METRICS_BUF_SIZE);
+    if (!metrics->buf)
+        goto err;
+
+    metrics->ring = qimm_metrics_ring_create(&metrics->fd, &metrics->size);
+    if (!metrics->ring) {
+        qimm_log("metrics: failed to create ring: %s", strerror(errno));
+        goto err;
+    }
+    metrics->reader_fd = qimm_metrics_ring_reader_fd(metrics->fd);
+    if (metrics->reader_fd < 0) {
+        qimm_log("metrics: failed to open ring for reader: %s",
+                 strerror(errno));
+        goto err;
+    }
+
+    struct wl_event_loop *loop =
+            wl_display_get_event_loop(shell->compositor->wl_display);
+    metrics->timer = wl_event_loop_add_timer(loop, qimm_metrics_tick, metrics);
+    if (!metrics->timer)
+        goto err;
+
+    shell->metrics = metrics;
+    return 0;
+
+err:
+    qimm_metrics_destroy(metrics);
+    return -1;
+}
+
+void
+qimm_metrics_release(struct qimm_shell *shell) {
+    struct qimm_metrics *metrics = shell->metrics;
+    if (!metrics)
+        return;
+
+    /* the resources may live longer than shell */
+    struct wl_resource *resource, *tmp;
+    wl_resource_for_each_safe(resource, tmp, &metrics->resources) {
+        wl_resource_set_user_data(resource, NULL);
+        wl_list_remove(wl_resource_get_link(resource));
+        wl_list_init(wl_resource_get_link(resource));
+    }
+
+    qimm_metrics_destroy(metrics);
+    shell->metrics = NULL;
+}
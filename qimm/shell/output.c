@@ -23,6 +23,11 @@ qimm_output_destroy(struct qimm_output *qimm_output) {
     assert(qimm_output->project_cur == NULL);
 
     wl_list_remove(&qimm_output->destroy_listener.link);
+    qimm_index_output_remove(qimm_output);
+    qimm_transaction_output_remove(qimm_output);
+    qimm_background_output_remove(qimm_output);
+    if (qimm_output->switching)
+        wl_list_remove(&qimm_output->frame_listener.link);
 
     wl_list_remove(&qimm_output->link);
     free(qimm_output);
@@ -56,6 +61,9 @@ qimm_output_create(struct qimm_shell *shell, struct weston_output *output) {
 
     wl_list_init(&qimm_output->projects);
 
+    if (qimm_index_output_add(qimm_output) < 0)
+        qimm_log("failed to index output (%s)", output->name);
+
     wl_list_insert(shell->outputs.prev, &qimm_output->link);
     if (!shell->output_focus)
         shell->output_focus = qimm_output;
@@ -71,6 +79,9 @@ handle_output_create(struct wl_listener *listener, void *data) {
 
     struct qimm_output *qimm_output = qimm_output_create(shell, output);
 
+    /* the restored and shown projects are laid out in one repaint */
+    qimm_transaction_begin(shell);
+
     /*
      * restore project from other output to this new output by output_name
      */
@@ -81,6 +92,7 @@ handle_output_create(struct wl_listener *listener, void *data) {
         struct qimm_project *project = qimm_project_create_assistant(shell);
         if (project == NULL) {
             qimm_log("cannot create project for new output (%s)", output->name);
+            qimm_transaction_commit(shell);
             return;
         }
 
@@ -91,6 +103,65 @@ handle_output_create(struct wl_listener *listener, void *data) {
     struct qimm_project *first =
             container_of(qimm_output->projects.next, struct qimm_project, link);
     qimm_project_show(first);
+
+    qimm_transaction_commit(shell);
+}
+
+/*
+ * the layout is painted by its live surface or placeholder
+ */
+static bool
+qimm_output_project_painted(struct qimm_project *project, int *snapshots) {
+    int count = 0;
+    struct qimm_layout *layout;
+    wl_list_for_each(layout, &project->layouts, link) {
+        if (layout->surface && weston_view_is_mapped(layout->surface->view))
+            continue;
+        if (!qimm_snapshot_layout_shown(layout))
+            return false;
+        count++;
+    }
+    *snapshots = count;
+    return true;
+}
+
+static void
+handle_output_frame(struct wl_listener *listener, void *data) {
+    struct qimm_output *output =
+            container_of(listener, struct qimm_output, frame_listener);
+    struct qimm_project *project = output->project_cur;
+
+    int snapshots = 0;
+    if (project && !qimm_output_project_painted(project, &snapshots))
+        return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (project)
+        qimm_log("project (%s) switch painted in %.3f ms, "
+                 "%d of %d layouts from snapshot",
+                 project->name,
+                 timespec_sub_to_nsec(&now, &output->switch_time) / 1000000.0,
+                 snapshots, wl_list_length(&project->layouts));
+    if (project && !project->painted) {
+        project->painted = true;
+        qimm_startup_mark(project->shell, "project_paint", project->name);
+    }
+
+    /* frame listener keeps drm output from planes, remove it at once */
+    wl_list_remove(&output->frame_listener.link);
+    output->switching = false;
+}
+
+void
+qimm_output_switch_start(struct qimm_output *output) {
+    clock_gettime(CLOCK_MONOTONIC, &output->switch_time);
+    if (output->switching)
+        return;
+
+    output->frame_listener.notify = handle_output_frame;
+    wl_signal_add(&output->output->frame_signal, &output->frame_listener);
+    output->switching = true;
 }
 
 static void
@@ -111,13 +182,51 @@ handle_output_move_layer(struct qimm_shell *shell,
     }
 }
 
+/*
+ * place layouts again in projects which are placed in the output,
+ * others are placed when shown
+ */
+static void
+qimm_output_layout_update(struct qimm_shell *shell,
+                          struct weston_output *output) {
+    struct qimm_output *qimm_output =
+            qimm_index_find_output(shell, output->name);
+    if (!qimm_output)
+        return;
+
+    struct qimm_project *project;
+    wl_list_for_each(project, &qimm_output->projects, link) {
+        if (project->output_layouted == qimm_output)
+            qimm_layout_project_update(project);
+    }
+}
+
 static void
 handle_output_move(struct wl_listener *listener, void *data) {
     struct qimm_shell *shell = container_of(listener,
                                             struct qimm_shell,
                                             output_move_listener);
 
+    qimm_transaction_begin(shell);
     qimm_layer_for_each(shell, handle_output_move_layer, data);
+    qimm_output_layout_update(shell, data);
+    qimm_transaction_commit(shell);
+}
+
+static void
+handle_output_resize(struct wl_listener *listener, void *data) {
+    struct qimm_shell *shell = container_of(listener,
+                                            struct qimm_shell,
+                                            output_resize_listener);
+
+    qimm_transaction_begin(shell);
+    qimm_output_layout_update(shell, data);
+    qimm_transaction_commit(shell);
+
+    struct qimm_output *qimm_output =
+            qimm_index_find_output(shell, ((struct weston_output *) data)->name);
+    if (qimm_output)
+        qimm_background_output_update(qimm_output);
 }
 
 void
@@ -136,6 +245,10 @@ qimm_output_init(struct qimm_shell *shell) {
     shell->output_move_listener.notify = handle_output_move;
     wl_signal_add(&shell->compositor->output_moved_signal,
                   &shell->output_move_listener);
+
+    shell->output_resize_listener.notify = handle_output_resize;
+    wl_signal_add(&shell->compositor->output_resized_signal,
+                  &shell->output_resize_listener);
 }
 
 void
@@ -147,6 +260,7 @@ qimm_output_release(struct qimm_shell *shell) {
 
     wl_list_remove(&shell->output_create_listener.link);
     wl_list_remove(&shell->output_move_listener.link);
+    wl_list_remove(&shell->output_resize_listener.link);
 }
 
 struct qimm_output *
@@ -159,12 +273,7 @@ qimm_output_get_default(struct qimm_shell *shell) {
 
 struct qimm_output *
 qimm_output_find_by_name(struct qimm_shell *shell, const char *name) {
-    struct qimm_output *output;
-    wl_list_for_each(output, &shell->outputs, link) {
-        if (!strcmp(output->output->name, name))
-            return output;
-    }
-    return NULL;
+    return qimm_index_find_output(shell, name);
 }
 
 void
@@ -188,6 +297,8 @@ qimm_output_project_remove(struct qimm_project *project) {
 
     if (project->output->project_cur == project)
         project->output->project_cur = NULL;
+    if (project->output->project_next == project)
+        project->output->project_next = NULL;
 
     project->output = NULL;
     free(project->output_name);
@@ -217,6 +328,8 @@ qimm_output_project_move(struct qimm_output *from) {
         wl_list_insert(to->projects.prev, &project->link);
 
         project->output = to;
+        if (from->project_next == project)
+            from->project_next = NULL;
         /*
          * do not set
          *   output_name = to.output.name
@@ -20,10 +20,10 @@
 /*
  * NOTE:
  * copy from compositor/main.c: child_client_exec
- * support command line agrs
+ * support command line agrs and pass socket by specified env
  */
 static void
-qimm_process_exec(int sockfd, char *const argv[]) {
+qimm_process_exec(int sockfd, const char *env, char *const argv[]) {
     char *cmd = get_command_line(argv);
     if (!cmd)
         goto final;
@@ -50,7 +50,7 @@ qimm_process_exec(int sockfd, char *const argv[]) {
 
     char s[32];
     snprintf(s, sizeof s, "%d", clientfd);
-    setenv("WAYLAND_SOCKET", s, 1);
+    setenv(env, s, 1);
 
     execv(argv[0], argv);
     /* exec- returned on error only */
@@ -65,9 +65,11 @@ final:
  * NOTE:
  * copy from compositor/main.c: weston_client_launch
  * support command line agrs and use vfork to wait child process to exec or exit
+ * pid of the client is returned in pid
  */
 struct wl_client *
-qimm_process_launch(struct weston_compositor *compositor, char *const argv[]) {
+qimm_process_launch(struct weston_compositor *compositor, char *const argv[],
+                    pid_t *pid_out) {
     char *cmd = get_command_line(argv);
     if (!cmd)
         return NULL;
@@ -95,7 +97,7 @@ qimm_process_launch(struct weston_compositor *compositor, char *const argv[]) {
     }
 
     if (pid == 0) {
-        qimm_process_exec(sv[1], argv);
+        qimm_process_exec(sv[1], "WAYLAND_SOCKET", argv);
         /* exit when error in child process */
         _exit(-1);
     }
@@ -111,6 +113,8 @@ qimm_process_launch(struct weston_compositor *compositor, char *const argv[]) {
     client = wl_client_create(compositor->wl_display, sv[0]);
     if (!client)
         qimm_log("process launch error: [%s] wl_client_create failed", cmd);
+    else
+        *pid_out = pid;
 
 final:
     if (!client)
@@ -119,3 +123,64 @@ final:
     free(cmd);
     return client;
 }
+
+/*
+ * launch a helper process which is not a wayland client,
+ * sockfd is passed to it by env, the same way as WAYLAND_SOCKET.
+ */
+pid_t
+qimm_process_spawn(char *const argv[], const char *env, int sockfd) {
+    char *cmd = get_command_line(argv);
+    if (!cmd)
+        return -1;
+    qimm_log("process spawning: [%s]", cmd);
+
+    pid_t pid = vfork();
+    if (pid == -1) {
+        qimm_log("process spawn error: [%s] fork failed: %s",
+                cmd, strerror(errno));
+        goto final;
+    }
+
+    if (pid == 0) {
+        qimm_process_exec(sockfd, env, argv);
+        /* exit when error in child process */
+        _exit(-1);
+    }
+
+    int status;
+    pid_t wait_pid = waitpid(pid, &status, WNOHANG);
+    if (wait_pid == -1) {
+        qimm_log("process spawn error: cannot get status for child process");
+        pid = -1;
+    } else if (wait_pid > 0) { /* child process has been disappeared */
+        qimm_log("process spawn error: [%s] exited", cmd);
+        pid = -1;
+    }
+
+final:
+    free(cmd);
+    return pid;
+}
+
+uint64_t
+qimm_process_cpu_time(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof path, "/proc/%d/stat", pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return 0;
+
+    char buf[512];
+    size_t len = fread(buf, 1, sizeof buf - 1, fp);
+    buf[len] = '\0';
+    fclose(fp);
+
+    /* the command may contain spaces, fields start after it */
+    char *pos = strrchr(buf, ')');
+    unsigned long utime, stime;
+    if (pos && sscanf(pos + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u "
+                               "%*u %*u %lu %lu", &utime, &stime) == 2)
+        return utime + stime;
+    return 0;
+}
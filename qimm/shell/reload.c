@@ -0,0 +1,663 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+#include "qimm-desktop-shell-server-protocol.h"
+
+#include <sys/inotify.h>
+
+/*
+ * Reload configs and datas of projects when their yaml files changed.
+ *
+ * The directories of configs and projects are watched by inotify. Each
+ * changed file is parsed again and compared with the live one, only the
+ * differences are applied: layouts with the same name keep their clients,
+ * added and removed layouts start and stop clients, changed geometry is
+ * placed by the layout flow, and changed themes redraw the clients.
+ *
+ * The changes are applied after files are quiet for a while, because
+ * editors may write a file in several steps.
+ */
+#define QIMM_RELOAD_DELAY 100 /* ms */
+#define QIMM_RELOAD_CONFIG_MASK (IN_CLOSE_WRITE | IN_MOVED_TO)
+#define QIMM_RELOAD_DATA_MASK (IN_CREATE | IN_MOVED_TO | IN_ONLYDIR)
+
+struct qimm_reload_watch {
+    struct wl_list link; /* qimm_reload::watches */
+    struct qimm_hash_node node; /* qimm_reload::wds */
+    int wd;
+    char *path;
+    char *project; /* name of project for its data directory */
+};
+
+struct qimm_reload_change {
+    struct wl_list link; /* qimm_reload::changes */
+    char *project; /* NULL for a config */
+    char *file; /* file of project data, or name of config */
+};
+
+struct qimm_reload {
+    struct qimm_shell *shell;
+    int fd;
+    struct wl_event_source *source;
+    struct wl_event_source *timer;
+
+    struct wl_list watches; /* qimm_reload_watch::link */
+    struct qimm_hash wds; /* qimm_reload_watch::node, by wd */
+    int data_wd; /* the data directory, -1 when not watched */
+
+    struct wl_list changes; /* qimm_reload_change::link */
+};
+
+/* --------- watch --------- */
+static struct qimm_reload_watch *
+qimm_reload_find_path(struct qimm_reload *reload, const char *path) {
+    struct qimm_reload_watch *watch;
+    wl_list_for_each(watch, &reload->watches, link) {
+        if (!strcmp(watch->path, path))
+            return watch;
+    }
+    return NULL;
+}
+
+static struct qimm_reload_watch *
+qimm_reload_find_wd(struct qimm_reload *reload, int wd) {
+    struct qimm_hash_node *node =
+            qimm_hash_find(&reload->wds, (void *) (intptr_t) wd);
+    if (!node)
+        return NULL;
+    return container_of(node, struct qimm_reload_watch, node);
+}
+
+static void
+qimm_reload_watch_free(struct qimm_reload *reload,
+                       struct qimm_reload_watch *watch) {
+    wl_list_remove(&watch->link);
+    qimm_hash_remove(&reload->wds, &watch->node);
+    free(watch->path);
+    free(watch->project);
+    free(watch);
+}
+
+static int
+qimm_reload_watch_add(struct qimm_reload *reload, const char *path,
+                      const char *project) {
+    if (qimm_reload_find_path(reload, path))
+        return 0;
+
+    struct qimm_reload_watch *watch = zalloc(sizeof *watch);
+    if (!watch)
+        return -1;
+    watch->wd = inotify_add_watch(reload->fd, path, QIMM_RELOAD_CONFIG_MASK);
+    watch->path = strdup(path);
+    watch->project = project ? strdup(project) : NULL;
+    if (watch->wd < 0 || !watch->path || (project && !watch->project) ||
+        qimm_hash_insert(&reload->wds, &watch->node,
+                         (void *) (intptr_t) watch->wd) < 0) {
+        /* the data directory of a new project is watched when created */
+        if (errno != ENOENT)
+            qimm_log("reload watch (%s) error: %s", path, strerror(errno));
+        if (watch->wd >= 0)
+            inotify_rm_watch(reload->fd, watch->wd);
+        free(watch->path);
+        free(watch->project);
+        free(watch);
+        return -1;
+    }
+    wl_list_insert(&reload->watches, &watch->link);
+    return 0;
+}
+
+/*
+ * watch the directory of config file
+ */
+static void
+qimm_reload_watch_config(struct qimm_reload *reload, const char *config_name) {
+    char *file, *path;
+    if (asprintf(&file, "%s.yaml", config_name) < 0)
+        return;
+    path = qimm_get_project_path(file);
+    free(file);
+    if (!path)
+        return;
+
+    char *slash = strrchr(path, '/');
+    if (slash && slash != path) {
+        *slash = '\0';
+        qimm_reload_watch_add(reload, path, NULL);
+    }
+    free(path);
+}
+
+static void
+qimm_reload_watch_project(struct qimm_reload *reload, const char *name) {
+    /* the log store is not watched, it is written by shell only */
+    if (reload->shell->data_store)
+        return;
+
+    char *path;
+    if (asprintf(&path, "%s/%s", reload->shell->data_path, name) < 0)
+        return;
+    qimm_reload_watch_add(reload, path, name);
+    free(path);
+}
+
+/* --------- apply --------- */
+static bool
+qimm_reload_str_equal(const char *a, const char *b) {
+    return a == b || (a && b && !strcmp(a, b));
+}
+
+static bool
+qimm_reload_themes_equal(struct qimm_project_config *a,
+                         struct qimm_project_config *b) {
+    struct wl_list *la = &a->themes, *lb = &b->themes;
+    for (la = la->next, lb = lb->next;
+         la != &a->themes && lb != &b->themes;
+         la = la->next, lb = lb->next) {
+        struct qimm_project_config_theme *ta =
+                container_of(la, struct qimm_project_config_theme, link);
+        struct qimm_project_config_theme *tb =
+                container_of(lb, struct qimm_project_config_theme, link);
+        if (!qimm_reload_str_equal(ta->name, tb->name) ||
+            !qimm_reload_str_equal(ta->foreground, tb->foreground) ||
+            !qimm_reload_str_equal(ta->background, tb->background))
+            return false;
+    }
+    return la == &a->themes && lb == &b->themes;
+}
+
+static bool
+qimm_reload_types_equal(struct qimm_project_config *a,
+                        struct qimm_project_config *b) {
+    struct wl_list *la = &a->types, *lb = &b->types;
+    for (la = la->next, lb = lb->next;
+         la != &a->types && lb != &b->types;
+         la = la->next, lb = lb->next) {
+        struct qimm_project_config_type *ta =
+                container_of(la, struct qimm_project_config_type, link);
+        struct qimm_project_config_type *tb =
+                container_of(lb, struct qimm_project_config_type, link);
+        if (!qimm_reload_str_equal(ta->name, tb->name) ||
+            !qimm_reload_str_equal(ta->summary, tb->summary))
+            return false;
+    }
+    return la == &a->types && lb == &b->types;
+}
+
+static bool
+qimm_reload_layouts_equal(struct qimm_project_config *a,
+                          struct qimm_project_config *b) {
+    struct wl_list *la = &a->layouts, *lb = &b->layouts;
+    for (la = la->next, lb = lb->next;
+         la != &a->layouts && lb != &b->layouts;
+         la = la->next, lb = lb->next) {
+        struct qimm_project_config_layout *ca =
+                container_of(la, struct qimm_project_config_layout, link);
+        struct qimm_project_config_layout *cb =
+                container_of(lb, struct qimm_project_config_layout, link);
+        if (!qimm_reload_str_equal(ca->name, cb->name) ||
+            ca->x != cb->x || ca->y != cb->y ||
+            ca->w != cb->w || ca->h != cb->h ||
+            ca->min_w != cb->min_w || ca->min_h != cb->min_h ||
+            ca->max_w != cb->max_w || ca->max_h != cb->max_h ||
+            ca->weight != cb->weight || ca->fps != cb->fps)
+            return false;
+    }
+    return la == &a->layouts && lb == &b->layouts;
+}
+
+/*
+ * ask each client of project to redraw once
+ */
+static void
+qimm_reload_project_redraw(struct qimm_project *project) {
+    struct qimm_layout *layout, *prev;
+    wl_list_for_each(layout, &project->layouts, link) {
+        struct qimm_client *client = layout->client;
+        if (!client || !client->resource ||
+            wl_resource_get_version(client->resource) < 5)
+            continue;
+
+        bool sent = false;
+        wl_list_for_each(prev, &project->layouts, link) {
+            if (prev == layout)
+                break;
+            sent = sent || prev->client == client;
+        }
+        if (!sent)
+            qimm_desktop_shell_send_redraw(client->resource);
+    }
+}
+
+static void
+qimm_reload_project_layouts(struct qimm_project *project,
+                            struct qimm_project_config *common,
+                            struct qimm_project_config *config) {
+    if (!qimm_layout_project_reload(project, common, config))
+        return;
+
+    /* a hidden project is placed and starts clients when shown */
+    struct qimm_output *output = project->output;
+    if (!output || output->project_cur != project)
+        return;
+
+    struct qimm_shell *shell = project->shell;
+    qimm_transaction_begin(shell);
+    qimm_layout_project_update(project);
+    qimm_surface_project_update_layer(project);
+    qimm_transaction_commit(shell);
+
+    qimm_client_project_start(project);
+}
+
+/*
+ * replace config of project, config is NULL when project has no config
+ */
+static void
+qimm_reload_project_config(struct qimm_project *project,
+                           struct qimm_project_config *config) {
+    struct qimm_shell *shell = project->shell;
+    struct qimm_project_config *old = project->config;
+
+    bool themes = true, types = true, layouts = true;
+    if (old && config) {
+        themes = !qimm_reload_themes_equal(old, config);
+        types = !qimm_reload_types_equal(old, config);
+        layouts = !qimm_reload_layouts_equal(old, config);
+    }
+    if (old == config || (!themes && !types && !layouts)) {
+        if (config && config != old)
+            qimm_config_project_free(config);
+        return;
+    }
+    qimm_log("project (%s) config reloaded:%s%s%s", project->name,
+             themes ? " themes" : "", types ? " types" : "",
+             layouts ? " layouts" : "");
+
+    /* types are found by index for new layouts */
+    if (old)
+        qimm_index_config_remove(shell, old);
+    project->config = config;
+    if (config && qimm_index_config_add(shell, config) < 0)
+        qimm_log("project (%s) config index failed", project->name);
+
+    /* a layout without type may have one now */
+    if (types || layouts)
+        qimm_reload_project_layouts(project, NULL, old);
+    if (themes)
+        qimm_reload_project_redraw(project);
+    qimm_search_project_update(project, project->background);
+
+    if (old)
+        qimm_config_project_free(old);
+}
+
+static void
+qimm_reload_common(struct qimm_reload *reload) {
+    struct qimm_shell *shell = reload->shell;
+    struct qimm_project_config *old = shell->config;
+    struct qimm_project_config *config =
+            qimm_config_project_load("shell->common", "common",
+                                     shell->cache_path);
+    if (!config)
+        return;
+
+    bool themes = !qimm_reload_themes_equal(old, config);
+    bool types = !qimm_reload_types_equal(old, config);
+    bool layouts = !qimm_reload_layouts_equal(old, config);
+    if (!themes && !types && !layouts) {
+        qimm_config_project_free(config);
+        return;
+    }
+    qimm_log("project (%s) config reloaded:%s%s%s", "common",
+             themes ? " themes" : "", types ? " types" : "",
+             layouts ? " layouts" : "");
+
+    qimm_index_config_remove(shell, old);
+    shell->config = config;
+    if (qimm_index_config_add(shell, config) < 0)
+        qimm_log("project (%s) config index failed", "common");
+
+    struct qimm_output *output;
+    wl_list_for_each(output, &shell->outputs, link) {
+        struct qimm_project *project;
+        wl_list_for_each(project, &output->projects, link) {
+            if (types || layouts)
+                qimm_reload_project_layouts(project, old, NULL);
+            if (themes)
+                qimm_reload_project_redraw(project);
+        }
+    }
+
+    qimm_config_project_free(old);
+}
+
+static void
+qimm_reload_config(struct qimm_reload *reload, const char *config_name) {
+    struct qimm_shell *shell = reload->shell;
+    if (!strcmp(config_name, "common")) {
+        qimm_reload_common(reload);
+        return;
+    }
+
+    /* each project has its own copy of config */
+    struct qimm_output *output;
+    wl_list_for_each(output, &shell->outputs, link) {
+        struct qimm_project *project;
+        wl_list_for_each(project, &output->projects, link) {
+            if (!project->config_name ||
+                strcmp(project->config_name, config_name))
+                continue;
+            struct qimm_project_config *config =
+                    qimm_config_project_load(project->name, config_name,
+                                             shell->cache_path);
+            if (config)
+                qimm_reload_project_config(project, config);
+        }
+    }
+}
+
+static bool
+qimm_reload_background_equal(struct qimm_data_background *a,
+                             struct qimm_data_background *b) {
+    if (!a || !b)
+        return a == b;
+    return a->color == b->color && a->type_e == b->type_e &&
+           qimm_reload_str_equal(a->image, b->image);
+}
+
+static void
+qimm_reload_project_background(struct qimm_project *project) {
+    struct qimm_data_background *background =
+            qimm_data_read_background(project->shell, project->name);
+    if (qimm_reload_background_equal(background, project->background)) {
+        if (background)
+            qimm_data_background_free(background);
+        return;
+    }
+    qimm_log("project (%s) background reloaded", project->name);
+
+    if (project->background)
+        qimm_data_background_free(project->background);
+    project->background = background;
+    if (project->output && project->output->project_cur == project)
+        qimm_background_output_update(project->output);
+    qimm_search_project_update(project, background);
+}
+
+/*
+ * the config name in project data is changed, the output name is only
+ * used when its output is created again
+ */
+static void
+qimm_reload_project_data(struct qimm_project *project) {
+    struct qimm_shell *shell = project->shell;
+    struct qimm_project *data = qimm_data_read_project(shell, project->name);
+    if (!data)
+        return;
+
+    if (!qimm_reload_str_equal(data->config_name, project->config_name)) {
+        struct qimm_project_config *config = NULL;
+        if (data->config_name)
+            config = qimm_config_project_load(project->name,
+                                              data->config_name,
+                                              shell->cache_path);
+        if (config || !data->config_name) {
+            free(project->config_name);
+            project->config_name = data->config_name;
+            data->config_name = NULL;
+            if (project->config_name)
+                qimm_reload_watch_config(shell->reload, project->config_name);
+            qimm_reload_project_config(project, config);
+        }
+    }
+
+    free(data->config_name);
+    free(data->output_name);
+    free(data);
+}
+
+static struct qimm_project *
+qimm_reload_find_project(struct qimm_shell *shell, const char *name) {
+    struct qimm_output *output;
+    wl_list_for_each(output, &shell->outputs, link) {
+        struct qimm_project *project;
+        wl_list_for_each(project, &output->projects, link) {
+            if (!strcmp(project->name, name))
+                return project;
+        }
+    }
+    return NULL;
+}
+
+static void
+qimm_reload_apply(struct qimm_reload *reload,
+                  struct qimm_reload_change *change) {
+    if (!change->project) {
+        qimm_reload_config(reload, change->file);
+        return;
+    }
+
+    struct qimm_project *project =
+            qimm_reload_find_project(reload->shell, change->project);
+    if (!project)
+        return;
+    if (!strcmp(change->file, "config.yaml"))
+        qimm_reload_project_data(project);
+    else if (!strcmp(change->file, "background.yaml"))
+        qimm_reload_project_background(project);
+}
+
+/* --------- events --------- */
+static void
+qimm_reload_change_free(struct qimm_reload_change *change) {
+    wl_list_remove(&change->link);
+    free(change->project);
+    free(change->file);
+    free(change);
+}
+
+static int
+qimm_reload_handle_timer(void *data) {
+    struct qimm_reload *reload = data;
+
+    struct qimm_reload_change *change, *tmp;
+    wl_list_for_each_safe(change, tmp, &reload->changes, link) {
+        qimm_reload_apply(reload, change);
+        qimm_reload_change_free(change);
+    }
+    return 0;
+}
+
+static void
+qimm_reload_add_change(struct qimm_reload *reload, const char *project,
+                       const char *file) {
+    struct qimm_reload_change *change;
+    wl_list_for_each(change, &reload->changes, link) {
+        if (qimm_reload_str_equal(change->project, project) &&
+            !strcmp(change->file, file))
+            goto delay;
+    }
+
+    change = zalloc(sizeof *change);
+    if (!change)
+        return;
+    change->project = project ? strdup(project) : NULL;
+    change->file = strdup(file);
+    wl_list_insert(reload->changes.prev, &change->link);
+
+delay:
+    wl_event_source_timer_update(reload->timer, QIMM_RELOAD_DELAY);
+}
+
+static void
+qimm_reload_handle_event(struct qimm_reload *reload,
+                         const struct inotify_event *event) {
+    if (event->wd == reload->data_wd) {
+        /* data directory of project saved the first time */
+        if (event->len &&
+            qimm_reload_find_project(reload->shell, event->name))
+            qimm_reload_watch_project(reload, event->name);
+        return;
+    }
+
+    struct qimm_reload_watch *watch = qimm_reload_find_wd(reload, event->wd);
+    if (!watch)
+        return;
+    if (event->mask & IN_IGNORED) {
+        /* the directory is removed */
+        qimm_reload_watch_free(reload, watch);
+        return;
+    }
+    if (!event->len)
+        return;
+
+    if (watch->project) {
+        qimm_reload_add_change(reload, watch->project, event->name);
+        return;
+    }
+
+    /* a config is reloaded when its path is in the directory */
+    size_t len = strlen(event->name);
+    if (len <= 5 || strcmp(event->name + len - 5, ".yaml"))
+        return;
+    char *path = qimm_get_project_path(event->name);
+    size_t dir_len = strlen(watch->path);
+    if (path && !strncmp(path, watch->path, dir_len) &&
+        path[dir_len] == '/' && !strcmp(path + dir_len + 1, event->name)) {
+        char name[len - 4];
+        snprintf(name, sizeof name, "%.*s", (int) len - 5, event->name);
+        qimm_reload_add_change(reload, NULL, name);
+    }
+    free(path);
+}
+
+static int
+qimm_reload_handle_inotify(int fd, uint32_t mask, void *data) {
+    struct qimm_reload *reload = data;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        ssize_t len = read(fd, buf, sizeof buf);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            break;
+
+        for (char *p = buf; p < buf + len;) {
+            const struct inotify_event *event =
+                    (const struct inotify_event *) p;
+            qimm_reload_handle_event(reload, event);
+            p += sizeof *event + event->len;
+        }
+    }
+    return 0;
+}
+
+/* --------- reload --------- */
+int
+qimm_reload_init(struct qimm_shell *shell) {
+    struct qimm_reload *reload = zalloc(sizeof *reload);
+    if (!reload)
+        return -1;
+    reload->shell = shell;
+    reload->data_wd = -1;
+    wl_list_init(&reload->watches);
+    wl_list_init(&reload->changes);
+    qimm_hash_init(&reload->wds, false);
+
+    struct wl_event_loop *loop =
+            wl_display_get_event_loop(shell->compositor->wl_display);
+    reload->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (reload->fd < 0)
+        goto err;
+    reload->source = wl_event_loop_add_fd(loop, reload->fd, WL_EVENT_READABLE,
+                                          qimm_reload_handle_inotify, reload);
+    reload->timer = wl_event_loop_add_timer(loop, qimm_reload_handle_timer,
+                                            reload);
+    if (!reload->source || !reload->timer)
+        goto err;
+
+    if (!shell->data_store)
+        reload->data_wd = inotify_add_watch(reload->fd, shell->data_path,
+                                            QIMM_RELOAD_DATA_MASK);
+    qimm_reload_watch_config(reload, "common");
+
+    shell->reload = reload;
+    return 0;
+
+err:
+    qimm_log("reload init error: %s", strerror(errno));
+    if (reload->timer)
+        wl_event_source_remove(reload->timer);
+    if (reload->source)
+        wl_event_source_remove(reload->source);
+    if (reload->fd >= 0)
+        close(reload->fd);
+    qimm_hash_release(&reload->wds);
+    free(reload);
+    return -1;
+}
+
+void
+qimm_reload_release(struct qimm_shell *shell) {
+    struct qimm_reload *reload = shell->reload;
+    if (!reload)
+        return;
+
+    struct qimm_reload_change *change, *tmp;
+    wl_list_for_each_safe(change, tmp, &reload->changes, link)
+        qimm_reload_change_free(change);
+    struct qimm_reload_watch *watch, *tmp2;
+    wl_list_for_each_safe(watch, tmp2, &reload->watches, link)
+        qimm_reload_watch_free(reload, watch);
+
+    wl_event_source_remove(reload->timer);
+    wl_event_source_remove(reload->source);
+    close(reload->fd);
+    qimm_hash_release(&reload->wds);
+    free(reload);
+    shell->reload = NULL;
+}
+
+void
+qimm_reload_project_add(struct qimm_project *project) {
+    struct qimm_reload *reload = project->shell->reload;
+    if (!reload)
+        return;
+
+    if (project->config_name)
+        qimm_reload_watch_config(reload, project->config_name);
+    qimm_reload_watch_project(reload, project->name);
+}
+
+void
+qimm_reload_project_remove(struct qimm_project *project) {
+    struct qimm_reload *reload = project->shell->reload;
+    if (!reload)
+        return;
+
+    struct qimm_reload_watch *watch;
+    wl_list_for_each(watch, &reload->watches, link) {
+        if (watch->project && !strcmp(watch->project, project->name)) {
+            inotify_rm_watch(reload->fd, watch->wd);
+            qimm_reload_watch_free(reload, watch);
+            break;
+        }
+    }
+}
@@ -19,6 +19,33 @@
 
 extern const struct weston_desktop_api qimm_shell_desktop_api;
 
+static void
+qimm_shell_destroy(struct wl_listener *listener, void *data);
+
+static struct qimm_shell *
+qimm_shell_get(struct weston_compositor *compositor) {
+    struct wl_listener *listener =
+            wl_signal_get(&compositor->destroy_signal, qimm_shell_destroy);
+    if (!listener)
+        return NULL;
+    return container_of(listener, struct qimm_shell, destroy_listener);
+}
+
+static const struct qimm_shell_api qimm_shell_api = {
+        .get = qimm_shell_get,
+        .project_create = qimm_project_create,
+        .project_destroy = qimm_project_destroy,
+        .project_show = qimm_project_show,
+        .output_project_remove = qimm_output_project_remove,
+        .output_project_move = qimm_output_project_move,
+        .output_project_restore = qimm_output_project_restore,
+        .index_client_add = qimm_index_client_add,
+        .index_client_remove = qimm_index_client_remove,
+        .layout_find_by_client = qimm_layout_find_by_client,
+        .transaction_begin = qimm_transaction_begin,
+        .transaction_commit = qimm_transaction_commit,
+};
+
 struct qimm_output *
 qimm_shell_get_focus_output(struct qimm_shell *shell) {
     return shell->output_focus;
@@ -38,6 +65,22 @@ terminate_binding(struct weston_keyboard *keyboard,
     weston_compositor_exit(data);
 }
 
+static void
+throttle_log_binding(struct weston_keyboard *keyboard,
+                     const struct timespec *time,
+                     uint32_t key, void *data) {
+    qimm_throttle_log(data);
+}
+
+static void
+sync_binding(struct weston_keyboard *keyboard,
+             const struct timespec *time,
+             uint32_t key, void *data) {
+    struct qimm_project *project = qimm_shell_get_current_project(data);
+    if (project)
+        qimm_sync_project_push(project);
+}
+
 static void
 click_to_activate_binding(struct weston_pointer *pointer,
                           const struct timespec *time,
@@ -70,6 +113,12 @@ shell_add_bindings(struct weston_compositor *ec, struct qimm_shell *shell) {
     weston_compositor_add_key_binding(ec, KEY_BACKSPACE,
                                       MODIFIER_CTRL | MODIFIER_ALT,
                                       terminate_binding, ec);
+    weston_compositor_add_key_binding(ec, KEY_F,
+                                      MODIFIER_CTRL | MODIFIER_ALT,
+                                      throttle_log_binding, shell);
+    weston_compositor_add_key_binding(ec, KEY_S,
+                                      MODIFIER_CTRL | MODIFIER_ALT,
+                                      sync_binding, shell);
 
     /* fixed bindings */
     weston_compositor_add_button_binding(ec, BTN_LEFT, 0,
@@ -88,6 +137,16 @@ qimm_shell_destroy(struct wl_listener *listener, void *data) {
     wl_list_remove(&shell->destroy_listener.link);
 
     qimm_project_unload(shell);
+    qimm_sync_release(shell);
+    /* flush project datas to disk before exit */
+    qimm_data_writer_release(shell);
+    qimm_data_store_release(shell);
+    qimm_lifecycle_release(shell);
+    qimm_snapshot_release(shell);
+    qimm_background_release(shell);
+    qimm_buffer_release(shell);
+    qimm_metrics_release(shell);
+    qimm_transaction_release(shell);
     qimm_client_release(shell);
 
     weston_desktop_destroy(shell->desktop);
@@ -95,6 +154,8 @@ qimm_shell_destroy(struct wl_listener *listener, void *data) {
     /* note: the projects in output has been cleared after project unload */
     qimm_output_release(shell);
     qimm_layer_release(shell);
+    qimm_index_release(shell);
+    qimm_startup_release(shell);
 
     free(shell);
 }
@@ -109,6 +170,7 @@ wet_shell_init(struct weston_compositor *ec, int *argc, char *argv[]) {
         return -1;
 
     shell->compositor = ec;
+    qimm_startup_init(shell);
 
     // handle destroy event
     if (!weston_compositor_add_destroy_listener_once(ec,
@@ -118,8 +180,10 @@ wet_shell_init(struct weston_compositor *ec, int *argc, char *argv[]) {
         return -1;
     }
 
+    qimm_index_init(shell);
     qimm_layer_init(shell);
     qimm_output_init(shell);
+    qimm_startup_mark(shell, "layer_output_init", NULL);
 
     // create desktop environment
     shell->desktop = weston_desktop_create(ec, &qimm_shell_desktop_api, shell);
@@ -129,13 +193,38 @@ wet_shell_init(struct weston_compositor *ec, int *argc, char *argv[]) {
     if (qimm_client_init(shell) < 0)
         goto out;
 
+    /* hidden projects run without hibernation if it failed */
+    if (qimm_lifecycle_init(shell) < 0)
+        qimm_log("failed to init project lifecycle");
+    /* snapshots and backgrounds are not shown without buffers */
+    if (qimm_buffer_init(shell) < 0)
+        qimm_log("failed to init internal buffer client");
+    /* switched projects show empty layouts until clients commit */
+    if (qimm_snapshot_init(shell) < 0)
+        qimm_log("failed to init snapshot cache");
+    /* projects are shown without background images */
+    if (qimm_background_init(shell) < 0)
+        qimm_log("failed to init background cache");
+    /* the metrics feed of clients is empty without sampler */
+    if (qimm_metrics_init(shell) < 0)
+        qimm_log("failed to init metrics sampler");
+    /* layouts are shown one by one without transaction */
+    if (qimm_transaction_init(shell) < 0)
+        qimm_log("failed to init layout transaction");
+    qimm_startup_mark(shell, "modules_init", NULL);
+
     /* load projects at last */
     if (qimm_project_load(shell) < 0)
         goto out;
 
     shell_add_bindings(ec, shell);
 
-    clock_gettime(CLOCK_MONOTONIC, &shell->startup_time);
+    if (weston_plugin_api_register(ec, QIMM_SHELL_API_NAME,
+                                   &qimm_shell_api,
+                                   sizeof qimm_shell_api) < 0)
+        qimm_log("failed to register shell api");
+
+    qimm_startup_mark(shell, "shell_ready", NULL);
     return 0;
 
 out:
@@ -0,0 +1,396 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+
+/*
+ * The snapshot cache keeps the last frame of each layout, so a project
+ * switched to shows its layouts at once while clients are starting,
+ * instead of empty places.
+ *
+ * A snapshot is copied from the renderer when project is hidden or
+ * evicted. Pixels are kept in ARGB8888 and run-length compressed,
+ * the least recently captured ones are dropped above the memory cap.
+ *
+ * When project is shown, each layout without live surface gets a
+ * placeholder view of its snapshot, which is replaced in the same
+ * repaint when the live surface is mapped.
+ */
+#define QIMM_SNAPSHOT_MEMORY_MAX (64 << 20) /* bytes of compressed data */
+#define QIMM_SNAPSHOT_RUN 0x80000000u
+
+struct qimm_snapshot {
+    struct wl_list link; /* qimm_snapshot_cache::snapshots */
+
+    struct qimm_project *project;
+    struct qimm_project_config_layout *config_layout;
+
+    int32_t width, height;
+    uint32_t *data;
+    size_t size; /* bytes of data */
+};
+
+/*
+ * a surface of the internal buffer client, shows snapshot for layout
+ */
+struct qimm_placeholder {
+    struct weston_layer *layer;
+    int32_t x, y;
+
+    struct qimm_buffer *buffer;
+    struct qimm_buffer_surface *surface;
+    struct weston_view *view; /* NULL until the buffer is committed */
+};
+
+struct qimm_snapshot_cache {
+    struct qimm_shell *shell;
+
+    struct wl_list snapshots; /* qimm_snapshot::link, most recent first */
+    size_t size;
+};
+
+/* --------- compress --------- */
+/*
+ * each block starts with a header word:
+ *     QIMM_SNAPSHOT_RUN | n    n copies of next pixel
+ *     n                       n literal pixels follow
+ */
+static uint32_t *
+qimm_snapshot_compress(const uint32_t *pixels, size_t count, size_t *size) {
+    /* literal blocks never grow data more than a header each */
+    uint32_t *out = malloc((count + count / 2 + 2) * sizeof(uint32_t));
+    if (!out)
+        return NULL;
+
+    size_t o = 0, i = 0, literal = 0; /* index of literal header */
+    bool in_literal = false;
+    while (i < count) {
+        size_t run = 1;
+        while (i + run < count && run < QIMM_SNAPSHOT_RUN - 1 &&
+               pixels[i + run] == pixels[i])
+            run++;
+
+        if (run >= 3) {
+            out[o++] = QIMM_SNAPSHOT_RUN | run;
+            out[o++] = pixels[i];
+            in_literal = false;
+        } else {
+            for (size_t j = 0; j < run; j++) {
+                if (!in_literal || out[literal] == QIMM_SNAPSHOT_RUN - 1) {
+                    literal = o++;
+                    out[literal] = 0;
+                    in_literal = true;
+                }
+                out[o++] = pixels[i + j];
+                out[literal]++;
+            }
+        }
+        i += run;
+    }
+
+    *size = o * sizeof(uint32_t);
+    return realloc(out, *size) ?: out;
+}
+
+static void
+qimm_snapshot_decompress(const uint32_t *in, size_t size,
+                         uint32_t *pixels, size_t count) {
+    size_t n = size / sizeof(uint32_t), i = 0, o = 0;
+    while (i < n && o < count) {
+        uint32_t header = in[i++];
+        uint32_t len = header & ~QIMM_SNAPSHOT_RUN;
+        len = MIN(len, count - o);
+        if (header & QIMM_SNAPSHOT_RUN) {
+            for (uint32_t j = 0; j < len; j++)
+                pixels[o++] = in[i];
+            i++;
+        } else {
+            len = MIN(len, n - i);
+            memcpy(pixels + o, in + i, len * sizeof(uint32_t));
+            o += len;
+            i += len;
+        }
+    }
+}
+
+/* --------- cache --------- */
+static void
+qimm_snapshot_destroy(struct qimm_snapshot_cache *cache,
+                      struct qimm_snapshot *snapshot) {
+    cache->size -= snapshot->size;
+    wl_list_remove(&snapshot->link);
+    free(snapshot->data);
+    free(snapshot);
+}
+
+static struct qimm_snapshot *
+qimm_snapshot_find(struct qimm_snapshot_cache *cache,
+                   struct qimm_layout *layout) {
+    struct qimm_snapshot *snapshot;
+    wl_list_for_each(snapshot, &cache->snapshots, link) {
+        if (snapshot->project == layout->project &&
+            snapshot->config_layout == layout->config_layout)
+            return snapshot;
+    }
+    return NULL;
+}
+
+static void
+qimm_snapshot_capture(struct qimm_snapshot_cache *cache,
+                      struct qimm_layout *layout,
+                      struct weston_surface *surface) {
+    int32_t width, height;
+    weston_surface_get_content_size(surface, &width, &height);
+    if (width <= 0 || height <= 0)
+        return;
+
+    size_t count = (size_t) width * height;
+    uint32_t *pixels = malloc(count * sizeof(uint32_t));
+    if (!pixels)
+        return;
+
+    if (weston_surface_copy_content(surface, pixels, count * sizeof(uint32_t),
+                                    0, 0, width, height) < 0) {
+        free(pixels);
+        return;
+    }
+
+    /* PIXMAN_a8b8g8r8 to ARGB8888 */
+    for (size_t i = 0; i < count; i++) {
+        uint32_t p = pixels[i];
+        pixels[i] = (p & 0xff00ff00) | (p & 0xff) << 16 | (p >> 16 & 0xff);
+    }
+
+    size_t size;
+    uint32_t *data = qimm_snapshot_compress(pixels, count, &size);
+    free(pixels);
+    if (!data)
+        return;
+
+    struct qimm_snapshot *snapshot = qimm_snapshot_find(cache, layout);
+    if (snapshot) {
+        qimm_snapshot_destroy(cache, snapshot);
+    }
+    snapshot = zalloc(sizeof *snapshot);
+    if (!snapshot) {
+        free(data);
+        return;
+    }
+    snapshot->project = layout->project;
+    snapshot->config_layout = layout->config_layout;
+    snapshot->width = width;
+    snapshot->height = height;
+    snapshot->data = data;
+    snapshot->size = size;
+    wl_list_insert(&cache->snapshots, &snapshot->link);
+    cache->size += size;
+
+    /* drop least recently captured ones */
+    struct qimm_snapshot *tmp;
+    wl_list_for_each_reverse_safe(snapshot, tmp, &cache->snapshots, link) {
+        if (cache->size <= QIMM_SNAPSHOT_MEMORY_MAX)
+            break;
+        qimm_snapshot_destroy(cache, snapshot);
+    }
+}
+
+/* --------- placeholder --------- */
+static int
+qimm_placeholder_get_label(struct weston_surface *surface,
+                           char *buf, size_t len) {
+    return snprintf(buf, len, "qimm snapshot placeholder");
+}
+
+static void
+qimm_placeholder_destroy(struct qimm_placeholder *placeholder) {
+    /* unmap at once, the surface is destroyed by compositor later */
+    if (placeholder->view)
+        weston_view_destroy(placeholder->view);
+    if (placeholder->surface)
+        qimm_buffer_surface_destroy(placeholder->surface);
+    if (placeholder->buffer)
+        qimm_buffer_destroy(placeholder->buffer);
+    free(placeholder);
+}
+
+static void
+qimm_placeholder_committed(struct weston_surface *surface, void *data) {
+    struct qimm_placeholder *placeholder = data;
+    if (placeholder->view)
+        return;
+
+    placeholder->view = weston_view_create(surface);
+    if (!placeholder->view)
+        return;
+    weston_surface_set_label_func(surface, qimm_placeholder_get_label);
+
+    weston_view_set_position(placeholder->view, placeholder->x,
+                             placeholder->y);
+    weston_layer_entry_insert(&placeholder->layer->view_list,
+                              &placeholder->view->layer_link);
+    weston_view_update_transform(placeholder->view);
+    surface->is_mapped = true;
+    placeholder->view->is_mapped = true;
+    weston_surface_damage(surface);
+}
+
+static struct qimm_placeholder *
+qimm_placeholder_create(struct qimm_snapshot_cache *cache,
+                        struct qimm_snapshot *snapshot,
+                        struct weston_layer *layer,
+                        int32_t x, int32_t y) {
+    struct qimm_placeholder *placeholder = zalloc(sizeof *placeholder);
+    if (!placeholder)
+        return NULL;
+    placeholder->layer = layer;
+    placeholder->x = x;
+    placeholder->y = y;
+
+    placeholder->buffer = qimm_buffer_create(cache->shell, snapshot->width,
+                                             snapshot->height);
+    if (!placeholder->buffer)
+        goto err;
+    qimm_snapshot_decompress(snapshot->data, snapshot->size,
+                             qimm_buffer_get_data(placeholder->buffer),
+                             (size_t) snapshot->width * snapshot->height);
+
+    /* the view is made when compositor handled the commit */
+    placeholder->surface =
+            qimm_buffer_surface_create(cache->shell,
+                                       qimm_placeholder_committed, placeholder);
+    if (!placeholder->surface)
+        goto err;
+    qimm_buffer_surface_attach(placeholder->surface, placeholder->buffer);
+
+    return placeholder;
+
+err:
+    qimm_placeholder_destroy(placeholder);
+    return NULL;
+}
+
+/* --------- interface --------- */
+int
+qimm_snapshot_init(struct qimm_shell *shell) {
+    struct qimm_snapshot_cache *cache = zalloc(sizeof *cache);
+    if (!cache)
+        return -1;
+
+    cache->shell = shell;
+    wl_list_init(&cache->snapshots);
+
+    shell->snapshot = cache;
+    return 0;
+}
+
+void
+qimm_snapshot_release(struct qimm_shell *shell) {
+    struct qimm_snapshot_cache *cache = shell->snapshot;
+    if (!cache)
+        return;
+
+    struct qimm_snapshot *snapshot, *tmp;
+    wl_list_for_each_safe(snapshot, tmp, &cache->snapshots, link)
+        qimm_snapshot_destroy(cache, snapshot);
+
+    free(cache);
+    shell->snapshot = NULL;
+}
+
+void
+qimm_snapshot_project_capture(struct qimm_project *project) {
+    struct qimm_snapshot_cache *cache = project->shell->snapshot;
+    if (!cache)
+        return;
+
+    struct qimm_layout *layout;
+    wl_list_for_each(layout, &project->layouts, link) {
+        if (!layout->surface || !weston_view_is_mapped(layout->surface->view))
+            continue;
+        struct weston_surface *surface =
+                weston_desktop_surface_get_surface(layout->surface->desktop_surface);
+        qimm_snapshot_capture(cache, layout, surface);
+    }
+}
+
+void
+qimm_snapshot_layout_capture(struct qimm_layout *layout,
+                             struct weston_surface *surface) {
+    struct qimm_snapshot_cache *cache = layout->project->shell->snapshot;
+    if (cache)
+        qimm_snapshot_capture(cache, layout, surface);
+}
+
+void
+qimm_snapshot_project_show(struct qimm_project *project) {
+    struct qimm_snapshot_cache *cache = project->shell->snapshot;
+    if (!cache)
+        return;
+
+    struct qimm_layout *layout;
+    wl_list_for_each(layout, &project->layouts, link) {
+        if (layout->placeholder)
+            continue;
+        if (layout->surface && weston_view_is_mapped(layout->surface->view))
+            continue;
+
+        struct qimm_snapshot *snapshot = qimm_snapshot_find(cache, layout);
+        if (!snapshot)
+            continue;
+
+        /* the first layout is for background */
+        struct weston_layer *layer = project->layouts.next == &layout->link ?
+                                     &project->shell->background_layer :
+                                     &project->layer;
+        layout->placeholder = qimm_placeholder_create(cache, snapshot, layer,
+                                                      layout->x, layout->y);
+    }
+}
+
+void
+qimm_snapshot_project_hide(struct qimm_project *project) {
+    struct qimm_layout *layout;
+    wl_list_for_each(layout, &project->layouts, link)
+        qimm_snapshot_layout_release(layout);
+}
+
+bool
+qimm_snapshot_layout_shown(struct qimm_layout *layout) {
+    return layout->placeholder && layout->placeholder->view;
+}
+
+void
+qimm_snapshot_layout_release(struct qimm_layout *layout) {
+    if (!layout->placeholder)
+        return;
+
+    qimm_placeholder_destroy(layout->placeholder);
+    layout->placeholder = NULL;
+}
+
+void
+qimm_snapshot_project_forget(struct qimm_project *project) {
+    struct qimm_snapshot_cache *cache = project->shell->snapshot;
+    if (!cache)
+        return;
+
+    struct qimm_snapshot *snapshot, *tmp;
+    wl_list_for_each_safe(snapshot, tmp, &cache->snapshots, link) {
+        if (snapshot->project == project)
+            qimm_snapshot_destroy(cache, snapshot);
+    }
+}
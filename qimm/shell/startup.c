@@ -0,0 +1,68 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+
+#include <libweston/weston-log.h>
+
+/*
+ * Trace the phases of shell startup in the "qimm-startup" log scope,
+ * e.g. run qimm with --logger-scopes=qimm-startup. Each phase is one line,
+ * prefixed by the scope name to be found in the weston log:
+ *
+ *     qimm-startup <phase> <monotonic ns> <ms since shell init> [detail]
+ *
+ * The phases are shell_init, layer_output_init, modules_init, data_path,
+ * common_config, disk_load, prepare_output and shell_ready in order, then
+ * client_launch and client_commit for each client and project_paint for
+ * the first full repaint of each project. disk_load_done is traced when the
+ * projects left to the background loader are merged.
+ */
+void
+qimm_startup_init(struct qimm_shell *shell) {
+    clock_gettime(CLOCK_MONOTONIC, &shell->startup_time);
+    shell->startup_scope =
+            weston_compositor_add_log_scope(shell->compositor,
+                                            QIMM_STARTUP_SCOPE,
+                                            "qimm shell startup phases\n",
+                                            NULL, NULL, NULL);
+    if (!shell->startup_scope)
+        qimm_log("failed to add log scope (%s)", QIMM_STARTUP_SCOPE);
+    qimm_startup_mark(shell, "shell_init", NULL);
+}
+
+void
+qimm_startup_release(struct qimm_shell *shell) {
+    weston_log_scope_destroy(shell->startup_scope);
+    shell->startup_scope = NULL;
+}
+
+void
+qimm_startup_mark(struct qimm_shell *shell, const char *phase,
+                  const char *detail) {
+    if (!weston_log_scope_is_enabled(shell->startup_scope))
+        return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t elapsed = timespec_sub_to_nsec(&now, &shell->startup_time);
+    weston_log_scope_printf(shell->startup_scope,
+                            "%s %s %" PRId64 " %.3f%s%s\n",
+                            QIMM_STARTUP_SCOPE, phase, timespec_to_nsec(&now),
+                            elapsed / 1000000.0,
+                            detail ? " " : "", detail ? detail : "");
+}
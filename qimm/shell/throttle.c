@@ -0,0 +1,146 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+
+static void
+qimm_throttle_send_done(struct qimm_throttle *throttle,
+                        const struct timespec *now) {
+    uint32_t msec = timespec_to_msec(now);
+    struct wl_resource *cb, *next;
+    wl_resource_for_each_safe(cb, next, &throttle->callbacks) {
+        wl_callback_send_done(cb, msec);
+        wl_resource_destroy(cb);
+    }
+    throttle->last_done = *now;
+}
+
+static int
+qimm_throttle_handle_timer(void *data) {
+    struct qimm_throttle *throttle = data;
+    struct weston_compositor *compositor =
+            throttle->layout->project->shell->compositor;
+
+    struct timespec now;
+    clock_gettime(compositor->presentation_clock, &now);
+    throttle->armed = false;
+    qimm_throttle_send_done(throttle, &now);
+    return 0;
+}
+
+static struct qimm_throttle *
+qimm_throttle_create(struct qimm_layout *layout) {
+    struct qimm_throttle *throttle = zalloc(sizeof *throttle);
+    if (!throttle)
+        return NULL;
+
+    struct wl_display *display = layout->project->shell->compositor->wl_display;
+    throttle->timer = wl_event_loop_add_timer(wl_display_get_event_loop(display),
+                                              qimm_throttle_handle_timer,
+                                              throttle);
+    if (!throttle->timer) {
+        free(throttle);
+        return NULL;
+    }
+
+    throttle->layout = layout;
+    wl_list_init(&throttle->callbacks);
+    return throttle;
+}
+
+/*
+ * the frame callbacks of commit are done at next repaint when the
+ * interval passed, otherwise they are held until the interval ends.
+ */
+void
+qimm_throttle_layout_committed(struct qimm_layout *layout,
+                               struct weston_surface *surface) {
+    layout->frames++;
+
+    int32_t fps = layout->config_layout->fps;
+    struct wl_list *callbacks = &surface->pending.frame_callback_list;
+    if (fps <= 0 || wl_list_empty(callbacks))
+        return;
+
+    if (!layout->throttle) {
+        layout->throttle = qimm_throttle_create(layout);
+        if (!layout->throttle)
+            return;
+    }
+    struct qimm_throttle *throttle = layout->throttle;
+
+    struct timespec now;
+    clock_gettime(surface->compositor->presentation_clock, &now);
+    int64_t interval = 1000000000LL / fps;
+    int64_t elapsed = timespec_sub_to_nsec(&now, &throttle->last_done);
+    if (!throttle->armed && elapsed >= interval) {
+        throttle->last_done = now;
+        return;
+    }
+
+    layout->frames_throttled++;
+    wl_list_insert_list(throttle->callbacks.prev, callbacks);
+    wl_list_init(callbacks);
+
+    if (!throttle->armed) {
+        int64_t ms = (interval - elapsed + 999999) / 1000000;
+        wl_event_source_timer_update(throttle->timer, MAX(ms, 1));
+        throttle->armed = true;
+    }
+}
+
+void
+qimm_throttle_layout_release(struct qimm_layout *layout) {
+    struct qimm_throttle *throttle = layout->throttle;
+    if (!throttle)
+        return;
+
+    /* the clients would wait for the held callbacks forever */
+    struct timespec now;
+    clock_gettime(layout->project->shell->compositor->presentation_clock, &now);
+    qimm_throttle_send_done(throttle, &now);
+
+    wl_event_source_remove(throttle->timer);
+    free(throttle);
+    layout->throttle = NULL;
+}
+
+static void
+qimm_throttle_project_log(struct qimm_project *project) {
+    long ticks = sysconf(_SC_CLK_TCK);
+    struct qimm_layout *layout;
+    wl_list_for_each(layout, &project->layouts, link) {
+        /* the cpu time is of client, shared by layouts in share mode */
+        uint64_t cpu = layout->client && layout->client->pid > 0 ?
+                       qimm_process_cpu_time(layout->client->pid) : 0;
+        qimm_log("project (%s) layout (%s) fps cap %d: %" PRIu64 " frames, "
+                 "%" PRIu64 " throttled, client cpu %.2f s",
+                 project->name, layout->config_layout->name,
+                 layout->config_layout->fps,
+                 layout->frames, layout->frames_throttled,
+                 ticks > 0 ? (double) cpu / ticks : 0.0);
+    }
+}
+
+void
+qimm_throttle_log(struct qimm_shell *shell) {
+    struct qimm_output *output;
+    wl_list_for_each(output, &shell->outputs, link) {
+        if (output->project_cur)
+            qimm_throttle_project_log(output->project_cur);
+    }
+}
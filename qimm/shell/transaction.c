@@ -0,0 +1,242 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+#include "qimm-desktop-shell-server-protocol.h"
+
+#define QIMM_TRANSACTION_DEADLINE 100 /* ms */
+
+/*
+ * show all changes of transaction in one repaint
+ */
+static void
+qimm_transaction_apply(struct qimm_transaction *transaction) {
+    struct qimm_layout *layout, *tmp;
+    wl_list_for_each_safe(layout, tmp, &transaction->layouts, transaction_link) {
+        wl_list_remove(&layout->transaction_link);
+        wl_list_init(&layout->transaction_link);
+    }
+    transaction->pending = 0;
+
+    struct qimm_output *output;
+    wl_list_for_each(output, &transaction->shell->outputs, link) {
+        if (output->transaction_held) {
+            output->transaction_held = false;
+            weston_output_release_repaint(output->output);
+        }
+    }
+
+    if (transaction->timer)
+        wl_event_source_timer_update(transaction->timer, 0);
+}
+
+static void
+qimm_transaction_layout_ready(struct qimm_transaction *transaction,
+                              struct qimm_layout *layout) {
+    wl_list_remove(&layout->transaction_link);
+    wl_list_init(&layout->transaction_link);
+    transaction->pending--;
+}
+
+/*
+ * apply when all layouts are ready, but not before sent to clients
+ */
+static void
+qimm_transaction_check(struct qimm_transaction *transaction) {
+    if (transaction->pending == 0 && transaction->depth == 0)
+        qimm_transaction_apply(transaction);
+}
+
+static int
+qimm_transaction_handle_deadline(void *data) {
+    struct qimm_transaction *transaction = data;
+
+    qimm_log("layout transaction %u applied at deadline, "
+             "%d layouts not committed",
+             transaction->serial, transaction->pending);
+    qimm_transaction_apply(transaction);
+    return 0;
+}
+
+int
+qimm_transaction_init(struct qimm_shell *shell) {
+    struct qimm_transaction *transaction = zalloc(sizeof *transaction);
+    if (!transaction)
+        return -1;
+
+    transaction->shell = shell;
+    wl_list_init(&transaction->layouts);
+
+    struct wl_event_loop *loop =
+            wl_display_get_event_loop(shell->compositor->wl_display);
+    transaction->timer = wl_event_loop_add_timer(loop,
+                                                 qimm_transaction_handle_deadline,
+                                                 transaction);
+    if (!transaction->timer) {
+        free(transaction);
+        return -1;
+    }
+
+    shell->transaction = transaction;
+    return 0;
+}
+
+void
+qimm_transaction_release(struct qimm_shell *shell) {
+    struct qimm_transaction *transaction = shell->transaction;
+    if (!transaction)
+        return;
+
+    qimm_transaction_apply(transaction);
+    wl_event_source_remove(transaction->timer);
+    shell->transaction = NULL;
+    free(transaction);
+}
+
+void
+qimm_transaction_begin(struct qimm_shell *shell) {
+    struct qimm_transaction *transaction = shell->transaction;
+    if (!transaction)
+        return;
+
+    /* the new changes join the transaction waiting for clients */
+    transaction->depth++;
+}
+
+/*
+ * send the transaction to clients of its layouts, each client once,
+ * after all their surfaces are configured.
+ */
+void
+qimm_transaction_commit(struct qimm_shell *shell) {
+    struct qimm_transaction *transaction = shell->transaction;
+    if (!transaction)
+        return;
+
+    assert(transaction->depth > 0);
+    if (--transaction->depth > 0)
+        return;
+
+    if (transaction->pending == 0) {
+        qimm_transaction_apply(transaction);
+        return;
+    }
+
+    /* the acks of the joined transaction are not for new configures */
+    transaction->serial++;
+
+    struct qimm_layout *layout;
+    wl_list_for_each(layout, &transaction->layouts, transaction_link) {
+        struct qimm_client *client = layout->client;
+        if (!client || !client->resource ||
+            client->transaction_serial == transaction->serial)
+            continue;
+
+        client->transaction_serial = transaction->serial;
+        qimm_desktop_shell_send_layout_transaction(client->resource,
+                                                   transaction->serial);
+    }
+
+    wl_event_source_timer_update(transaction->timer,
+                                 QIMM_TRANSACTION_DEADLINE);
+}
+
+/*
+ * hold repaint of output showing the layout until it is committed,
+ * layouts of hidden projects are shown later and need not wait.
+ */
+void
+qimm_transaction_layout_add(struct qimm_layout *layout) {
+    struct qimm_project *project = layout->project;
+    struct qimm_transaction *transaction = project->shell->transaction;
+    if (!transaction || transaction->depth == 0)
+        return;
+
+    struct qimm_output *output = project->output;
+    if (!output || output->project_cur != project || !layout->surface ||
+        !weston_surface_is_mapped(layout->surface->view->surface))
+        return;
+
+    if (wl_list_empty(&layout->transaction_link)) {
+        wl_list_insert(transaction->layouts.prev, &layout->transaction_link);
+        transaction->pending++;
+    }
+
+    if (!output->transaction_held) {
+        output->transaction_held = true;
+        weston_output_hold_repaint(output->output);
+    }
+}
+
+/*
+ * the layout is ready when its surface committed the configured size
+ */
+void
+qimm_transaction_layout_committed(struct qimm_layout *layout) {
+    struct qimm_transaction *transaction = layout->project->shell->transaction;
+    if (!transaction || wl_list_empty(&layout->transaction_link))
+        return;
+
+    struct weston_geometry geometry =
+            weston_desktop_surface_get_geometry(layout->surface->desktop_surface);
+    if (geometry.width == layout->sent_w &&
+        geometry.height == layout->sent_h) {
+        qimm_transaction_layout_ready(transaction, layout);
+        qimm_transaction_check(transaction);
+    }
+}
+
+/*
+ * the layout is not waited when its surface is gone
+ */
+void
+qimm_transaction_layout_remove(struct qimm_layout *layout) {
+    struct qimm_transaction *transaction = layout->project->shell->transaction;
+    if (!transaction || wl_list_empty(&layout->transaction_link))
+        return;
+
+    qimm_transaction_layout_ready(transaction, layout);
+    qimm_transaction_check(transaction);
+}
+
+/*
+ * the client committed all its surfaces of transaction,
+ * whatever sizes it chose.
+ */
+void
+qimm_transaction_ack(struct qimm_shell *shell, struct qimm_client *client,
+                     uint32_t serial) {
+    struct qimm_transaction *transaction = shell->transaction;
+    if (!transaction || !client || serial != transaction->serial)
+        return;
+
+    struct qimm_layout *layout, *tmp;
+    wl_list_for_each_safe(layout, tmp, &transaction->layouts, transaction_link) {
+        if (layout->client == client)
+            qimm_transaction_layout_ready(transaction, layout);
+    }
+    qimm_transaction_check(transaction);
+}
+
+void
+qimm_transaction_output_remove(struct qimm_output *output) {
+    if (!output->transaction_held)
+        return;
+
+    output->transaction_held = false;
+    weston_output_release_repaint(output->output);
+}
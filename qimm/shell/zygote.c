@@ -0,0 +1,140 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+
+static void
+qimm_zygote_destroy(struct qimm_zygote *zygote) {
+    if (zygote->source)
+        wl_event_source_remove(zygote->source);
+    /* zygote exits when its control socket closed */
+    close(zygote->sock);
+    free(zygote);
+}
+
+static int
+qimm_zygote_handle_hangup(int fd, uint32_t mask, void *data) {
+    struct qimm_shell *shell = data;
+
+    qimm_log("zygote (%d) has gone, fallback to exec mode",
+             shell->zygote->pid);
+    qimm_zygote_destroy(shell->zygote);
+    shell->zygote = NULL;
+    return 0;
+}
+
+int
+qimm_zygote_init(struct qimm_shell *shell) {
+    const char *mode = getenv(QIMM_CLIENT_MODE);
+    if (mode && !strcmp(mode, "exec")) {
+        qimm_log("client start in exec mode");
+        return 0;
+    }
+
+    struct qimm_zygote *zygote = zalloc(sizeof *zygote);
+    if (!zygote)
+        return -1;
+
+    int sv[2];
+    if (os_socketpair_cloexec(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+        qimm_log("zygote error: socketpair failed: %s", strerror(errno));
+        free(zygote);
+        goto fallback;
+    }
+
+    char *argv[] = {shell->client_path, "--zygote", NULL};
+    zygote->pid = qimm_process_spawn(argv, QIMM_ZYGOTE_SOCKET, sv[1]);
+    close(sv[1]);
+    zygote->sock = sv[0];
+    if (zygote->pid < 0) {
+        qimm_zygote_destroy(zygote);
+        goto fallback;
+    }
+
+    struct wl_event_loop *loop =
+            wl_display_get_event_loop(shell->compositor->wl_display);
+    zygote->source = wl_event_loop_add_fd(loop, zygote->sock, 0,
+                                          qimm_zygote_handle_hangup, shell);
+
+    shell->zygote = zygote;
+    qimm_log("client start in zygote mode, zygote pid %d", zygote->pid);
+    return 0;
+
+fallback:
+    qimm_log("zygote start failed, fallback to exec mode");
+    return 0;
+}
+
+void
+qimm_zygote_release(struct qimm_shell *shell) {
+    if (!shell->zygote)
+        return;
+
+    qimm_zygote_destroy(shell->zygote);
+    shell->zygote = NULL;
+}
+
+/*
+ * fork a pre-initialised client from zygote
+ * return client the same way as qimm_process_launch
+ */
+struct wl_client *
+qimm_zygote_launch(struct qimm_shell *shell, char *const argv[],
+                   pid_t *pid_out) {
+    struct qimm_zygote *zygote = shell->zygote;
+    assert(zygote);
+
+    char *cmd = get_command_line(argv);
+    if (!cmd)
+        return NULL;
+    qimm_log("zygote launching: [%s]", cmd);
+
+    int sv[2];
+    if (os_socketpair_cloexec(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        qimm_log("zygote launch error: [%s] socketpair failed: %s",
+                 cmd, strerror(errno));
+        free(cmd);
+        return NULL;
+    }
+
+    struct wl_client *client = NULL;
+
+    if (qimm_zygote_send_request(zygote->sock, sv[1], argv) < 0) {
+        qimm_log("zygote launch error: [%s] request rejected", cmd);
+        goto final;
+    }
+
+    /* the zygote only forks, so the reply comes back at once */
+    pid_t pid = qimm_zygote_recv_reply(zygote->sock);
+    if (pid < 0) {
+        qimm_log("zygote launch error: [%s] fork failed", cmd);
+        goto final;
+    }
+
+    client = wl_client_create(shell->compositor->wl_display, sv[0]);
+    if (!client)
+        qimm_log("zygote launch error: [%s] wl_client_create failed", cmd);
+    else
+        *pid_out = pid;
+
+final:
+    if (!client)
+        close(sv[0]);
+    close(sv[1]);
+    free(cmd);
+    return client;
+}
@@ -0,0 +1,171 @@
+/* This file is part of qimm project.
+ * qimm is a Situational Linux Desktop Based on Weston.
+ * Copyright (C) 2021 The qimm Authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "qimm.h"
+
+#include <sys/un.h>
+
+/*
+ * qimm-syncd keeps synced projects of devices in a directory,
+ * and serves them to qimm over a unix socket.
+ */
+static volatile sig_atomic_t running = 1;
+
+static void
+usage(int error_code) {
+    FILE *out = error_code == EXIT_SUCCESS ? stdout : stderr;
+    fprintf(out,
+            "Usage: qimm-syncd --socket=PATH --dir=DIR\n"
+            "\n"
+            "Serve projects synced by qimm --sync-peer=unix:PATH\n"
+            "\n"
+            "  -s, --socket=PATH\tThe unix socket to listen on\n"
+            "  -d, --dir=DIR\t\tThe directory of chunks and manifests\n"
+            "  -h, --help\t\tThis help message\n\n");
+
+    exit(error_code);
+}
+
+static int
+log_handler(const char *fmt, va_list ap) {
+    return vfprintf(stderr, fmt, ap);
+}
+
+static void
+stop(int sig) {
+    running = 0;
+}
+
+struct client {
+    struct qimm_sync_peer *peer;
+    int fd;
+};
+
+static void *
+client_thread(void *data) {
+    struct client *client = data;
+    if (qimm_sync_peer_serve(client->peer, client->fd) < 0)
+        qimm_log("client dropped: %s", strerror(errno));
+    close(client->fd);
+    free(client);
+    return NULL;
+}
+
+static int
+listen_socket(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof addr.sun_path) {
+        qimm_log("socket path is too long: %s", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof addr) < 0 ||
+        listen(fd, 8) < 0) {
+        qimm_log("listen on %s error: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int
+main(int argc, char **argv) {
+    const char *socket_path = NULL, *dir = NULL;
+
+    const struct option long_options[] = {
+            {"help",   no_argument,       NULL, 'h'},
+            {"socket", required_argument, NULL, 's'},
+            {"dir",    required_argument, NULL, 'd'},
+            {0, 0, 0,                        0}
+    };
+    while (1) {
+        int i = 0;
+        int c = getopt_long(argc, argv, "hs:d:", long_options, &i);
+        if (c == -1)
+            break;
+        switch (c) {
+            case 'h':
+                usage(EXIT_SUCCESS);
+                break;
+            case 's':
+                socket_path = optarg;
+                break;
+            case 'd':
+                dir = optarg;
+                break;
+            default:
+                usage(EXIT_FAILURE);
+        }
+    }
+    if (!socket_path || !dir)
+        usage(EXIT_FAILURE);
+
+    weston_log_set_handler(log_handler, log_handler);
+
+    struct qimm_sync_peer *peer = qimm_sync_peer_open(dir);
+    if (!peer)
+        return EXIT_FAILURE;
+    int fd = listen_socket(socket_path);
+    if (fd < 0) {
+        qimm_sync_peer_close(peer);
+        return EXIT_FAILURE;
+    }
+
+    /* no SA_RESTART, so accept returns when stopped */
+    struct sigaction sa = {.sa_handler = stop};
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    /*
+     * each qimm keeps its connection, serve it in a thread.
+     * the directory is safe to share: files are written by rename.
+     */
+    while (running) {
+        int client_fd = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno != EINTR)
+                qimm_log("accept error: %s", strerror(errno));
+            continue;
+        }
+        struct client *client = malloc(sizeof *client);
+        pthread_t thread;
+        if (!client) {
+            close(client_fd);
+            continue;
+        }
+        client->peer = peer;
+        client->fd = client_fd;
+        if (create_worker_thread(&thread, client_thread, client) < 0) {
+            qimm_log("client thread error: %s", strerror(errno));
+            close(client_fd);
+            free(client);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    /* the peer is left to clients still served */
+    close(fd);
+    unlink(socket_path);
+    return EXIT_SUCCESS;
+}
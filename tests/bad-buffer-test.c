@@ -36,16 +36,44 @@
 #include "weston-test-client-helper.h"
 #include "weston-test-fixture-compositor.h"
 
+struct setup_args {
+	struct fixture_metadata meta;
+	enum renderer_type renderer;
+	bool render_threads;
+};
+
+static const struct setup_args my_setup_args[] = {
+	{
+		.meta.name = "noop",
+		.renderer = RENDERER_NOOP,
+	},
+	{
+		.meta.name = "pixman render threads",
+		.renderer = RENDERER_PIXMAN,
+		.render_threads = true,
+	},
+};
+
 static enum test_result_code
-fixture_setup(struct weston_test_harness *harness)
+fixture_setup(struct weston_test_harness *harness, const struct setup_args *arg)
 {
 	struct compositor_setup setup;
 
 	compositor_setup_defaults(&setup);
+	setup.renderer = arg->renderer;
+
+	if (arg->render_threads) {
+		/* Read the truncated buffer on a render worker, not on the
+		 * compositor thread. */
+		setup.test_quirks.render_on_workers_only = true;
+		weston_ini_setup(&setup,
+				 cfgln("[core]"),
+				 cfgln("render-threads=1"));
+	}
 
 	return weston_test_harness_execute_as_client(harness, &setup);
 }
-DECLARE_FIXTURE_SETUP(fixture_setup);
+DECLARE_FIXTURE_SETUP_WITH_ARG(fixture_setup, my_setup_args, meta);
 
 /* These three functions are copied from shared/os-compatibility.c in order to
  * behave like older clients, and allow ftruncate() to shrink the file’s size,
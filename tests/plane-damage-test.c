@@ -0,0 +1,380 @@
+/*
+ * Copyright © 2021 The qimm Authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <libweston/libweston.h>
+#include "libweston-internal.h"
+#include "shared/helpers.h"
+#include "weston-test-runner.h"
+#include "weston-test-fixture-compositor.h"
+
+/*
+ * weston_output_accumulate_damage walks the paint nodes bucketed per
+ * plane; check it against a walk of the whole z-order list for each
+ * plane, as it was done before the buckets, in a scene of overlapping
+ * views spread over several planes. The views hidden under opaque views
+ * are culled, but their buffers must still be released.
+ */
+#define VIEW_COUNT 200
+#define PLANE_COUNT 4 /* besides the primary plane */
+#define OUTPUT_WIDTH 640
+#define OUTPUT_HEIGHT 480
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness)
+{
+	struct compositor_setup setup;
+
+	compositor_setup_defaults(&setup);
+	setup.width = OUTPUT_WIDTH;
+	setup.height = OUTPUT_HEIGHT;
+
+	return weston_test_harness_execute_as_plugin(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP(fixture_setup);
+
+struct scene {
+	struct weston_compositor *compositor;
+	struct weston_output *output;
+	struct weston_layer layer;
+	struct weston_surface *surfaces[VIEW_COUNT];
+	struct weston_plane planes[PLANE_COUNT];
+	uint32_t seed;
+};
+
+static int
+scene_random(struct scene *scene, int max)
+{
+	scene->seed = scene->seed * 1103515245 + 12345;
+	return (int)((scene->seed >> 8) % max);
+}
+
+static struct weston_view *
+scene_view(struct scene *scene, int i)
+{
+	return container_of(scene->surfaces[i]->views.next,
+			    struct weston_view, surface_link);
+}
+
+/* Windows of 20 to 200 pixels, half of them opaque, some of them
+ * partly off the output, on the primary plane or an overlay plane.
+ */
+static void
+scene_init(struct scene *scene, struct weston_compositor *compositor)
+{
+	struct weston_surface *surface;
+	struct weston_view *view;
+	int i, plane;
+
+	scene->compositor = compositor;
+	scene->output = container_of(compositor->output_list.next,
+				     struct weston_output, link);
+	scene->seed = 1;
+
+	for (i = 0; i < PLANE_COUNT; i++) {
+		weston_plane_init(&scene->planes[i], compositor, 0, 0);
+		weston_compositor_stack_plane(compositor, &scene->planes[i],
+					      NULL);
+	}
+
+	weston_layer_init(&scene->layer, compositor);
+	weston_layer_set_position(&scene->layer,
+				  WESTON_LAYER_POSITION_NORMAL);
+
+	for (i = 0; i < VIEW_COUNT; i++) {
+		surface = weston_surface_create(compositor);
+		assert(surface);
+		surface->width = 20 + scene_random(scene, 180);
+		surface->height = 20 + scene_random(scene, 180);
+		if (i % 2 == 0) {
+			pixman_region32_fini(&surface->opaque);
+			pixman_region32_init_rect(&surface->opaque, 0, 0,
+						  surface->width,
+						  surface->height);
+		}
+
+		view = weston_view_create(surface);
+		assert(view);
+		weston_view_set_position(view,
+					 scene_random(scene, OUTPUT_WIDTH) - 50,
+					 scene_random(scene, OUTPUT_HEIGHT) - 50);
+		weston_layer_entry_insert(&scene->layer.view_list,
+					  &view->layer_link);
+		scene->surfaces[i] = surface;
+	}
+
+	weston_compositor_build_view_list(compositor, scene->output);
+
+	for (i = 0; i < VIEW_COUNT; i++) {
+		plane = scene_random(scene, PLANE_COUNT + 1);
+		weston_view_move_to_plane(scene_view(scene, i),
+					  plane ? &scene->planes[plane - 1] :
+						  &compositor->primary_plane);
+	}
+}
+
+static void
+scene_fini(struct scene *scene)
+{
+	int i;
+
+	/* the views are destroyed with the surfaces */
+	for (i = 0; i < VIEW_COUNT; i++)
+		weston_surface_destroy(scene->surfaces[i]);
+	weston_layer_fini(&scene->layer);
+	weston_compositor_build_view_list(scene->compositor, NULL);
+	for (i = 0; i < PLANE_COUNT; i++)
+		weston_plane_release(&scene->planes[i]);
+}
+
+/* Clients commit damage on a third of the surfaces */
+static void
+scene_commit(struct scene *scene)
+{
+	struct weston_surface *surface;
+	struct weston_plane *plane;
+	int i;
+
+	wl_list_for_each(plane, &scene->compositor->plane_list, link) {
+		pixman_region32_clear(&plane->damage);
+		pixman_region32_clear(&plane->clip);
+	}
+
+	for (i = 0; i < VIEW_COUNT; i++) {
+		surface = scene->surfaces[i];
+		pixman_region32_clear(&surface->damage);
+		if (i % 3)
+			continue;
+		pixman_region32_union_rect(&surface->damage, &surface->damage,
+					   0, 0, surface->width / 2,
+					   surface->height / 2);
+	}
+}
+
+/* The damage of each plane from a walk of the whole z-order list, for
+ * views without transform, with the same culling of occluded views.
+ */
+static void
+accumulate_damage_full_walk(struct scene *scene)
+{
+	struct weston_output *output = scene->output;
+	struct weston_paint_node *pnode;
+	struct weston_plane *plane;
+	struct weston_view *view;
+	pixman_region32_t opaque, clip, damage, visible;
+	bool occluded;
+	int i;
+
+	pixman_region32_init(&clip);
+	wl_list_for_each(plane, &scene->compositor->plane_list, link) {
+		pixman_region32_copy(&plane->clip, &clip);
+		pixman_region32_init(&opaque);
+
+		wl_list_for_each(pnode, &output->paint_node_z_order_list,
+				 z_order_link) {
+			view = pnode->view;
+			if (view->plane != plane)
+				continue;
+
+			assert(!view->transform.enabled);
+			pixman_region32_init(&visible);
+			pixman_region32_intersect(&visible,
+						  &view->transform.boundingbox,
+						  &output->region);
+			pixman_region32_subtract(&visible, &visible, &opaque);
+			pixman_region32_subtract(&visible, &visible,
+						 &plane->clip);
+			occluded = !pixman_region32_not_empty(&visible);
+			pixman_region32_fini(&visible);
+
+			pixman_region32_init(&damage);
+			if (!occluded)
+				pixman_region32_copy(&damage,
+						     &view->surface->damage);
+			pixman_region32_translate(&damage, view->geometry.x,
+						  view->geometry.y);
+			pixman_region32_intersect(&damage, &damage,
+						  &view->transform.boundingbox);
+			pixman_region32_subtract(&damage, &damage, &opaque);
+			pixman_region32_union(&plane->damage, &plane->damage,
+					      &damage);
+			pixman_region32_fini(&damage);
+			pixman_region32_copy(&view->clip, &opaque);
+			pixman_region32_union(&opaque, &opaque,
+					      &view->transform.opaque);
+		}
+
+		pixman_region32_union(&clip, &clip, &opaque);
+		pixman_region32_fini(&opaque);
+	}
+	pixman_region32_fini(&clip);
+
+	for (i = 0; i < VIEW_COUNT; i++)
+		pixman_region32_clear(&scene->surfaces[i]->damage);
+}
+
+PLUGIN_TEST(plane_damage_matches_full_walk)
+{
+	struct scene scene = { 0 };
+	pixman_region32_t clips[VIEW_COUNT];
+	pixman_region32_t plane_damage[PLANE_COUNT + 1];
+	pixman_region32_t plane_clip[PLANE_COUNT + 1];
+	struct weston_plane *plane;
+	bool damaged = false;
+	int i;
+
+	assert(!wl_list_empty(&compositor->output_list));
+	scene_init(&scene, compositor);
+
+	scene_commit(&scene);
+	accumulate_damage_full_walk(&scene);
+
+	for (i = 0; i < VIEW_COUNT; i++) {
+		pixman_region32_init(&clips[i]);
+		pixman_region32_copy(&clips[i], &scene_view(&scene, i)->clip);
+	}
+	i = 0;
+	wl_list_for_each(plane, &compositor->plane_list, link) {
+		assert(i < PLANE_COUNT + 1);
+		pixman_region32_init(&plane_damage[i]);
+		pixman_region32_copy(&plane_damage[i], &plane->damage);
+		pixman_region32_init(&plane_clip[i]);
+		pixman_region32_copy(&plane_clip[i], &plane->clip);
+		damaged = damaged || pixman_region32_not_empty(&plane->damage);
+		i++;
+	}
+	assert(i == PLANE_COUNT + 1);
+	/* the scene must damage something to compare */
+	assert(damaged);
+
+	scene_commit(&scene);
+	weston_output_accumulate_damage(scene.output);
+
+	for (i = 0; i < VIEW_COUNT; i++)
+		assert(pixman_region32_equal(&clips[i],
+					     &scene_view(&scene, i)->clip));
+	i = 0;
+	wl_list_for_each(plane, &compositor->plane_list, link) {
+		assert(pixman_region32_equal(&plane_damage[i], &plane->damage));
+		assert(pixman_region32_equal(&plane_clip[i], &plane->clip));
+		i++;
+	}
+
+	for (i = 0; i < VIEW_COUNT; i++)
+		pixman_region32_fini(&clips[i]);
+	for (i = 0; i < PLANE_COUNT + 1; i++) {
+		pixman_region32_fini(&plane_damage[i]);
+		pixman_region32_fini(&plane_clip[i]);
+	}
+
+	scene_fini(&scene);
+}
+
+static struct weston_view *
+add_view(struct weston_compositor *compositor, struct weston_layer *layer,
+	 int x, int y, int width, int height)
+{
+	struct weston_surface *surface;
+	struct weston_view *view;
+
+	surface = weston_surface_create(compositor);
+	assert(surface);
+	surface->width = width;
+	surface->height = height;
+	pixman_region32_fini(&surface->opaque);
+	pixman_region32_init_rect(&surface->opaque, 0, 0, width, height);
+
+	view = weston_view_create(surface);
+	assert(view);
+	weston_view_set_position(view, x, y);
+	weston_layer_entry_insert(&layer->view_list, &view->layer_link);
+
+	return view;
+}
+
+PLUGIN_TEST(hidden_surface_buffer_released)
+{
+	struct weston_output *output;
+	struct weston_layer layer;
+	struct weston_view *hidden, *cover;
+	struct weston_paint_node *pnode;
+	struct weston_buffer *buffer;
+	struct wl_resource *resource;
+	struct wl_client *client;
+	int sv[2];
+
+	assert(!wl_list_empty(&compositor->output_list));
+	output = container_of(compositor->output_list.next,
+			      struct weston_output, link);
+
+	/* a client owning the buffer, to which the release is sent */
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == 0);
+	client = wl_client_create(compositor->wl_display, sv[0]);
+	assert(client);
+	resource = wl_resource_create(client, &wl_buffer_interface, 1, 0);
+	assert(resource);
+	buffer = weston_buffer_from_resource(resource);
+	assert(buffer);
+
+	weston_layer_init(&layer, compositor);
+	weston_layer_set_position(&layer, WESTON_LAYER_POSITION_NORMAL);
+
+	/* inserted on top, the cover hides the other view entirely */
+	hidden = add_view(compositor, &layer, 100, 100, 50, 50);
+	cover = add_view(compositor, &layer, 0, 0, OUTPUT_WIDTH, OUTPUT_HEIGHT);
+
+	weston_buffer_reference(&hidden->surface->buffer_ref, buffer);
+	assert(buffer->busy_count == 1);
+	pixman_region32_union_rect(&hidden->surface->damage,
+				   &hidden->surface->damage, 0, 0, 50, 50);
+
+	weston_compositor_build_view_list(compositor, output);
+	weston_output_accumulate_damage(output);
+
+	pnode = weston_view_find_paint_node(hidden, output);
+	assert(pnode);
+	assert(!pixman_region32_not_empty(&pnode->visible));
+
+	/* culled, yet flushed and released early as a visible surface */
+	assert(!pixman_region32_not_empty(&hidden->surface->damage));
+	assert(hidden->surface->buffer_ref.buffer == NULL);
+	assert(buffer->busy_count == 0);
+
+	weston_surface_destroy(cover->surface);
+	weston_surface_destroy(hidden->surface);
+	weston_layer_fini(&layer);
+	weston_compositor_build_view_list(compositor, NULL);
+
+	/* destroys the buffer resource */
+	wl_client_destroy(client);
+	close(sv[1]);
+}
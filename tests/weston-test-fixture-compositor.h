@@ -59,7 +59,9 @@ enum shell_type {
 	/** The ivi-shell. */
 	SHELL_IVI,
 	/** The fullscreen-shell. */
-	SHELL_FULLSCREEN
+	SHELL_FULLSCREEN,
+	/** The qimm-shell, with the data directory in $HOME. */
+	SHELL_QIMM
 };
 
 /** Weston compositor configuration